@@ -0,0 +1,16 @@
+#ifndef __AF_PACKET_H__
+#define __AF_PACKET_H__
+
+#include "bridge.h"
+
+/**
+ * Packet socket bridge backend (Linux)
+ *
+ * One AF_PACKET socket per port, bound to the interface, which sends the
+ * frames as provided. A batch goes to the kernel with sendmmsg(), one
+ * system call for all its frames, which point into the pooled buffers;
+ * the queueing discipline is bypassed where the kernel supports it.
+ */
+extern const bridge_backend_t bridge_backend_packet;
+
+#endif
@@ -0,0 +1,48 @@
+#ifndef __AGGREGATE_H__
+#define __AGGREGATE_H__
+
+#include "config.h"
+#include "firewall.h"
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <netinet/in.h>
+
+#define AGGREGATE_BITMAP_WORDS  4                   /**< 256 addresses of a /24 */
+
+#define AGGREGATE_IPV6_SUBNET   64                  /**< IPv6 addresses are blocked as their /64 */
+#define AGGREGATE_IPV6_SITE     48                  /**< enough blocked /64s block their /48 */
+
+#define AGGREGATE_ALLOWED_SUBNET    0x01            /**< the /64 covers an allowlisted address */
+#define AGGREGATE_ALLOWED_SITE      0x02            /**< the /48 covers an allowlisted address */
+
+/**
+ * CIDR aggregation of blocked addresses
+ *
+ * Single addresses are collected per /24 and the table gets the minimal
+ * set of prefixes which covers them: a prefix (not shorter than the
+ * configured one) replaces its addresses if at least density percent of
+ * it is blocked and it does not cover an allowlisted address which is not
+ * blocked itself. With a density of 100 the aggregation is lossless. A
+ * /24 blocked as a whole (e.g. escalated by the block state machine) is
+ * pinned instead of competing with that cover: it stays blocked, except
+ * for its allowlisted addresses.
+ *
+ * An IPv6 address is blocked as its /64, any address of which is at the
+ * disposal of an attacker, unless the /64 covers an allowlisted address.
+ * The /64s of a /48 are replaced by the /48 once the configured number of
+ * them is blocked and the /48 does not cover an allowlisted address.
+ *
+ * Only the firewall worker calls it, the allowlist of the /24 (or the
+ * AGGREGATE_ALLOWED_* flags) is looked up by the poster and travels with
+ * the address.
+ */
+bool            aggregate_init          (config_t *config);
+bool            aggregate_enabled       (void);
+void            aggregate_add           (firewall_table_t table, struct in_addr *addr, const uint64_t allowed[AGGREGATE_BITMAP_WORDS]);
+void            aggregate_remove        (firewall_table_t table, struct in_addr *addr);
+void            aggregate_pin           (firewall_table_t table, struct in_addr *addr, bool pinned, const uint64_t allowed[AGGREGATE_BITMAP_WORDS]);
+void            aggregate_add_ipv6      (firewall_table_t table, const struct in6_addr *addr, uint32_t allowed);
+void            aggregate_remove_ipv6   (firewall_table_t table, const struct in6_addr *addr);
+
+#endif
@@ -0,0 +1,33 @@
+#ifndef __AMPLIFICATION_H__
+#define __AMPLIFICATION_H__
+
+#include "packet/packet.h"
+
+#include <stdint.h>
+#include <stdbool.h>
+
+typedef struct _amplification_sample_t  amplification_sample_t;
+
+/**
+ * Sizes and amplification of a response, filled in by correlation_process()
+ * and weighting the response in the detection (victim meter, heavy hitters)
+ */
+struct _amplification_sample_t {
+    uint32_t            query_len;          /**< wire bytes of the query, estimated from the echoed question if not matched */
+    uint32_t            response_len;       /**< wire bytes of the response including all fragments */
+    uint32_t            factor;             /**< running amplification of (server, qname, qtype), 1 = ordinary traffic */
+};
+
+static inline void
+amplification_sample_init(amplification_sample_t *sample)
+{
+    sample->query_len       = 0;
+    sample->response_len    = 0;
+    sample->factor          = 1;
+}
+
+bool            amplification_init      (void);
+void            amplification_process   (packet_t *packet, raw_packet_t *raw_packet, uint32_t query_len, amplification_sample_t *sample);
+
+#endif
+
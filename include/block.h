@@ -0,0 +1,35 @@
+#ifndef __BLOCK_H__
+#define __BLOCK_H__
+
+#include "config.h"
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <netinet/in.h>
+
+typedef enum _block_state_t {
+    BLOCK_STATE_WATCH,                      /**< violations are scored, or on probation after a block */
+    BLOCK_STATE_BLOCKED                     /**< in the firewall table until the hold is over */
+} block_state_t;
+
+/**
+ * Block state machine
+ *
+ * Detection reports violations of a source, which are scored with an
+ * exponential decay (half-life 1 s). A source is blocked (/32) once its
+ * score reaches the enter threshold and unblocked only when the hold is
+ * over and the score has fallen below the lower exit threshold, so that a
+ * rate oscillating around one threshold does not add and remove the same
+ * address over and over. The hold doubles with every block of a source
+ * (up to a maximum) and one doubling is forgotten per hold it stays quiet
+ * on probation. Once enough sources of a /24 are blocked, the /24 itself
+ * is blocked by the same rules, with half of that number as exit
+ * threshold.
+ *
+ * Holds and probations are driven by the timer wheel, called from the
+ * capture loop only.
+ */
+bool            block_init      (config_t *config);
+void            block_report    (struct in_addr *addr, uint32_t weight, uint64_t now);
+
+#endif
@@ -0,0 +1,36 @@
+#ifndef __BLOCKLIST_H__
+#define __BLOCKLIST_H__
+
+#include "config.h"
+#include "prefix_set.h"
+#include "blocklist_reader.h"
+
+#include <stdint.h>
+#include <stdbool.h>
+
+typedef struct _blocklist_prefix_t {
+    prefix_t            prefix;
+    uint8_t             policy;             /**< blocklist_policy_t */
+} blocklist_prefix_t;
+
+/**
+ * Shared blocklist
+ *
+ * Publishes the blocked and slipped sources of the firewall, together
+ * with the trusted and blocked prefixes of the prefix file, into a memory
+ * mapped file, so that local processes (a resolver pre-filter, a metrics
+ * exporter) need neither the pf table nor a lock to look a client up.
+ *
+ * The file holds two slots: a new generation is written into the one
+ * readers do not look at and the header switches to it, both under a
+ * seqlock.
+ * A prefix in several sets has the policy of the first of allow, block,
+ * slip. The firewall worker publishes after every flush which changed the
+ * tables and whenever the lpm build has handed over a new prefix file.
+ */
+bool            blocklist_init      (config_t *config);
+void            blocklist_static    (const blocklist_prefix_t *prefixes, uint32_t count);
+void            blocklist_update    (const prefix_set_t *blocked, const prefix_set_t *slipped, bool changed);
+void            blocklist_stop      (void);
+
+#endif
@@ -0,0 +1,96 @@
+#ifndef __BLOCKLIST_READER_H__
+#define __BLOCKLIST_READER_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <sys/types.h>
+#include <netinet/in.h>
+
+#define BLOCKLIST_MAGIC             0x4c424444          /**< "DDBL" */
+#define BLOCKLIST_VERSION           1
+#define BLOCKLIST_SLOTS             2
+
+typedef enum _blocklist_policy_t {
+    BLOCKLIST_POLICY_NONE,                  /**< no prefix matches */
+    BLOCKLIST_POLICY_ALLOW,                 /**< trusted: never refuse */
+    BLOCKLIST_POLICY_BLOCK,                 /**< blocked: drop or refuse */
+    BLOCKLIST_POLICY_SLIP,                  /**< slipped: answer with TC=1 only */
+    BLOCKLIST_POLICY_SIZE
+} blocklist_policy_t;
+
+typedef struct _blocklist_ipv4_t {
+    uint32_t            addr;               /**< host byte order, masked to the length */
+    uint32_t            policy;
+} blocklist_ipv4_t;
+
+typedef struct _blocklist_ipv6_t {
+    uint64_t            hi;                 /**< host byte order, masked to the length */
+    uint64_t            lo;
+    uint32_t            policy;
+    uint32_t            reserved;
+} blocklist_ipv6_t;
+
+/**
+ * Generation of the blocklist: the prefixes of each family, sorted by
+ * length and address, start at first[length]
+ */
+typedef struct _blocklist_slot_t {
+    uint32_t            ipv4_count;
+    uint32_t            ipv6_count;
+    uint32_t            ipv6_offset;        /**< bytes from data to the IPv6 prefixes */
+    uint32_t            reserved;
+    uint64_t            ipv4_lengths;       /**< bit l set: prefixes of length l */
+    uint64_t            ipv6_lengths[3];
+    uint32_t            ipv4_first[32 + 2];
+    uint32_t            ipv6_first[128 + 2];
+    uint8_t             data[] __attribute__((aligned(8)));
+} blocklist_slot_t;
+
+/**
+ * Head of the file, followed by BLOCKLIST_SLOTS slots of slot_size bytes.
+ * seq is odd while the writer writes a slot and switches to it
+ */
+typedef struct _blocklist_header_t {
+    uint32_t            magic;
+    uint32_t            version;
+    uint32_t            capacity;           /**< prefixes per slot */
+    uint32_t            slot_size;          /**< bytes */
+    uint64_t            seq;
+    uint64_t            generation;
+    uint32_t            active;             /**< slot of the current generation */
+    uint32_t            dropped;            /**< prefixes the current generation had no room for */
+    uint64_t            published;          /**< s since the epoch */
+} blocklist_header_t;
+
+#define BLOCKLIST_SLOT_OFFSET       ((sizeof(blocklist_header_t) + 63) & ~(size_t) 63)
+
+typedef struct _blocklist_reader_t {
+    const char         *path;
+    const uint8_t      *map;
+    size_t              size;
+    dev_t               dev;
+    ino_t               ino;
+} blocklist_reader_t;
+
+/**
+ * Reader of the shared blocklist
+ *
+ * The defender publishes its block, slip and allow sets into a memory
+ * mapped file (see blocklist.h). Readers in other processes map it read
+ * only and look addresses up without a lock or a system call: the header
+ * is a seqlock, a lookup which overlapped the publication of a generation
+ * is simply repeated. The longest matching prefix wins, like in the prefix
+ * policies of the defender.
+ *
+ * A restarted defender replaces the file: refresh a reader now and then
+ * (e.g. once per second) from the thread which does its lookups. This
+ * file and blocklist_reader.c only depend on libc, for resolver plugins.
+ */
+bool                blocklist_reader_open       (blocklist_reader_t *reader, const char *path);
+bool                blocklist_reader_refresh    (blocklist_reader_t *reader);
+void                blocklist_reader_close      (blocklist_reader_t *reader);
+blocklist_policy_t  blocklist_lookup_ipv4       (const blocklist_reader_t *reader, uint32_t addr, uint64_t *generation);
+blocklist_policy_t  blocklist_lookup_ipv6       (const blocklist_reader_t *reader, const struct in6_addr *addr, uint64_t *generation);
+
+#endif
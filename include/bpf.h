@@ -2,10 +2,18 @@
 #ifndef __BPF_H__
 #define __BPF_H__
 
+#include "bridge.h"
 #include "packet/raw_packet.h"
 #include <stdbool.h>
 
-int  bpf_open(const char *iface, const unsigned int timeout, const unsigned int *buffer_len);
-bool bpf_read(int bpf, raw_packet_t *raw_packet, const unsigned int buffer_len);
+int           bpf_open(const char *iface, const unsigned int timeout, unsigned int *buffer_len, bool bridged);
+raw_packet_t *bpf_read(int bpf, const unsigned int buffer_len);
+bool          bpf_write(int bpf, raw_packet_t *raw_packet);
+
+#ifdef __FreeBSD__
+bool          bpf_match(const raw_packet_t *raw_packet);
+
+extern const bridge_backend_t bridge_backend_bpf;
+#endif
 
 #endif
@@ -0,0 +1,57 @@
+#ifndef __BRIDGE_H__
+#define __BRIDGE_H__
+
+#include "config.h"
+#include "packet/raw_packet.h"
+
+#include <stdint.h>
+#include <stdbool.h>
+
+typedef enum _bridge_port_t {
+    BRIDGE_PORT_A,                          /**< ifname */
+    BRIDGE_PORT_B,                          /**< bridge_ifname */
+    BRIDGE_PORT_SIZE
+} bridge_port_t;
+
+typedef struct _bridge_stats_t {
+    uint64_t            forwarded;          /**< frames handed to the backend */
+    uint64_t            dropped;            /**< frames of attack traffic not forwarded */
+    uint64_t            copied;             /**< frames in a foreign buffer, copied before queueing */
+    uint64_t            batches;            /**< backend sends */
+    uint64_t            errors;             /**< frames the backend could not send */
+} bridge_stats_t;
+
+/**
+ * Transmit backend: sends a batch of frames out of a port, at once if the
+ * platform can. The frames stay owned by the bridge.
+ */
+typedef struct _bridge_backend_t {
+    const char         *name;
+    bool                (*open)     (config_t *config);
+    void                (*close)    (void);
+    uint32_t            (*send)     (bridge_port_t port, raw_packet_t **frames, uint32_t count);
+} bridge_backend_t;
+
+/**
+ * Inline bridge
+ *
+ * For sites without pf: every frame captured on one port is decided on by
+ * the verdict cache (and the detection for a miss) and only the allowed
+ * ones are sent out of the other port, so attack traffic is dropped in the
+ * capture loop without a firewall round trip. Forwarded frames are queued
+ * per port and sent as one batch at the end of the capture batch, or once
+ * bridge_batch frames are queued. Pooled buffers are queued by reference,
+ * only frames in a foreign buffer are copied. The capture devices have to
+ * capture every incoming frame (promiscuous, no filter, not the frames
+ * sent by the bridge itself).
+ */
+bool                        bridge_init         (config_t *config);
+bool                        bridge_enabled      (void);
+void                        bridge_forward      (raw_packet_t *raw_packet, bridge_port_t port);
+void                        bridge_drop         (raw_packet_t *raw_packet, bridge_port_t port);
+void                        bridge_flush        (void);
+void                        bridge_stats        (bridge_stats_t *stats);
+void                        bridge_stop         (void);
+const bridge_backend_t     *bridge_backend_find (const char *name);
+
+#endif
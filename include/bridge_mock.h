@@ -0,0 +1,17 @@
+#ifndef __BRIDGE_MOCK_H__
+#define __BRIDGE_MOCK_H__
+
+#include "bridge.h"
+
+/**
+ * In-process bridge backend
+ *
+ * Counts the frames and bytes of every port instead of sending them, so
+ * that the inline mode can run, and be benchmarked, without NICs.
+ */
+extern const bridge_backend_t bridge_backend_mock;
+
+uint64_t    bridge_mock_frames  (bridge_port_t port);
+uint64_t    bridge_mock_bytes   (bridge_port_t port);
+
+#endif
@@ -0,0 +1,31 @@
+#ifndef __CARDINALITY_H__
+#define __CARDINALITY_H__
+
+#include "config.h"
+#include "packet/packet.h"
+
+#include <stdint.h>
+#include <stdbool.h>
+
+typedef enum _cardinality_type_t {
+    CARDINALITY_VICTIM,                 /**< distinct reflectors per destination */
+    CARDINALITY_REFLECTOR,              /**< distinct destinations per DNS server */
+    CARDINALITY_TYPE_SIZE
+} cardinality_type_t;
+
+/**
+ * Distinct counter of reflectors per victim and of victims per reflector
+ *
+ * A reflection attack shows one destination receiving responses from
+ * thousands of distinct servers, a legitimate client talks to a handful.
+ * Every tracked address has a HyperLogLog sketch, sparse while small. The
+ * tables are bounded: a full probe window evicts its smallest sketch, and
+ * idle addresses expire.
+ */
+bool            cardinality_init        (config_t *config);
+void            cardinality_process     (packet_t *packet, raw_packet_t *raw_packet);
+uint64_t        cardinality_estimate    (cardinality_type_t type, uint32_t addr);
+uint64_t        cardinality_prefix      (cardinality_type_t type, uint32_t addr, uint8_t prefix_len);
+
+#endif
+
@@ -9,6 +9,53 @@ typedef struct _config_t {
     char           *ifname;
     unsigned int    timeout;
     
+    char           *bridge_ifname;          /**< inline mode: frames are bridged between ifname and this interface, NULL = monitor only */
+    char           *bridge_backend;         /**< bpf, packet or mock, NULL = default of the platform */
+    uint32_t        bridge_batch;           /**< frames queued per port before they are sent */
+    
+    char           *firewall_backend;       /**< pf, nft or mock, NULL = default of the platform */
+    char           *firewall_block_table;   /**< table (pf) or set (nft) of blocked sources */
+    char           *firewall_slip_table;    /**< table (pf) or set (nft) of slipped sources */
+    uint32_t        firewall_mock_latency;  /**< us the mock backend takes per batch */
+    uint32_t        firewall_queue;         /**< firewall actions queued for the worker */
+    uint32_t        firewall_interval;      /**< ms between two firewall flushes */
+    uint32_t        firewall_sync;          /**< s between two firewall table reconciliations, 0 = never */
+    uint32_t        aggregate_prefix;       /**< shortest prefix blocked addresses are aggregated to (24..32), 0 = disabled */
+    uint32_t        aggregate_density;      /**< percent of a prefix which must be blocked to block all of it */
+    uint32_t        aggregate_ipv6_subnets; /**< blocked /64s which block their /48, 0 = never */
+    
+    char           *blocklist_file;         /**< shared blocklist published for other processes, NULL = disabled */
+    uint32_t        blocklist_size;         /**< prefixes per generation of the shared blocklist */
+    
+    uint32_t        slip_rate;          /**< queries per second and source before slipping, 0 = disabled */
+    uint32_t        slip_burst;         /**< queries a source may send at once */
+    uint32_t        slip_hold;          /**< seconds a source stays in the slip table after the last excess */
+    
+    uint32_t        correlation_size;       /**< outstanding queries tracked, 0 = disabled */
+    uint32_t        correlation_timeout;    /**< ms a query waits for its response */
+    
+    uint32_t        victim_packets;         /**< response packets per second (weighted by amplification) to a destination to become a victim */
+    uint32_t        victim_bytes;           /**< response bytes per second to a destination to become a victim */
+    
+    uint32_t        heavy_hitter_size;      /**< top-K entries monitored per type, 0 = disabled */
+    uint32_t        heavy_hitter_interval;  /**< seconds between two reports, 0 = no report */
+    
+    uint32_t        rrl_rate;               /**< responses per second and (client prefix, qname, qtype, rcode), 0 = disabled */
+    uint32_t        rrl_burst;              /**< responses a bucket may send at once */
+    uint32_t        rrl_prefix;             /**< client prefix length */
+    uint32_t        rrl_action;             /**< rrl_action_t of a limited bucket */
+    
+    uint32_t        block_enter;            /**< decayed violations (half-life 1 s) which block a source, 0 = disabled */
+    uint32_t        block_exit;             /**< decayed violations below which a blocked source may be unblocked, 0 < exit < enter */
+    uint32_t        block_hold;             /**< seconds a source stays blocked at least, doubled for every block in a row */
+    uint32_t        block_hold_max;         /**< seconds, cap of the doubled hold */
+    uint32_t        block_escalate;         /**< blocked sources of a /24 which block all of it, 0 = never */
+    
+    uint32_t        cardinality_reflectors; /**< distinct servers answering to a destination to alert, 0 = disabled */
+    uint32_t        cardinality_victims;    /**< distinct destinations of a server to alert, 0 = disabled */
+    
+    char           *policy_file;            /**< qname policy rules, NULL = disabled */
+    char           *prefix_file;            /**< prefix policies (protected, trusted, blocked), NULL = disabled */
 } config_t;
 
 #endif
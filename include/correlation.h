@@ -0,0 +1,40 @@
+#ifndef __CORRELATION_H__
+#define __CORRELATION_H__
+
+#include "config.h"
+#include "amplification.h"
+#include "packet/packet.h"
+
+#include <stdint.h>
+#include <stdbool.h>
+
+typedef struct _correlation_key_t       correlation_key_t;
+typedef enum   _correlation_result_t    correlation_result_t;
+
+enum _correlation_result_t {
+    CORRELATION_IGNORED,                    /**< no DNS message (or without question) */
+    CORRELATION_QUERY,                      /**< query inserted */
+    CORRELATION_MATCHED,                    /**< response matched an outstanding query */
+    CORRELATION_UNSOLICITED                 /**< response without query: reflected traffic */
+};
+
+/**
+ * A query is identified by the client (address, port), the server, the
+ * DNS ID and the question. A response has to match all of them
+ */
+struct _correlation_key_t {
+    uint32_t            client_addr;        /**< IPv4 address (network byte order) */
+    uint32_t            server_addr;        /**< IPv4 address (network byte order) */
+    uint16_t            client_port;
+    uint16_t            id;                 /**< DNS ID */
+    uint32_t            qname_hash;         /**< dns_label_hash() of the first question */
+};
+
+bool                    correlation_init    (config_t *config);
+correlation_result_t    correlation_process (packet_t *packet, raw_packet_t *raw_packet, amplification_sample_t *sample);
+
+bool                    correlation_insert  (const correlation_key_t *key, uint16_t query_len, uint64_t now);
+bool                    correlation_match   (const correlation_key_t *key, uint16_t *query_len);
+
+#endif
+
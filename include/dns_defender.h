@@ -3,11 +3,13 @@
 #define __DNS_DEFENDER_H__
 
 #include "config.h"
+#include "bridge.h"
 
 #include <stdint.h>
 #include <stdbool.h>
 
 bool            dns_defender_init(config_t *config);
 int             dns_defender_mainloop(void);
+void            dns_defender_frame(raw_packet_t *raw_packet, bridge_port_t port);
 
 #endif
@@ -0,0 +1,54 @@
+#ifndef __FIREWALL_H__
+#define __FIREWALL_H__
+
+#include "config.h"
+#include "firewall_backend.h"
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <netinet/in.h>
+
+typedef enum _firewall_table_t {
+    FIREWALL_TABLE_BLOCK,                   /**< all traffic of these sources is blocked */
+    FIREWALL_TABLE_SLIP,                    /**< UDP responses to these destinations are blocked (TC=1 is sent instead) */
+    FIREWALL_TABLE_SIZE
+} firewall_table_t;
+
+typedef enum _firewall_action_t {
+    FIREWALL_ADD,
+    FIREWALL_REMOVE
+} firewall_action_t;
+
+typedef struct _firewall_stats_t {
+    uint64_t            posted;             /**< actions accepted by the queue */
+    uint64_t            dropped;            /**< actions rejected, queue full */
+    uint64_t            applied;            /**< actions handed to the backend */
+    uint64_t            flushes;            /**< backend flushes */
+    uint32_t            depth;              /**< actions in the queue */
+    uint32_t            depth_max;
+    uint64_t            latency_sum;        /**< us from posting to the flush, over all applied actions */
+    uint64_t            latency_max;        /**< us */
+} firewall_stats_t;
+
+/**
+ * Asynchronous firewall
+ *
+ * Capture and detection post firewall actions to a bounded lock-free
+ * multi-producer single-consumer queue and never wait for the firewall. A
+ * worker thread drains the queue into the batches of the backend (pf, nft
+ * or mock) and flushes them at most once per interval, so that a burst of
+ * blocks becomes a few ioctls or transactions. The established states of
+ * newly blocked sources are killed in the same flush, right after the
+ * adds, so a block takes effect at once. The worker keeps the desired
+ * content of every table: duplicates never reach the backend and the
+ * backend tables are reconciled with it every sync interval.
+ */
+bool            firewall_init       (config_t *config);
+bool            firewall_post       (firewall_table_t table, struct in_addr *addr, uint8_t prefix_len, firewall_action_t action);
+bool            firewall_post_ipv6  (firewall_table_t table, struct in6_addr *addr, uint8_t prefix_len, firewall_action_t action);
+void            firewall_apply      (firewall_table_t table, const prefix_t *prefix, firewall_action_t action);
+void            firewall_stats      (firewall_stats_t *stats);
+void            firewall_stop       (void);
+
+#endif
+
@@ -0,0 +1,46 @@
+#ifndef __FIREWALL_BACKEND_H__
+#define __FIREWALL_BACKEND_H__
+
+#include "config.h"
+#include "prefix_set.h"
+
+#include <stdint.h>
+#include <stdbool.h>
+
+typedef struct _firewall_backend_stats_t {
+    uint64_t            batches;            /**< ioctls / transactions sent */
+    uint64_t            added;              /**< prefixes sent for adding */
+    uint64_t            removed;            /**< prefixes sent for removal */
+    uint64_t            errors;             /**< failed batches */
+    uint64_t            killed;             /**< states of blocked sources killed */
+} firewall_backend_stats_t;
+
+/**
+ * Firewall backend
+ *
+ * Adds and removals are queued per table and applied as one batch by
+ * flush(). The firewall worker only adds prefixes which are not in a table
+ * and removes prefixes which are, as far as it knows. sync() makes a table
+ * exactly the desired set (sorted by prefix_compare), whatever happened to
+ * it meanwhile. kill() queues killing the established states of the
+ * sources in a newly blocked prefix, which the table alone would let pass
+ * until they time out: flush() kills them right after the table adds of
+ * the same batch, sync() once it has repaired the table. remove() cancels
+ * the queued kill of the prefix. Backends which match the table
+ * for every packet have no kill(). All calls come from the firewall worker.
+ */
+typedef struct _firewall_backend_t {
+    const char         *name;
+    bool                (*open)     (config_t *config);
+    void                (*close)    (void);
+    int                 (*add)      (const char *table, const prefix_t *prefix);
+    int                 (*remove)   (const char *table, const prefix_t *prefix);
+    int                 (*kill)     (const char *table, const prefix_t *prefix);
+    int                 (*flush)    (void);
+    int                 (*sync)     (const char *table, const prefix_t *desired, uint32_t count);
+    void                (*stats)    (firewall_backend_stats_t *stats);
+} firewall_backend_t;
+
+const firewall_backend_t   *firewall_backend_find   (const char *name);
+
+#endif
@@ -0,0 +1,22 @@
+#ifndef __FIREWALL_MOCK_H__
+#define __FIREWALL_MOCK_H__
+
+#include "firewall_backend.h"
+
+/**
+ * In-process firewall backend
+ *
+ * Records the operations of every batch into in-memory tables and takes
+ * firewall_mock_latency microseconds per batch, like a kernel round trip
+ * would. Established flows can be simulated as well: they pass until a
+ * state kill of their source removes them. Lets the blocking side, and
+ * the latency from detection to block, run on any build host.
+ */
+extern const firewall_backend_t firewall_backend_mock;
+
+bool        firewall_mock_contains  (const char *table, const prefix_t *prefix);
+uint32_t    firewall_mock_count     (const char *table);
+bool        firewall_mock_connect   (const prefix_t *source);
+uint32_t    firewall_mock_states    (const prefix_t *prefix);
+
+#endif
@@ -0,0 +1,41 @@
+#ifndef __HASH_H__
+#define __HASH_H__
+
+#include <stdint.h>
+
+#define HASH_SEED                   UINT64_C(0x9e3779b97f4a7c15)
+#define HASH_FNV1A_INIT             UINT32_C(0x811c9dc5)
+#define HASH_FNV1A_PRIME            UINT32_C(0x01000193)
+
+/**
+ * Finalizer of MurmurHash3, every input bit affects every output bit
+ */
+static inline uint64_t
+hash_mix64(uint64_t x)
+{
+    x ^= x >> 33;
+    x *= UINT64_C(0xff51afd7ed558ccd);
+    x ^= x >> 33;
+    x *= UINT64_C(0xc4ceb9fe1a85ec53);
+    x ^= x >> 33;
+
+    return x;
+}
+
+static inline uint64_t
+hash_combine(uint64_t hash, uint64_t value)
+{
+    return hash_mix64(hash ^ (value + HASH_SEED + (hash << 6) + (hash >> 2)));
+}
+
+/**
+ * FNV-1a, byte by byte (short strings such as DNS labels)
+ */
+static inline uint32_t
+hash_fnv1a(uint32_t hash, uint8_t byte)
+{
+    return (hash ^ byte) * HASH_FNV1A_PRIME;
+}
+
+#endif
+
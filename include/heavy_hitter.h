@@ -0,0 +1,31 @@
+#ifndef __HEAVY_HITTER_H__
+#define __HEAVY_HITTER_H__
+
+#include "config.h"
+#include "topk.h"
+#include "amplification.h"
+#include "packet/packet.h"
+
+#include <stdint.h>
+#include <stdbool.h>
+
+typedef enum _heavy_hitter_type_t {
+    HEAVY_HITTER_VICTIM,                    /**< destinations by response bytes */
+    HEAVY_HITTER_REFLECTOR,                 /**< resolvers by response bytes sent */
+    HEAVY_HITTER_QNAME,                     /**< questions (name and type) by amplified bytes */
+    HEAVY_HITTER_TYPE_SIZE
+} heavy_hitter_type_t;
+
+/**
+ * Heavy hitters
+ *
+ * Top victims, reflectors and question names of the current traffic. The
+ * counters are halved every interval, when the top entries are logged.
+ * heavy_hitter_snapshot() may be called from any thread.
+ */
+bool            heavy_hitter_init       (config_t *config);
+void            heavy_hitter_process    (packet_t *packet, raw_packet_t *raw_packet, const amplification_sample_t *sample);
+uint32_t        heavy_hitter_snapshot   (heavy_hitter_type_t type, topk_entry_t *entries, uint32_t size);
+
+#endif
+
@@ -0,0 +1,37 @@
+#ifndef __HLL_H__
+#define __HLL_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define HLL_PRECISION               10
+#define HLL_REGISTERS               (1 << HLL_PRECISION)        /**< 1024 registers: ~3.2% standard error */
+#define HLL_SPARSE_MAX              64                          /**< sparse entries before promotion to dense */
+
+typedef struct _hll_t   hll_t;
+
+/**
+ * HyperLogLog distinct counter
+ *
+ * A sketch starts sparse, a list of (register, rank) pairs inline, and is
+ * promoted to dense registers (one byte each) once the list is full. The
+ * harmonic sum of the registers is kept up to date, so an estimate is O(1).
+ * Dense sketches are merged register-wise with SIMD.
+ */
+struct _hll_t {
+    uint8_t            *dense;                              /**< HLL_REGISTERS, NULL while sparse */
+    uint16_t            sparse_len;
+    uint16_t            zeros;                              /**< registers which are zero */
+    double              sum;                                /**< sum of 2^-register */
+    uint16_t            sparse[HLL_SPARSE_MAX];             /**< register << 6 | rank */
+};
+
+void            hll_init        (hll_t *hll);
+void            hll_free        (hll_t *hll);
+bool            hll_add         (hll_t *hll, uint64_t hash);
+uint64_t        hll_estimate    (const hll_t *hll);
+void            hll_merge       (uint8_t *registers, const hll_t *hll);
+uint64_t        hll_estimate_registers(const uint8_t *registers);
+
+#endif
+
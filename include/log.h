@@ -70,6 +70,26 @@ typedef enum {
     LOG_HEADER_IPV4,
     LOG_HEADER_UDPV4,
     LOG_HEADER_DNS,
+    LOG_HEADER_GRE,
+    LOG_HEADER_VXLAN,
+    LOG_SLIP,
+    LOG_DISPATCH,
+    LOG_CORRELATION,
+    LOG_VICTIM,
+    LOG_TOPK,
+    LOG_HEAVY_HITTER,
+    LOG_AMPLIFICATION,
+    LOG_RRL,
+    LOG_HLL,
+    LOG_CARDINALITY,
+    LOG_VERDICT,
+    LOG_POLICY,
+    LOG_LPM,
+    LOG_FIREWALL,
+    LOG_AGGREGATE,
+    LOG_BLOCK,
+    LOG_BRIDGE,
+    LOG_BLOCKLIST,
 } log_category_t;
 
 typedef enum {
@@ -36,6 +36,8 @@
 #define LOG_IPV4_HEADER(category, level, packet, msg)       LOG_NETWORK_FUNCTION(log_ipv4_header,        category, level, packet, msg)
 #define LOG_UDPV4_HEADER(category, level, packet, msg)      LOG_NETWORK_FUNCTION(log_udpv4_header,       category, level, packet, msg)
 #define LOG_DNS_HEADER(category, level, packet, msg)        LOG_NETWORK_FUNCTION(log_dns_header,         category, level, packet, msg)
+#define LOG_GRE_HEADER(category, level, packet, msg)        LOG_NETWORK_FUNCTION(log_gre_header,         category, level, packet, msg)
+#define LOG_VXLAN_HEADER(category, level, packet, msg)      LOG_NETWORK_FUNCTION(log_vxlan_header,       category, level, packet, msg)
 
 /*** DECLARATION ************************************************************/
 
@@ -46,6 +48,8 @@ void        log_ethernet_header     (const ethernet_header_t        *ether_heade
 void        log_ipv4_header         (const ipv4_header_t            *ipv4_header);
 void        log_udpv4_header        (const udpv4_header_t           *udpv4_header);
 void        log_dns_header          (const dns_header_t             *dns_header);
+void        log_gre_header          (const gre_header_t             *gre_header);
+void        log_vxlan_header        (const vxlan_header_t           *vxlan_header);
 
 void        log_dns_queries         (const uint16_t count, const dns_query_t *query);
 void        log_dns_resource_records(const uint16_t count, const dns_rr_t    *rr);
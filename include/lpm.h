@@ -0,0 +1,47 @@
+#ifndef __LPM_H__
+#define __LPM_H__
+
+#include "config.h"
+#include "packet/net_address.h"
+
+#include <stdint.h>
+#include <stdbool.h>
+
+typedef enum _lpm_policy_t {
+    LPM_POLICY_NONE,                        /**< no prefix matches */
+    LPM_POLICY_PROTECTED,                   /**< our own prefixes */
+    LPM_POLICY_TRUSTED,                     /**< trusted clients and resolvers: never limited */
+    LPM_POLICY_BLOCKED,                     /**< statically blocked: skipped by the capture loop */
+    LPM_POLICY_SIZE
+} lpm_policy_t;
+
+/**
+ * Longest-prefix-match tables of prefix policies
+ *
+ * The prefix file maps one IPv4 or IPv6 prefix per line to a policy:
+ *
+ *   # prefix           policy
+ *   192.0.2.0/24       protected
+ *   198.51.100.53/32   trusted
+ *   2001:db8::/32      blocked
+ *
+ * IPv4 is a DIR-24-8 table: one access for prefixes up to /24, two for
+ * longer ones. IPv6 is a poptrie: a direct table of the first 16 bits and
+ * nodes of 6 bit strides, whose children and runs of equal leaves are
+ * packed behind bitmaps and found by popcount.
+ *
+ * A reload builds new tables in a thread. The capture loop publishes them
+ * between two batches (lpm_publish), when no lookup holds the old tables.
+ * The trusted and blocked prefixes also go to the shared blocklist.
+ */
+bool            lpm_init            (config_t *config);
+bool            lpm_reload          (void);
+void            lpm_publish         (void);
+lpm_policy_t    lpm_lookup_ipv4     (uint32_t addr);
+lpm_policy_t    lpm_lookup_ipv6     (const ipv6_address_t *addr);
+void            lpm_bitmap_ipv4     (uint32_t addr, uint32_t policies, uint64_t bitmap[4]);
+bool            lpm_match_ipv6      (const ipv6_address_t *addr, uint8_t len, uint32_t policies);
+const char     *lpm_policy_name     (lpm_policy_t policy);
+
+#endif
+
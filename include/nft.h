@@ -0,0 +1,40 @@
+#ifndef __NFT_H__
+#define __NFT_H__
+
+#include "firewall_backend.h"
+
+#define NFT_TABLE           "dnsdefend"     /**< inet table holding the sets */
+
+/**
+ * nftables set backend (Linux)
+ *
+ * The firewall tables are named sets of the inet table NFT_TABLE, which
+ * the ruleset has to define with interval flags. A set holds one family,
+ * IPv6 prefixes go to the set with the suffix 6, e.g.
+ *
+ *   table inet dnsdefend {
+ *       set hacker  { type ipv4_addr; flags interval; }
+ *       set hacker6 { type ipv6_addr; flags interval; }
+ *       set slip    { type ipv4_addr; flags interval; }
+ *       set slip6   { type ipv6_addr; flags interval; }
+ *       chain input {
+ *           type filter hook input priority 0;
+ *           ip  saddr @hacker  drop
+ *           ip6 saddr @hacker6 drop
+ *       }
+ *   }
+ *
+ * A flush sends the queued element changes of all sets as one netlink
+ * batch, which the kernel applies as one transaction: all or nothing. A
+ * sync flushes a set and refills it with the desired prefixes in one
+ * transaction, so there is no need to read it back. An interval set
+ * rejects overlapping elements: the backend needs prefix aggregation,
+ * which never hands a prefix together with one it covers.
+ *
+ * There is no state kill: the sets are matched for every packet, so a
+ * block cuts established connections as well, as long as the ruleset
+ * matches them before accepting "ct state established".
+ */
+extern const firewall_backend_t firewall_backend_nft;
+
+#endif
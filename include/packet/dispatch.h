@@ -0,0 +1,87 @@
+#ifndef __DISPATCH_H__
+#define __DISPATCH_H__
+
+#include "packet/packet.h"
+
+#define DISPATCH_ENTRY_MAX              256         /**< distinct decoder/encoder pairs, id 0 is "not registered" */
+#define DISPATCH_KEY_MAX                65536
+
+#define DISPATCH_LIKELY(x)              __builtin_expect(!!(x), 1)
+#define DISPATCH_UNLIKELY(x)            __builtin_expect(!!(x), 0)
+
+/**
+ * Registers a protocol in a dispatch layer from the protocol's own module,
+ * no core file has to be touched, e.g.
+ *
+ * DISPATCH_REGISTER(dns_header) {
+ *     dispatch_register(DISPATCH_LAYER_UDP_PORT, PORT_DNS, dns_header_decode, dns_header_encode);
+ * }
+ */
+#define DISPATCH_REGISTER(name)         static void __attribute__((constructor)) name##_register(void)
+
+typedef enum _dispatch_layer_t {
+    DISPATCH_LAYER_ETHERTYPE,                       /**< Ethernet type, also the GRE protocol type */
+    DISPATCH_LAYER_IP_PROTOCOL,                     /**< IPv4 protocol */
+    DISPATCH_LAYER_UDP_PORT,                        /**< UDP source or destination port */
+    DISPATCH_LAYER_SIZE
+} dispatch_layer_t;
+
+typedef struct _dispatch_entry_t {
+    header_decode_fn    decode;
+    header_encode_fn    encode;
+} dispatch_entry_t;
+
+/**
+ * Dense lookup tables: every layer maps a key to an entry id, so dispatch
+ * is a table load and an indirect call. The UDP ports have an additional
+ * bitmap (8 KiB), which rejects unregistered ports without touching the
+ * 64 KiB id table
+ */
+extern dispatch_entry_t         dispatch_entry[DISPATCH_ENTRY_MAX];
+extern uint8_t                 *dispatch_table[DISPATCH_LAYER_SIZE];
+extern uint64_t                 dispatch_udp_port_bitmap[DISPATCH_KEY_MAX / 64];
+
+bool dispatch_register(dispatch_layer_t layer, uint16_t key, header_decode_fn decode, header_encode_fn encode);
+
+static inline header_decode_fn
+dispatch_decoder(dispatch_layer_t layer, uint16_t key)
+{
+    return dispatch_entry[dispatch_table[layer][key]].decode;
+}
+
+static inline header_encode_fn
+dispatch_encoder(dispatch_layer_t layer, uint16_t key)
+{
+    return dispatch_entry[dispatch_table[layer][key]].encode;
+}
+
+static inline bool
+dispatch_udp_port_registered(uint16_t port)
+{
+    return (dispatch_udp_port_bitmap[port >> 6] >> (port & 63)) & 1;
+}
+
+/**
+ * Decodes the next layer, NULL if the key is not registered
+ */
+static inline header_t *
+dispatch_decode(dispatch_layer_t layer, uint16_t key, netif_t *netif, packet_t *packet, raw_packet_t *raw_packet, packet_offset_t offset)
+{
+    header_decode_fn decode = dispatch_decoder(layer, key);
+
+    return (decode != NULL) ? decode(netif, packet, raw_packet, offset) : NULL;
+}
+
+/**
+ * Encodes the next layer, 0 if the key is not registered
+ */
+static inline packet_len_t
+dispatch_encode(dispatch_layer_t layer, uint16_t key, netif_t *netif, packet_t *packet, raw_packet_t *raw_packet, packet_offset_t offset)
+{
+    header_encode_fn encode = dispatch_encoder(layer, key);
+
+    return (encode != NULL) ? encode(netif, packet, raw_packet, offset) : 0;
+}
+
+#endif
+
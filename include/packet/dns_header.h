@@ -25,6 +25,16 @@ typedef struct _dns_rr_opt_t        dns_rr_opt_t;
 #define DNS_HEADER_OFFSET_NS_COUNT          8
 #define DNS_HEADER_OFFSET_AR_COUNT          10
 
+#define DNS_HEADER_FLAG_QR                  0x8000
+#define DNS_HEADER_MASK_OPCODE              0x7800
+#define DNS_HEADER_FLAG_AA                  0x0400
+#define DNS_HEADER_FLAG_TC                  0x0200
+#define DNS_HEADER_FLAG_RD                  0x0100
+#define DNS_HEADER_FLAG_RA                  0x0080
+#define DNS_HEADER_FLAG_AD                  0x0020
+#define DNS_HEADER_FLAG_CD                  0x0010
+#define DNS_HEADER_MASK_RCODE               0x000f
+
 #define DNS_HEADER_OPCODE_QUERY             0
 #define DNS_HEADER_OPCODE_IQUERY            1
 #define DNS_HEADER_OPCODE_STATUS            2
@@ -54,6 +64,8 @@ typedef struct _dns_rr_opt_t        dns_rr_opt_t;
 #define DNS_HEADER_RCODE_BAD_TRUNCATION     22
 
 #define DNS_DOMAIN_MAX_LEN                  253
+#define DNS_COMPRESSION_MAX                 64          /* max. names remembered for message compression */
+#define DNS_COMPRESSION_MAX_OFFSET          0x3fff      /* a pointer has 14 bits */
 
 #define DNS_LABEL_MAX_LEN                   63
 #define DNS_LABEL_POINTER_MASK              0xc0
@@ -187,6 +199,9 @@ struct _dns_header_t {
 
     dns_rr_t                       *ar;
     uint16_t                        ar_count;       /**< Number of resource records in the additional records section */
+
+    packet_offset_t                 offset;         /**< offset of the DNS header in the raw packet (decode only) */
+    packet_len_t                    qd_len;         /**< length of the question section on the wire (decode only) */
 };
 
 /**
@@ -278,7 +293,8 @@ struct _dns_query_t {
     uint32_t                        ttl;        \
     uint16_t                        rdlength;   \
                                                 \
-    dns_rr_t                       *next;
+    dns_rr_t                       *next;       \
+    const uint8_t                  *rdata;      /**< rdata in the decoded raw packet (valid as long as the raw packet) */
 
 /**
  *  Start of Authority (SOA)
@@ -454,6 +470,7 @@ struct _dns_rr_opt_t {
     uint16_t                        rdlength;
 
     dns_rr_t                       *next;
+    const uint8_t                  *rdata;
 };
 
 struct _dns_rr_t {
@@ -483,6 +500,8 @@ void            dns_query_free      (dns_query_t *query);
 dns_rr_t       *dns_rr_new          (void);
 void            dns_rr_free         (dns_rr_t *resource_record);
 
+uint32_t        dns_label_hash      (const dns_label_t *label);
+
 void            dns_convert_to_domain(char *domain, const dns_label_t *label);
 void            dns_convert_to_label_list(dns_label_t **label, const char *domain);
 
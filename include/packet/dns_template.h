@@ -0,0 +1,47 @@
+#ifndef __DNS_TEMPLATE_H__
+#define __DNS_TEMPLATE_H__
+
+typedef struct _dns_template_t          dns_template_t;
+
+#include "packet/packet.h"
+
+/* length of the precompiled part: IPv4 + UDP + DNS header */
+#define DNS_TEMPLATE_LEN                (IPV4_HEADER_LEN + UDPV4_HEADER_LEN + DNS_HEADER_LEN)
+
+#define DNS_TEMPLATE_OFFSET_IPV4        0
+#define DNS_TEMPLATE_OFFSET_UDPV4       (DNS_TEMPLATE_OFFSET_IPV4  + IPV4_HEADER_LEN)
+#define DNS_TEMPLATE_OFFSET_DNS         (DNS_TEMPLATE_OFFSET_UDPV4 + UDPV4_HEADER_LEN)
+
+#define DNS_TEMPLATE_TTL                64
+
+/**
+ * Precompiled response skeleton
+ *
+ * The IPv4, UDP and DNS header of a response are encoded once. For every
+ * query only the Ethernet header is written, the addresses, ports, lengths,
+ * checksums and the DNS ID are patched and the question is copied from the
+ * query
+ *
+ *  +---------------------+
+ *  |   Ethernet (VLAN)   | written from the query (addresses swapped)
+ *  +---------------------+
+ *  |        IPv4         | template, patched
+ *  +---------------------+
+ *  |         UDP         | template, patched
+ *  +---------------------+
+ *  |     DNS Header      | template, patched (ID, RD, Opcode, QDCOUNT)
+ *  +---------------------+
+ *  |      Question       | copied from the query
+ *  +---------------------+
+ */
+struct _dns_template_t {
+    uint8_t             data[DNS_TEMPLATE_LEN];
+    uint16_t            flags;                  /**< DNS flags of the response */
+    uint16_t            id;                     /**< IPv4 identification, incremented per response */
+};
+
+bool            dns_template_compile    (dns_template_t *template, uint8_t rcode, bool truncated);
+raw_packet_t   *dns_template_apply      (dns_template_t *template, packet_t *query, raw_packet_t *query_raw);
+
+#endif
+
@@ -31,6 +31,18 @@ typedef struct _ethernet_header_t       ethernet_header_t;
 #define ETHERTYPE_IPV6                  0x86DD
 #endif
 
+#ifndef ETHERTYPE_TEB
+#define ETHERTYPE_TEB                   0x6558      /* Transparent Ethernet Bridging (GRE payload) */
+#endif
+
+#ifndef ETHERTYPE_ERSPAN_II
+#define ETHERTYPE_ERSPAN_II             0x88BE      /* ERSPAN type I and II (GRE payload) */
+#endif
+
+#ifndef ETHERTYPE_ERSPAN_III
+#define ETHERTYPE_ERSPAN_III            0x22EB      /* ERSPAN type III (GRE payload) */
+#endif
+
 typedef struct _vlan_header_t {
     union {
         uint16_t        tci;            /* Tag Control Information */
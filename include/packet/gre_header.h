@@ -0,0 +1,135 @@
+#ifndef __GRE_HEADER_H__
+#define __GRE_HEADER_H__
+
+typedef struct _gre_header_t            gre_header_t;
+typedef struct _erspan_header_t         erspan_header_t;
+
+#include "packet/packet.h"
+
+/* length on the wire! */
+#define GRE_HEADER_LEN                  4           /* without optional fields */
+#define GRE_HEADER_OPTION_LEN           4           /* checksum + reserved1, key, sequence: each 4 bytes */
+#define ERSPAN_II_HEADER_LEN            8
+#define ERSPAN_III_HEADER_LEN           12
+#define ERSPAN_III_SUBHEADER_LEN        8           /* platform specific sub-header, see 'o' flag */
+
+#define GRE_HEADER_OFFSET_FLAGS         0
+#define GRE_HEADER_OFFSET_PROTOCOL      2
+#define GRE_HEADER_OFFSET_OPTION        4
+
+#define ERSPAN_HEADER_OFFSET_WORD0      0
+#define ERSPAN_HEADER_OFFSET_WORD1      4
+#define ERSPAN_HEADER_OFFSET_WORD2      8
+
+/* GRE header values */
+#define GRE_HEADER_VERSION              0           /* version 1 is PPTP (enhanced GRE), not supported */
+
+#define ERSPAN_TYPE_NONE                0
+#define ERSPAN_TYPE_I                   1           /* no ERSPAN header at all, GRE without sequence number */
+#define ERSPAN_TYPE_II                  2           /* ERSPAN header version 1 */
+#define ERSPAN_TYPE_III                 3           /* ERSPAN header version 2 */
+
+/**
+ *  ERSPAN Type II (version 1)
+ *
+ *   0                   1                   2                   3
+ *   0 1 2 3 4 5 6 7 8 9 0 1 2 3 4 5 6 7 8 9 0 1 2 3 4 5 6 7 8 9 0 1
+ *  +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+ *  |  Ver  |          VLAN         | COS | En|T|    Session ID     |
+ *  +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+ *  |      Reserved         |                  Index                |
+ *  +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+ *
+ *  ERSPAN Type III (version 2)
+ *
+ *  +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+ *  |  Ver  |          VLAN         | COS |BSO|T|     Session ID    |
+ *  +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+ *  |                          Timestamp                            |
+ *  +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+ *  |             SGT               |P|    FT   |   Hw ID   |D|Gra|O|
+ *  +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+ */
+struct _erspan_header_t {
+    uint8_t             type;                   /**< ERSPAN_TYPE_* */
+    union {
+        uint32_t        word0;
+        struct {
+            uint32_t    session_id  : 10;       /**< Session ID (LSB) */
+            uint32_t    truncated   : 1;        /**< frame was truncated (T) */
+            uint32_t    encap       : 2;        /**< original encapsulation (En) resp. bad/short/oversized (BSO) */
+            uint32_t    cos         : 3;        /**< Class of Service of the original frame */
+            uint32_t    vlan        : 12;       /**< VLAN of the original frame */
+            uint32_t    version     : 4;        /**< ERSPAN version (MSB) */
+        };
+    };
+    union {
+        uint32_t        word1;
+        struct {
+            uint32_t    index       : 20;       /**< port index of the source (type II only) */
+            uint32_t    reserved    : 12;
+        };
+        uint32_t        timestamp;              /**< timestamp (type III only) */
+    };
+    union {
+        uint32_t        word2;                  /**< type III only */
+        struct {
+            uint32_t    o           : 1;        /**< platform specific sub-header follows (LSB) */
+            uint32_t    granularity : 2;        /**< timestamp granularity */
+            uint32_t    direction   : 1;        /**< 0 = ingress, 1 = egress */
+            uint32_t    hw_id       : 6;        /**< hardware ID of the ERSPAN engine */
+            uint32_t    ft          : 5;        /**< frame type */
+            uint32_t    p           : 1;        /**< original frame was a ethernet frame */
+            uint32_t    sgt         : 16;       /**< Security Group Tag (MSB) */
+        };
+    };
+};
+
+/**
+ *  GRE (RFC 2784, key and sequence number RFC 2890)
+ *
+ *   0                   1                   2                   3
+ *   0 1 2 3 4 5 6 7 8 9 0 1 2 3 4 5 6 7 8 9 0 1 2 3 4 5 6 7 8 9 0 1
+ *  +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+ *  |C| |K|S| Reserved0       | Ver |         Protocol Type         |
+ *  +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+ *  |      Checksum (optional)      |       Reserved1 (Optional)    |
+ *  +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+ *  |                         Key (optional)                        |
+ *  +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+ *  |                 Sequence Number (Optional)                    |
+ *  +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+ *
+ *  The payload is either an Ethernet frame (transparent ethernet bridging),
+ *  an ERSPAN header followed by the mirrored Ethernet frame or an IPv4 packet.
+ */
+struct _gre_header_t {
+    header_t            header;
+
+    union {
+        uint16_t        flags_version;
+        struct {
+            uint16_t    version     : 3;        /**< Version (LSB) */
+            uint16_t    flags       : 5;        /**< Reserved0 */
+            uint16_t    recursion   : 3;        /**< Recursion Control (RFC 1701, deprecated) */
+            uint16_t    strict      : 1;        /**< Strict Source Route (RFC 1701, deprecated) */
+            uint16_t    s           : 1;        /**< Sequence Number present */
+            uint16_t    k           : 1;        /**< Key present */
+            uint16_t    r           : 1;        /**< Routing present (RFC 1701, deprecated) */
+            uint16_t    c           : 1;        /**< Checksum present (MSB) */
+        };
+    };
+    uint16_t            protocol;               /**< Ethertype of the payload */
+    uint16_t            checksum;
+    uint32_t            key;
+    uint32_t            sequence;
+
+    erspan_header_t     erspan;
+};
+
+gre_header_t       *gre_header_new      (void);
+void                gre_header_free     (header_t *header);
+header_t           *gre_header_decode   (netif_t *netif, packet_t *packet, raw_packet_t *raw_packet, packet_offset_t offset);
+
+#endif
+
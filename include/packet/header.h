@@ -22,6 +22,8 @@ enum _header_type_t {
     PACKET_TYPE_UDPV6,
     PACKET_TYPE_TCPV6,
     PACKET_TYPE_DNS,
+    PACKET_TYPE_GRE,
+    PACKET_TYPE_VXLAN,
     PACKET_TYPE_IGNORE,
     PACKET_TYPE_ALL
 };
@@ -65,6 +67,8 @@ struct _header_t {
 #include "packet/ethernet_header.h"
 #include "packet/ipv4_header.h"
 #include "packet/udpv4_header.h"
+#include "packet/gre_header.h"
+#include "packet/vxlan_header.h"
 #include "packet/dns_header.h"
 
 #endif
@@ -32,6 +32,7 @@ typedef struct _ipv4_header_t           ipv4_header_t;
 #define IPV4_PROTOCOL_ICMP              1
 #define IPV4_PROTOCOL_TCP               6
 #define IPV4_PROTOCOL_UDP               17
+#define IPV4_PROTOCOL_GRE               47
 
 /* port */
 #define IPV4_PORT_DNS                   53
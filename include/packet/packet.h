@@ -29,12 +29,15 @@ struct _packet_t {
     packet_direction_t      direction;
     header_t               *head;
     header_t               *tail;
+    bool                    fragment;       /**< first fragment of a fragmented datagram: the payload is incomplete */
+    uint32_t                weight;         /**< captured packets this one stands for (sampled flows), 1 otherwise */
 };
 
 bool            packet_init     (void);
 packet_t *      packet_new      (void);
 bool            packet_encode   (netif_t *netif, packet_t *packet, raw_packet_t *raw_packet);
 packet_t       *packet_decode   (netif_t *netif,                   raw_packet_t *raw_packet);
+header_t       *packet_get_header(packet_t *packet, header_type_t type);
 
 #endif
 
@@ -3,6 +3,7 @@
 #define __PORT_H__
 
 #define PORT_DNS                53
+#define PORT_VXLAN              4789
 
 #endif
 
@@ -4,17 +4,41 @@
 #include "object.h"
 #include "net_address.h"
 
-typedef struct _raw_packet_t {
+/**
+ * Packet buffers are size-classed: most DNS frames fit into a small buffer,
+ * large buffers are only taken for jumbo frames and GRO/TSO super-frames
+ */
+#define RAW_PACKET_SIZE_SMALL           512         /**< typical DNS queries and small responses */
+#define RAW_PACKET_SIZE_MEDIUM          2048        /**< standard frames (1518 bytes + VLAN tags) */
+#define RAW_PACKET_SIZE_JUMBO           9216        /**< 9000-MTU jumbo frames */
+#define RAW_PACKET_SIZE_MAX             65535       /**< GRO/TSO super-frames, max. capture length */
+
+typedef enum _raw_packet_class_t {
+    RAW_PACKET_CLASS_SMALL,
+    RAW_PACKET_CLASS_MEDIUM,
+    RAW_PACKET_CLASS_JUMBO,
+    RAW_PACKET_CLASS_MAX,
+    RAW_PACKET_CLASS_SIZE,                          /**< number of pooled size classes */
+    RAW_PACKET_CLASS_EXTERNAL = RAW_PACKET_CLASS_SIZE   /**< data is not owned (static or foreign buffer) */
+} raw_packet_class_t;
+
+typedef struct _raw_packet_t    raw_packet_t;
+
+struct _raw_packet_t {
     object_t            obj;
-    uint16_t            len;
-    union {
-        uint8_t         data[ETH_MAX_FRAME_SIZE];
-        uint32_t        data32[ETH_MAX_FRAME_SIZE / 4];
-    };
-} raw_packet_t;
-
-raw_packet_t *raw_packet_new(void);
-bool          raw_packet_init(raw_packet_t *raw_packet);
+    uint16_t            len;                        /**< bytes used in data */
+    uint16_t            size;                       /**< bytes available in data (capacity) */
+    raw_packet_class_t  klass;
+    uint64_t            timestamp;                  /**< capture time in microseconds, zero if unknown */
+    uint8_t            *data;
+    raw_packet_t       *next;                       /**< capture batch, free list of the size class */
+};
+
+raw_packet_t *raw_packet_new(uint32_t size);
+bool          raw_packet_init(raw_packet_t *raw_packet, uint8_t *data, uint16_t size);
 uint16_t      raw_packet_calc_checksum(uint16_t *buffer, uint16_t len);
+uint32_t      raw_packet_sum_checksum (uint32_t sum, const uint8_t *buffer, uint16_t len);
+uint16_t      raw_packet_fold_checksum(uint32_t sum);
 
 #endif
+
@@ -0,0 +1,42 @@
+#ifndef __VXLAN_HEADER_H__
+#define __VXLAN_HEADER_H__
+
+typedef struct _vxlan_header_t          vxlan_header_t;
+
+#include "packet/packet.h"
+
+/* length on the wire! */
+#define VXLAN_HEADER_LEN                8
+
+#define VXLAN_HEADER_OFFSET_FLAGS       0
+#define VXLAN_HEADER_OFFSET_VNI         4
+
+/* VXLAN header values */
+#define VXLAN_HEADER_FLAG_VNI           0x08        /* I flag: VNI is valid */
+
+/**
+ *  VXLAN (RFC 7348)
+ *
+ *   0                   1                   2                   3
+ *   0 1 2 3 4 5 6 7 8 9 0 1 2 3 4 5 6 7 8 9 0 1 2 3 4 5 6 7 8 9 0 1
+ *  +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+ *  |R|R|R|R|I|R|R|R|            Reserved                           |
+ *  +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+ *  |                VXLAN Network Identifier (VNI) |   Reserved    |
+ *  +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+ *
+ *  The payload is the inner Ethernet frame.
+ */
+struct _vxlan_header_t {
+    header_t            header;
+
+    uint8_t             flags;
+    uint32_t            vni;                    /**< 24-bit VXLAN Network Identifier */
+};
+
+vxlan_header_t     *vxlan_header_new    (void);
+void                vxlan_header_free   (header_t *header);
+header_t           *vxlan_header_decode (netif_t *netif, packet_t *packet, raw_packet_t *raw_packet, packet_offset_t offset);
+
+#endif
+
@@ -1,11 +1,19 @@
-
 #ifndef __PF_H__
 #define __PF_H__
 
-#include <netinet/in.h>
+#include "firewall_backend.h"
 
-int  pf_add_ipv4_address(struct in_addr *addr);
-int  pf_remove_ipv4_address(struct in_addr *addr);
+/**
+ * pf table backend
+ *
+ * Adds and removals are queued per table and pushed with one ioctl per
+ * table and direction on flush, over one /dev/pf descriptor which stays
+ * open. Within a batch a removal cancels the queued add of the same
+ * address and vice versa. The kernel reports back per address
+ * (PFR_FLAG_FEEDBACK), which is logged. A sync reads the table back
+ * (DIOCRGETADDRS) and pushes the difference to the desired set. A table
+ * holds IPv4 and IPv6 prefixes alike.
+ */
+extern const firewall_backend_t firewall_backend_pf;
 
 #endif
-
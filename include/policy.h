@@ -0,0 +1,41 @@
+#ifndef __POLICY_H__
+#define __POLICY_H__
+
+#include "config.h"
+#include "packet/packet.h"
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define POLICY_QTYPE_MAX            8                   /**< qtypes of a rule, none = any qtype */
+
+typedef enum _policy_action_t {
+    POLICY_NONE,                            /**< no rule matches */
+    POLICY_ALLOW,                           /**< exempt from slip and response rate limiting */
+    POLICY_SUSPECT                          /**< response is limited at once */
+} policy_action_t;
+
+typedef struct _policy_trie_t   policy_trie_t;
+
+/**
+ * Qname policy
+ *
+ * Rules are read from a file, one per line:
+ *
+ *   # action   suffix          [qtype,...]
+ *   allow      example.com
+ *   suspect    *.isc.org       ANY,DNSKEY
+ *
+ * A suffix matches the name itself and all names below it, "*." matches
+ * only the names below. The longest matching suffix with a matching qtype
+ * wins. The rules are compiled into a trie over the reversed labels, so a
+ * qname is matched in one walk from the root; a reload (SIGHUP) compiles a
+ * new trie and swaps it in atomically.
+ */
+bool            policy_init         (config_t *config);
+bool            policy_reload       (void);
+policy_action_t policy_match        (const dns_label_t *qname, uint16_t qtype);
+policy_action_t policy_process      (packet_t *packet);
+
+#endif
+
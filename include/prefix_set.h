@@ -0,0 +1,38 @@
+#ifndef __PREFIX_SET_H__
+#define __PREFIX_SET_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <netinet/in.h>
+
+/**
+ * IPv4 or IPv6 prefix as handed to the firewall backends
+ */
+typedef struct _prefix_t {
+    uint8_t             family;                     /**< AF_INET, AF_INET6, zero if unused */
+    uint8_t             len;
+    union {
+        struct in_addr  ipv4;
+        struct in6_addr ipv6;
+    };
+} prefix_t;
+
+/**
+ * Set of prefixes: open addressing with linear probing, grows at half load
+ */
+typedef struct _prefix_set_t {
+    prefix_t           *prefixes;
+    uint32_t            count;
+    uint32_t            size;                       /**< power of two */
+} prefix_set_t;
+
+int         prefix_compare          (const void *a, const void *b);
+bool        prefix_covers           (const prefix_t *prefix, const prefix_t *addr);
+bool        prefix_set_add          (prefix_set_t *set, const prefix_t *prefix);
+bool        prefix_set_remove       (prefix_set_t *set, const prefix_t *prefix);
+bool        prefix_set_contains     (const prefix_set_t *set, const prefix_t *prefix);
+uint32_t    prefix_set_sorted       (const prefix_set_t *set, prefix_t *prefixes);
+void        prefix_set_free         (prefix_set_t *set);
+const char *prefix_ntop             (const prefix_t *prefix, char *str, size_t len);
+
+#endif
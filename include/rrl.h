@@ -0,0 +1,33 @@
+#ifndef __RRL_H__
+#define __RRL_H__
+
+#include "config.h"
+#include "packet/packet.h"
+
+#include <stdint.h>
+#include <stdbool.h>
+
+typedef enum _rrl_action_t {
+    RRL_ACTION_PASS,                        /**< conforming, or limited responses are only logged */
+    RRL_ACTION_SLIP,                        /**< client is handed to the slip responder (TC=1) */
+    RRL_ACTION_BLOCK                        /**< client is reported to the block state machine */
+} rrl_action_t;
+
+/**
+ * Response rate limiting
+ *
+ * Responses are metered with token buckets keyed by (client prefix, qname,
+ * qtype, rcode), as BIND's RRL does in the server. The buckets are a
+ * fixed-size set-associative table: one probe of a set per response, the
+ * least recently used bucket of the set is evicted. A bucket which runs
+ * out of tokens takes the configured action, e.g.
+ *
+ *   table <hacker> persist
+ *   block quick from <hacker>
+ *   block quick to <hacker>
+ */
+bool            rrl_init        (config_t *config);
+rrl_action_t    rrl_process     (packet_t *packet, raw_packet_t *raw_packet, bool suspect);
+
+#endif
+
@@ -0,0 +1,29 @@
+#ifndef __SLIP_H__
+#define __SLIP_H__
+
+#include "config.h"
+#include "packet/packet.h"
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <netinet/in.h>
+
+/**
+ * Slip responder
+ *
+ * Sources exceeding the query rate are added to the pf table "slip", which
+ * blocks the (large) UDP responses of the resolver to them, e.g.
+ *
+ *   table <slip> persist
+ *   block out quick proto udp from any port 53 to <slip>
+ *
+ * Every query of such a source is answered with a minimal truncated
+ * response (TC=1) instead. Real clients retry over TCP, spoofed victims of
+ * a reflection attack only receive a small packet.
+ */
+bool            slip_init       (config_t *config, int bpf);
+bool            slip_process    (packet_t *packet, raw_packet_t *raw_packet);
+bool            slip_add        (struct in_addr *addr, uint64_t now);
+
+#endif
+
@@ -0,0 +1,53 @@
+#ifndef __TIMER_WHEEL_H__
+#define __TIMER_WHEEL_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#define TIMER_WHEEL_TICK            1000            /**< us per tick */
+#define TIMER_WHEEL_BITS            8
+#define TIMER_WHEEL_SLOTS           (1 << TIMER_WHEEL_BITS)
+#define TIMER_WHEEL_LEVELS          4               /**< 256 ms, 65 s, 4.6 h, 49 days */
+
+/**
+ * Timer events are embedded into the state they expire, the callback gets
+ * back to it with TIMER_EVENT_CONTAINER
+ */
+#define TIMER_EVENT_CONTAINER(event, type, member)  ((type *) ((uint8_t *) (event) - offsetof(type, member)))
+
+typedef struct _timer_event_t   timer_event_t;
+typedef void (*timer_callback_t)(timer_event_t *event, uint64_t now);
+
+struct _timer_event_t {
+    timer_event_t      *next;
+    timer_event_t     **pprev;                      /**< NULL if not armed */
+    uint64_t            expires;                    /**< us */
+    timer_callback_t    callback;
+    uint8_t             level;
+    uint8_t             slot;
+};
+
+static inline void
+timer_event_init(timer_event_t *event, timer_callback_t callback)
+{
+    event->next     = NULL;
+    event->pprev    = NULL;
+    event->expires  = 0;
+    event->callback = callback;
+}
+
+static inline bool
+timer_event_armed(const timer_event_t *event)
+{
+    return event->pprev != NULL;
+}
+
+void                timer_wheel_start   (uint64_t now);
+void                timer_wheel_arm     (timer_event_t *event, uint64_t expires);
+void                timer_wheel_cancel  (timer_event_t *event);
+void                timer_wheel_move    (timer_event_t *to, timer_event_t *from);
+void                timer_wheel_advance (uint64_t now);
+
+#endif
+
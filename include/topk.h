@@ -0,0 +1,43 @@
+#ifndef __TOPK_H__
+#define __TOPK_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define TOPK_LABEL_LEN              256                 /**< domain name incl. terminator */
+
+typedef struct _topk_entry_t    topk_entry_t;
+typedef struct _topk_t          topk_t;
+
+struct _topk_entry_t {
+    uint64_t            key;
+    uint64_t            count;                          /**< overestimate: true count is in [count - error, count] */
+    uint64_t            error;                          /**< count of the entry it replaced */
+    uint32_t            slot;                           /**< slot in the key index */
+    char                label[TOPK_LABEL_LEN];          /**< optional, set by the owner on insert */
+};
+
+/**
+ * Space-Saving top-K: K counters are monitored, a key which is not
+ * monitored replaces the smallest counter and inherits its count as error.
+ * The counters are a min-heap (weighted updates), the keys are indexed by
+ * a small hash table. Updates come from a single writer, snapshots can be
+ * taken by any thread (seqlock)
+ */
+struct _topk_t {
+    const char         *name;
+    uint32_t            size;                           /**< K */
+    uint32_t            used;
+    uint32_t            seq;                            /**< odd while an update is in progress */
+    topk_entry_t       *entries;                        /**< min-heap by count */
+    uint32_t           *index;                          /**< heap position + 1, zero if empty */
+    uint32_t            index_mask;
+};
+
+bool            topk_init       (topk_t *topk, const char *name, uint32_t size);
+topk_entry_t   *topk_update     (topk_t *topk, uint64_t key, uint64_t weight, bool *inserted);
+void            topk_decay      (topk_t *topk);
+uint32_t        topk_snapshot   (topk_t *topk, topk_entry_t *entries, uint32_t size);
+
+#endif
+
@@ -0,0 +1,54 @@
+#ifndef __VERDICT_H__
+#define __VERDICT_H__
+
+#include "packet/packet.h"
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define VERDICT_CACHE_SIZE          4096                /**< flows per worker, power of two */
+#define VERDICT_SAMPLE_RATE         16                  /**< one of that many packets of a sampled flow is decoded */
+
+typedef enum _verdict_t {
+    VERDICT_PASS,                           /**< not cached: every packet takes the full decode and detection */
+    VERDICT_DROP,                           /**< client is blocked or slipped by pf: skip (inline: drop) */
+    VERDICT_SAMPLE                          /**< flow to a known victim: decode one of VERDICT_SAMPLE_RATE */
+} verdict_t;
+
+typedef struct _verdict_flow_t {
+    uint32_t            src;                /**< IPv4 addresses (network byte order), zero if not cacheable */
+    uint32_t            dest;
+    uint16_t            src_port;
+    uint16_t            dest_port;
+} verdict_flow_t;
+
+typedef struct _verdict_entry_t {
+    verdict_flow_t      flow;
+    uint32_t            generation;         /**< valid while equal to the global generation */
+    uint16_t            verdict;
+    uint16_t            hits;               /**< packets of a sampled flow since the last decode */
+} verdict_entry_t;
+
+/**
+ * Flow verdict cache
+ *
+ * During an attack the same (reflector, victim, ports) tuples repeat
+ * millions of times. A direct-mapped cache per worker keeps the verdict of
+ * a UDP flow, found by a fast-path classifier on the raw frame (plain or
+ * VLAN-tagged IPv4, first fragments excluded), so that repeats skip the
+ * decode and the detection. Trusted and blocked sources (prefix policies)
+ * are skipped by the classifier itself. Verdicts are invalidated all at once by a
+ * generation counter, whenever a blocklist or a victim changes.
+ */
+typedef struct _verdict_cache_t {
+    verdict_entry_t     entries[VERDICT_CACHE_SIZE];
+} verdict_cache_t;
+
+void            verdict_cache_init  (verdict_cache_t *cache);
+bool            verdict_lookup      (verdict_cache_t *cache, raw_packet_t *raw_packet, verdict_flow_t *flow, uint32_t *weight, verdict_t *verdict);
+void            verdict_store       (verdict_cache_t *cache, const verdict_flow_t *flow, verdict_t verdict);
+verdict_t       verdict_classify    (packet_t *packet, bool limited, bool victim);
+void            verdict_invalidate  (void);
+
+#endif
+
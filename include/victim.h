@@ -0,0 +1,25 @@
+#ifndef __VICTIM_H__
+#define __VICTIM_H__
+
+#include "config.h"
+#include "amplification.h"
+#include "packet/packet.h"
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/**
+ * Victim rate meter
+ *
+ * Response packets and bytes per second are metered per destination
+ * address in a time-decayed count-min sketch (constant memory and time,
+ * however many addresses are spoofed). Every packet is weighted by its
+ * amplification factor. A destination exceeding a threshold is promoted
+ * into a small exact table of victims, where it stays until its rate has
+ * dropped below half of the threshold.
+ */
+bool            victim_init     (config_t *config);
+bool            victim_process  (packet_t *packet, raw_packet_t *raw_packet, const amplification_sample_t *sample);
+
+#endif
+
@@ -0,0 +1,161 @@
+#define _GNU_SOURCE                                     /**< sendmmsg() */
+
+#include "af_packet.h"
+#include "log.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <unistd.h>
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+#include <net/if.h>
+#include <linux/if_packet.h>
+
+typedef struct _af_packet_t {
+    int                 sockets[BRIDGE_PORT_SIZE];      /**< -1 if not open */
+    struct mmsghdr     *messages;
+    struct iovec       *iovecs;
+    uint32_t            size;                           /**< messages of a batch */
+} af_packet_t;
+
+static af_packet_t af_packet = {
+    .sockets = { -1, -1 }
+};
+
+static void af_packet_close(void);
+
+/**
+ * Opens a send-only packet socket on an interface
+ */
+static int
+af_packet_socket(const char *ifname)
+{
+    struct sockaddr_ll  addr;
+    int                 fd;
+    int                 enable = 1;
+
+    /* protocol 0: nothing is received on it */
+    if ((fd = socket(AF_PACKET, SOCK_RAW, 0)) == -1) {
+        LOG_ERRNO(LOG_BRIDGE, LOG_ERROR, errno, ("Could not open packet socket"));
+        return -1;
+    }
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sll_family     = AF_PACKET;
+    addr.sll_ifindex    = if_nametoindex(ifname);
+
+    if (addr.sll_ifindex == 0 || bind(fd, (struct sockaddr *) &addr, sizeof(addr)) == -1) {
+        LOG_ERRNO(LOG_BRIDGE, LOG_ERROR, errno, ("Could not bind packet socket to interface %s", ifname));
+        close(fd);
+        return -1;
+    }
+
+    if (setsockopt(fd, SOL_PACKET, PACKET_QDISC_BYPASS, &enable, sizeof(enable)) == -1) {
+        LOG_ERRNO(LOG_BRIDGE, LOG_WARNING, errno, ("Could not bypass the queueing discipline of %s", ifname));
+    }
+
+    return fd;
+}
+
+static bool
+af_packet_open(config_t *config)
+{
+    const char *ifnames[BRIDGE_PORT_SIZE] = {
+        [BRIDGE_PORT_A] = config->ifname,
+        [BRIDGE_PORT_B] = config->bridge_ifname
+    };
+    uint32_t    port;
+
+    af_packet.size      = config->bridge_batch > 0 ? config->bridge_batch : 1;
+    af_packet.messages  = calloc(af_packet.size, sizeof(struct mmsghdr));
+    af_packet.iovecs    = calloc(af_packet.size, sizeof(struct iovec));
+
+    if (af_packet.messages == NULL || af_packet.iovecs == NULL) {
+        LOG_PRINTLN(LOG_BRIDGE, LOG_ERROR, ("could not allocate packet socket batch"));
+        af_packet_close();
+        return false;
+    }
+
+    for (port = 0; port < BRIDGE_PORT_SIZE; port++) {
+        if ((af_packet.sockets[port] = af_packet_socket(ifnames[port])) == -1) {
+            af_packet_close();
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static void
+af_packet_close(void)
+{
+    uint32_t port;
+
+    for (port = 0; port < BRIDGE_PORT_SIZE; port++) {
+        if (af_packet.sockets[port] != -1) {
+            close(af_packet.sockets[port]);
+            af_packet.sockets[port] = -1;
+        }
+    }
+
+    free(af_packet.messages);
+    free(af_packet.iovecs);
+    af_packet.messages  = NULL;
+    af_packet.iovecs    = NULL;
+}
+
+/****************************************************************************
+ * af_packet_send
+ *
+ * Sends a batch with sendmmsg(), the kernel may take only a part of it per
+ * call. A full send buffer drops the rest of the batch, like a full
+ * transmit ring of a switch would
+ *
+ * @param  port                     port
+ * @param  frames                   whole frames including Ethernet header
+ * @param  count                    number of frames, at most bridge_batch
+ * @return                          number of frames sent
+ ***************************************************************************/
+static uint32_t
+af_packet_send(bridge_port_t port, raw_packet_t **frames, uint32_t count)
+{
+    uint32_t    sent = 0;
+    uint32_t    i;
+    int         ret;
+
+    for (i = 0; i < count; i++) {
+        af_packet.iovecs[i].iov_base    = frames[i]->data;
+        af_packet.iovecs[i].iov_len     = frames[i]->len;
+
+        memset(&(af_packet.messages[i]), 0, sizeof(struct mmsghdr));
+        af_packet.messages[i].msg_hdr.msg_iov       = &(af_packet.iovecs[i]);
+        af_packet.messages[i].msg_hdr.msg_iovlen    = 1;
+    }
+
+    while (sent < count) {
+        if ((ret = sendmmsg(af_packet.sockets[port], &(af_packet.messages[sent]), count - sent, MSG_DONTWAIT)) == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+
+            LOG_ERRNO(LOG_BRIDGE, LOG_WARNING, errno, ("Could not send %" PRIu32 " frames on port %u", count - sent, port));
+            break;
+        }
+
+        sent += ret;
+    }
+
+    return sent;
+}
+
+const bridge_backend_t bridge_backend_packet = {
+    .name       = "packet",
+    .open       = af_packet_open,
+    .close      = af_packet_close,
+    .send       = af_packet_send
+};
@@ -0,0 +1,726 @@
+#include "aggregate.h"
+#include "log.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <arpa/inet.h>
+
+#define AGGREGATE_DEPTH             8                   /**< /24 to /32 */
+#define AGGREGATE_NODES             (2 << AGGREGATE_DEPTH)
+#define AGGREGATE_INIT_SIZE         64                  /**< buckets, power of two */
+#define AGGREGATE_SUBNETS_INIT_SIZE 4
+
+/**
+ * The prefixes of a /24 form a complete binary tree: node 1 is the /24,
+ * the children of node n are 2n and 2n + 1, nodes 256..511 are the /32
+ */
+typedef struct _aggregate_bucket_t {
+    bool                used;
+    bool                pinned;                         /**< the /24 is blocked as a whole */
+    uint8_t             table;                          /**< firewall_table_t */
+    uint32_t            prefix;                         /**< /24 (host byte order) */
+    uint32_t            count;                          /**< blocked addresses */
+    uint64_t            members[AGGREGATE_BITMAP_WORDS];
+    uint64_t            allowed[AGGREGATE_BITMAP_WORDS];
+    uint64_t            emitted[AGGREGATE_NODES / 64];  /**< prefixes in the firewall table */
+} aggregate_bucket_t;
+
+typedef struct _aggregate_subnet_t {
+    uint16_t            id;                             /**< bits 48..63 */
+    uint32_t            count;                          /**< blocked addresses */
+} aggregate_subnet_t;
+
+/**
+ * The /64s of a /48 with blocked addresses, the /48 itself is blocked
+ * instead if there are enough of them
+ */
+typedef struct _aggregate_site_t {
+    bool                used;
+    uint8_t             table;                          /**< firewall_table_t */
+    bool                blocked;                        /**< the /48 is in the firewall table */
+    bool                allowed;                        /**< the /48 covers an allowlisted address */
+    uint64_t            prefix;                         /**< /48 in the upper bits (host byte order) */
+    aggregate_subnet_t *subnets;                        /**< ordered by id */
+    uint32_t            count;
+    uint32_t            size;
+} aggregate_site_t;
+
+typedef struct _aggregate_t {
+    uint32_t            min_depth;                      /**< shortest prefix - 24 */
+    uint32_t            density;                        /**< percent */
+    aggregate_bucket_t *buckets;
+    uint32_t            count;
+    uint32_t            size;                           /**< power of two, zero if disabled */
+    uint32_t            subnets;                        /**< blocked /64s which block their /48, 0 = never */
+    aggregate_site_t   *sites;
+    uint32_t            site_count;
+    uint32_t            site_size;                      /**< power of two */
+    prefix_set_t        members[FIREWALL_TABLE_SIZE];   /**< IPv6 addresses blocked through a site */
+} aggregate_t;
+
+static aggregate_t aggregate;
+
+bool
+aggregate_init(config_t *config)
+{
+    memset(&aggregate, 0, sizeof(aggregate));
+
+    if (config->aggregate_ipv6_subnets > 1 << (AGGREGATE_IPV6_SUBNET - AGGREGATE_IPV6_SITE)) {
+        LOG_PRINTLN(LOG_AGGREGATE, LOG_ERROR, ("invalid aggregation configuration: ipv6_subnets=%" PRIu32, config->aggregate_ipv6_subnets));
+        return false;
+    }
+
+    if ((aggregate.sites = calloc(AGGREGATE_INIT_SIZE, sizeof(aggregate_site_t))) == NULL) {
+        LOG_PRINTLN(LOG_AGGREGATE, LOG_ERROR, ("could not allocate aggregation sites"));
+        return false;
+    }
+
+    aggregate.site_size = AGGREGATE_INIT_SIZE;
+    aggregate.subnets   = config->aggregate_ipv6_subnets;
+
+    if (config->aggregate_prefix == 0) {
+        LOG_PRINTLN(LOG_AGGREGATE, LOG_INFO, ("prefix aggregation disabled, IPv6 /%u aggregation: /%u after %" PRIu32 " subnets",
+                                              AGGREGATE_IPV6_SUBNET, AGGREGATE_IPV6_SITE, config->aggregate_ipv6_subnets));
+        return true;
+    }
+
+    if (config->aggregate_prefix < 24 || config->aggregate_prefix > 32 || config->aggregate_density == 0 || config->aggregate_density > 100) {
+        LOG_PRINTLN(LOG_AGGREGATE, LOG_ERROR, ("invalid aggregation configuration: prefix=%" PRIu32 ", density=%" PRIu32, config->aggregate_prefix, config->aggregate_density));
+        return false;
+    }
+
+    if ((aggregate.buckets = calloc(AGGREGATE_INIT_SIZE, sizeof(aggregate_bucket_t))) == NULL) {
+        LOG_PRINTLN(LOG_AGGREGATE, LOG_ERROR, ("could not allocate aggregation buckets"));
+        free(aggregate.sites);
+        return false;
+    }
+
+    aggregate.size      = AGGREGATE_INIT_SIZE;
+    aggregate.min_depth = config->aggregate_prefix - 24;
+    aggregate.density   = config->aggregate_density;
+
+    LOG_PRINTLN(LOG_AGGREGATE, LOG_INFO, ("prefix aggregation enabled: prefix=/%" PRIu32 ", density=%" PRIu32 "%%, IPv6 /%u: /%u after %" PRIu32 " subnets",
+                                          config->aggregate_prefix, config->aggregate_density, AGGREGATE_IPV6_SUBNET, AGGREGATE_IPV6_SITE, config->aggregate_ipv6_subnets));
+
+    return true;
+}
+
+/**
+ * Whether IPv4 addresses are aggregated, IPv6 addresses always are
+ */
+bool
+aggregate_enabled(void)
+{
+    return aggregate.size > 0;
+}
+
+static inline uint32_t
+aggregate_hash(firewall_table_t table, uint32_t prefix)
+{
+    return ((prefix >> 8) ^ ((uint32_t) table << 24)) * 2654435761u;
+}
+
+static uint32_t
+aggregate_find(aggregate_bucket_t *buckets, uint32_t size, firewall_table_t table, uint32_t prefix)
+{
+    uint32_t i = aggregate_hash(table, prefix) & (size - 1);
+
+    while (buckets[i].used && (buckets[i].prefix != prefix || buckets[i].table != table)) {
+        i = (i + 1) & (size - 1);
+    }
+
+    return i;
+}
+
+static aggregate_bucket_t *
+aggregate_bucket_get(firewall_table_t table, uint32_t prefix)
+{
+    aggregate_bucket_t *buckets;
+    aggregate_bucket_t *bucket;
+    uint32_t            i;
+
+    /* grow at half load */
+    if ((aggregate.count + 1) * 2 > aggregate.size) {
+        if ((buckets = calloc(aggregate.size * 2, sizeof(aggregate_bucket_t))) == NULL) {
+            LOG_PRINTLN(LOG_AGGREGATE, LOG_ERROR, ("could not grow aggregation buckets"));
+            return NULL;
+        }
+
+        for (i = 0; i < aggregate.size; i++) {
+            if (aggregate.buckets[i].used) {
+                buckets[aggregate_find(buckets, aggregate.size * 2, aggregate.buckets[i].table, aggregate.buckets[i].prefix)] = aggregate.buckets[i];
+            }
+        }
+
+        free(aggregate.buckets);
+        aggregate.buckets   = buckets;
+        aggregate.size     *= 2;
+    }
+
+    bucket = &(aggregate.buckets[aggregate_find(aggregate.buckets, aggregate.size, table, prefix)]);
+
+    if (!bucket->used) {
+        memset(bucket, 0, sizeof(aggregate_bucket_t));
+        bucket->used    = true;
+        bucket->table   = table;
+        bucket->prefix  = prefix;
+        aggregate.count++;
+    }
+
+    return bucket;
+}
+
+/**
+ * Forgets a bucket with backward shift, so that no probe sequence is broken
+ */
+static void
+aggregate_bucket_free(aggregate_bucket_t *bucket)
+{
+    uint32_t    mask = aggregate.size - 1;
+    uint32_t    i    = bucket - aggregate.buckets;
+    uint32_t    j;
+    uint32_t    home;
+
+    for (j = (i + 1) & mask; aggregate.buckets[j].used; j = (j + 1) & mask) {
+        home = aggregate_hash(aggregate.buckets[j].table, aggregate.buckets[j].prefix) & mask;
+
+        if (((j - home) & mask) >= ((j - i) & mask)) {
+            aggregate.buckets[i] = aggregate.buckets[j];
+            i = j;
+        }
+    }
+
+    aggregate.buckets[i].used = false;
+    aggregate.count--;
+}
+
+/**
+ * Counts the set bits of [first, first + len), len is a power of two
+ */
+static uint32_t
+aggregate_bits(const uint64_t *bitmap, const uint64_t *exclude, uint32_t first, uint32_t len)
+{
+    uint64_t    mask;
+    uint32_t    count = 0;
+    uint32_t    i;
+
+    if (len >= 64) {
+        for (i = first / 64; i < (first + len) / 64; i++) {
+            count += __builtin_popcountll(bitmap[i] & ~(exclude != NULL ? exclude[i] : 0));
+        }
+        return count;
+    }
+
+    mask = (((uint64_t) 1 << len) - 1) << (first % 64);
+
+    return __builtin_popcountll(bitmap[first / 64] & ~(exclude != NULL ? exclude[first / 64] : 0) & mask);
+}
+
+/**
+ * Picks the shortest prefixes which are dense enough and do not cover an
+ * allowlisted address, descends into the children otherwise
+ */
+static void
+aggregate_cover(aggregate_bucket_t *bucket, const uint64_t *members, uint32_t node, uint32_t depth, uint64_t *cover)
+{
+    uint32_t    len   = 256 >> depth;
+    uint32_t    first = (node - (1 << depth)) * len;
+    uint32_t    count = aggregate_bits(members, NULL, first, len);
+
+    if (count == 0) {
+        return;
+    }
+
+    if (depth == AGGREGATE_DEPTH ||
+        ((depth >= aggregate.min_depth || bucket->pinned) && count * 100 >= aggregate.density * len && aggregate_bits(bucket->allowed, members, first, len) == 0)) {
+        cover[node / 64] |= (uint64_t) 1 << (node % 64);
+        return;
+    }
+
+    aggregate_cover(bucket, members, 2 * node,     depth + 1, cover);
+    aggregate_cover(bucket, members, 2 * node + 1, depth + 1, cover);
+}
+
+/**
+ * Recomputes the cover of a bucket and hands the difference to the
+ * firewall, removals first
+ */
+static void
+aggregate_update(aggregate_bucket_t *bucket)
+{
+    uint64_t        cover[AGGREGATE_NODES / 64] = { 0 };
+    uint64_t        members[AGGREGATE_BITMAP_WORDS];
+    uint64_t        changed;
+    uint32_t        node;
+    uint32_t        depth;
+    uint32_t        i;
+    prefix_t        prefix = { .family = AF_INET };
+    char            prefix_str[INET6_ADDRSTRLEN + 4];
+    int             pass;
+
+    /* a pinned /24 has all the addresses blocked which are not allowlisted */
+    for (i = 0; i < AGGREGATE_BITMAP_WORDS; i++) {
+        members[i] = bucket->members[i] | (bucket->pinned ? ~bucket->allowed[i] : 0);
+    }
+
+    aggregate_cover(bucket, members, 1, 0, cover);
+
+    for (pass = 0; pass < 2; pass++) {
+        for (i = 0; i < AGGREGATE_NODES / 64; i++) {
+            changed = pass == 0 ? bucket->emitted[i] & ~cover[i] : cover[i] & ~bucket->emitted[i];
+
+            while (changed != 0) {
+                node     = i * 64 + __builtin_ctzll(changed);
+                changed &= changed - 1;
+
+                depth               = 31 - __builtin_clz(node);
+                prefix.len          = 24 + depth;
+                prefix.ipv4.s_addr  = htonl(bucket->prefix | ((node - (1 << depth)) << (AGGREGATE_DEPTH - depth)));
+
+                firewall_apply(bucket->table, &prefix, pass == 0 ? FIREWALL_REMOVE : FIREWALL_ADD);
+
+                if (prefix.len < 32) {
+                    LOG_PRINTLN(LOG_AGGREGATE, LOG_INFO, ("%s %s (%" PRIu32 " addresses blocked)", pass == 0 ? "withdraw" : "aggregate",
+                                                          prefix_ntop(&prefix, prefix_str, sizeof(prefix_str)),
+                                                          aggregate_bits(bucket->members, NULL, (node - (1 << depth)) << (AGGREGATE_DEPTH - depth), 256 >> depth)));
+                }
+            }
+        }
+    }
+
+    memcpy(bucket->emitted, cover, sizeof(cover));
+}
+
+/****************************************************************************
+ * aggregate_add
+ *
+ * @param  table                    table
+ * @param  addr                     address
+ * @param  allowed                  allowlisted addresses of its /24
+ ***************************************************************************/
+void
+aggregate_add(firewall_table_t table, struct in_addr *addr, const uint64_t allowed[AGGREGATE_BITMAP_WORDS])
+{
+    aggregate_bucket_t *bucket;
+    uint32_t            host = ntohl(addr->s_addr);
+    uint32_t            bit  = host & 0xff;
+    bool                changed;
+
+    if ((bucket = aggregate_bucket_get(table, host & 0xffffff00)) == NULL) {
+        firewall_apply(table, &((prefix_t) { .family = AF_INET, .len = 32, .ipv4 = *addr }), FIREWALL_ADD);
+        return;
+    }
+
+    changed = memcmp(bucket->allowed, allowed, sizeof(bucket->allowed)) != 0;
+
+    if ((bucket->members[bit / 64] & ((uint64_t) 1 << (bit % 64))) && !changed) {
+        return;
+    }
+
+    memcpy(bucket->allowed, allowed, sizeof(bucket->allowed));
+
+    if ((bucket->members[bit / 64] & ((uint64_t) 1 << (bit % 64))) == 0) {
+        bucket->members[bit / 64] |= (uint64_t) 1 << (bit % 64);
+        bucket->count++;
+    }
+
+    /* a changed allowlist moves the cover as well */
+    aggregate_update(bucket);
+}
+
+void
+aggregate_remove(firewall_table_t table, struct in_addr *addr)
+{
+    aggregate_bucket_t *bucket;
+    uint32_t            host = ntohl(addr->s_addr);
+    uint32_t            bit  = host & 0xff;
+
+    bucket = &(aggregate.buckets[aggregate_find(aggregate.buckets, aggregate.size, table, host & 0xffffff00)]);
+
+    if (!bucket->used || (bucket->members[bit / 64] & ((uint64_t) 1 << (bit % 64))) == 0) {
+        firewall_apply(table, &((prefix_t) { .family = AF_INET, .len = 32, .ipv4 = *addr }), FIREWALL_REMOVE);
+        return;
+    }
+
+    bucket->members[bit / 64] &= ~((uint64_t) 1 << (bit % 64));
+    bucket->count--;
+
+    aggregate_update(bucket);
+
+    if (bucket->count == 0 && !bucket->pinned) {
+        aggregate_bucket_free(bucket);
+    }
+}
+
+/****************************************************************************
+ * aggregate_pin
+ *
+ * Blocks (or stops blocking) a /24 as a whole, whatever the density of its
+ * blocked addresses. Allowlisted addresses stay out, the /24 is then
+ * covered by the longest prefixes around them
+ *
+ * @param  table                    table
+ * @param  addr                     /24
+ * @param  pinned                   block or stop blocking
+ * @param  allowed                  allowlisted addresses of the /24
+ ***************************************************************************/
+void
+aggregate_pin(firewall_table_t table, struct in_addr *addr, bool pinned, const uint64_t allowed[AGGREGATE_BITMAP_WORDS])
+{
+    aggregate_bucket_t *bucket;
+    uint32_t            prefix  = ntohl(addr->s_addr) & 0xffffff00;
+    bool                changed = false;
+
+    if (pinned) {
+        if ((bucket = aggregate_bucket_get(table, prefix)) == NULL) {
+            firewall_apply(table, &((prefix_t) { .family = AF_INET, .len = 24, .ipv4 = *addr }), FIREWALL_ADD);
+            return;
+        }
+
+        changed = memcmp(bucket->allowed, allowed, sizeof(bucket->allowed)) != 0;
+        memcpy(bucket->allowed, allowed, sizeof(bucket->allowed));
+
+    } else {
+        bucket = &(aggregate.buckets[aggregate_find(aggregate.buckets, aggregate.size, table, prefix)]);
+
+        if (!bucket->used || !bucket->pinned) {
+            firewall_apply(table, &((prefix_t) { .family = AF_INET, .len = 24, .ipv4 = *addr }), FIREWALL_REMOVE);
+            return;
+        }
+    }
+
+    if (bucket->pinned == pinned) {
+        if (changed) {
+            aggregate_update(bucket);
+        }
+        return;
+    }
+
+    bucket->pinned = pinned;
+
+    LOG_PRINTLN(LOG_AGGREGATE, LOG_INFO, ("%s %s/24 (%" PRIu32 " addresses blocked)", pinned ? "pin" : "unpin", inet_ntoa(*addr), bucket->count));
+
+    aggregate_update(bucket);
+
+    if (bucket->count == 0 && !bucket->pinned) {
+        aggregate_bucket_free(bucket);
+    }
+}
+
+/*** IPv6: /64 and /48 ********************************************************/
+
+static inline uint32_t
+aggregate_site_hash(firewall_table_t table, uint64_t prefix)
+{
+    return (uint32_t) (((prefix >> 16) ^ ((uint64_t) table << 48)) * 0x9e3779b97f4a7c15ull >> 32);
+}
+
+static uint32_t
+aggregate_site_find(aggregate_site_t *sites, uint32_t size, firewall_table_t table, uint64_t prefix)
+{
+    uint32_t i = aggregate_site_hash(table, prefix) & (size - 1);
+
+    while (sites[i].used && (sites[i].prefix != prefix || sites[i].table != table)) {
+        i = (i + 1) & (size - 1);
+    }
+
+    return i;
+}
+
+static aggregate_site_t *
+aggregate_site_get(firewall_table_t table, uint64_t prefix)
+{
+    aggregate_site_t   *sites;
+    aggregate_site_t   *site;
+    uint32_t            i;
+
+    /* grow at half load */
+    if ((aggregate.site_count + 1) * 2 > aggregate.site_size) {
+        if ((sites = calloc(aggregate.site_size * 2, sizeof(aggregate_site_t))) == NULL) {
+            LOG_PRINTLN(LOG_AGGREGATE, LOG_ERROR, ("could not grow aggregation sites"));
+            return NULL;
+        }
+
+        for (i = 0; i < aggregate.site_size; i++) {
+            if (aggregate.sites[i].used) {
+                sites[aggregate_site_find(sites, aggregate.site_size * 2, aggregate.sites[i].table, aggregate.sites[i].prefix)] = aggregate.sites[i];
+            }
+        }
+
+        free(aggregate.sites);
+        aggregate.sites      = sites;
+        aggregate.site_size *= 2;
+    }
+
+    site = &(aggregate.sites[aggregate_site_find(aggregate.sites, aggregate.site_size, table, prefix)]);
+
+    if (!site->used) {
+        memset(site, 0, sizeof(aggregate_site_t));
+        site->used      = true;
+        site->table     = table;
+        site->prefix    = prefix;
+        aggregate.site_count++;
+    }
+
+    return site;
+}
+
+/**
+ * Forgets a site with backward shift, so that no probe sequence is broken
+ */
+static void
+aggregate_site_free(aggregate_site_t *site)
+{
+    uint32_t    mask = aggregate.site_size - 1;
+    uint32_t    i    = site - aggregate.sites;
+    uint32_t    j;
+    uint32_t    home;
+
+    free(site->subnets);
+
+    for (j = (i + 1) & mask; aggregate.sites[j].used; j = (j + 1) & mask) {
+        home = aggregate_site_hash(aggregate.sites[j].table, aggregate.sites[j].prefix) & mask;
+
+        if (((j - home) & mask) >= ((j - i) & mask)) {
+            aggregate.sites[i] = aggregate.sites[j];
+            i = j;
+        }
+    }
+
+    aggregate.sites[i].used = false;
+    aggregate.site_count--;
+}
+
+/**
+ * Binary search for a /64 of a site
+ *
+ * @return                  index of the subnet, or where to insert it
+ */
+static uint32_t
+aggregate_subnet_find(aggregate_site_t *site, uint16_t id)
+{
+    uint32_t    low  = 0;
+    uint32_t    high = site->count;
+    uint32_t    mid;
+
+    while (low < high) {
+        mid = (low + high) / 2;
+
+        if (site->subnets[mid].id < id) {
+            low  = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+
+    return low;
+}
+
+static inline uint64_t
+aggregate_ipv6_upper(const struct in6_addr *addr)
+{
+    uint64_t    upper = 0;
+    uint32_t    i;
+
+    for (i = 0; i < 8; i++) {
+        upper = (upper << 8) | addr->s6_addr[i];
+    }
+
+    return upper;
+}
+
+static prefix_t *
+aggregate_ipv6_prefix(prefix_t *prefix, uint64_t upper, uint8_t len)
+{
+    uint32_t    i;
+
+    memset(prefix, 0, sizeof(prefix_t));
+    prefix->family  = AF_INET6;
+    prefix->len     = len;
+
+    for (i = 8; i-- > 0; upper >>= 8) {
+        prefix->ipv6.s6_addr[i] = (uint8_t) upper;
+    }
+
+    return prefix;
+}
+
+static void
+aggregate_ipv6_apply(firewall_table_t table, uint64_t upper, uint8_t len, firewall_action_t action)
+{
+    prefix_t    prefix;
+
+    firewall_apply(table, aggregate_ipv6_prefix(&prefix, upper, len), action);
+}
+
+/**
+ * Swaps the /64s of a site for its /48 and back when it crosses the
+ * threshold, removals first. Otherwise only the /64 which changed is
+ * handed to the firewall, if the /48 does not cover it
+ *
+ * @param  id                       /64 which was blocked or unblocked, -1 if none
+ */
+static void
+aggregate_site_update(aggregate_site_t *site, int32_t id, firewall_action_t action)
+{
+    bool        blocked = aggregate.subnets > 0 && site->count >= aggregate.subnets && !site->allowed;
+    uint64_t    prefix  = site->prefix;
+    prefix_t    site_prefix;
+    char        prefix_str[INET6_ADDRSTRLEN + 4];
+    uint32_t    i;
+
+    if (blocked && !site->blocked) {
+        for (i = 0; i < site->count; i++) {
+            aggregate_ipv6_apply(site->table, prefix | site->subnets[i].id, AGGREGATE_IPV6_SUBNET, FIREWALL_REMOVE);
+        }
+
+        aggregate_ipv6_apply(site->table, prefix, AGGREGATE_IPV6_SITE, FIREWALL_ADD);
+
+    } else if (!blocked && site->blocked) {
+        aggregate_ipv6_apply(site->table, prefix, AGGREGATE_IPV6_SITE, FIREWALL_REMOVE);
+
+        for (i = 0; i < site->count; i++) {
+            aggregate_ipv6_apply(site->table, prefix | site->subnets[i].id, AGGREGATE_IPV6_SUBNET, FIREWALL_ADD);
+        }
+
+    } else if (!blocked && id >= 0) {
+        aggregate_ipv6_apply(site->table, prefix | (uint16_t) id, AGGREGATE_IPV6_SUBNET, action);
+    }
+
+    if (blocked != site->blocked) {
+        LOG_PRINTLN(LOG_AGGREGATE, LOG_INFO, ("%s %s (%" PRIu32 " subnets blocked)", blocked ? "aggregate" : "withdraw",
+                                              prefix_ntop(aggregate_ipv6_prefix(&site_prefix, prefix, AGGREGATE_IPV6_SITE), prefix_str, sizeof(prefix_str)),
+                                              site->count));
+    }
+
+    site->blocked = blocked;
+}
+
+/**
+ * Out of memory: the address is blocked on its own, as it is not a member
+ * its removal goes straight to the firewall as well
+ */
+static void
+aggregate_site_untracked(aggregate_site_t *site, const prefix_t *member)
+{
+    firewall_apply(site->table, member, FIREWALL_ADD);
+
+    if (site->count == 0) {
+        aggregate_site_free(site);
+    }
+}
+
+/****************************************************************************
+ * aggregate_add_ipv6
+ *
+ * @param  table                    table
+ * @param  addr                     address
+ * @param  allowed                  AGGREGATE_ALLOWED_* of its /64 and /48
+ ***************************************************************************/
+void
+aggregate_add_ipv6(firewall_table_t table, const struct in6_addr *addr, uint32_t allowed)
+{
+    prefix_t            member = { .family = AF_INET6, .len = 128, .ipv6 = *addr };
+    aggregate_site_t   *site;
+    aggregate_subnet_t *subnets;
+    uint64_t            upper = aggregate_ipv6_upper(addr);
+    uint16_t            id    = (uint16_t) upper;
+    uint32_t            size;
+    uint32_t            i;
+
+    /* the /64 is shared with an allowlisted address: only this one is blocked */
+    if (allowed & AGGREGATE_ALLOWED_SUBNET) {
+        firewall_apply(table, &member, FIREWALL_ADD);
+        return;
+    }
+
+    if (prefix_set_contains(&(aggregate.members[table]), &member)) {
+        site = &(aggregate.sites[aggregate_site_find(aggregate.sites, aggregate.site_size, table, upper & ~(uint64_t) 0xffff)]);
+
+        /* the allowlist of the /48 may have changed */
+        if (site->used && site->allowed != ((allowed & AGGREGATE_ALLOWED_SITE) != 0)) {
+            site->allowed = !site->allowed;
+            aggregate_site_update(site, -1, FIREWALL_ADD);
+        }
+        return;
+    }
+
+    if ((site = aggregate_site_get(table, upper & ~(uint64_t) 0xffff)) == NULL) {
+        firewall_apply(table, &member, FIREWALL_ADD);
+        return;
+    }
+
+    site->allowed = (allowed & AGGREGATE_ALLOWED_SITE) != 0;
+    i             = aggregate_subnet_find(site, id);
+
+    if (i == site->count || site->subnets[i].id != id) {
+        if (site->count == site->size) {
+            size = site->size > 0 ? site->size * 2 : AGGREGATE_SUBNETS_INIT_SIZE;
+
+            if ((subnets = realloc(site->subnets, size * sizeof(aggregate_subnet_t))) == NULL) {
+                LOG_PRINTLN(LOG_AGGREGATE, LOG_ERROR, ("could not grow aggregation subnets"));
+                aggregate_site_untracked(site, &member);
+                return;
+            }
+
+            site->subnets   = subnets;
+            site->size      = size;
+        }
+
+        if (!prefix_set_add(&(aggregate.members[table]), &member)) {
+            LOG_PRINTLN(LOG_AGGREGATE, LOG_ERROR, ("could not track blocked address"));
+            aggregate_site_untracked(site, &member);
+            return;
+        }
+
+        memmove(&(site->subnets[i + 1]), &(site->subnets[i]), (site->count - i) * sizeof(aggregate_subnet_t));
+        site->subnets[i] = (aggregate_subnet_t) { .id = id, .count = 1 };
+        site->count++;
+
+        aggregate_site_update(site, id, FIREWALL_ADD);
+        return;
+    }
+
+    if (!prefix_set_add(&(aggregate.members[table]), &member)) {
+        LOG_PRINTLN(LOG_AGGREGATE, LOG_ERROR, ("could not track blocked address"));
+        aggregate_site_untracked(site, &member);
+        return;
+    }
+
+    site->subnets[i].count++;
+
+    /* the allowlist may have changed */
+    aggregate_site_update(site, -1, FIREWALL_ADD);
+}
+
+void
+aggregate_remove_ipv6(firewall_table_t table, const struct in6_addr *addr)
+{
+    prefix_t            member = { .family = AF_INET6, .len = 128, .ipv6 = *addr };
+    aggregate_site_t   *site;
+    uint64_t            upper = aggregate_ipv6_upper(addr);
+    uint16_t            id    = (uint16_t) upper;
+    uint32_t            i;
+
+    if (!prefix_set_remove(&(aggregate.members[table]), &member)) {
+        firewall_apply(table, &member, FIREWALL_REMOVE);
+        return;
+    }
+
+    site = &(aggregate.sites[aggregate_site_find(aggregate.sites, aggregate.site_size, table, upper & ~(uint64_t) 0xffff)]);
+    i    = aggregate_subnet_find(site, id);
+
+    if (--site->subnets[i].count > 0) {
+        return;
+    }
+
+    memmove(&(site->subnets[i]), &(site->subnets[i + 1]), (site->count - i - 1) * sizeof(aggregate_subnet_t));
+    site->count--;
+
+    aggregate_site_update(site, id, FIREWALL_REMOVE);
+
+    if (site->count == 0) {
+        aggregate_site_free(site);
+    }
+}
@@ -0,0 +1,170 @@
+#include "amplification.h"
+#include "hash.h"
+#include "log.h"
+
+#include <string.h>
+#include <inttypes.h>
+#include <arpa/inet.h>
+
+#define AMPLIFICATION_TABLE_SIZE    4096                /**< tracked (server, qname, qtype), power of two */
+#define AMPLIFICATION_PROBE_MAX     8
+#define AMPLIFICATION_EPOCH         10000000            /**< us, the sums are halved every epoch */
+#define AMPLIFICATION_DECAY_MAX     32                  /**< epochs until the sums are zero anyway */
+#define AMPLIFICATION_LOG_FACTOR    10                  /**< responses from this factor on are logged */
+
+typedef struct _amplification_entry_t {
+    uint32_t            server;                         /**< IPv4 address (network byte order), zero if unused */
+    uint32_t            qname_hash;
+    uint16_t            qtype;
+    uint32_t            epoch;                          /**< epoch of the last decay */
+    uint64_t            query_bytes;
+    uint64_t            response_bytes;
+} amplification_entry_t;
+
+typedef struct _amplification_t {
+    bool                    enabled;
+    amplification_entry_t   entries[AMPLIFICATION_TABLE_SIZE];
+} amplification_t;
+
+static amplification_t amplification;
+
+bool
+amplification_init(void)
+{
+    memset(&amplification, 0, sizeof(amplification));
+
+    amplification.enabled = true;
+
+    return true;
+}
+
+/**
+ * Wire size of a response. The first fragment of a fragmented datagram
+ * carries the UDP length of the whole datagram, every further fragment
+ * repeats the IPv4 header
+ */
+static uint32_t
+amplification_wire_len(packet_t *packet, ipv4_header_t *ipv4, udpv4_header_t *udpv4)
+{
+    uint32_t header_len = ipv4->ihl * 4;
+    uint32_t payload_len;
+    uint32_t fragments;
+
+    if (!packet->fragment || ipv4->len <= header_len) {
+        return ipv4->len;
+    }
+
+    payload_len = ipv4->len - header_len;
+
+    if (udpv4->len <= payload_len) {
+        return ipv4->len;
+    }
+
+    fragments = (udpv4->len + payload_len - 1) / payload_len;
+
+    return udpv4->len + fragments * header_len;
+}
+
+/**
+ * Finds the entry of (server, qname, qtype), replaces the least used one
+ * of the probing distance if not found
+ */
+static amplification_entry_t *
+amplification_get(uint32_t server, uint32_t qname_hash, uint16_t qtype, uint32_t epoch)
+{
+    amplification_entry_t  *entry;
+    amplification_entry_t  *victim = NULL;
+    uint32_t                idx;
+    uint32_t                i;
+
+    idx = hash_combine(hash_mix64(server), ((uint64_t) qtype << 32) | qname_hash);
+
+    for (i = 0; i < AMPLIFICATION_PROBE_MAX; i++) {
+        entry = &(amplification.entries[(idx + i) & (AMPLIFICATION_TABLE_SIZE - 1)]);
+
+        if (entry->server == server && entry->qname_hash == qname_hash && entry->qtype == qtype) {
+            return entry;
+        }
+
+        if (victim == NULL || entry->server == 0 || (victim->server != 0 && entry->response_bytes < victim->response_bytes)) {
+            victim = entry;
+        }
+    }
+
+    victim->server          = server;
+    victim->qname_hash      = qname_hash;
+    victim->qtype           = qtype;
+    victim->epoch           = epoch;
+    victim->query_bytes     = 0;
+    victim->response_bytes  = 0;
+
+    return victim;
+}
+
+/****************************************************************************
+ * amplification_process
+ *
+ * Accounts a response against its query and returns the running
+ * amplification of its server and question
+ *
+ * @param  packet                   decoded response
+ * @param  raw_packet               raw packet (timestamp)
+ * @param  query_len                wire bytes of the matched query, zero if unmatched
+ * @param  sample                   sizes and amplification factor of the response
+ ***************************************************************************/
+void
+amplification_process(packet_t *packet, raw_packet_t *raw_packet, uint32_t query_len, amplification_sample_t *sample)
+{
+    ipv4_header_t          *ipv4;
+    udpv4_header_t         *udpv4;
+    dns_header_t           *dns;
+    amplification_entry_t  *entry;
+    uint32_t                server;
+    uint32_t                epoch;
+    uint32_t                elapsed;
+    uint32_t                factor;
+    struct in_addr          addr;
+
+    amplification_sample_init(sample);
+
+    ipv4    = (ipv4_header_t *)  packet_get_header(packet, PACKET_TYPE_IPV4);
+    udpv4   = (udpv4_header_t *) packet_get_header(packet, PACKET_TYPE_UDPV4);
+    dns     = (dns_header_t *)   packet_get_header(packet, PACKET_TYPE_DNS);
+
+    if (!amplification.enabled || ipv4 == NULL || udpv4 == NULL || dns == NULL || dns->qd == NULL) {
+        return;
+    }
+
+    /* unmatched: the query was (at least) the echoed header and question */
+    if (query_len == 0) {
+        query_len = ipv4->ihl * 4 + UDPV4_HEADER_LEN + DNS_HEADER_LEN + dns->qd_len;
+    }
+
+    sample->query_len       = query_len;
+    sample->response_len    = amplification_wire_len(packet, ipv4, udpv4);
+
+    memcpy(&server, ipv4->src.addr, IPV4_ADDRESS_LEN);
+    epoch = raw_packet->timestamp / AMPLIFICATION_EPOCH;
+    entry = amplification_get(server, dns_label_hash(dns->qd->qname), dns->qd->qtype, epoch);
+
+    /* decay */
+    if ((elapsed = epoch - entry->epoch) > 0) {
+        entry->query_bytes      = elapsed < AMPLIFICATION_DECAY_MAX ? entry->query_bytes    >> elapsed : 0;
+        entry->response_bytes   = elapsed < AMPLIFICATION_DECAY_MAX ? entry->response_bytes >> elapsed : 0;
+        entry->epoch            = epoch;
+    }
+
+    entry->query_bytes     += sample->query_len;
+    entry->response_bytes  += sample->response_len;
+
+    /* rounded, at least 1 */
+    factor = (entry->response_bytes + entry->query_bytes / 2) / entry->query_bytes;
+    sample->factor = factor > 0 ? factor : 1;
+
+    if (sample->factor >= AMPLIFICATION_LOG_FACTOR) {
+        addr.s_addr = server;
+        LOG_PRINTLN(LOG_AMPLIFICATION, LOG_DEBUG, ("amplification %" PRIu32 "x: server=%s, qtype=%" PRIu16 ", query=%" PRIu32 ", response=%" PRIu32,
+                                                   sample->factor, inet_ntoa(addr), dns->qd->qtype, sample->query_len, sample->response_len));
+    }
+}
+
@@ -0,0 +1,316 @@
+#include "block.h"
+#include "firewall.h"
+#include "timer_wheel.h"
+#include "verdict.h"
+#include "log.h"
+
+#include <string.h>
+#include <inttypes.h>
+#include <arpa/inet.h>
+
+#define BLOCK_TABLE_SIZE            4096                /**< tracked sources and networks, power of two */
+#define BLOCK_TABLE_BITS            12
+#define BLOCK_PROBE_MAX             8                   /**< linear probing distance */
+#define BLOCK_UNIT                  16                  /**< one violation in score units */
+#define BLOCK_HALF_LIFE             1000000             /**< us until a score is halved */
+#define BLOCK_IDLE                  10000000            /**< us a source is watched without violations */
+#define BLOCK_STRIKES_MAX           32
+#define BLOCK_RETRY_INTERVAL        1000000             /**< us until a failed firewall action is retried */
+#define BLOCK_NETWORK_LEN           24
+
+typedef struct _block_entry_t {
+    uint32_t            prefix;                         /**< IPv4 prefix (network byte order) */
+    uint8_t             len;                            /**< 32: source, 24: network, zero if unused */
+    uint8_t             state;                          /**< block_state_t */
+    uint8_t             strikes;                        /**< blocks not yet forgotten */
+    uint32_t            score;                          /**< /32: decayed violations in BLOCK_UNIT, /24: blocked sources */
+    uint64_t            updated;                        /**< us of the last decay */
+    uint64_t            until;                          /**< us the hold, probation or watch is over */
+    timer_event_t       timer;
+} block_entry_t;
+
+typedef struct _block_t {
+    bool                enabled;
+    uint32_t            enter;                          /**< in BLOCK_UNIT */
+    uint32_t            exit;                           /**< in BLOCK_UNIT */
+    uint64_t            hold;                           /**< us */
+    uint64_t            hold_max;                       /**< us */
+    uint32_t            escalate;                       /**< blocked sources of a /24, 0 = never */
+    uint64_t            blocks;                         /**< firewall adds */
+    uint64_t            extended;                       /**< holds extended instead of unblocking */
+    block_entry_t       entries[BLOCK_TABLE_SIZE];
+} block_t;
+
+static block_t block;
+
+static void             block_expire    (timer_event_t *event, uint64_t now);
+
+bool
+block_init(config_t *config)
+{
+    memset(&block, 0, sizeof(block));
+
+    if (config->block_enter == 0) {
+        LOG_PRINTLN(LOG_BLOCK, LOG_INFO, ("blocking disabled"));
+        return true;
+    }
+
+    /* a score never decays below 0: exit=0 would never unblock */
+    if (config->block_exit == 0 || config->block_exit >= config->block_enter || config->block_hold == 0 || config->block_hold_max < config->block_hold) {
+        LOG_PRINTLN(LOG_BLOCK, LOG_ERROR, ("invalid block configuration: enter=%" PRIu32 ", exit=%" PRIu32 ", hold=%" PRIu32 "s, hold_max=%" PRIu32 "s",
+                                           config->block_enter, config->block_exit, config->block_hold, config->block_hold_max));
+        return false;
+    }
+
+    block.enabled   = true;
+    block.enter     = config->block_enter * BLOCK_UNIT;
+    block.exit      = config->block_exit  * BLOCK_UNIT;
+    block.hold      = (uint64_t) config->block_hold     * 1000000;
+    block.hold_max  = (uint64_t) config->block_hold_max * 1000000;
+    block.escalate  = config->block_escalate;
+
+    LOG_PRINTLN(LOG_BLOCK, LOG_INFO, ("blocking enabled: enter=%" PRIu32 ", exit=%" PRIu32 ", hold=%" PRIu32 "..%" PRIu32 "s, escalate=%" PRIu32,
+                                      config->block_enter, config->block_exit, config->block_hold, config->block_hold_max, config->block_escalate));
+
+    return true;
+}
+
+/**
+ * Hold of the strikes-th block in a row: doubles from the configured one
+ */
+static uint64_t
+block_hold(uint32_t strikes)
+{
+    uint32_t shift = strikes > 0 ? strikes - 1 : 0;
+
+    if (shift >= 32 || (block.hold << shift) > block.hold_max) {
+        return block.hold_max;
+    }
+
+    return block.hold << shift;
+}
+
+/**
+ * Halves the score every BLOCK_HALF_LIFE, linear in between
+ */
+static void
+block_decay(block_entry_t *entry, uint64_t now)
+{
+    uint64_t elapsed = now > entry->updated ? now - entry->updated : 0;
+
+    if (elapsed >= 32 * (uint64_t) BLOCK_HALF_LIFE) {
+        entry->score = 0;
+    } else {
+        entry->score >>= elapsed / BLOCK_HALF_LIFE;
+        entry->score  -= (uint64_t) entry->score * (elapsed % BLOCK_HALF_LIFE) / (2 * BLOCK_HALF_LIFE);
+    }
+
+    entry->updated = now;
+}
+
+/**
+ * Finds or inserts an entry. A free slot is taken first, otherwise the
+ * least recently scored entry which is neither blocked, on probation nor
+ * a network with blocked sources is replaced
+ */
+static block_entry_t *
+block_entry_get(uint32_t prefix, uint8_t len, bool create, uint64_t now)
+{
+    block_entry_t  *entry;
+    block_entry_t  *victim = NULL;
+    uint32_t        idx;
+    uint32_t        i;
+
+    idx = ((prefix ^ len) * 2654435761u) >> (32 - BLOCK_TABLE_BITS);
+
+    for (i = 0; i < BLOCK_PROBE_MAX; i++) {
+        entry = &(block.entries[(idx + i) & (BLOCK_TABLE_SIZE - 1)]);
+
+        if (entry->prefix == prefix && entry->len == len) {
+            return entry;
+        }
+
+        /* forgetting leaves holes, so the whole probing distance is searched */
+        if (victim != NULL && victim->len == 0) {
+            continue;
+        }
+
+        if (entry->len == 0 ||
+            (entry->state == BLOCK_STATE_WATCH && entry->strikes == 0 && (entry->len == 32 || entry->score == 0) &&
+             (victim == NULL || entry->updated < victim->updated))) {
+            victim = entry;
+        }
+    }
+
+    if (!create || victim == NULL) {
+        return NULL;
+    }
+
+    victim->prefix  = prefix;
+    victim->len     = len;
+    victim->state   = BLOCK_STATE_WATCH;
+    victim->strikes = 0;
+    victim->score   = 0;
+    victim->updated = now;
+    victim->until   = now + BLOCK_IDLE;
+
+    /* a replaced entry keeps its timer, the expiry re-arms it for the new one */
+    if (!timer_event_armed(&(victim->timer))) {
+        timer_event_init(&(victim->timer), block_expire);
+        timer_wheel_arm(&(victim->timer), victim->until);
+    }
+
+    return victim;
+}
+
+/**
+ * Puts an entry into the firewall table for the hold of its next strike
+ */
+static void
+block_enter(block_entry_t *entry, uint64_t now)
+{
+    block_entry_t  *network;
+    struct in_addr  addr = { .s_addr = entry->prefix };
+
+    if (!firewall_post(FIREWALL_TABLE_BLOCK, &addr, entry->len, FIREWALL_ADD)) {
+        return;
+    }
+
+    if (entry->strikes < BLOCK_STRIKES_MAX) {
+        entry->strikes++;
+    }
+
+    entry->state = BLOCK_STATE_BLOCKED;
+    entry->until = now + block_hold(entry->strikes);
+    block.blocks++;
+
+    timer_wheel_arm(&(entry->timer), entry->until);
+
+    LOG_PRINTLN(LOG_BLOCK, LOG_INFO, ("block: %s/%u for %" PRIu64 "s (strike %u)", inet_ntoa(addr), entry->len, block_hold(entry->strikes) / 1000000, entry->strikes));
+
+    if (entry->len != 32 || block.escalate == 0) {
+        return;
+    }
+
+    if ((network = block_entry_get(entry->prefix & htonl(UINT32_MAX << (32 - BLOCK_NETWORK_LEN)), BLOCK_NETWORK_LEN, true, now)) == NULL) {
+        return;
+    }
+
+    network->score++;
+    network->updated = now;
+
+    if (network->state == BLOCK_STATE_WATCH && network->score >= block.escalate) {
+        block_enter(network, now);
+    }
+}
+
+/****************************************************************************
+ * block_report
+ *
+ * Scores a violation of a source and blocks it when the score reaches the
+ * enter threshold
+ *
+ * @param  addr                     source
+ * @param  weight                   violations (sampled packets stand for several)
+ * @param  now                      us
+ ***************************************************************************/
+void
+block_report(struct in_addr *addr, uint32_t weight, uint64_t now)
+{
+    block_entry_t *entry;
+
+    if (!block.enabled || (entry = block_entry_get(addr->s_addr, 32, true, now)) == NULL) {
+        return;
+    }
+
+    block_decay(entry, now);
+    entry->score += (weight > 0 ? weight : 1) * BLOCK_UNIT;
+
+    if (entry->state == BLOCK_STATE_WATCH && entry->score >= block.enter) {
+        block_enter(entry, now);
+    }
+}
+
+/**
+ * Whether a blocked entry has to stay: a source still violating or a
+ * network with enough blocked sources
+ */
+static bool
+block_stays(block_entry_t *entry, uint64_t now)
+{
+    if (entry->len == 32) {
+        block_decay(entry, now);
+        return entry->score >= block.exit;
+    }
+
+    return entry->score >= (block.escalate + 1) / 2;
+}
+
+/**
+ * Ends holds, probations and the watch of idle sources. The timer is armed
+ * lazily: reports do not move it, it re-arms itself until there is
+ * nothing left
+ */
+static void
+block_expire(timer_event_t *event, uint64_t now)
+{
+    block_entry_t  *entry = TIMER_EVENT_CONTAINER(event, block_entry_t, timer);
+    block_entry_t  *network;
+    struct in_addr  addr = { .s_addr = entry->prefix };
+
+    if (now < entry->until) {
+        timer_wheel_arm(event, entry->until);
+        return;
+    }
+
+    if (entry->state == BLOCK_STATE_BLOCKED) {
+        if (block_stays(entry, now)) {
+            entry->until = now + block.hold;
+            block.extended++;
+            timer_wheel_arm(event, entry->until);
+            return;
+        }
+
+        if (!firewall_post(FIREWALL_TABLE_BLOCK, &addr, entry->len, FIREWALL_REMOVE)) {
+            timer_wheel_arm(event, now + BLOCK_RETRY_INTERVAL);
+            return;
+        }
+
+        LOG_PRINTLN(LOG_BLOCK, LOG_INFO, ("unblock: %s/%u, probation %" PRIu64 "s (blocks=%" PRIu64 ", extended=%" PRIu64 ")",
+                                          inet_ntoa(addr), entry->len, block_hold(entry->strikes) / 1000000, block.blocks, block.extended));
+
+        entry->state = BLOCK_STATE_WATCH;
+        entry->until = now + block_hold(entry->strikes);
+        verdict_invalidate();
+
+        if (entry->len == 32 &&
+            (network = block_entry_get(entry->prefix & htonl(UINT32_MAX << (32 - BLOCK_NETWORK_LEN)), BLOCK_NETWORK_LEN, false, now)) != NULL &&
+            network->score > 0) {
+            network->score--;
+        }
+
+        timer_wheel_arm(event, entry->until);
+        return;
+    }
+
+    /* a quiet probation forgets one strike */
+    if (entry->strikes > 0) {
+        entry->strikes--;
+        entry->until = now + (entry->strikes > 0 ? block_hold(entry->strikes) : BLOCK_IDLE);
+        timer_wheel_arm(event, entry->until);
+        return;
+    }
+
+    /* still violating, or a network with blocked sources */
+    if (entry->len == 32) {
+        block_decay(entry, now);
+    }
+
+    if (entry->score > 0) {
+        entry->until = now + BLOCK_IDLE;
+        timer_wheel_arm(event, entry->until);
+        return;
+    }
+
+    entry->len = 0;
+}
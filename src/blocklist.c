@@ -0,0 +1,382 @@
+#include "blocklist.h"
+#include "log.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <inttypes.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <arpa/inet.h>
+
+/**
+ * Static prefixes handed over by the lpm build
+ */
+typedef struct _blocklist_static_t {
+    uint32_t            count;
+    blocklist_prefix_t  prefixes[];
+} blocklist_static_t;
+
+typedef struct _blocklist_t {
+    bool                enabled;
+    uint8_t            *map;
+    size_t              size;
+    blocklist_header_t *header;
+    uint32_t            capacity;
+    uint32_t            dropped;                        /**< of the last generation, logged on change */
+    blocklist_prefix_t *prefixes;                       /**< scratch of a generation (worker) */
+    blocklist_static_t *statics;                        /**< published with every generation (worker) */
+    blocklist_static_t *pending;                        /**< handed over, not yet picked up */
+} blocklist_t;
+
+static blocklist_t blocklist;
+
+/**
+ * Clears the host bits, the readers look up masked addresses
+ */
+static void
+blocklist_mask(prefix_t *prefix)
+{
+    uint8_t    *bytes = (uint8_t *) &(prefix->ipv6);
+    uint32_t    size  = prefix->family == AF_INET6 ? sizeof(struct in6_addr) : sizeof(struct in_addr);
+    uint32_t    i;
+
+    for (i = 0; i < size; i++) {
+        if (i * 8 >= prefix->len) {
+            bytes[i] = 0;
+        } else if (i * 8 + 8 > prefix->len) {
+            bytes[i] &= 0xff << (8 - (prefix->len - i * 8));
+        }
+    }
+}
+
+static inline blocklist_slot_t *
+blocklist_slot(uint32_t slot)
+{
+    return (blocklist_slot_t *) (blocklist.map + BLOCKLIST_SLOT_OFFSET + (size_t) slot * blocklist.header->slot_size);
+}
+
+bool
+blocklist_init(config_t *config)
+{
+    char        tmp[PATH_MAX];
+    size_t      slot_size;
+    void       *map;
+    int         fd;
+
+    memset(&blocklist, 0, sizeof(blocklist));
+
+    if (config->blocklist_file == NULL || config->blocklist_size == 0) {
+        LOG_PRINTLN(LOG_BLOCKLIST, LOG_INFO, ("shared blocklist disabled"));
+        return true;
+    }
+
+    blocklist.capacity  = config->blocklist_size;
+    slot_size           = (sizeof(blocklist_slot_t) + (size_t) blocklist.capacity * sizeof(blocklist_ipv6_t) + 63) & ~(size_t) 63;
+    blocklist.size      = BLOCKLIST_SLOT_OFFSET + BLOCKLIST_SLOTS * slot_size;
+
+    if (slot_size > UINT32_MAX || (blocklist.prefixes = calloc(blocklist.capacity, sizeof(blocklist_prefix_t))) == NULL) {
+        LOG_PRINTLN(LOG_BLOCKLIST, LOG_ERROR, ("could not allocate shared blocklist of %" PRIu32 " prefixes", blocklist.capacity));
+        return false;
+    }
+
+    /* readers of a previous run keep the old file until they refresh */
+    snprintf(tmp, sizeof(tmp), "%s.tmp", config->blocklist_file);
+
+    if ((fd = open(tmp, O_RDWR | O_CREAT | O_TRUNC, 0644)) < 0) {
+        LOG_ERRNO(LOG_BLOCKLIST, LOG_ERROR, errno, ("Could not create %s", tmp));
+        blocklist_stop();
+        return false;
+    }
+
+    if (ftruncate(fd, blocklist.size) != 0 ||
+        (map = mmap(NULL, blocklist.size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0)) == MAP_FAILED) {
+        LOG_ERRNO(LOG_BLOCKLIST, LOG_ERROR, errno, ("Could not map %s", tmp));
+        close(fd);
+        unlink(tmp);
+        blocklist_stop();
+        return false;
+    }
+
+    close(fd);
+
+    blocklist.map       = map;
+    blocklist.header    = map;
+
+    /* both slots are empty: generation 0 matches nothing */
+    blocklist.header->capacity  = blocklist.capacity;
+    blocklist.header->slot_size = slot_size;
+    blocklist.header->version   = BLOCKLIST_VERSION;
+    blocklist.header->published = time(NULL);
+    __atomic_store_n(&(blocklist.header->magic), BLOCKLIST_MAGIC, __ATOMIC_RELEASE);
+
+    if (rename(tmp, config->blocklist_file) != 0) {
+        LOG_ERRNO(LOG_BLOCKLIST, LOG_ERROR, errno, ("Could not rename %s", tmp));
+        unlink(tmp);
+        blocklist_stop();
+        return false;
+    }
+
+    blocklist.enabled = true;
+
+    LOG_PRINTLN(LOG_BLOCKLIST, LOG_INFO, ("shared blocklist enabled: %s, %" PRIu32 " prefixes, %zu bytes",
+                                          config->blocklist_file, blocklist.capacity, blocklist.size));
+
+    return true;
+}
+
+/****************************************************************************
+ * blocklist_static
+ *
+ * Hands the static prefixes over to the worker, they replace the ones of
+ * the previous call. Called by the lpm build, from any thread
+ *
+ * @param  prefixes                 trusted (allow) and blocked prefixes
+ * @param  count                    number of prefixes
+ ***************************************************************************/
+void
+blocklist_static(const blocklist_prefix_t *prefixes, uint32_t count)
+{
+    blocklist_static_t *statics;
+    uint32_t            i;
+
+    if (!blocklist.enabled) {
+        return;
+    }
+
+    if ((statics = malloc(sizeof(blocklist_static_t) + (size_t) count * sizeof(blocklist_prefix_t))) == NULL) {
+        LOG_PRINTLN(LOG_BLOCKLIST, LOG_ERROR, ("could not hand over %" PRIu32 " static prefixes", count));
+        return;
+    }
+
+    statics->count = count;
+    memcpy(statics->prefixes, prefixes, (size_t) count * sizeof(blocklist_prefix_t));
+
+    for (i = 0; i < count; i++) {
+        blocklist_mask(&(statics->prefixes[i].prefix));
+    }
+
+    free(__atomic_exchange_n(&(blocklist.pending), statics, __ATOMIC_ACQ_REL));
+}
+
+/**
+ * Appends the prefixes of a set, as far as there is room
+ */
+static uint32_t
+blocklist_collect(const prefix_t *prefixes, uint32_t size, uint8_t policy, uint32_t count, uint32_t *dropped)
+{
+    uint32_t i;
+
+    for (i = 0; i < size; i++) {
+        if (prefixes[i].family == 0) {
+            continue;
+        }
+
+        if (count == blocklist.capacity) {
+            (*dropped)++;
+            continue;
+        }
+
+        blocklist.prefixes[count].prefix = prefixes[i];
+        blocklist.prefixes[count].policy = policy;
+        blocklist_mask(&(blocklist.prefixes[count].prefix));
+        count++;
+    }
+
+    return count;
+}
+
+/**
+ * Orders by family, length and address, equal prefixes by precedence of
+ * their policy
+ */
+static int
+blocklist_compare(const void *a, const void *b)
+{
+    const blocklist_prefix_t   *x = a;
+    const blocklist_prefix_t   *y = b;
+    int                         cmp;
+
+    if (x->prefix.family != y->prefix.family) {
+        return x->prefix.family < y->prefix.family ? -1 : 1;
+    }
+
+    if (x->prefix.len != y->prefix.len) {
+        return x->prefix.len < y->prefix.len ? -1 : 1;
+    }
+
+    if ((cmp = prefix_compare(&(x->prefix), &(y->prefix))) != 0) {
+        return cmp;
+    }
+
+    return (int) x->policy - (int) y->policy;
+}
+
+/**
+ * Writes the sorted prefixes into a slot, the first of equal prefixes wins
+ */
+static void
+blocklist_write(blocklist_slot_t *slot, uint32_t count)
+{
+    blocklist_ipv4_t   *ipv4 = (blocklist_ipv4_t *) slot->data;
+    blocklist_ipv6_t   *ipv6;
+    const prefix_t     *prefix;
+    const uint8_t      *bytes;
+    uint32_t            n4 = 0;
+    uint32_t            n6 = 0;
+    uint32_t            len;
+    uint32_t            i;
+    uint32_t            j;
+
+    memset(slot, 0, sizeof(blocklist_slot_t));
+
+    for (i = 0; i < count && blocklist.prefixes[i].prefix.family == AF_INET; i++) {
+        if (i > 0 && prefix_compare(&(blocklist.prefixes[i].prefix), &(blocklist.prefixes[i - 1].prefix)) == 0) {
+            continue;
+        }
+
+        len = blocklist.prefixes[i].prefix.len;
+
+        ipv4[n4++] = (blocklist_ipv4_t) { .addr = ntohl(blocklist.prefixes[i].prefix.ipv4.s_addr), .policy = blocklist.prefixes[i].policy };
+        slot->ipv4_lengths |= (uint64_t) 1 << len;
+        slot->ipv4_first[len + 1]++;
+    }
+
+    slot->ipv6_offset   = n4 * sizeof(blocklist_ipv4_t);
+    ipv6                = (blocklist_ipv6_t *) (slot->data + slot->ipv6_offset);
+
+    for (; i < count; i++) {
+        prefix = &(blocklist.prefixes[i].prefix);
+
+        if (i > 0 && prefix_compare(prefix, &(blocklist.prefixes[i - 1].prefix)) == 0) {
+            continue;
+        }
+
+        bytes = prefix->ipv6.s6_addr;
+        len   = prefix->len;
+
+        ipv6[n6] = (blocklist_ipv6_t) { .policy = blocklist.prefixes[i].policy };
+
+        for (j = 0; j < 8; j++) {
+            ipv6[n6].hi = (ipv6[n6].hi << 8) | bytes[j];
+            ipv6[n6].lo = (ipv6[n6].lo << 8) | bytes[j + 8];
+        }
+
+        n6++;
+        slot->ipv6_lengths[len / 64] |= (uint64_t) 1 << (len % 64);
+        slot->ipv6_first[len + 1]++;
+    }
+
+    for (len = 0; len <= 32; len++) {
+        slot->ipv4_first[len + 1] += slot->ipv4_first[len];
+    }
+
+    for (len = 0; len <= 128; len++) {
+        slot->ipv6_first[len + 1] += slot->ipv6_first[len];
+    }
+
+    slot->ipv4_count = n4;
+    slot->ipv6_count = n6;
+}
+
+/**
+ * Writes a new generation into the inactive slot and switches to it
+ */
+static void
+blocklist_publish(const prefix_set_t *blocked, const prefix_set_t *slipped)
+{
+    blocklist_header_t *header = blocklist.header;
+    uint32_t            next   = header->active ^ 1;
+    uint32_t            dropped = 0;
+    uint32_t            count   = 0;
+    uint64_t            seq;
+
+    /* precedence is decided by the sort, the static prefixes come first to be kept when full */
+    if (blocklist.statics != NULL) {
+        for (; count < blocklist.statics->count && count < blocklist.capacity; count++) {
+            blocklist.prefixes[count] = blocklist.statics->prefixes[count];
+        }
+        dropped += blocklist.statics->count - count;
+    }
+
+    count = blocklist_collect(blocked->prefixes, blocked->size, BLOCKLIST_POLICY_BLOCK, count, &dropped);
+    count = blocklist_collect(slipped->prefixes, slipped->size, BLOCKLIST_POLICY_SLIP,  count, &dropped);
+
+    qsort(blocklist.prefixes, count, sizeof(blocklist_prefix_t), blocklist_compare);
+
+    /* a reader still on this slot (active two generations ago) fails the seqlock */
+    seq = header->seq;
+    __atomic_store_n(&(header->seq), seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+
+    blocklist_write(blocklist_slot(next), count);
+
+    __atomic_store_n(&(header->active),     next,                  __ATOMIC_RELAXED);
+    __atomic_store_n(&(header->generation), header->generation + 1, __ATOMIC_RELAXED);
+    __atomic_store_n(&(header->dropped),    dropped,               __ATOMIC_RELAXED);
+    __atomic_store_n(&(header->published),  (uint64_t) time(NULL), __ATOMIC_RELAXED);
+
+    __atomic_store_n(&(header->seq), seq + 2, __ATOMIC_RELEASE);
+
+    if (dropped != blocklist.dropped) {
+        LOG_PRINTLN(LOG_BLOCKLIST, dropped > 0 ? LOG_ERROR : LOG_INFO, ("generation %" PRIu64 ": %" PRIu32 " prefixes did not fit (capacity %" PRIu32 ")",
+                                                                        header->generation, dropped, blocklist.capacity));
+        blocklist.dropped = dropped;
+    }
+
+    LOG_PRINTLN(LOG_BLOCKLIST, LOG_DEBUG, ("generation %" PRIu64 ": %" PRIu32 " IPv4, %" PRIu32 " IPv6 prefixes",
+                                           header->generation, blocklist_slot(next)->ipv4_count, blocklist_slot(next)->ipv6_count));
+}
+
+/****************************************************************************
+ * blocklist_update
+ *
+ * Publishes a new generation if the tables changed or new static
+ * prefixes were handed over. Firewall worker only
+ *
+ * @param  blocked                  desired content of the block table
+ * @param  slipped                  desired content of the slip table
+ * @param  changed                  the tables have been flushed
+ ***************************************************************************/
+void
+blocklist_update(const prefix_set_t *blocked, const prefix_set_t *slipped, bool changed)
+{
+    blocklist_static_t *statics;
+
+    if (!blocklist.enabled) {
+        return;
+    }
+
+    if (__atomic_load_n(&(blocklist.pending), __ATOMIC_RELAXED) != NULL) {
+        statics = __atomic_exchange_n(&(blocklist.pending), NULL, __ATOMIC_ACQ_REL);
+
+        free(blocklist.statics);
+        blocklist.statics = statics;
+        changed = true;
+    }
+
+    if (changed) {
+        blocklist_publish(blocked, slipped);
+    }
+}
+
+/**
+ * Unmaps the file, which keeps the last generation for the readers
+ */
+void
+blocklist_stop(void)
+{
+    if (blocklist.map != NULL) {
+        munmap(blocklist.map, blocklist.size);
+    }
+
+    free(blocklist.prefixes);
+    free(blocklist.statics);
+    free(__atomic_exchange_n(&(blocklist.pending), NULL, __ATOMIC_ACQ_REL));
+
+    memset(&blocklist, 0, sizeof(blocklist));
+}
@@ -0,0 +1,341 @@
+#include "blocklist_reader.h"
+
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <arpa/inet.h>
+
+static inline const blocklist_header_t *
+blocklist_header(const blocklist_reader_t *reader)
+{
+    return (const blocklist_header_t *) reader->map;
+}
+
+static inline uint64_t
+blocklist_mask64(uint32_t len)
+{
+    return len == 0 ? 0 : ~(uint64_t) 0 << (64 - len);
+}
+
+/**
+ * Checks a mapped file: a half written or foreign file is never read
+ */
+static bool
+blocklist_valid(const uint8_t *map, size_t size)
+{
+    const blocklist_header_t *header = (const blocklist_header_t *) map;
+
+    if (size < BLOCKLIST_SLOT_OFFSET || header->magic != BLOCKLIST_MAGIC || header->version != BLOCKLIST_VERSION) {
+        return false;
+    }
+
+    return header->slot_size >= sizeof(blocklist_slot_t) + (size_t) header->capacity * sizeof(blocklist_ipv6_t) &&
+           size >= BLOCKLIST_SLOT_OFFSET + (size_t) BLOCKLIST_SLOTS * header->slot_size;
+}
+
+/****************************************************************************
+ * blocklist_reader_open
+ *
+ * Maps the blocklist file read only
+ *
+ * @param  reader                   reader
+ * @param  path                     file the defender publishes to
+ * @return                          false (errno set) if the file is missing or invalid
+ ***************************************************************************/
+bool
+blocklist_reader_open(blocklist_reader_t *reader, const char *path)
+{
+    struct stat st;
+    void       *map;
+    int         fd;
+
+    memset(reader, 0, sizeof(blocklist_reader_t));
+
+    if ((fd = open(path, O_RDONLY)) < 0) {
+        return false;
+    }
+
+    if (fstat(fd, &st) != 0) {
+        close(fd);
+        return false;
+    }
+
+    if ((map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0)) == MAP_FAILED) {
+        close(fd);
+        return false;
+    }
+
+    close(fd);
+
+    if (!blocklist_valid(map, st.st_size)) {
+        munmap(map, st.st_size);
+        errno = EINVAL;
+        return false;
+    }
+
+    reader->path    = path;
+    reader->map     = map;
+    reader->size    = st.st_size;
+    reader->dev     = st.st_dev;
+    reader->ino     = st.st_ino;
+
+    return true;
+}
+
+/****************************************************************************
+ * blocklist_reader_refresh
+ *
+ * Maps the file again if the defender has replaced it. Must not run
+ * concurrently with a lookup of the same reader
+ *
+ * @param  reader                   reader
+ * @return                          true if the reader maps the current file
+ ***************************************************************************/
+bool
+blocklist_reader_refresh(blocklist_reader_t *reader)
+{
+    blocklist_reader_t  fresh;
+    struct stat         st;
+
+    if (stat(reader->path, &st) != 0) {
+        return false;
+    }
+
+    if (reader->map != NULL && st.st_dev == reader->dev && st.st_ino == reader->ino) {
+        return true;
+    }
+
+    if (!blocklist_reader_open(&fresh, reader->path)) {
+        return false;
+    }
+
+    blocklist_reader_close(reader);
+    *reader = fresh;
+
+    return true;
+}
+
+void
+blocklist_reader_close(blocklist_reader_t *reader)
+{
+    if (reader->map != NULL) {
+        munmap((void *) reader->map, reader->size);
+    }
+
+    reader->map     = NULL;
+    reader->size    = 0;
+}
+
+/**
+ * Longest match in one slot. The slot may be rewritten under the reader:
+ * every index is bounded, the seqlock discards the result
+ */
+static blocklist_policy_t
+blocklist_search_ipv4(const blocklist_slot_t *slot, uint32_t capacity, uint32_t addr)
+{
+    const blocklist_ipv4_t *prefixes = (const blocklist_ipv4_t *) slot->data;
+    uint64_t                lengths  = slot->ipv4_lengths & ((((uint64_t) 1) << 33) - 1);
+    uint32_t                count    = slot->ipv4_count < capacity ? slot->ipv4_count : capacity;
+    uint32_t                len;
+    uint32_t                key;
+    uint32_t                lo;
+    uint32_t                hi;
+    uint32_t                mid;
+
+    while (lengths != 0) {
+        len      = 63 - __builtin_clzll(lengths);
+        lengths &= ~((uint64_t) 1 << len);
+
+        key = (uint32_t) (blocklist_mask64(len) >> 32) & addr;
+        lo  = slot->ipv4_first[len];
+        hi  = slot->ipv4_first[len + 1];
+
+        if (hi > count || lo > hi) {
+            return BLOCKLIST_POLICY_NONE;
+        }
+
+        while (lo < hi) {
+            mid = lo + (hi - lo) / 2;
+
+            if (prefixes[mid].addr == key) {
+                return prefixes[mid].policy < BLOCKLIST_POLICY_SIZE ? prefixes[mid].policy : BLOCKLIST_POLICY_NONE;
+            }
+
+            if (prefixes[mid].addr < key) {
+                lo = mid + 1;
+            } else {
+                hi = mid;
+            }
+        }
+    }
+
+    return BLOCKLIST_POLICY_NONE;
+}
+
+static blocklist_policy_t
+blocklist_search_ipv6(const blocklist_slot_t *slot, uint32_t capacity, uint64_t addr_hi, uint64_t addr_lo)
+{
+    const blocklist_ipv6_t *prefixes;
+    uint32_t                count = slot->ipv6_count < capacity ? slot->ipv6_count : capacity;
+    uint64_t                lengths;
+    uint64_t                key_hi;
+    uint64_t                key_lo;
+    uint32_t                len;
+    uint32_t                word;
+    uint32_t                lo;
+    uint32_t                hi;
+    uint32_t                mid;
+
+    if (slot->ipv6_offset % sizeof(uint64_t) != 0 ||
+        slot->ipv6_offset > capacity * sizeof(blocklist_ipv6_t) - count * sizeof(blocklist_ipv6_t)) {
+        return BLOCKLIST_POLICY_NONE;
+    }
+
+    prefixes = (const blocklist_ipv6_t *) (slot->data + slot->ipv6_offset);
+
+    for (word = 3; word-- > 0; ) {
+        lengths = slot->ipv6_lengths[word] & (word == 2 ? 1 : ~(uint64_t) 0);
+
+        while (lengths != 0) {
+            len      = 63 - __builtin_clzll(lengths);
+            lengths &= ~((uint64_t) 1 << len);
+            len     += word * 64;
+
+            key_hi = addr_hi & blocklist_mask64(len < 64 ? len : 64);
+            key_lo = addr_lo & blocklist_mask64(len > 64 ? len - 64 : 0);
+            lo     = slot->ipv6_first[len];
+            hi     = slot->ipv6_first[len + 1];
+
+            if (hi > count || lo > hi) {
+                return BLOCKLIST_POLICY_NONE;
+            }
+
+            while (lo < hi) {
+                mid = lo + (hi - lo) / 2;
+
+                if (prefixes[mid].hi == key_hi && prefixes[mid].lo == key_lo) {
+                    return prefixes[mid].policy < BLOCKLIST_POLICY_SIZE ? prefixes[mid].policy : BLOCKLIST_POLICY_NONE;
+                }
+
+                if (prefixes[mid].hi < key_hi || (prefixes[mid].hi == key_hi && prefixes[mid].lo < key_lo)) {
+                    lo = mid + 1;
+                } else {
+                    hi = mid;
+                }
+            }
+        }
+    }
+
+    return BLOCKLIST_POLICY_NONE;
+}
+
+/**
+ * Slot of the current generation and its seqlock sequence, NULL while the
+ * writer publishes
+ */
+static inline const blocklist_slot_t *
+blocklist_slot_begin(const blocklist_reader_t *reader, uint64_t *seq)
+{
+    const blocklist_header_t   *header = blocklist_header(reader);
+    uint32_t                    active;
+
+    if ((*seq = __atomic_load_n(&(header->seq), __ATOMIC_ACQUIRE)) & 1) {
+        return NULL;
+    }
+
+    active = __atomic_load_n(&(header->active), __ATOMIC_RELAXED) % BLOCKLIST_SLOTS;
+
+    return (const blocklist_slot_t *) (reader->map + BLOCKLIST_SLOT_OFFSET + (size_t) active * header->slot_size);
+}
+
+/**
+ * Whether the lookup did not overlap a switch
+ */
+static inline bool
+blocklist_slot_end(const blocklist_reader_t *reader, uint64_t seq, uint64_t *generation)
+{
+    const blocklist_header_t *header = blocklist_header(reader);
+
+    if (generation != NULL) {
+        *generation = __atomic_load_n(&(header->generation), __ATOMIC_RELAXED);
+    }
+
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+
+    return __atomic_load_n(&(header->seq), __ATOMIC_RELAXED) == seq;
+}
+
+/****************************************************************************
+ * blocklist_lookup_ipv4
+ *
+ * @param  reader                   reader
+ * @param  addr                     IPv4 address (network byte order)
+ * @param  generation               returns the generation looked up, may be NULL
+ * @return                          policy of the longest matching prefix
+ ***************************************************************************/
+blocklist_policy_t
+blocklist_lookup_ipv4(const blocklist_reader_t *reader, uint32_t addr, uint64_t *generation)
+{
+    const blocklist_slot_t *slot;
+    blocklist_policy_t      policy;
+    uint64_t                seq;
+
+    if (reader->map == NULL) {
+        return BLOCKLIST_POLICY_NONE;
+    }
+
+    addr = ntohl(addr);
+
+    do {
+        if ((slot = blocklist_slot_begin(reader, &seq)) == NULL) {
+            continue;
+        }
+
+        policy = blocklist_search_ipv4(slot, blocklist_header(reader)->capacity, addr);
+
+    } while (slot == NULL || !blocklist_slot_end(reader, seq, generation));
+
+    return policy;
+}
+
+/****************************************************************************
+ * blocklist_lookup_ipv6
+ *
+ * @param  reader                   reader
+ * @param  addr                     IPv6 address
+ * @param  generation               returns the generation looked up, may be NULL
+ * @return                          policy of the longest matching prefix
+ ***************************************************************************/
+blocklist_policy_t
+blocklist_lookup_ipv6(const blocklist_reader_t *reader, const struct in6_addr *addr, uint64_t *generation)
+{
+    const blocklist_slot_t *slot;
+    blocklist_policy_t      policy;
+    uint64_t                addr_hi = 0;
+    uint64_t                addr_lo = 0;
+    uint64_t                seq;
+    uint32_t                i;
+
+    if (reader->map == NULL) {
+        return BLOCKLIST_POLICY_NONE;
+    }
+
+    for (i = 0; i < 8; i++) {
+        addr_hi = (addr_hi << 8) | addr->s6_addr[i];
+        addr_lo = (addr_lo << 8) | addr->s6_addr[i + 8];
+    }
+
+    do {
+        if ((slot = blocklist_slot_begin(reader, &seq)) == NULL) {
+            continue;
+        }
+
+        policy = blocklist_search_ipv6(slot, blocklist_header(reader)->capacity, addr_hi, addr_lo);
+
+    } while (slot == NULL || !blocklist_slot_end(reader, seq, generation));
+
+    return policy;
+}
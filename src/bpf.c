@@ -2,6 +2,7 @@
 #include "bpf.h"
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <errno.h>
 #include <fcntl.h>
@@ -15,6 +16,7 @@
 #include <net/if.h>
 
 #include <unistd.h>
+#include <inttypes.h>
 
 #include "log.h"
 
@@ -22,6 +24,10 @@
 #include "packet/port.h"
 
 #define BPF_DEVICE_MAX      99
+#define BPF_BUFFER_LEN      (512 * 1024)        /**< requested store buffer, must hold several 64 KiB super-frames */
+
+static uint8_t     *bpf_buffer;                 /**< read buffer of all devices, allocated with the largest negotiated buffer length */
+static unsigned int bpf_buffer_size;
 
 /**
  * A      is the accumulator
@@ -40,33 +46,39 @@ static struct bpf_insn bpf_filter[] = {
     
             /* Make sure this is an IP packet... */
 /*  1 */    BPF_STMT(BPF_LD + BPF_H + BPF_ABS, 12),                         /**< Load absolute (BPF_ABS) half-word (BPF_H) offset 12 to accumulator: Destination MAC (6) + Source MAC (6) = 12 packet offset */
-/*  2 */    BPF_JUMP(BPF_JMP + BPF_JEQ + BPF_K, ETHERTYPE_IPV4, 0, 8),      /**< Jump to offset if accumulator equals (BPF_JEQ) to constant (BPF_K) ETHERTYPE_IP:
-                                                                             *   pc = 2, if true: offset 0, otherwise: offset 8 (pc += (A == k) ? jt : jf) */
-            /* Make sure it's a UDP packet... */
+/*  2 */    BPF_JUMP(BPF_JMP + BPF_JEQ + BPF_K, ETHERTYPE_IPV4, 0, 12),     /**< Jump to offset if accumulator equals (BPF_JEQ) to constant (BPF_K) ETHERTYPE_IP:
+                                                                             *   pc = 2, if true: 2 + 1 + 0 = 3, otherwise: 2 + 1 + 12 = 15 (pc += 1 + ((A == k) ? jt : jf)) */
+            /* Is it a GRE (ERSPAN) packet? Tunnels are always passed, the inner frame is checked by the decoder */
 /*  3 */    BPF_STMT(BPF_LD + BPF_B + BPF_ABS, 23),                         /**< Load absolute byte (BPF_B) offset 23 to accumulator: ethernet header (14) + Version/IHL (1) + DSCP (1) + Total Length (2) + ID (2) + Flags/Fragment Offset (2) + TTL (1) = 23 packet offset */
-/*  4 */    BPF_JUMP(BPF_JMP + BPF_JEQ + BPF_K, IPV4_PROTOCOL_UDP, 0, 6),   /**< Jump to offset if accumulator equals (BPF_JEQ) to constant (BPF_K) IPV4_PROTOCOL_UDP:
-                                                                              *   pc = 4, if true: 4 + 0 = 4, otherwise: 4 + 6 = 10 */
+/*  4 */    BPF_JUMP(BPF_JMP + BPF_JEQ + BPF_K, IPV4_PROTOCOL_GRE, 9, 0),   /**< Jump to "accept" if accumulator equals IPV4_PROTOCOL_GRE: pc = 4, if true: 4 + 1 + 9 = 14 */
+
+            /* Make sure it's a UDP packet... */
+/*  5 */    BPF_JUMP(BPF_JMP + BPF_JEQ + BPF_K, IPV4_PROTOCOL_UDP, 0, 9),   /**< Jump to offset if accumulator equals (BPF_JEQ) to constant (BPF_K) IPV4_PROTOCOL_UDP:
+                                                                              *   pc = 5, if true: 5 + 1 + 0 = 6, otherwise: 5 + 1 + 9 = 15 */
 
             /* Make sure this isn't a fragment... */
-/*  5 */    BPF_STMT(BPF_LD + BPF_H + BPF_ABS, 20),                         /**< Load absolute half-word offset 20 to accumulator: ethernet header (14) + Version/IHL (1) + DSCP (1) + Total Length (2) + ID (2) = 20 packet offset */
-/*  6 */    BPF_JUMP(BPF_JMP + BPF_JSET + BPF_K, 0x1fff, 4, 0),             /**< Jump to offset if accumulator bitwise AND to constant BPF_JSET */
+/*  6 */    BPF_STMT(BPF_LD + BPF_H + BPF_ABS, 20),                         /**< Load absolute half-word offset 20 to accumulator: ethernet header (14) + Version/IHL (1) + DSCP (1) + Total Length (2) + ID (2) = 20 packet offset */
+/*  7 */    BPF_JUMP(BPF_JMP + BPF_JSET + BPF_K, 0x1fff, 7, 0),             /**< Jump to offset if accumulator bitwise AND to constant BPF_JSET */
 
             /* Get the IP header length... */
-/*  7 */    BPF_STMT(BPF_LDX + BPF_B + BPF_MSH, 14),                        /**< Load IPv4 header length (BPF_MSH) from byte (BPF_B) offset 14 to index register (BPF_LDX) */
+/*  8 */    BPF_STMT(BPF_LDX + BPF_B + BPF_MSH, 14),                        /**< Load IPv4 header length (BPF_MSH) from byte (BPF_B) offset 14 to index register (BPF_LDX) */
 
             /* Make sure it's to the right source port... */
-/*  8 */    BPF_STMT(BPF_LD + BPF_H + BPF_IND, 14),                         /**< Load indirect (BPF_IND) half-word (BPF_H) offset 14 to accumulator: ethernet header (14) = 14 packet offset */
-/*  9 */    BPF_JUMP(BPF_JMP + BPF_JEQ + BPF_K, PORT_DNS, 2, 0),
+/*  9 */    BPF_STMT(BPF_LD + BPF_H + BPF_IND, 14),                         /**< Load indirect (BPF_IND) half-word (BPF_H) offset 14 to accumulator: ethernet header (14) = 14 packet offset */
+/* 10 */    BPF_JUMP(BPF_JMP + BPF_JEQ + BPF_K, PORT_DNS, 3, 0),
 
             /* ... or destination port */
-/* 10 */    BPF_STMT(BPF_LD + BPF_H + BPF_IND, 16),                         /**< Load indirect (BPF_IND) half-word (BPF_H) offset 16 to accumulator: ethernet header (14)  + source port (2) = 16 packet offset */
-/* 11 */    BPF_JUMP(BPF_JMP + BPF_JEQ + BPF_K, PORT_DNS, 0, 1),
+/* 11 */    BPF_STMT(BPF_LD + BPF_H + BPF_IND, 16),                         /**< Load indirect (BPF_IND) half-word (BPF_H) offset 16 to accumulator: ethernet header (14)  + source port (2) = 16 packet offset */
+/* 12 */    BPF_JUMP(BPF_JMP + BPF_JEQ + BPF_K, PORT_DNS, 1, 0),
+
+            /* ... or it's a VXLAN tunnel */
+/* 13 */    BPF_JUMP(BPF_JMP + BPF_JEQ + BPF_K, PORT_VXLAN, 0, 1),
 
             /* If we passed all the tests, ask for the whole packet. */
-/* 12 */    BPF_STMT(BPF_RET+BPF_K, (u_int)-1),
+/* 14 */    BPF_STMT(BPF_RET+BPF_K, (u_int)-1),
 
             /* Otherwise, drop it. */
-/* 13 */    BPF_STMT(BPF_RET+BPF_K, 0)
+/* 15 */    BPF_STMT(BPF_RET+BPF_K, 0)
 
 };
 
@@ -75,16 +87,29 @@ static struct bpf_program bpf_program = {
     (struct bpf_insn *) &bpf_filter
 };
 
-int
-bpf_open(const char *iface, const unsigned int timeout, const unsigned int *buffer_len)
+/**
+ * Inline bridge: every frame has to be captured to be forwarded, the
+ * frames of bpf_filter are picked by bpf_match() instead
+ */
+static struct bpf_insn bpf_filter_all[] = {
+            BPF_STMT(BPF_RET+BPF_K, (u_int)-1)
+};
+
+static struct bpf_program bpf_program_all = {
+    sizeof(bpf_filter_all) / sizeof(struct bpf_insn),
+    (struct bpf_insn *) &bpf_filter_all
+};
+
+/**
+ * Opens the first free bpf device
+ */
+static int
+bpf_device_open(void)
 {
     int             bpf;
     int             i;
     const char      prefix[] = "/dev/bpf";
     char            bpf_dev[sizeof(prefix) + 2 + 1];
-    struct ifreq    iface_bind;
-    u_int           enable = 1;
-    struct timeval  tv_timeout;
     
     /* try to open a bpf device after another */
     for (i = 0; i < BPF_DEVICE_MAX; i++) {
@@ -111,6 +136,42 @@ bpf_open(const char *iface, const unsigned int timeout, const unsigned int *buff
     /* bpf successfully opened */
     LOG_PRINTLN(LOG_SOCKET_BPF, LOG_DEBUG, ("BPF device %s successfully opened: bpf=%d", bpf_dev, bpf));
     
+    return bpf;
+}
+
+/****************************************************************************
+ * bpf_open
+ *
+ * Opens a capture device. A bridged one captures every frame the
+ * interface receives (promiscuous, no filter), but not the frames sent on
+ * it, which would be bridged back
+ *
+ * @param  iface                    interface
+ * @param  timeout                  read timeout (s)
+ * @param  buffer_len               returns the buffer length of the device
+ * @param  bridged                  inline bridge port
+ * @return                          bpf device, -1 on error
+ ***************************************************************************/
+int
+bpf_open(const char *iface, const unsigned int timeout, unsigned int *buffer_len, bool bridged)
+{
+    int             bpf;
+    struct ifreq    iface_bind;
+    u_int           enable = 1;
+    u_int           direction = BPF_D_IN;
+    struct timeval  tv_timeout;
+    uint8_t        *buffer;
+    
+    if ((bpf = bpf_device_open()) == -1) {
+        return -1;
+    }
+    
+    /* Set buffer length, only possible before binding to the interface */
+    *buffer_len = BPF_BUFFER_LEN;
+    if (ioctl(bpf, BIOCSBLEN, buffer_len) == -1) {
+        LOG_ERRNO(LOG_SOCKET_BPF, LOG_WARNING, errno, ("Could not set buffer length: len=%u", BPF_BUFFER_LEN));
+    }
+    
     /* bind to interface */
     strlcpy(iface_bind.ifr_name, iface, IFNAMSIZ);
     if (ioctl(bpf, BIOCSETIF, &iface_bind) == -1) {
@@ -127,7 +188,7 @@ bpf_open(const char *iface, const unsigned int timeout, const unsigned int *buff
     LOG_PRINTLN(LOG_SOCKET_BPF, LOG_DEBUG, ("Enable immediate mode"));
     
     /* Enable write link level source address as provided*/
-    if (ioctl(bpf, BIOCGHDRCMPLT, &enable) == -1) {
+    if (ioctl(bpf, BIOCSHDRCMPLT, &enable) == -1) {
         LOG_ERRNO(LOG_SOCKET_BPF, LOG_ERROR, errno, ("Could not enable write link level source address as provided"));
         return -1;
     }
@@ -140,6 +201,17 @@ bpf_open(const char *iface, const unsigned int timeout, const unsigned int *buff
     }
     LOG_PRINTLN(LOG_SOCKET_BPF, LOG_DEBUG, ("Get buffer length: len=%u", *buffer_len));
     
+    /* the devices are read one after another, they share the buffer */
+    if (*buffer_len > bpf_buffer_size) {
+        buffer = realloc(bpf_buffer, *buffer_len);
+        if (buffer == NULL) {
+            LOG_ERRNO(LOG_SOCKET_BPF, LOG_ERROR, errno, ("Could not allocate buffer: len=%u", *buffer_len));
+            return -1;
+        }
+        bpf_buffer      = buffer;
+        bpf_buffer_size = *buffer_len;
+    }
+    
     /* Set timeout */
     tv_timeout.tv_sec   = timeout;
     tv_timeout.tv_usec  = 0;
@@ -151,35 +223,243 @@ bpf_open(const char *iface, const unsigned int timeout, const unsigned int *buff
     LOG_PRINTLN(LOG_SOCKET_BPF, LOG_DEBUG, ("Set timeout to %us", timeout));
     
     /* Set filter */
-    if (ioctl(bpf, BIOCSETF, (struct bpf_program *) &bpf_program) == -1) {
+    if (ioctl(bpf, BIOCSETF, bridged ? &bpf_program_all : &bpf_program) == -1) {
         LOG_ERRNO(LOG_SOCKET_BPF, LOG_ERROR, errno, ("Could not set filter"));
         return -1;
     }
-    LOG_PRINTLN(LOG_SOCKET_BPF, LOG_DEBUG, ("Set filter"));
+    LOG_PRINTLN(LOG_SOCKET_BPF, LOG_DEBUG, ("Set filter%s", bridged ? " (all frames)" : ""));
+    
+    if (!bridged) {
+        return bpf;
+    }
+    
+    /* Frames to other hosts have to be bridged as well */
+    if (ioctl(bpf, BIOCPROMISC, NULL) == -1) {
+        LOG_ERRNO(LOG_SOCKET_BPF, LOG_ERROR, errno, ("Could not enable promiscuous mode"));
+        return -1;
+    }
+    LOG_PRINTLN(LOG_SOCKET_BPF, LOG_DEBUG, ("Enable promiscuous mode"));
+    
+    /* Only received frames: the frames the bridge sends on this interface are seen as well otherwise */
+    if (ioctl(bpf, BIOCSDIRECTION, &direction) == -1) {
+        LOG_ERRNO(LOG_SOCKET_BPF, LOG_ERROR, errno, ("Could not capture received frames only"));
+        return -1;
+    }
+    LOG_PRINTLN(LOG_SOCKET_BPF, LOG_DEBUG, ("Capture received frames only"));
     
     return bpf;
 }
 
+/****************************************************************************
+ * bpf_match
+ *
+ * Userspace twin of bpf_filter: whether a frame is inspected. Frames of a
+ * bridged device are captured unfiltered, the others are forwarded as
+ * they are. Keep in sync with bpf_filter
+ *
+ * @param  raw_packet               frame
+ * @return                          true if bpf_filter accepts the frame
+ ***************************************************************************/
 bool
-bpf_read(int bpf, raw_packet_t *raw_packet, const unsigned int buffer_len)
+bpf_match(const raw_packet_t *raw_packet)
+{
+    const uint8_t  *data = raw_packet->data;
+    uint32_t        ihl;
+    uint16_t        src_port;
+    uint16_t        dest_port;
+    
+    if (raw_packet->len < ETHERNET_HEADER_LEN + IPV4_HEADER_LEN ||
+        ((data[12] << 8) | data[13]) != ETHERTYPE_IPV4) {
+        return false;
+    }
+    
+    if (data[23] == IPV4_PROTOCOL_GRE) {
+        return true;
+    }
+    
+    if (data[23] != IPV4_PROTOCOL_UDP || (((data[20] << 8) | data[21]) & 0x1fff) != 0) {
+        return false;
+    }
+    
+    ihl = 4 * (data[14] & 0x0f);
+    
+    if (raw_packet->len < ETHERNET_HEADER_LEN + ihl + 4) {
+        return false;
+    }
+    
+    src_port    = (data[ETHERNET_HEADER_LEN + ihl]     << 8) | data[ETHERNET_HEADER_LEN + ihl + 1];
+    dest_port   = (data[ETHERNET_HEADER_LEN + ihl + 2] << 8) | data[ETHERNET_HEADER_LEN + ihl + 3];
+    
+    return src_port == PORT_DNS || dest_port == PORT_DNS || dest_port == PORT_VXLAN;
+}
+
+/****************************************************************************
+ * bpf_read
+ *
+ * Reads a capture batch: every frame of the buffer is returned, chained by
+ * next. The raw packets are taken from the size class which fits the
+ * capture length of the frame (jumbo frames, GRO/TSO super-frames up to
+ * 64 KiB)
+ *
+ * @param  bpf                      bpf device
+ * @param  buffer_len               buffer length of the bpf device
+ * @return                          first raw packet (each to be released), NULL if none
+ ***************************************************************************/
+raw_packet_t *
+bpf_read(int bpf, const unsigned int buffer_len)
 {
-    uint8_t         buffer[buffer_len];
+    raw_packet_t   *head = NULL;
+    raw_packet_t  **tail = &head;
+    raw_packet_t   *raw_packet;
     ssize_t         bytes_read;
+    ssize_t         pos;
     struct bpf_hdr *bpf_header;
     
-    bytes_read = read(bpf, buffer, buffer_len);
+    bytes_read = read(bpf, bpf_buffer, buffer_len);
     if (bytes_read == -1) {
         LOG_ERRNO(LOG_SOCKET_BPF, LOG_WARNING, errno, ("Could not read")); 
-    } else if (bytes_read > 0) {
-        bpf_header = (struct bpf_hdr *) buffer;
+        return NULL;
+    }
+    
+    for (pos = 0; pos + (ssize_t) sizeof(struct bpf_hdr) <= bytes_read; pos += BPF_WORDALIGN(bpf_header->bh_hdrlen + bpf_header->bh_caplen)) {
+        bpf_header = (struct bpf_hdr *) &(bpf_buffer[pos]);
+        
+        if (pos + bpf_header->bh_hdrlen + bpf_header->bh_caplen > bytes_read) {
+            LOG_PRINTLN(LOG_SOCKET_BPF, LOG_WARNING, ("malformed bpf header, caplen=%u, read=%zd", bpf_header->bh_caplen, bytes_read - pos));
+            break;
+        }
+        
+        if (bpf_header->bh_caplen < bpf_header->bh_datalen) {
+            LOG_PRINTLN(LOG_SOCKET_BPF, LOG_WARNING, ("truncated packet, caplen=%u, len=%u", bpf_header->bh_caplen, bpf_header->bh_datalen));
+        }
+        
+        raw_packet = raw_packet_new(bpf_header->bh_caplen);
+        if (raw_packet == NULL) {
+            continue;
+        }
         
-        raw_packet->len = bytes_read - bpf_header->bh_hdrlen;
-        memcpy(raw_packet->data, &(buffer[bpf_header->bh_hdrlen]), raw_packet->len);
+        raw_packet->len         = bpf_header->bh_caplen;
+        raw_packet->timestamp   = (uint64_t) bpf_header->bh_tstamp.tv_sec * 1000000 + bpf_header->bh_tstamp.tv_usec;
+        raw_packet->next        = NULL;
+        memcpy(raw_packet->data, &(bpf_buffer[pos + bpf_header->bh_hdrlen]), raw_packet->len);
         
         LOG_PRINTLN(LOG_SOCKET_BPF, LOG_INFO, ("received a packet, len=%d", raw_packet->len));
         
-        return true;
+        *tail = raw_packet;
+        tail  = &(raw_packet->next);
     }
     
-    return false;
+    return head;
 }
+
+/****************************************************************************
+ * bpf_write
+ *
+ * The link level header is written as provided (BIOCGHDRCMPLT)
+ *
+ * @param  bpf                      bpf device
+ * @param  raw_packet               whole frame including Ethernet header
+ * @return                          true if the frame was written completely
+ ***************************************************************************/
+bool
+bpf_write(int bpf, raw_packet_t *raw_packet)
+{
+    ssize_t         bytes_written;
+    
+    bytes_written = write(bpf, raw_packet->data, raw_packet->len);
+    if (bytes_written == -1) {
+        LOG_ERRNO(LOG_SOCKET_BPF, LOG_WARNING, errno, ("Could not write"));
+        return false;
+    }
+    
+    if (bytes_written != raw_packet->len) {
+        LOG_PRINTLN(LOG_SOCKET_BPF, LOG_WARNING, ("sent a partial packet, len=%zd/%u", bytes_written, raw_packet->len));
+        return false;
+    }
+    
+    LOG_PRINTLN(LOG_SOCKET_BPF, LOG_INFO, ("sent a packet, len=%u", raw_packet->len));
+    
+    return true;
+}
+
+/**
+ * Opens a device for sending on an interface, the link level header is
+ * written as provided
+ */
+static int
+bpf_bridge_device(const char *iface)
+{
+    int             bpf;
+    struct ifreq    iface_bind;
+    u_int           enable = 1;
+    
+    if ((bpf = bpf_device_open()) == -1) {
+        return -1;
+    }
+    
+    strlcpy(iface_bind.ifr_name, iface, IFNAMSIZ);
+    if (ioctl(bpf, BIOCSETIF, &iface_bind) == -1 || ioctl(bpf, BIOCSHDRCMPLT, &enable) == -1) {
+        LOG_ERRNO(LOG_SOCKET_BPF, LOG_ERROR, errno, ("Could not bind interface %s to BPF device", iface));
+        close(bpf);
+        return -1;
+    }
+    
+    return bpf;
+}
+
+static int bpf_bridge[BRIDGE_PORT_SIZE] = { -1, -1 };
+
+static void
+bpf_bridge_close(void)
+{
+    uint32_t port;
+    
+    for (port = 0; port < BRIDGE_PORT_SIZE; port++) {
+        if (bpf_bridge[port] != -1) {
+            close(bpf_bridge[port]);
+            bpf_bridge[port] = -1;
+        }
+    }
+}
+
+static bool
+bpf_bridge_open(config_t *config)
+{
+    if ((bpf_bridge[BRIDGE_PORT_A] = bpf_bridge_device(config->ifname))        == -1 ||
+        (bpf_bridge[BRIDGE_PORT_B] = bpf_bridge_device(config->bridge_ifname)) == -1) {
+        bpf_bridge_close();
+        return false;
+    }
+    
+    return true;
+}
+
+/**
+ * A bpf device takes one frame per write(): the batch is written in one
+ * go, without copying the frames
+ */
+static uint32_t
+bpf_bridge_send(bridge_port_t port, raw_packet_t **frames, uint32_t count)
+{
+    uint32_t sent = 0;
+    uint32_t i;
+    
+    for (i = 0; i < count; i++) {
+        if (write(bpf_bridge[port], frames[i]->data, frames[i]->len) == frames[i]->len) {
+            sent++;
+        }
+    }
+    
+    if (sent < count) {
+        LOG_ERRNO(LOG_SOCKET_BPF, LOG_WARNING, errno, ("Could not send %" PRIu32 " of %" PRIu32 " frames on port %u", count - sent, count, port));
+    }
+    
+    return sent;
+}
+
+const bridge_backend_t bridge_backend_bpf = {
+    .name       = "bpf",
+    .open       = bpf_bridge_open,
+    .close      = bpf_bridge_close,
+    .send       = bpf_bridge_send
+};
@@ -0,0 +1,240 @@
+#include "bridge.h"
+#include "bridge_mock.h"
+#include "log.h"
+#include "log_network.h"
+
+#ifdef __FreeBSD__
+#include "bpf.h"
+#endif
+
+#ifdef __linux__
+#include "af_packet.h"
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+
+typedef struct _bridge_t {
+    bool                        enabled;
+    const bridge_backend_t     *backend;
+    uint32_t                    batch;                          /**< frames queued per port before a send */
+    raw_packet_t              **queue[BRIDGE_PORT_SIZE];        /**< frames to send out of the port */
+    uint32_t                    count[BRIDGE_PORT_SIZE];
+    bridge_stats_t              stats;
+} bridge_t;
+
+static bridge_t bridge;
+
+/**
+ * The first backend of the platform is the default
+ */
+static const bridge_backend_t *bridge_backends[] = {
+#ifdef __FreeBSD__
+    &bridge_backend_bpf,
+#endif
+#ifdef __linux__
+    &bridge_backend_packet,
+#endif
+    &bridge_backend_mock,
+    NULL
+};
+
+/****************************************************************************
+ * bridge_backend_find
+ *
+ * @param  name                     bpf, packet, mock, NULL for the default
+ * @return                          backend, NULL if not available
+ ***************************************************************************/
+const bridge_backend_t *
+bridge_backend_find(const char *name)
+{
+    uint32_t i;
+
+    for (i = 0; bridge_backends[i] != NULL; i++) {
+        if (name == NULL || strcmp(bridge_backends[i]->name, name) == 0) {
+            return bridge_backends[i];
+        }
+    }
+
+    LOG_PRINTLN(LOG_BRIDGE, LOG_ERROR, ("bridge backend not available: %s", name));
+
+    return NULL;
+}
+
+bool
+bridge_init(config_t *config)
+{
+    uint32_t port;
+
+    memset(&bridge, 0, sizeof(bridge));
+
+    if (config->bridge_ifname == NULL) {
+        LOG_PRINTLN(LOG_BRIDGE, LOG_INFO, ("inline bridge disabled"));
+        return true;
+    }
+
+    bridge.batch = config->bridge_batch > 0 ? config->bridge_batch : 1;
+
+    for (port = 0; port < BRIDGE_PORT_SIZE; port++) {
+        if ((bridge.queue[port] = calloc(bridge.batch, sizeof(raw_packet_t *))) == NULL) {
+            LOG_PRINTLN(LOG_BRIDGE, LOG_ERROR, ("could not allocate bridge queue"));
+            bridge_stop();
+            return false;
+        }
+    }
+
+    if ((bridge.backend = bridge_backend_find(config->bridge_backend)) == NULL || !bridge.backend->open(config)) {
+        bridge.backend = NULL;
+        bridge_stop();
+        return false;
+    }
+
+    bridge.enabled = true;
+
+    LOG_PRINTLN(LOG_BRIDGE, LOG_INFO, ("inline bridge enabled: %s <-> %s, backend=%s, batch=%" PRIu32,
+                                       config->ifname, config->bridge_ifname, bridge.backend->name, bridge.batch));
+
+    return true;
+}
+
+bool
+bridge_enabled(void)
+{
+    return bridge.enabled;
+}
+
+/**
+ * Sends the queued frames of a port and releases them
+ */
+static void
+bridge_flush_port(bridge_port_t port)
+{
+    uint32_t sent;
+    uint32_t i;
+
+    if (bridge.count[port] == 0) {
+        return;
+    }
+
+    sent = bridge.backend->send(port, bridge.queue[port], bridge.count[port]);
+
+    bridge.stats.batches++;
+    bridge.stats.forwarded  += sent;
+    bridge.stats.errors     += bridge.count[port] - sent;
+
+    for (i = 0; i < bridge.count[port]; i++) {
+        object_release(bridge.queue[port][i]);
+    }
+
+    bridge.count[port] = 0;
+}
+
+/****************************************************************************
+ * bridge_forward
+ *
+ * Queues an allowed frame to be sent out of the other port
+ *
+ * @param  raw_packet               frame
+ * @param  port                     port the frame was captured on
+ ***************************************************************************/
+void
+bridge_forward(raw_packet_t *raw_packet, bridge_port_t port)
+{
+    raw_packet_t   *frame;
+    bridge_port_t   out = (port == BRIDGE_PORT_A) ? BRIDGE_PORT_B : BRIDGE_PORT_A;
+
+    if (!bridge.enabled) {
+        return;
+    }
+
+    /* a foreign buffer may be gone before the send */
+    if (raw_packet->klass == RAW_PACKET_CLASS_EXTERNAL) {
+        if ((frame = raw_packet_new(raw_packet->len)) == NULL) {
+            bridge.stats.errors++;
+            return;
+        }
+
+        frame->len          = raw_packet->len;
+        frame->timestamp    = raw_packet->timestamp;
+        memcpy(frame->data, raw_packet->data, raw_packet->len);
+        bridge.stats.copied++;
+
+    } else {
+        frame = object_retain(raw_packet);
+    }
+
+    bridge.queue[out][bridge.count[out]++] = frame;
+
+    if (bridge.count[out] == bridge.batch) {
+        bridge_flush_port(out);
+    }
+}
+
+/**
+ * Counts a frame which is not forwarded
+ */
+void
+bridge_drop(raw_packet_t *raw_packet, bridge_port_t port)
+{
+    if (!bridge.enabled) {
+        return;
+    }
+
+    LOG_RAW_PACKET(LOG_BRIDGE, LOG_VERBOSE, raw_packet, ("drop on port %u", port));
+
+    bridge.stats.dropped++;
+}
+
+/****************************************************************************
+ * bridge_flush
+ *
+ * Sends the queued frames of both ports, called after every capture batch
+ ***************************************************************************/
+void
+bridge_flush(void)
+{
+    uint32_t port;
+
+    if (!bridge.enabled) {
+        return;
+    }
+
+    for (port = 0; port < BRIDGE_PORT_SIZE; port++) {
+        bridge_flush_port(port);
+    }
+}
+
+void
+bridge_stats(bridge_stats_t *stats)
+{
+    *stats = bridge.stats;
+}
+
+/**
+ * Sends what is queued and closes the backend
+ */
+void
+bridge_stop(void)
+{
+    uint32_t port;
+
+    if (bridge.enabled) {
+        bridge_flush();
+
+        LOG_PRINTLN(LOG_BRIDGE, LOG_INFO, ("forwarded=%" PRIu64 ", dropped=%" PRIu64 ", copied=%" PRIu64 ", batches=%" PRIu64 ", errors=%" PRIu64,
+                                           bridge.stats.forwarded, bridge.stats.dropped, bridge.stats.copied, bridge.stats.batches, bridge.stats.errors));
+    }
+
+    if (bridge.backend != NULL) {
+        bridge.backend->close();
+        bridge.backend = NULL;
+    }
+
+    for (port = 0; port < BRIDGE_PORT_SIZE; port++) {
+        free(bridge.queue[port]);
+        bridge.queue[port] = NULL;
+    }
+
+    bridge.enabled = false;
+}
@@ -0,0 +1,66 @@
+#include "bridge_mock.h"
+#include "log.h"
+
+#include <string.h>
+
+typedef struct _bridge_mock_t {
+    uint64_t            frames[BRIDGE_PORT_SIZE];
+    uint64_t            bytes[BRIDGE_PORT_SIZE];
+} bridge_mock_t;
+
+static bridge_mock_t bridge_mock;
+
+static bool
+bridge_mock_open(config_t *config)
+{
+    memset(&bridge_mock, 0, sizeof(bridge_mock));
+
+    LOG_PRINTLN(LOG_BRIDGE, LOG_INFO, ("mock bridge: %s <-> %s", config->ifname, config->bridge_ifname));
+
+    return true;
+}
+
+/**
+ * The counters stay for inspection after the bridge has stopped
+ */
+static void
+bridge_mock_close(void)
+{
+
+}
+
+static uint32_t
+bridge_mock_send(bridge_port_t port, raw_packet_t **frames, uint32_t count)
+{
+    uint32_t i;
+
+    for (i = 0; i < count; i++) {
+        bridge_mock.bytes[port] += frames[i]->len;
+    }
+
+    bridge_mock.frames[port] += count;
+
+    return count;
+}
+
+/**
+ * Frames sent out of a port
+ */
+uint64_t
+bridge_mock_frames(bridge_port_t port)
+{
+    return bridge_mock.frames[port];
+}
+
+uint64_t
+bridge_mock_bytes(bridge_port_t port)
+{
+    return bridge_mock.bytes[port];
+}
+
+const bridge_backend_t bridge_backend_mock = {
+    .name       = "mock",
+    .open       = bridge_mock_open,
+    .close      = bridge_mock_close,
+    .send       = bridge_mock_send
+};
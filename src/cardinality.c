@@ -0,0 +1,266 @@
+#include "cardinality.h"
+#include "hll.h"
+#include "hash.h"
+#include "timer_wheel.h"
+#include "log.h"
+
+#include "packet/port.h"
+
+#include <string.h>
+#include <inttypes.h>
+#include <arpa/inet.h>
+
+#define CARDINALITY_TABLE_SIZE      1024                /**< tracked addresses per type, power of two */
+#define CARDINALITY_TABLE_BITS      10
+#define CARDINALITY_PROBE_MAX       8
+#define CARDINALITY_IDLE            60000000            /**< us without a response until an address expires */
+
+typedef struct _cardinality_entry_t {
+    uint32_t            addr;                           /**< IPv4 address (network byte order), zero if unused */
+    bool                alerted;                        /**< threshold crossed and logged */
+    uint64_t            last;                           /**< us of the last response */
+    hll_t               hll;
+    timer_event_t       timer;                          /**< idle expiry */
+} cardinality_entry_t;
+
+typedef struct _cardinality_table_t {
+    uint64_t            threshold;                      /**< distinct addresses to alert, 0 = disabled */
+    cardinality_entry_t entries[CARDINALITY_TABLE_SIZE];
+} cardinality_table_t;
+
+typedef struct _cardinality_t {
+    bool                enabled;
+    cardinality_table_t table[CARDINALITY_TYPE_SIZE];
+} cardinality_t;
+
+static cardinality_t cardinality;
+
+static const char *cardinality_name[CARDINALITY_TYPE_SIZE] = {
+    [CARDINALITY_VICTIM]        = "reflectors to victim",
+    [CARDINALITY_REFLECTOR]     = "victims of reflector"
+};
+
+static void             cardinality_expire  (timer_event_t *event, uint64_t now);
+
+bool
+cardinality_init(config_t *config)
+{
+    memset(&cardinality, 0, sizeof(cardinality));
+
+    if (config->cardinality_reflectors == 0 && config->cardinality_victims == 0) {
+        LOG_PRINTLN(LOG_CARDINALITY, LOG_INFO, ("distinct counting disabled"));
+        return true;
+    }
+
+    cardinality.enabled                                 = true;
+    cardinality.table[CARDINALITY_VICTIM].threshold     = config->cardinality_reflectors;
+    cardinality.table[CARDINALITY_REFLECTOR].threshold  = config->cardinality_victims;
+
+    LOG_PRINTLN(LOG_CARDINALITY, LOG_INFO, ("distinct counting enabled: reflectors=%" PRIu32 ", victims=%" PRIu32, config->cardinality_reflectors, config->cardinality_victims));
+
+    return true;
+}
+
+/**
+ * Finds an address, or takes a slot for it: a free one or else the one
+ * with the smallest sketch in the probe window. Only an eviction needs the
+ * estimates
+ */
+static cardinality_entry_t *
+cardinality_get(cardinality_table_t *table, uint32_t addr, bool insert)
+{
+    cardinality_entry_t    *entry;
+    cardinality_entry_t    *victim_entry = NULL;
+    uint64_t                estimate;
+    uint64_t                victim_estimate = UINT64_MAX;
+    uint32_t                idx;
+    uint32_t                i;
+
+    idx = (addr * 2654435761u) >> (32 - CARDINALITY_TABLE_BITS);
+
+    for (i = 0; i < CARDINALITY_PROBE_MAX; i++) {
+        entry = &(table->entries[(idx + i) & (CARDINALITY_TABLE_SIZE - 1)]);
+
+        if (entry->addr == addr) {
+            return entry;
+        }
+
+        if (entry->addr == 0 && victim_entry == NULL) {
+            victim_entry = entry;
+        }
+    }
+
+    if (!insert) {
+        return NULL;
+    }
+
+    /* the window is full */
+    if (victim_entry == NULL) {
+        for (i = 0; i < CARDINALITY_PROBE_MAX; i++) {
+            entry = &(table->entries[(idx + i) & (CARDINALITY_TABLE_SIZE - 1)]);
+
+            if ((estimate = hll_estimate(&(entry->hll))) < victim_estimate) {
+                victim_entry    = entry;
+                victim_estimate = estimate;
+            }
+        }
+    }
+
+    if (victim_entry->addr != 0) {
+        timer_wheel_cancel(&(victim_entry->timer));
+        hll_free(&(victim_entry->hll));
+    }
+
+    victim_entry->addr      = addr;
+    victim_entry->alerted   = false;
+
+    hll_init(&(victim_entry->hll));
+    timer_event_init(&(victim_entry->timer), cardinality_expire);
+
+    return victim_entry;
+}
+
+/**
+ * Adds a peer to the sketch of an address, and alerts once its distinct
+ * count crosses the threshold
+ */
+static void
+cardinality_update(cardinality_type_t type, uint32_t addr, uint32_t peer, uint64_t now)
+{
+    cardinality_table_t    *table = &(cardinality.table[type]);
+    cardinality_entry_t    *entry;
+    uint64_t                estimate;
+    struct in_addr          in_addr;
+
+    if (table->threshold == 0) {
+        return;
+    }
+
+    entry = cardinality_get(table, addr, true);
+
+    if (!timer_event_armed(&(entry->timer))) {
+        timer_wheel_arm(&(entry->timer), now + CARDINALITY_IDLE);
+    }
+
+    entry->last = now;
+
+    if (!hll_add(&(entry->hll), hash_mix64(peer ^ HASH_SEED)) || entry->alerted) {
+        return;
+    }
+
+    if ((estimate = hll_estimate(&(entry->hll))) < table->threshold) {
+        return;
+    }
+
+    entry->alerted  = true;
+    in_addr.s_addr  = addr;
+
+    LOG_PRINTLN(LOG_CARDINALITY, LOG_WARNING, ("%s %s: ~%" PRIu64 " distinct, ~%" PRIu64 " in its /24", cardinality_name[type],
+                                                                                                       inet_ntoa(in_addr),
+                                                                                                       estimate,
+                                                                                                       cardinality_prefix(type, addr, 24)));
+}
+
+/****************************************************************************
+ * cardinality_process
+ *
+ * Counts the distinct servers answering to a destination, and the
+ * distinct destinations a server answers to
+ *
+ * @param  packet                   decoded packet
+ * @param  raw_packet               raw packet (timestamp)
+ ***************************************************************************/
+void
+cardinality_process(packet_t *packet, raw_packet_t *raw_packet)
+{
+    ipv4_header_t  *ipv4;
+    udpv4_header_t *udpv4;
+    dns_header_t   *dns;
+    uint32_t        server;
+    uint32_t        client;
+
+    if (!cardinality.enabled) {
+        return;
+    }
+
+    ipv4    = (ipv4_header_t *)  packet_get_header(packet, PACKET_TYPE_IPV4);
+    udpv4   = (udpv4_header_t *) packet_get_header(packet, PACKET_TYPE_UDPV4);
+    dns     = (dns_header_t *)   packet_get_header(packet, PACKET_TYPE_DNS);
+
+    /* only responses of a DNS server */
+    if (ipv4 == NULL || udpv4 == NULL || dns == NULL || !dns->flags.qr || udpv4->src_port != PORT_DNS) {
+        return;
+    }
+
+    memcpy(&server, ipv4->src.addr,  IPV4_ADDRESS_LEN);
+    memcpy(&client, ipv4->dest.addr, IPV4_ADDRESS_LEN);
+
+    cardinality_update(CARDINALITY_VICTIM,    client, server, raw_packet->timestamp);
+    cardinality_update(CARDINALITY_REFLECTOR, server, client, raw_packet->timestamp);
+}
+
+/**
+ * Estimated distinct peers of an address, zero if it is not tracked
+ */
+uint64_t
+cardinality_estimate(cardinality_type_t type, uint32_t addr)
+{
+    cardinality_entry_t *entry;
+
+    if (addr == 0 || (entry = cardinality_get(&(cardinality.table[type]), addr, false)) == NULL) {
+        return 0;
+    }
+
+    return hll_estimate(&(entry->hll));
+}
+
+/****************************************************************************
+ * cardinality_prefix
+ *
+ * Estimates the distinct peers of all tracked addresses in a prefix: the
+ * union of their sketches (carpet bombing of a network)
+ *
+ * @param  type                     table
+ * @param  addr                     address in the prefix (network byte order)
+ * @param  prefix_len               prefix length
+ * @return                          estimated distinct peers
+ ***************************************************************************/
+uint64_t
+cardinality_prefix(cardinality_type_t type, uint32_t addr, uint8_t prefix_len)
+{
+    cardinality_table_t    *table = &(cardinality.table[type]);
+    uint8_t                 registers[HLL_REGISTERS] __attribute__((aligned(16)));
+    uint32_t                mask;
+    uint32_t                i;
+
+    mask = prefix_len == 0 ? 0 : htonl(UINT32_MAX << (32 - prefix_len));
+
+    memset(registers, 0, sizeof(registers));
+
+    for (i = 0; i < CARDINALITY_TABLE_SIZE; i++) {
+        if (table->entries[i].addr != 0 && (table->entries[i].addr & mask) == (addr & mask)) {
+            hll_merge(registers, &(table->entries[i].hll));
+        }
+    }
+
+    return hll_estimate_registers(registers);
+}
+
+/**
+ * Drops an address which has not received a response for a while
+ */
+static void
+cardinality_expire(timer_event_t *event, uint64_t now)
+{
+    cardinality_entry_t *entry = TIMER_EVENT_CONTAINER(event, cardinality_entry_t, timer);
+
+    if (now < entry->last + CARDINALITY_IDLE) {
+        timer_wheel_arm(event, entry->last + CARDINALITY_IDLE);
+        return;
+    }
+
+    hll_free(&(entry->hll));
+
+    entry->addr = 0;
+}
+
@@ -0,0 +1,484 @@
+#include "correlation.h"
+#include "hash.h"
+#include "timer_wheel.h"
+#include "log.h"
+
+#include "packet/port.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <arpa/inet.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+/**
+ * Open addressing hash table (Swiss table): the slots are grouped by 16,
+ * every slot has a control byte holding 7 bits of the hash (or EMPTY /
+ * DELETED). A group is probed with a single SIMD compare of its 16 control
+ * bytes, so only slots with a matching tag are compared by key. Groups are
+ * probed quadratically.
+ */
+#define CORRELATION_GROUP_SIZE          16
+#define CORRELATION_CTRL_EMPTY          ((int8_t) 0x80)     /**< -128 */
+#define CORRELATION_CTRL_DELETED        ((int8_t) 0xfe)     /**< -2 */
+#define CORRELATION_MAX_LOAD(capacity)  ((capacity) / 8 * 7)
+#define CORRELATION_MIN_CAPACITY        (CORRELATION_GROUP_SIZE * 4)
+
+typedef struct _correlation_entry_t {
+    correlation_key_t   key;
+    timer_event_t       timer;                          /**< expiry of the query */
+    uint16_t            query_len;                      /**< wire bytes of the query */
+} correlation_entry_t;
+
+typedef struct _correlation_t {
+    bool                    enabled;
+    uint64_t                timeout;                    /**< us */
+    uint32_t                capacity;                   /**< slots, power of two */
+    uint32_t                group_mask;                 /**< number of groups - 1 */
+    uint32_t                used;                       /**< full + deleted slots */
+    uint32_t                size;                       /**< full slots */
+    int8_t                 *ctrl;                       /**< control bytes, 16-byte aligned */
+    correlation_entry_t    *entries;
+
+    /* statistics */
+    uint64_t                queries;
+    uint64_t                matched;
+    uint64_t                unsolicited;
+    uint64_t                expired;                    /**< queries without response */
+    uint64_t                dropped;                    /**< table full */
+} correlation_t;
+
+static correlation_t correlation;
+
+static void *
+correlation_alloc(size_t alignment, size_t size)
+{
+    void *ptr;
+
+    if (posix_memalign(&ptr, alignment, size) != 0) {
+        return NULL;
+    }
+
+    return ptr;
+}
+
+/*****************************************************************************
+ * Group probing
+ */
+typedef uint32_t correlation_mask_t;                    /**< bit i: slot i of the group */
+
+#ifdef __SSE2__
+
+static inline correlation_mask_t
+correlation_group_match(const int8_t *ctrl, int8_t tag)
+{
+    __m128i group = _mm_load_si128((const __m128i *) ctrl);
+
+    return _mm_movemask_epi8(_mm_cmpeq_epi8(group, _mm_set1_epi8(tag)));
+}
+
+static inline correlation_mask_t
+correlation_group_match_free(const int8_t *ctrl)
+{
+    /* EMPTY and DELETED are the only negative values, FULL is 0..127 */
+    return _mm_movemask_epi8(_mm_load_si128((const __m128i *) ctrl));
+}
+
+#else
+
+/* SWAR: two 64-bit words per group */
+static inline correlation_mask_t
+correlation_swar_match(uint64_t word, int8_t tag)
+{
+    const uint64_t  lsbs = UINT64_C(0x0101010101010101);
+    const uint64_t  msbs = UINT64_C(0x8080808080808080);
+    uint64_t        x    = word ^ (lsbs * (uint8_t) tag);
+    uint64_t        hits = ~((((x & ~msbs) + ~msbs) | x) | ~msbs);     /**< exact: MSB set where byte == 0 */
+    correlation_mask_t mask = 0;
+    uint32_t        i;
+
+    for (i = 0; i < 8; i++) {
+        mask |= ((hits >> (i * 8 + 7)) & 1) << i;
+    }
+
+    return mask;
+}
+
+static inline correlation_mask_t
+correlation_group_match(const int8_t *ctrl, int8_t tag)
+{
+    uint64_t        word[2];
+
+    memcpy(word, ctrl, sizeof(word));
+
+    return correlation_swar_match(word[0], tag) | (correlation_swar_match(word[1], tag) << 8);
+}
+
+static inline correlation_mask_t
+correlation_group_match_free(const int8_t *ctrl)
+{
+    correlation_mask_t  mask = 0;
+    uint32_t            i;
+
+    for (i = 0; i < CORRELATION_GROUP_SIZE; i++) {
+        mask |= (correlation_mask_t) (ctrl[i] < 0) << i;
+    }
+
+    return mask;
+}
+
+#endif
+
+static inline uint64_t
+correlation_hash(const correlation_key_t *key)
+{
+    uint64_t hash;
+
+    hash = hash_mix64(((uint64_t) key->client_addr << 32) | key->server_addr);
+    hash = hash_combine(hash, ((uint64_t) key->client_port << 48) | ((uint64_t) key->id << 32) | key->qname_hash);
+
+    return hash;
+}
+
+static inline bool
+correlation_key_equal(const correlation_key_t *a, const correlation_key_t *b)
+{
+    return a->client_addr == b->client_addr && a->server_addr == b->server_addr &&
+           a->client_port == b->client_port && a->id          == b->id          &&
+           a->qname_hash  == b->qname_hash;
+}
+
+static inline void
+correlation_slot_free(uint32_t slot)
+{
+    const int8_t *group = &(correlation.ctrl[slot & ~(CORRELATION_GROUP_SIZE - 1)]);
+
+    /* a group with an empty slot never continued a probe sequence, so the slot can become empty again */
+    if (correlation_group_match(group, CORRELATION_CTRL_EMPTY) != 0) {
+        correlation.ctrl[slot] = CORRELATION_CTRL_EMPTY;
+        correlation.used--;
+    } else {
+        correlation.ctrl[slot] = CORRELATION_CTRL_DELETED;
+    }
+
+    correlation.size--;
+}
+
+/**
+ * Returns the slot of a key or -1
+ */
+static int64_t
+correlation_find(const correlation_key_t *key, uint64_t hash)
+{
+    const int8_t        tag = hash & 0x7f;
+    uint32_t            group;
+    uint32_t            step;
+    uint32_t            slot;
+    correlation_mask_t  mask;
+
+    group = (hash >> 7) & correlation.group_mask;
+
+    for (step = 0; step <= correlation.group_mask; step++) {
+        mask = correlation_group_match(&(correlation.ctrl[group * CORRELATION_GROUP_SIZE]), tag);
+
+        while (mask != 0) {
+            slot = group * CORRELATION_GROUP_SIZE + __builtin_ctz(mask);
+
+            if (correlation_key_equal(&(correlation.entries[slot].key), key)) {
+                return slot;
+            }
+
+            mask &= mask - 1;
+        }
+
+        /* an empty slot ends the probe sequence */
+        if (correlation_group_match(&(correlation.ctrl[group * CORRELATION_GROUP_SIZE]), CORRELATION_CTRL_EMPTY) != 0) {
+            return -1;
+        }
+
+        group = (group + step + 1) & correlation.group_mask;
+    }
+
+    return -1;
+}
+
+/**
+ * Rebuilds the table without deleted entries, the timers move with the entries
+ */
+static void
+correlation_rehash(void)
+{
+    int8_t                 *old_ctrl    = correlation.ctrl;
+    correlation_entry_t    *old_entries = correlation.entries;
+    uint64_t                hash;
+    uint32_t                group;
+    uint32_t                step;
+    uint32_t                slot;
+    uint32_t                i;
+
+    correlation.ctrl    = correlation_alloc(CORRELATION_GROUP_SIZE, correlation.capacity);
+    correlation.entries = correlation_alloc(64, (size_t) correlation.capacity * sizeof(correlation_entry_t));
+
+    if (correlation.ctrl == NULL || correlation.entries == NULL) {
+        LOG_PRINTLN(LOG_CORRELATION, LOG_ERROR, ("could not rehash correlation table"));
+        free(correlation.ctrl);
+        free(correlation.entries);
+        correlation.ctrl    = old_ctrl;
+        correlation.entries = old_entries;
+        return;
+    }
+
+    memset(correlation.ctrl, CORRELATION_CTRL_EMPTY, correlation.capacity);
+    correlation.used = 0;
+    correlation.size = 0;
+
+    for (i = 0; i < correlation.capacity; i++) {
+        if (old_ctrl[i] < 0) {
+            continue;
+        }
+
+        hash  = correlation_hash(&(old_entries[i].key));
+        group = (hash >> 7) & correlation.group_mask;
+
+        /* no deleted slots in the new table: the first free slot is empty */
+        for (step = 0; correlation_group_match_free(&(correlation.ctrl[group * CORRELATION_GROUP_SIZE])) == 0; step++) {
+            group = (group + step + 1) & correlation.group_mask;
+        }
+
+        slot = group * CORRELATION_GROUP_SIZE + __builtin_ctz(correlation_group_match_free(&(correlation.ctrl[group * CORRELATION_GROUP_SIZE])));
+
+        correlation.ctrl[slot]                  = hash & 0x7f;
+        correlation.entries[slot].key           = old_entries[i].key;
+        correlation.entries[slot].query_len     = old_entries[i].query_len;
+        timer_wheel_move(&(correlation.entries[slot].timer), &(old_entries[i].timer));
+        correlation.used++;
+        correlation.size++;
+    }
+
+    free(old_ctrl);
+    free(old_entries);
+
+    LOG_PRINTLN(LOG_CORRELATION, LOG_DEBUG, ("rehashed correlation table: size=%" PRIu32 "/%" PRIu32, correlation.size, correlation.capacity));
+}
+
+/**
+ * A query has not been answered in time
+ */
+static void
+correlation_expire(timer_event_t *event, uint64_t now)
+{
+    correlation_entry_t *entry = TIMER_EVENT_CONTAINER(event, correlation_entry_t, timer);
+
+    correlation_slot_free(entry - correlation.entries);
+    correlation.expired++;
+}
+
+bool
+correlation_init(config_t *config)
+{
+    uint32_t capacity;
+
+    memset(&correlation, 0, sizeof(correlation));
+
+    if (config->correlation_size == 0) {
+        LOG_PRINTLN(LOG_CORRELATION, LOG_INFO, ("query/response correlation disabled"));
+        return true;
+    }
+
+    /* power of two, sized for the maximum load */
+    for (capacity = CORRELATION_MIN_CAPACITY; CORRELATION_MAX_LOAD(capacity) < config->correlation_size; capacity <<= 1);
+
+    correlation.ctrl    = correlation_alloc(CORRELATION_GROUP_SIZE, capacity);
+    correlation.entries = correlation_alloc(64, (size_t) capacity * sizeof(correlation_entry_t));
+
+    if (correlation.ctrl == NULL || correlation.entries == NULL) {
+        LOG_PRINTLN(LOG_CORRELATION, LOG_ERROR, ("could not allocate correlation table (capacity=%" PRIu32 ")", capacity));
+        free(correlation.ctrl);
+        free(correlation.entries);
+        return false;
+    }
+
+    memset(correlation.ctrl, CORRELATION_CTRL_EMPTY, capacity);
+
+    correlation.enabled     = true;
+    correlation.capacity    = capacity;
+    correlation.group_mask  = capacity / CORRELATION_GROUP_SIZE - 1;
+    correlation.timeout     = (uint64_t) config->correlation_timeout * 1000;
+
+    LOG_PRINTLN(LOG_CORRELATION, LOG_INFO, ("query/response correlation enabled: capacity=%" PRIu32 ", timeout=%" PRIu32 "ms", capacity, config->correlation_timeout));
+
+    return true;
+}
+
+/****************************************************************************
+ * correlation_insert
+ *
+ * Inserts an outstanding query, a retransmission only refreshes the expiry
+ * and the size
+ *
+ * @return                          false if the table is full
+ ***************************************************************************/
+bool
+correlation_insert(const correlation_key_t *key, uint16_t query_len, uint64_t now)
+{
+    uint64_t            hash = correlation_hash(key);
+    int64_t             found;
+    uint32_t            group;
+    uint32_t            step;
+    uint32_t            slot;
+    correlation_mask_t  mask;
+
+    if ((found = correlation_find(key, hash)) >= 0) {
+        correlation.entries[found].query_len = query_len;
+        timer_wheel_arm(&(correlation.entries[found].timer), now + correlation.timeout);
+        return true;
+    }
+
+    /* too many tombstones: rebuild, if it's still too full, drop */
+    if (correlation.used >= CORRELATION_MAX_LOAD(correlation.capacity)) {
+        correlation_rehash();
+
+        if (correlation.used >= CORRELATION_MAX_LOAD(correlation.capacity)) {
+            correlation.dropped++;
+            return false;
+        }
+    }
+
+    group = (hash >> 7) & correlation.group_mask;
+
+    for (step = 0; step <= correlation.group_mask; step++) {
+        mask = correlation_group_match_free(&(correlation.ctrl[group * CORRELATION_GROUP_SIZE]));
+
+        if (mask != 0) {
+            slot = group * CORRELATION_GROUP_SIZE + __builtin_ctz(mask);
+
+            if (correlation.ctrl[slot] == CORRELATION_CTRL_EMPTY) {
+                correlation.used++;
+            }
+
+            correlation.ctrl[slot]              = hash & 0x7f;
+            correlation.entries[slot].key       = *key;
+            correlation.entries[slot].query_len = query_len;
+            correlation.size++;
+
+            timer_event_init(&(correlation.entries[slot].timer), correlation_expire);
+            timer_wheel_arm(&(correlation.entries[slot].timer), now + correlation.timeout);
+
+            return true;
+        }
+
+        group = (group + step + 1) & correlation.group_mask;
+    }
+
+    correlation.dropped++;
+
+    return false;
+}
+
+/****************************************************************************
+ * correlation_match
+ *
+ * Matches a response against the outstanding queries, a match is deleted
+ *
+ * @param  key                      key of the response
+ * @param  query_len                wire bytes of the matched query
+ * @return                          true if the query was found
+ ***************************************************************************/
+bool
+correlation_match(const correlation_key_t *key, uint16_t *query_len)
+{
+    int64_t slot = correlation_find(key, correlation_hash(key));
+
+    if (slot < 0) {
+        return false;
+    }
+
+    *query_len = correlation.entries[slot].query_len;
+
+    timer_wheel_cancel(&(correlation.entries[slot].timer));
+    correlation_slot_free(slot);
+
+    return true;
+}
+
+/****************************************************************************
+ * correlation_process
+ *
+ * Queries are inserted, responses are matched. A response which does not
+ * match an outstanding query was never asked for by the client. Every
+ * response is accounted against its query for the amplification
+ *
+ * @param  packet                   decoded packet
+ * @param  raw_packet               raw packet (timestamp)
+ * @param  sample                   sizes and amplification of a response
+ * @return                          classification of the packet
+ ***************************************************************************/
+correlation_result_t
+correlation_process(packet_t *packet, raw_packet_t *raw_packet, amplification_sample_t *sample)
+{
+    ipv4_header_t          *ipv4;
+    udpv4_header_t         *udpv4;
+    dns_header_t           *dns;
+    correlation_key_t       key;
+    correlation_result_t    result;
+    uint16_t                query_len = 0;
+    struct in_addr          addr;
+
+    amplification_sample_init(sample);
+
+    ipv4    = (ipv4_header_t *)  packet_get_header(packet, PACKET_TYPE_IPV4);
+    udpv4   = (udpv4_header_t *) packet_get_header(packet, PACKET_TYPE_UDPV4);
+    dns     = (dns_header_t *)   packet_get_header(packet, PACKET_TYPE_DNS);
+
+    if (ipv4 == NULL || udpv4 == NULL || dns == NULL || dns->qd == NULL) {
+        return CORRELATION_IGNORED;
+    }
+
+    /* without correlation every response is accounted against its echoed question */
+    if (!correlation.enabled) {
+        if (dns->flags.qr) {
+            amplification_process(packet, raw_packet, 0, sample);
+        }
+
+        return CORRELATION_IGNORED;
+    }
+
+    key.id          = dns->id;
+    key.qname_hash  = dns_label_hash(dns->qd->qname) ^ ((uint32_t) dns->qd->qtype << 16 | dns->qd->qclass);
+
+    /* query: client -> server */
+    if (!dns->flags.qr) {
+        memcpy(&(key.client_addr), ipv4->src.addr,  IPV4_ADDRESS_LEN);
+        memcpy(&(key.server_addr), ipv4->dest.addr, IPV4_ADDRESS_LEN);
+        key.client_port = udpv4->src_port;
+
+        correlation.queries++;
+        correlation_insert(&key, ipv4->len, raw_packet->timestamp);
+
+        return CORRELATION_QUERY;
+    }
+
+    /* response: server -> client */
+    memcpy(&(key.client_addr), ipv4->dest.addr, IPV4_ADDRESS_LEN);
+    memcpy(&(key.server_addr), ipv4->src.addr,  IPV4_ADDRESS_LEN);
+    key.client_port = udpv4->dest_port;
+
+    if (correlation_match(&key, &query_len)) {
+        correlation.matched++;
+        result = CORRELATION_MATCHED;
+    } else {
+        correlation.unsolicited++;
+        result = CORRELATION_UNSOLICITED;
+
+        addr.s_addr = key.server_addr;
+        LOG_PRINTLN(LOG_CORRELATION, LOG_WARNING, ("unsolicited response: id=0x%04" PRIx16 ", reflector=%s, len=%u", dns->id, inet_ntoa(addr), raw_packet->len));
+    }
+
+    amplification_process(packet, raw_packet, query_len, sample);
+
+    return result;
+}
+
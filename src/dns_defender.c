@@ -3,23 +3,46 @@
 #include "log.h"
 #include "log_network.h"
 #include "bpf.h"
-#include "pf.h"
+#include "bridge.h"
+#include "firewall.h"
+#include "block.h"
+#include "slip.h"
+#include "rrl.h"
+#include "amplification.h"
+#include "correlation.h"
+#include "victim.h"
+#include "heavy_hitter.h"
+#include "cardinality.h"
+#include "verdict.h"
+#include "policy.h"
+#include "lpm.h"
+#include "timer_wheel.h"
 
 #include "packet/packet.h"
 
 #include <signal.h>
+#include <poll.h>
+#include <sys/time.h>
 #include <errno.h>
+#include <string.h>
 
 typedef struct _dns_defender_t {
     bool                    running;
+    volatile sig_atomic_t   reload;                 /**< SIGHUP: reload the policies between two capture batches */
     int                     bpf;
     unsigned int            bpf_buf_len;
+    int                     bpf_bridge;             /**< inline: capture device of bridge_ifname, -1 if monitoring only */
+    unsigned int            bpf_bridge_buf_len;
+    unsigned int            timeout;                /**< s without a frame until time goes on */
     netif_t                 netif;
+    verdict_cache_t         verdict;
 } dns_defender_t;
 
 static dns_defender_t dns_defender;
 
 static void dns_defender_int_signal(int signo);
+static void dns_defender_hup_signal(int signo);
+static bool dns_defender_process(raw_packet_t *raw_packet);
 
 bool
 dns_defender_init(config_t *config)
@@ -29,38 +52,104 @@ dns_defender_init(config_t *config)
         return false;
     }
     
+    if (signal(SIGHUP, dns_defender_hup_signal) == SIG_ERR) {
+        return false;
+    }
+    
     /* init log */
     log_init();
     
     /* open BPF device */
+    dns_defender.bpf        = -1;
+    dns_defender.bpf_bridge = -1;
+    dns_defender.timeout    = config->timeout;
     /*
-    dns_defender.bpf = bpf_open(config->ifname, config->timeout, &(dns_defender.bpf_buf_len));
+    dns_defender.bpf = bpf_open(config->ifname, config->timeout, &(dns_defender.bpf_buf_len), config->bridge_ifname != NULL);
     if (dns_defender.bpf == -1) {
         return false;
     }
+    
+    // inline: the other port is captured as well
+    if (config->bridge_ifname != NULL) {
+        dns_defender.bpf_bridge = bpf_open(config->bridge_ifname, config->timeout, &(dns_defender.bpf_bridge_buf_len), true);
+        if (dns_defender.bpf_bridge == -1) {
+            return false;
+        }
+    }
     */
     dns_defender.running = true;
     
     //ipv4_address_t ipv4_address = { { .addr = { 192, 168, 0, 123 } } };
     
-    //pf_add_ipv4_address((struct in_addr *) &ipv4_address);
-    //pf_remove_ipv4_address((struct in_addr *) &ipv4_address);
+    //pf_add_ipv4_address(PF_TABLE_BLOCK, (struct in_addr *) &ipv4_address);
+    //pf_remove_ipv4_address(PF_TABLE_BLOCK, (struct in_addr *) &ipv4_address);
     
+#ifdef __FreeBSD__
     if (!netif_init(&dns_defender.netif, config->ifname)) {
         return false;
     }
+#else
+    /* no link layer addresses to read without if_dl: the interface is known by name only */
+    memset(&dns_defender.netif, 0, sizeof(netif_t));
+    strncpy(dns_defender.netif.name, config->ifname, NETIF_NAME_SIZE - 1);
+#endif
+    
+    verdict_cache_init(&dns_defender.verdict);
+    
+    if (!firewall_init(config)) {
+        return false;
+    }
+    
+    if (!block_init(config)) {
+        return false;
+    }
+    
+    if (!bridge_init(config)) {
+        return false;
+    }
+    
+    if (!slip_init(config, dns_defender.bpf)) {
+        return false;
+    }
+    
+    if (!rrl_init(config)) {
+        return false;
+    }
+    
+    if (!amplification_init()) {
+        return false;
+    }
+    
+    if (!correlation_init(config)) {
+        return false;
+    }
+    
+    if (!victim_init(config)) {
+        return false;
+    }
+    
+    if (!heavy_hitter_init(config)) {
+        return false;
+    }
+    
+    if (!cardinality_init(config)) {
+        return false;
+    }
+    
+    if (!policy_init(config)) {
+        return false;
+    }
+    
+    if (!lpm_init(config)) {
+        return false;
+    }
     
     return true;
 }
 
-struct test_packet {
-    uint8_t  data[2500];
-    uint16_t size;
-};
-
 raw_packet_t test_packet[] = {
     [0] = {
-        .data = { 
+        .data = (uint8_t []) {
             0x00, 0x15, 0x17, 0x0e, 0x61, 0xa2, 0x00, 0x03,
             0x6c, 0xb3, 0x54, 0x1b, 0x08, 0x00, 0x45, 0x00,
             0x00, 0x38, 0x62, 0x25, 0x00, 0x00, 0xf2, 0x11,
@@ -71,10 +160,12 @@ raw_packet_t test_packet[] = {
             0xff, 0x00, 0x01, 0x00, 0x00, 0x29, 0x23, 0x28,
             0x00, 0x00, 0x00, 0x00, 0x00, 0x00
         },
-        .len = 70
+        .len   = 70,
+        .size  = 70,
+        .klass = RAW_PACKET_CLASS_EXTERNAL
     },
     [1] = {
-        .data = { 
+        .data = (uint8_t []) {
   /*  0 */  0x00, 0x03, 0x6c, 0xb3, 0x54, 0x1b, 0x00, 0x15, /*  7 */
   /*  8 */  0x17, 0x0e, 0x61, 0xa2, 0x08, 0x00, 0x45, 0x00, /* 15 */
   /* 16 */  0x00, 0x42, 0xc4, 0xf8, 0x00, 0x00, 0x40, 0x11, /* 23 */
@@ -86,10 +177,12 @@ raw_packet_t test_packet[] = {
   /* 64 */  0x00, 0x00, 0x0f, 0x00, 0x01, 0x00, 0x00, 0x29, /* 71 */
   /* 72 */  0x10, 0x00, 0x00, 0x00, 0x80, 0x00, 0x00, 0x00  /* 79 */
         },
-        .len = 80
+        .len   = 80,
+        .size  = 80,
+        .klass = RAW_PACKET_CLASS_EXTERNAL
     },
     [2] = {
-        .data = {
+        .data = (uint8_t []) {
    /*       eth.dst == 00:15:17:0e:61:a2 && ip.dst == 195.134.157.20 */
    /*       ip.src == 160.85.104.61 && ip.dst == 195.134.157.20 */
   /*  0 */  0x00, 0x15, 0x17, 0x0e, 0x61, 0xa2, 0x00, 0x03, /*  7 */
@@ -114,10 +207,12 @@ raw_packet_t test_packet[] = {
   /*152 */  0x00, 0x29, 0x10, 0x00, 0x00, 0x00, 0x00, 0x00, /*159 */
   /*160 */  0x00, 0x00
         },
-        .len = 162
+        .len   = 162,
+        .size  = 162,
+        .klass = RAW_PACKET_CLASS_EXTERNAL
     },
     [3] = {
-        .data = { 
+        .data = (uint8_t []) {
             0x00, 0x15, 0x17, 0x0e, 0x61, 0xa2, 0x00, 0x03,
             0x6c, 0xb3, 0x54, 0x1b, 0x08, 0x00, 0x45, 0x00,
             0x01, 0x70, 0xa8, 0xcd, 0x00, 0x00, 0x39, 0x11,
@@ -167,35 +262,216 @@ raw_packet_t test_packet[] = {
             0xdf, 0xbc, 0x04, 0x00, 0x00, 0x29, 0x10, 0x00,
             0x00, 0x00, 0x80, 0x00, 0x00, 0x00
         },
-        .len = 382
+        .len   = 382,
+        .size  = 382,
+        .klass = RAW_PACKET_CLASS_EXTERNAL
+    },
+    [4] = {
+        .data = (uint8_t []) {
+   /*       VXLAN (vni 5001) from 10.0.0.1, inner frame = [1] */
+            0x00, 0x1b, 0x21, 0x0a, 0x0b, 0x0c, 0x00, 0x1b,
+            0x21, 0x01, 0x02, 0x03, 0x08, 0x00, 0x45, 0x00,
+            0x00, 0x74, 0x12, 0x34, 0x00, 0x00, 0x40, 0x11,
+            0x54, 0x43, 0x0a, 0x00, 0x00, 0x01, 0x0a, 0x00,
+            0x00, 0x02, 0xc0, 0x00, 0x12, 0xb5, 0x00, 0x60,
+            0x00, 0x00, 0x08, 0x00, 0x00, 0x00, 0x00, 0x13,
+            0x89, 0x00, 0x00, 0x03, 0x6c, 0xb3, 0x54, 0x1b,
+            0x00, 0x15, 0x17, 0x0e, 0x61, 0xa2, 0x08, 0x00,
+            0x45, 0x00, 0x00, 0x42, 0xc4, 0xf8, 0x00, 0x00,
+            0x40, 0x11, 0xfd, 0x4f, 0xc3, 0x86, 0x9d, 0x14,
+            0xc3, 0xa0, 0x94, 0x27, 0x00, 0x35, 0x79, 0x8c,
+            0x00, 0x2e, 0xd6, 0xa2, 0xff, 0xd7, 0x80, 0x05,
+            0x00, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x01,
+            0x05, 0x79, 0x38, 0x33, 0x30, 0x33, 0x03, 0x6e,
+            0x65, 0x74, 0x00, 0x00, 0x0f, 0x00, 0x01, 0x00,
+            0x00, 0x29, 0x10, 0x00, 0x00, 0x00, 0x80, 0x00,
+            0x00, 0x00
+        },
+        .len   = 130,
+        .size  = 130,
+        .klass = RAW_PACKET_CLASS_EXTERNAL
+    },
+    [5] = {
+        .data = (uint8_t []) {
+   /*       GRE + ERSPAN type II (session 42) from 10.0.0.3, inner frame = [1] */
+            0x00, 0x1b, 0x21, 0x0a, 0x0b, 0x0c, 0x00, 0x1b,
+            0x21, 0x01, 0x02, 0x03, 0x08, 0x00, 0x45, 0x00,
+            0x00, 0x74, 0x12, 0x34, 0x00, 0x00, 0x40, 0x2f,
+            0x54, 0x23, 0x0a, 0x00, 0x00, 0x03, 0x0a, 0x00,
+            0x00, 0x02, 0x10, 0x00, 0x88, 0xbe, 0x00, 0x00,
+            0x00, 0x07, 0x10, 0x64, 0x18, 0x2a, 0x00, 0x00,
+            0x00, 0x05, 0x00, 0x03, 0x6c, 0xb3, 0x54, 0x1b,
+            0x00, 0x15, 0x17, 0x0e, 0x61, 0xa2, 0x08, 0x00,
+            0x45, 0x00, 0x00, 0x42, 0xc4, 0xf8, 0x00, 0x00,
+            0x40, 0x11, 0xfd, 0x4f, 0xc3, 0x86, 0x9d, 0x14,
+            0xc3, 0xa0, 0x94, 0x27, 0x00, 0x35, 0x79, 0x8c,
+            0x00, 0x2e, 0xd6, 0xa2, 0xff, 0xd7, 0x80, 0x05,
+            0x00, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x01,
+            0x05, 0x79, 0x38, 0x33, 0x30, 0x33, 0x03, 0x6e,
+            0x65, 0x74, 0x00, 0x00, 0x0f, 0x00, 0x01, 0x00,
+            0x00, 0x29, 0x10, 0x00, 0x00, 0x00, 0x80, 0x00,
+            0x00, 0x00
+        },
+        .len   = 130,
+        .size  = 130,
+        .klass = RAW_PACKET_CLASS_EXTERNAL
     }
 };
 
+/**
+ * Decodes a packet and runs the detection, unless its flow has a cached
+ * verdict. The verdict of the flow is updated from the detection
+ *
+ * @return                  false if the packet is attack traffic (inline: dropped)
+ */
+static bool
+dns_defender_process(raw_packet_t *raw_packet)
+{
+    packet_t                   *packet;
+    amplification_sample_t      sample;
+    verdict_flow_t              flow;
+    verdict_t                   verdict;
+    uint32_t                    weight;
+    rrl_action_t                action = RRL_ACTION_PASS;
+    policy_action_t             policy;
+    bool                        victim;
+    bool                        slipped = false;
+    
+    if (verdict_lookup(&dns_defender.verdict, raw_packet, &flow, &weight, &verdict)) {
+        return verdict != VERDICT_DROP;
+    }
+    
+    packet = packet_decode(&dns_defender.netif, raw_packet);
+    packet->weight = weight;
+    log_packet(packet);
+    policy = policy_process(packet);
+    if (policy != POLICY_ALLOW) {
+        slipped = slip_process(packet, raw_packet);
+        action  = rrl_process(packet, raw_packet, policy == POLICY_SUSPECT);
+    }
+    correlation_process(packet, raw_packet, &sample);
+    victim = victim_process(packet, raw_packet, &sample);
+    heavy_hitter_process(packet, raw_packet, &sample);
+    cardinality_process(packet, raw_packet);
+    
+    verdict_store(&dns_defender.verdict, &flow, verdict_classify(packet, action != RRL_ACTION_PASS, victim));
+    object_release(packet);
+    
+    /* a slipped query has been answered with TC=1, a limited response is what pf would block */
+    return !slipped && action == RRL_ACTION_PASS;
+}
+
+/****************************************************************************
+ * dns_defender_frame
+ *
+ * Inspects a captured frame and, inline, forwards it to the other port
+ * unless it is attack traffic
+ *
+ * @param  raw_packet               frame
+ * @param  port                     port the frame was captured on
+ ***************************************************************************/
+void
+dns_defender_frame(raw_packet_t *raw_packet, bridge_port_t port)
+{
+    bool forward = true;
+    
+    LOG_RAW_PACKET(LOG_DNS_DEFENDER, LOG_INFO, raw_packet, ("RX"));
+    
+#ifdef __FreeBSD__
+    /* a bridged device captures every frame, only those of the capture filter are inspected */
+    if (!bridge_enabled() || bpf_match(raw_packet)) {
+        forward = dns_defender_process(raw_packet);
+    }
+#else
+    forward = dns_defender_process(raw_packet);
+#endif
+    
+    if (forward) {
+        bridge_forward(raw_packet, port);
+    } else {
+        bridge_drop(raw_packet, port);
+    }
+}
+
 int
 dns_defender_mainloop(void)
 {
-    packet_t       *packet;
-    //raw_packet_t    raw_packet;
+    //raw_packet_t               *raw_packet;
+    //raw_packet_t               *next;
+    //uint64_t                    now;
+    //struct timeval              tv;
+    //bool                        received;
+    //uint32_t                    port;
+    //uint32_t                    ports = bridge_enabled() ? BRIDGE_PORT_SIZE : 1;
+    //struct pollfd               fds[BRIDGE_PORT_SIZE] = {
+    //    [BRIDGE_PORT_A] = { .fd = dns_defender.bpf,        .events = POLLIN },
+    //    [BRIDGE_PORT_B] = { .fd = dns_defender.bpf_bridge, .events = POLLIN }
+    //};
+    //unsigned int                buf_len[BRIDGE_PORT_SIZE] = { dns_defender.bpf_buf_len, dns_defender.bpf_bridge_buf_len };
     
     /*
+    // timers armed by the first batch are relative to now, not to their own expiry
+    gettimeofday(&tv, NULL);
+    timer_wheel_start((uint64_t) tv.tv_sec * 1000000 + tv.tv_usec);
+    
     while (dns_defender.running) {
-        if (bpf_read(dns_defender.bpf, &raw_packet, dns_defender.bpf_buf_len)) {
-            LOG_RAW_PACKET(LOG_DNS_DEFENDER, LOG_INFO, &raw_packet, ("RX"));
-            
-            packet = packet_decode(&dns_defender.netif, &raw_packet);
-            log_packet(packet);
-            object_release(packet);
+        received = false;
+        
+        // inline: both ports are captured, a frame is forwarded to the other one
+        if (poll(fds, ports, dns_defender.timeout * 1000) > 0) {
+            for (port = 0; port < ports; port++) {
+                if ((fds[port].revents & POLLIN) == 0 || (raw_packet = bpf_read(fds[port].fd, buf_len[port])) == NULL) {
+                    continue;
+                }
+                
+                for (; raw_packet != NULL; raw_packet = next) {
+                    dns_defender_frame(raw_packet, port);
+                    
+                    now      = raw_packet->timestamp;
+                    next     = raw_packet->next;
+                    received = true;
+                    object_release(raw_packet);
+                }
+            }
+        }
+        
+        // read timeout: time goes on without packets
+        if (!received) {
+            gettimeofday(&tv, NULL);
+            now = (uint64_t) tv.tv_sec * 1000000 + tv.tv_usec;
+        }
+        
+        // inline: the forwarded frames of the capture batch are sent at once
+        bridge_flush();
+        
+        // expire state once per capture batch
+        timer_wheel_advance(now);
+        
+        // quiescent point: no lookup holds the prefix tables
+        lpm_publish();
+        
+        if (dns_defender.reload) {
+            dns_defender.reload = false;
+            policy_reload();
+            lpm_reload();
         }
     }
+    
+    bridge_stop();
+    firewall_stop();
     */
     
-    for (int i = 0; i < 4; i++) {
-        LOG_RAW_PACKET(LOG_DNS_DEFENDER, LOG_INFO, &test_packet[i], ("RX"));
-        packet = packet_decode(&dns_defender.netif, &test_packet[i]);
-        log_packet(packet);
-        object_release(packet);
+    timer_wheel_start(test_packet[0].timestamp);
+    
+    for (int i = 0; i < sizeof(test_packet) / sizeof(test_packet[0]); i++) {
+        dns_defender_frame(&test_packet[i], BRIDGE_PORT_A);
     }
     
+    bridge_flush();
+    timer_wheel_advance(test_packet[sizeof(test_packet) / sizeof(test_packet[0]) - 1].timestamp);
+    bridge_stop();
+    firewall_stop();
+    
     return 0;
 }
 
@@ -205,3 +481,9 @@ dns_defender_int_signal(int signo)
     LOG_PRINTLN(LOG_DNS_DEFENDER, LOG_INFO, ("\nCaught INT signal. Exit!"));
     dns_defender.running = false;
 }
+
+static void
+dns_defender_hup_signal(int signo)
+{
+    dns_defender.reload = true;
+}
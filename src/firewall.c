@@ -0,0 +1,484 @@
+#include "firewall.h"
+#include "aggregate.h"
+#include "blocklist.h"
+#include "lpm.h"
+#include "log.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <time.h>
+#include <pthread.h>
+
+#define FIREWALL_POLL               1000000             /**< ns the worker sleeps on an empty queue */
+#define FIREWALL_REPORT_INTERVAL    10000000            /**< us between two statistics reports */
+
+typedef struct _firewall_item_t {
+    uint8_t             table;                          /**< firewall_table_t */
+    uint8_t             action;                         /**< firewall_action_t */
+    prefix_t            prefix;
+    uint64_t            posted;                         /**< us, monotonic */
+    uint64_t            allowed[AGGREGATE_BITMAP_WORDS];    /**< aggregated adds and /24 pins: allowlisted addresses of the /24 (IPv4),
+                                                                 AGGREGATE_ALLOWED_* in the first word (IPv6) */
+} firewall_item_t;
+
+/**
+ * Cell of the bounded MPSC queue: a producer owns the cell at position pos
+ * when seq == pos, the consumer when seq == pos + 1
+ */
+typedef struct _firewall_cell_t {
+    uint64_t            seq;
+    firewall_item_t     item;
+} firewall_cell_t;
+
+typedef struct _firewall_t {
+    bool                running;
+    pthread_t           worker;
+    uint64_t            interval;                       /**< us between two flushes */
+    uint64_t            sync;                           /**< us between two reconciliations, 0 = never */
+    firewall_cell_t    *cells;
+    uint64_t            mask;
+    uint64_t            tail __attribute__((aligned(64)));  /**< producers */
+    uint64_t            head __attribute__((aligned(64)));  /**< consumer */
+    firewall_stats_t    stats;
+    const firewall_backend_t   *backend;
+    const char         *tables[FIREWALL_TABLE_SIZE];    /**< names in the backend */
+    prefix_set_t        desired[FIREWALL_TABLE_SIZE];   /**< content the tables should have (worker) */
+    prefix_t           *sorted;                         /**< scratch for a sync */
+} firewall_t;
+
+static firewall_t firewall;
+
+static void            *firewall_worker     (void *arg);
+
+static uint64_t
+firewall_now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (uint64_t) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+bool
+firewall_init(config_t *config)
+{
+    uint64_t    size;
+    uint64_t    i;
+    int         err;
+
+    memset(&firewall, 0, sizeof(firewall));
+
+    if (!aggregate_init(config) || !blocklist_init(config)) {
+        return false;
+    }
+
+    firewall.tables[FIREWALL_TABLE_BLOCK]   = config->firewall_block_table;
+    firewall.tables[FIREWALL_TABLE_SLIP]    = config->firewall_slip_table;
+
+    if ((firewall.backend = firewall_backend_find(config->firewall_backend)) == NULL || !firewall.backend->open(config)) {
+        return false;
+    }
+
+    for (size = 1; size < config->firewall_queue; size <<= 1);
+
+    if ((firewall.cells = calloc(size, sizeof(firewall_cell_t))) == NULL) {
+        LOG_PRINTLN(LOG_FIREWALL, LOG_ERROR, ("could not allocate firewall queue"));
+        firewall.backend->close();
+        return false;
+    }
+
+    for (i = 0; i < size; i++) {
+        firewall.cells[i].seq = i;
+    }
+
+    firewall.mask       = size - 1;
+    firewall.interval   = (uint64_t) config->firewall_interval * 1000;
+    firewall.sync       = (uint64_t) config->firewall_sync * 1000000;
+    firewall.running    = true;
+
+    if ((err = pthread_create(&(firewall.worker), NULL, firewall_worker, NULL)) != 0) {
+        LOG_ERRNO(LOG_FIREWALL, LOG_ERROR, err, ("Could not start firewall worker"));
+        firewall.backend->close();
+        free(firewall.cells);
+        return false;
+    }
+
+    LOG_PRINTLN(LOG_FIREWALL, LOG_INFO, ("firewall worker started: backend=%s, queue=%" PRIu64 ", interval=%" PRIu32 "ms, sync=%" PRIu32 "s",
+                                         firewall.backend->name, size, config->firewall_interval, config->firewall_sync));
+
+    return true;
+}
+
+/**
+ * Claims the cell at the tail of the queue for a producer
+ *
+ * @return                  NULL if the queue is full
+ */
+static firewall_cell_t *
+firewall_claim(void)
+{
+    firewall_cell_t    *cell;
+    uint64_t            pos = __atomic_load_n(&(firewall.tail), __ATOMIC_RELAXED);
+    uint64_t            seq;
+    int64_t             diff;
+
+    for (;;) {
+        cell = &(firewall.cells[pos & firewall.mask]);
+        seq  = __atomic_load_n(&(cell->seq), __ATOMIC_ACQUIRE);
+        diff = (int64_t) (seq - pos);
+
+        if (diff == 0) {
+            if (__atomic_compare_exchange_n(&(firewall.tail), &pos, pos + 1, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+                return cell;
+            }
+        } else if (diff < 0) {
+            __atomic_add_fetch(&(firewall.stats.dropped), 1, __ATOMIC_RELAXED);
+            return NULL;
+        } else {
+            pos = __atomic_load_n(&(firewall.tail), __ATOMIC_RELAXED);
+        }
+    }
+}
+
+/**
+ * Hands a claimed cell to the consumer
+ */
+static void
+firewall_publish(firewall_cell_t *cell)
+{
+    __atomic_store_n(&(cell->seq), cell->seq + 1, __ATOMIC_RELEASE);
+    __atomic_add_fetch(&(firewall.stats.posted), 1, __ATOMIC_RELAXED);
+}
+
+/****************************************************************************
+ * firewall_post
+ *
+ * Posts an action to the worker, never blocks
+ *
+ * @param  table                    table
+ * @param  addr                     address
+ * @param  prefix_len               prefix length, 32 for an address
+ * @param  action                   add or remove
+ * @return                          false if the queue is full
+ ***************************************************************************/
+bool
+firewall_post(firewall_table_t table, struct in_addr *addr, uint8_t prefix_len, firewall_action_t action)
+{
+    firewall_cell_t    *cell;
+
+    if ((cell = firewall_claim()) == NULL) {
+        return false;
+    }
+
+    cell->item = (firewall_item_t) {
+        .table      = table,
+        .action     = action,
+        .prefix     = { .family = AF_INET, .len = prefix_len, .ipv4 = *addr },
+        .posted     = firewall_now()
+    };
+
+    /* the lpm tables may only be read here, not by the worker */
+    if (action == FIREWALL_ADD && (prefix_len == 32 || prefix_len == 24) && aggregate_enabled()) {
+        lpm_bitmap_ipv4(addr->s_addr, (1 << LPM_POLICY_PROTECTED) | (1 << LPM_POLICY_TRUSTED), cell->item.allowed);
+    }
+
+    firewall_publish(cell);
+
+    return true;
+}
+
+/****************************************************************************
+ * firewall_post_ipv6
+ *
+ * Posts an action to the worker, never blocks. An address is blocked as
+ * its /64 (or /48), see aggregate.h
+ *
+ * @param  table                    table
+ * @param  addr                     address
+ * @param  prefix_len               prefix length, 128 for an address
+ * @param  action                   add or remove
+ * @return                          false if the queue is full
+ ***************************************************************************/
+bool
+firewall_post_ipv6(firewall_table_t table, struct in6_addr *addr, uint8_t prefix_len, firewall_action_t action)
+{
+    firewall_cell_t    *cell;
+    uint32_t            policies = (1 << LPM_POLICY_PROTECTED) | (1 << LPM_POLICY_TRUSTED);
+
+    if ((cell = firewall_claim()) == NULL) {
+        return false;
+    }
+
+    cell->item = (firewall_item_t) {
+        .table      = table,
+        .action     = action,
+        .prefix     = { .family = AF_INET6, .len = prefix_len, .ipv6 = *addr },
+        .posted     = firewall_now()
+    };
+
+    if (action == FIREWALL_ADD && prefix_len == 128) {
+        cell->item.allowed[0] = (lpm_match_ipv6(IPV6_ADDRESS(addr), AGGREGATE_IPV6_SUBNET, policies) ? AGGREGATE_ALLOWED_SUBNET : 0) |
+                                (lpm_match_ipv6(IPV6_ADDRESS(addr), AGGREGATE_IPV6_SITE,   policies) ? AGGREGATE_ALLOWED_SITE   : 0);
+    }
+
+    firewall_publish(cell);
+
+    return true;
+}
+
+/**
+ * Takes the next action off the queue (consumer only)
+ */
+static bool
+firewall_take(firewall_item_t *item)
+{
+    firewall_cell_t    *cell = &(firewall.cells[firewall.head & firewall.mask]);
+
+    if (__atomic_load_n(&(cell->seq), __ATOMIC_ACQUIRE) != firewall.head + 1) {
+        return false;
+    }
+
+    *item = cell->item;
+
+    __atomic_store_n(&(cell->seq), firewall.head + firewall.mask + 1, __ATOMIC_RELEASE);
+    __atomic_store_n(&(firewall.head), firewall.head + 1, __ATOMIC_RELEASE);
+
+    return true;
+}
+
+/****************************************************************************
+ * firewall_apply
+ *
+ * Hands a prefix to the backend, unless the table has (add) or has not
+ * (remove) it already. Worker only: called for the drained actions and
+ * by the aggregation
+ *
+ * @param  table                    table
+ * @param  prefix                   prefix
+ * @param  action                   add or remove
+ ***************************************************************************/
+void
+firewall_apply(firewall_table_t table, const prefix_t *prefix, firewall_action_t action)
+{
+    prefix_set_t   *desired = &(firewall.desired[table]);
+
+    if (action == FIREWALL_ADD) {
+        if (prefix_set_contains(desired, prefix)) {
+            return;
+        }
+
+        if (!prefix_set_add(desired, prefix)) {
+            LOG_PRINTLN(LOG_FIREWALL, LOG_ERROR, ("could not track prefix of table %s", firewall.tables[table]));
+            return;
+        }
+
+        firewall.backend->add(firewall.tables[table], prefix);
+
+        /* established flows of a blocked source would keep passing until they time out */
+        if (table == FIREWALL_TABLE_BLOCK && firewall.backend->kill != NULL) {
+            firewall.backend->kill(firewall.tables[table], prefix);
+        }
+
+    } else if (prefix_set_remove(desired, prefix)) {
+        firewall.backend->remove(firewall.tables[table], prefix);
+    }
+}
+
+/**
+ * Makes the backend tables the desired sets
+ */
+static void
+firewall_sync(void)
+{
+    prefix_t   *sorted;
+    uint32_t    count;
+    uint32_t    table;
+
+    for (table = 0; table < FIREWALL_TABLE_SIZE; table++) {
+        if ((sorted = realloc(firewall.sorted, (firewall.desired[table].count + 1) * sizeof(prefix_t))) == NULL) {
+            LOG_PRINTLN(LOG_FIREWALL, LOG_ERROR, ("could not sync table %s", firewall.tables[table]));
+            continue;
+        }
+
+        firewall.sorted = sorted;
+        count           = prefix_set_sorted(&(firewall.desired[table]), sorted);
+
+        firewall.backend->sync(firewall.tables[table], sorted, count);
+    }
+}
+
+static void
+firewall_report(void)
+{
+    firewall_stats_t            stats;
+    firewall_backend_stats_t    backend;
+
+    firewall_stats(&stats);
+    firewall.backend->stats(&backend);
+
+    LOG_PRINTLN(LOG_FIREWALL, LOG_INFO, ("posted=%" PRIu64 ", dropped=%" PRIu64 ", applied=%" PRIu64 ", flushes=%" PRIu64 ", depth=%" PRIu32 " (max %" PRIu32 "), latency avg=%" PRIu64 "us max=%" PRIu64 "us",
+                                         stats.posted, stats.dropped, stats.applied, stats.flushes, stats.depth, stats.depth_max,
+                                         stats.applied > 0 ? stats.latency_sum / stats.applied : 0, stats.latency_max));
+    LOG_PRINTLN(LOG_FIREWALL, LOG_INFO, ("%s: batches=%" PRIu64 ", added=%" PRIu64 ", removed=%" PRIu64 ", killed=%" PRIu64 ", errors=%" PRIu64,
+                                         firewall.backend->name, backend.batches, backend.added, backend.removed, backend.killed, backend.errors));
+}
+
+/**
+ * Drains the queue into the backend batches, flushes them at most once per
+ * interval and reconciles the tables every sync interval. Stops after the
+ * last action once firewall_stop() was called
+ */
+static void *
+firewall_worker(void *arg)
+{
+    struct timespec     poll = { .tv_sec = 0, .tv_nsec = FIREWALL_POLL };
+    firewall_item_t     item;
+    uint64_t            oldest  = 0;                    /**< posting time of the oldest unflushed action */
+    uint64_t            pending = 0;                    /**< actions since the last flush */
+    uint64_t            flushed = 0;
+    uint64_t            synced  = 0;
+    uint64_t            reported;
+    uint64_t            latency;
+    uint64_t            now;
+    uint32_t            depth;
+    uint32_t            taken;
+    bool                running;
+    bool                changed;
+
+    reported = firewall_now();
+
+    for (;;) {
+        running = __atomic_load_n(&(firewall.running), __ATOMIC_ACQUIRE);
+
+        depth = __atomic_load_n(&(firewall.tail), __ATOMIC_RELAXED) - firewall.head;
+        if (depth > firewall.stats.depth_max) {
+            __atomic_store_n(&(firewall.stats.depth_max), depth, __ATOMIC_RELAXED);
+        }
+
+        /* bounded by the depth seen above: a busy queue must not starve the flush */
+        for (taken = 0; taken < depth && firewall_take(&item); taken++) {
+            if (item.prefix.family == AF_INET6 && item.prefix.len == 128) {
+                if (item.action == FIREWALL_ADD) {
+                    aggregate_add_ipv6(item.table, &(item.prefix.ipv6), item.allowed[0]);
+                } else {
+                    aggregate_remove_ipv6(item.table, &(item.prefix.ipv6));
+                }
+            } else if (item.prefix.family == AF_INET && item.prefix.len == 32 && aggregate_enabled()) {
+                if (item.action == FIREWALL_ADD) {
+                    aggregate_add(item.table, &(item.prefix.ipv4), item.allowed);
+                } else {
+                    aggregate_remove(item.table, &(item.prefix.ipv4));
+                }
+            } else if (item.prefix.family == AF_INET && item.prefix.len == 24 && aggregate_enabled()) {
+                aggregate_pin(item.table, &(item.prefix.ipv4), item.action == FIREWALL_ADD, item.allowed);
+            } else {
+                firewall_apply(item.table, &(item.prefix), item.action);
+            }
+
+            if (pending++ == 0) {
+                oldest = item.posted;
+            }
+        }
+
+        now     = firewall_now();
+        changed = false;
+
+        /* rate limited: the backend batches keep coalescing until the interval is over */
+        if (pending > 0 && (now >= flushed + firewall.interval || !running)) {
+            /* the batch is lost, the desired sets are not: a sync repairs the tables */
+            if (firewall.backend->flush() != 0) {
+                synced = 0;
+            }
+
+            flushed = firewall_now();
+            latency = flushed - oldest;
+
+            __atomic_add_fetch(&(firewall.stats.applied),     pending, __ATOMIC_RELAXED);
+            __atomic_add_fetch(&(firewall.stats.flushes),     1,       __ATOMIC_RELAXED);
+            __atomic_add_fetch(&(firewall.stats.latency_sum), latency * pending, __ATOMIC_RELAXED);
+            if (latency > firewall.stats.latency_max) {
+                __atomic_store_n(&(firewall.stats.latency_max), latency, __ATOMIC_RELAXED);
+            }
+
+            pending = 0;
+            changed = true;
+        }
+
+        /* other processes see the tables as flushed */
+        blocklist_update(&(firewall.desired[FIREWALL_TABLE_BLOCK]), &(firewall.desired[FIREWALL_TABLE_SLIP]), changed);
+
+        /* the tables may have been changed behind our back (restart, pfctl, nft) */
+        if (firewall.sync > 0 && running && pending == 0 && (synced == 0 || now >= synced + firewall.sync)) {
+            firewall_sync();
+
+            synced = firewall_now();
+        }
+
+        if (now >= reported + FIREWALL_REPORT_INTERVAL) {
+            if (firewall.stats.posted > 0) {
+                firewall_report();
+            }
+            reported = now;
+        }
+
+        if (!running && pending == 0 && __atomic_load_n(&(firewall.tail), __ATOMIC_ACQUIRE) == firewall.head) {
+            break;
+        }
+
+        if (taken == 0 && (pending == 0 || now < flushed + firewall.interval)) {
+            nanosleep(&poll, NULL);
+        }
+    }
+
+    firewall.backend->close();
+
+    return NULL;
+}
+
+/**
+ * Statistics, the latency of the flush is counted for every action in it
+ * from the oldest one (upper bound)
+ */
+void
+firewall_stats(firewall_stats_t *stats)
+{
+    stats->posted       = __atomic_load_n(&(firewall.stats.posted),      __ATOMIC_RELAXED);
+    stats->dropped      = __atomic_load_n(&(firewall.stats.dropped),     __ATOMIC_RELAXED);
+    stats->applied      = __atomic_load_n(&(firewall.stats.applied),     __ATOMIC_RELAXED);
+    stats->flushes      = __atomic_load_n(&(firewall.stats.flushes),     __ATOMIC_RELAXED);
+    stats->depth        = __atomic_load_n(&(firewall.tail), __ATOMIC_RELAXED) - __atomic_load_n(&(firewall.head), __ATOMIC_RELAXED);
+    stats->depth_max    = __atomic_load_n(&(firewall.stats.depth_max),   __ATOMIC_RELAXED);
+    stats->latency_sum  = __atomic_load_n(&(firewall.stats.latency_sum), __ATOMIC_RELAXED);
+    stats->latency_max  = __atomic_load_n(&(firewall.stats.latency_max), __ATOMIC_RELAXED);
+}
+
+/**
+ * Applies the queued actions and stops the worker
+ */
+void
+firewall_stop(void)
+{
+    uint32_t table;
+
+    if (!__atomic_exchange_n(&(firewall.running), false, __ATOMIC_ACQ_REL)) {
+        return;
+    }
+
+    pthread_join(firewall.worker, NULL);
+    firewall_report();
+
+    free(firewall.cells);
+    firewall.cells = NULL;
+
+    for (table = 0; table < FIREWALL_TABLE_SIZE; table++) {
+        prefix_set_free(&(firewall.desired[table]));
+    }
+
+    free(firewall.sorted);
+    firewall.sorted = NULL;
+
+    blocklist_stop();
+}
+
@@ -0,0 +1,49 @@
+#include "firewall_backend.h"
+#include "firewall_mock.h"
+#include "log.h"
+
+#ifdef __FreeBSD__
+#include "pf.h"
+#endif
+
+#ifdef __linux__
+#include "nft.h"
+#endif
+
+#include <string.h>
+
+/**
+ * The first backend of the platform is the default
+ */
+static const firewall_backend_t *firewall_backends[] = {
+#ifdef __FreeBSD__
+    &firewall_backend_pf,
+#endif
+#ifdef __linux__
+    &firewall_backend_nft,
+#endif
+    &firewall_backend_mock,
+    NULL
+};
+
+/****************************************************************************
+ * firewall_backend_find
+ *
+ * @param  name                     pf, nft, mock, NULL for the default
+ * @return                          backend, NULL if not available
+ ***************************************************************************/
+const firewall_backend_t *
+firewall_backend_find(const char *name)
+{
+    uint32_t i;
+
+    for (i = 0; firewall_backends[i] != NULL; i++) {
+        if (name == NULL || strcmp(firewall_backends[i]->name, name) == 0) {
+            return firewall_backends[i];
+        }
+    }
+
+    LOG_PRINTLN(LOG_FIREWALL, LOG_ERROR, ("firewall backend not available: %s", name));
+
+    return NULL;
+}
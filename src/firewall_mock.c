@@ -0,0 +1,398 @@
+#include "firewall_mock.h"
+#include "log.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <time.h>
+#include <pthread.h>
+
+#define FIREWALL_MOCK_TABLES_MAX    4
+#define FIREWALL_MOCK_OPS_INIT_SIZE 64
+
+typedef struct _firewall_mock_op_t {
+    prefix_t            prefix;
+    bool                add;
+} firewall_mock_op_t;
+
+typedef struct _firewall_mock_list_t {
+    prefix_t           *prefixes;
+    uint32_t            count;
+    uint32_t            size;
+} firewall_mock_list_t;
+
+typedef struct _firewall_mock_table_t {
+    const char                 *name;                   /**< NULL if unused */
+    prefix_set_t                content;
+    firewall_mock_op_t         *ops;                    /**< queued for the next flush, in order */
+    uint32_t                    op_count;
+    uint32_t                    op_size;
+    firewall_mock_list_t        kills;                  /**< queued for the next flush */
+} firewall_mock_table_t;
+
+typedef struct _firewall_mock_t {
+    struct timespec             latency;
+    firewall_mock_table_t       tables[FIREWALL_MOCK_TABLES_MAX];
+    firewall_mock_list_t        states;                 /**< sources of established flows */
+    pthread_mutex_t             states_lock;            /**< flows are established by the test, killed by the worker */
+    firewall_backend_stats_t    stats;
+} firewall_mock_t;
+
+static firewall_mock_t firewall_mock = {
+    .states_lock    = PTHREAD_MUTEX_INITIALIZER
+};
+
+static firewall_mock_table_t *
+firewall_mock_table_get(const char *name, bool create)
+{
+    uint32_t i;
+
+    for (i = 0; i < FIREWALL_MOCK_TABLES_MAX && firewall_mock.tables[i].name != NULL; i++) {
+        if (strcmp(firewall_mock.tables[i].name, name) == 0) {
+            return &(firewall_mock.tables[i]);
+        }
+    }
+
+    if (!create || i == FIREWALL_MOCK_TABLES_MAX) {
+        return NULL;
+    }
+
+    firewall_mock.tables[i].name = name;
+
+    return &(firewall_mock.tables[i]);
+}
+
+static bool
+firewall_mock_list_add(firewall_mock_list_t *list, const prefix_t *prefix)
+{
+    prefix_t   *prefixes;
+    uint32_t    size;
+
+    if (list->count == list->size) {
+        size = list->size > 0 ? list->size * 2 : FIREWALL_MOCK_OPS_INIT_SIZE;
+
+        if ((prefixes = realloc(list->prefixes, size * sizeof(prefix_t))) == NULL) {
+            return false;
+        }
+
+        list->prefixes  = prefixes;
+        list->size      = size;
+    }
+
+    list->prefixes[list->count++] = *prefix;
+
+    return true;
+}
+
+/**
+ * Simulates the round trip of one batch
+ */
+static void
+firewall_mock_batch(void)
+{
+    firewall_mock.stats.batches++;
+
+    if (firewall_mock.latency.tv_sec > 0 || firewall_mock.latency.tv_nsec > 0) {
+        nanosleep(&(firewall_mock.latency), NULL);
+    }
+}
+
+static bool
+firewall_mock_open(config_t *config)
+{
+    uint32_t i;
+
+    for (i = 0; i < FIREWALL_MOCK_TABLES_MAX; i++) {
+        prefix_set_free(&(firewall_mock.tables[i].content));
+        free(firewall_mock.tables[i].ops);
+        free(firewall_mock.tables[i].kills.prefixes);
+    }
+
+    free(firewall_mock.states.prefixes);
+
+    memset(&firewall_mock, 0, sizeof(firewall_mock));
+    pthread_mutex_init(&(firewall_mock.states_lock), NULL);
+
+    firewall_mock.latency.tv_sec    = config->firewall_mock_latency / 1000000;
+    firewall_mock.latency.tv_nsec   = (config->firewall_mock_latency % 1000000) * 1000;
+
+    LOG_PRINTLN(LOG_FIREWALL, LOG_INFO, ("mock firewall: latency=%" PRIu32 "us per batch", config->firewall_mock_latency));
+
+    return true;
+}
+
+/**
+ * The tables stay for inspection after the worker has stopped
+ */
+static void
+firewall_mock_close(void)
+{
+
+}
+
+static int
+firewall_mock_queue(const char *name, const prefix_t *prefix, bool add)
+{
+    firewall_mock_table_t  *table;
+    firewall_mock_op_t     *ops;
+    uint32_t                size;
+
+    if ((table = firewall_mock_table_get(name, true)) == NULL) {
+        LOG_PRINTLN(LOG_FIREWALL, LOG_ERROR, ("mock firewall: too many tables: %s", name));
+        return -1;
+    }
+
+    if (table->op_count == table->op_size) {
+        size = table->op_size > 0 ? table->op_size * 2 : FIREWALL_MOCK_OPS_INIT_SIZE;
+
+        if ((ops = realloc(table->ops, size * sizeof(firewall_mock_op_t))) == NULL) {
+            return -1;
+        }
+
+        table->ops      = ops;
+        table->op_size  = size;
+    }
+
+    table->ops[table->op_count++] = (firewall_mock_op_t) { .prefix = *prefix, .add = add };
+
+    return 0;
+}
+
+static int
+firewall_mock_add(const char *table, const prefix_t *prefix)
+{
+    return firewall_mock_queue(table, prefix, true);
+}
+
+static int
+firewall_mock_remove(const char *name, const prefix_t *prefix)
+{
+    firewall_mock_table_t  *table;
+    uint32_t                i;
+
+    /* an unblocked source keeps its flows */
+    if ((table = firewall_mock_table_get(name, false)) != NULL) {
+        for (i = 0; i < table->kills.count; i++) {
+            if (prefix_compare(&(table->kills.prefixes[i]), prefix) == 0) {
+                table->kills.prefixes[i] = table->kills.prefixes[--table->kills.count];
+                break;
+            }
+        }
+    }
+
+    return firewall_mock_queue(name, prefix, false);
+}
+
+static int
+firewall_mock_kill(const char *name, const prefix_t *prefix)
+{
+    firewall_mock_table_t *table;
+
+    if ((table = firewall_mock_table_get(name, true)) == NULL) {
+        LOG_PRINTLN(LOG_FIREWALL, LOG_ERROR, ("mock firewall: too many tables: %s", name));
+        return -1;
+    }
+
+    return firewall_mock_list_add(&(table->kills), prefix) ? 0 : -1;
+}
+
+/**
+ * Kills the established flows of the queued sources, like DIOCKILLSTATES
+ */
+static void
+firewall_mock_flush_kills(firewall_mock_list_t *kills)
+{
+    firewall_mock_list_t   *states = &(firewall_mock.states);
+    char                    prefix_str[INET6_ADDRSTRLEN + 4];
+    uint32_t                killed;
+    uint32_t                i;
+    uint32_t                j;
+
+    pthread_mutex_lock(&(firewall_mock.states_lock));
+
+    for (i = 0; i < kills->count; i++) {
+        for (j = 0, killed = 0; j < states->count; ) {
+            if (prefix_covers(&(kills->prefixes[i]), &(states->prefixes[j]))) {
+                states->prefixes[j] = states->prefixes[--states->count];
+                killed++;
+            } else {
+                j++;
+            }
+        }
+
+        LOG_PRINTLN(LOG_FIREWALL, LOG_DEBUG, ("mock firewall: kill %" PRIu32 " states of %s", killed,
+                                              prefix_ntop(&(kills->prefixes[i]), prefix_str, sizeof(prefix_str))));
+
+        firewall_mock.stats.killed += killed;
+    }
+
+    pthread_mutex_unlock(&(firewall_mock.states_lock));
+
+    kills->count = 0;
+}
+
+/**
+ * Applies the queued operations of every table as one batch, the state
+ * kills after the adds
+ */
+static int
+firewall_mock_flush(void)
+{
+    firewall_mock_table_t  *table;
+    char                    prefix_str[INET6_ADDRSTRLEN + 4];
+    uint32_t                i;
+    uint32_t                j;
+    int                     ret = 0;
+
+    for (i = 0; i < FIREWALL_MOCK_TABLES_MAX && firewall_mock.tables[i].name != NULL; i++) {
+        table = &(firewall_mock.tables[i]);
+
+        if (table->op_count == 0) {
+            continue;
+        }
+
+        firewall_mock_batch();
+
+        for (j = 0; j < table->op_count; j++) {
+            LOG_PRINTLN(LOG_FIREWALL, LOG_DEBUG, ("mock firewall: %s %s %s", table->ops[j].add ? "add" : "remove",
+                                                  prefix_ntop(&(table->ops[j].prefix), prefix_str, sizeof(prefix_str)), table->name));
+
+            if (table->ops[j].add) {
+                if (!prefix_set_add(&(table->content), &(table->ops[j].prefix))) {
+                    firewall_mock.stats.errors++;
+                    ret = -1;
+                    continue;
+                }
+                firewall_mock.stats.added++;
+            } else {
+                prefix_set_remove(&(table->content), &(table->ops[j].prefix));
+                firewall_mock.stats.removed++;
+            }
+        }
+
+        table->op_count = 0;
+    }
+
+    for (i = 0; i < FIREWALL_MOCK_TABLES_MAX && firewall_mock.tables[i].name != NULL; i++) {
+        firewall_mock_flush_kills(&(firewall_mock.tables[i].kills));
+    }
+
+    return ret;
+}
+
+/**
+ * Replaces the content, like a transaction flushing and refilling the table
+ */
+static int
+firewall_mock_sync(const char *name, const prefix_t *desired, uint32_t count)
+{
+    firewall_mock_table_t  *table;
+    uint32_t                i;
+
+    firewall_mock_flush();
+
+    if ((table = firewall_mock_table_get(name, true)) == NULL) {
+        LOG_PRINTLN(LOG_FIREWALL, LOG_ERROR, ("mock firewall: too many tables: %s", name));
+        return -1;
+    }
+
+    firewall_mock_batch();
+
+    firewall_mock.stats.removed += table->content.count;
+    prefix_set_free(&(table->content));
+
+    for (i = 0; i < count; i++) {
+        if (!prefix_set_add(&(table->content), &(desired[i]))) {
+            firewall_mock.stats.errors++;
+            return -1;
+        }
+    }
+
+    firewall_mock.stats.added += count;
+
+    return 0;
+}
+
+static void
+firewall_mock_stats(firewall_backend_stats_t *stats)
+{
+    *stats = firewall_mock.stats;
+}
+
+/****************************************************************************
+ * firewall_mock_contains
+ *
+ * @param  table                    table name
+ * @param  prefix                   prefix
+ * @return                          true if a flushed batch added the prefix
+ ***************************************************************************/
+bool
+firewall_mock_contains(const char *table, const prefix_t *prefix)
+{
+    firewall_mock_table_t *mock = firewall_mock_table_get(table, false);
+
+    return mock != NULL && prefix_set_contains(&(mock->content), prefix);
+}
+
+uint32_t
+firewall_mock_count(const char *table)
+{
+    firewall_mock_table_t *mock = firewall_mock_table_get(table, false);
+
+    return mock != NULL ? mock->content.count : 0;
+}
+
+/****************************************************************************
+ * firewall_mock_connect
+ *
+ * Establishes a flow from a source, as a rule keeping state would: it
+ * passes until the state is killed, whatever the tables hold
+ *
+ * @param  source                   source address
+ * @return                          false if out of memory
+ ***************************************************************************/
+bool
+firewall_mock_connect(const prefix_t *source)
+{
+    bool added;
+
+    pthread_mutex_lock(&(firewall_mock.states_lock));
+    added = firewall_mock_list_add(&(firewall_mock.states), source);
+    pthread_mutex_unlock(&(firewall_mock.states_lock));
+
+    return added;
+}
+
+/**
+ * Established flows of the sources in a prefix
+ */
+uint32_t
+firewall_mock_states(const prefix_t *prefix)
+{
+    uint32_t count = 0;
+    uint32_t i;
+
+    pthread_mutex_lock(&(firewall_mock.states_lock));
+
+    for (i = 0; i < firewall_mock.states.count; i++) {
+        if (prefix_covers(prefix, &(firewall_mock.states.prefixes[i]))) {
+            count++;
+        }
+    }
+
+    pthread_mutex_unlock(&(firewall_mock.states_lock));
+
+    return count;
+}
+
+const firewall_backend_t firewall_backend_mock = {
+    .name       = "mock",
+    .open       = firewall_mock_open,
+    .close      = firewall_mock_close,
+    .add        = firewall_mock_add,
+    .remove     = firewall_mock_remove,
+    .kill       = firewall_mock_kill,
+    .flush      = firewall_mock_flush,
+    .sync       = firewall_mock_sync,
+    .stats      = firewall_mock_stats
+};
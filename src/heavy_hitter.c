@@ -0,0 +1,175 @@
+#include "heavy_hitter.h"
+#include "timer_wheel.h"
+#include "log.h"
+#include "log_network.h"
+
+#include "packet/port.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <arpa/inet.h>
+
+#define HEAVY_HITTER_REPORT         10                  /**< entries logged per type */
+
+typedef struct _heavy_hitter_t {
+    bool                enabled;
+    uint64_t            interval;                       /**< us */
+    topk_t              topk[HEAVY_HITTER_TYPE_SIZE];
+    topk_entry_t       *report;                         /**< snapshot buffer of the report */
+    timer_event_t       timer;
+} heavy_hitter_t;
+
+static heavy_hitter_t heavy_hitter;
+
+static const char *heavy_hitter_name[HEAVY_HITTER_TYPE_SIZE] = {
+    [HEAVY_HITTER_VICTIM]       = "victims",
+    [HEAVY_HITTER_REFLECTOR]    = "reflectors",
+    [HEAVY_HITTER_QNAME]        = "qnames"
+};
+
+static void             heavy_hitter_report (timer_event_t *event, uint64_t now);
+
+bool
+heavy_hitter_init(config_t *config)
+{
+    heavy_hitter_type_t type;
+
+    memset(&heavy_hitter, 0, sizeof(heavy_hitter));
+
+    if (config->heavy_hitter_size == 0) {
+        LOG_PRINTLN(LOG_HEAVY_HITTER, LOG_INFO, ("heavy hitters disabled"));
+        return true;
+    }
+
+    for (type = 0; type < HEAVY_HITTER_TYPE_SIZE; type++) {
+        if (!topk_init(&(heavy_hitter.topk[type]), heavy_hitter_name[type], config->heavy_hitter_size)) {
+            return false;
+        }
+    }
+
+    heavy_hitter.report = calloc(config->heavy_hitter_size, sizeof(topk_entry_t));
+    if (heavy_hitter.report == NULL) {
+        return false;
+    }
+
+    heavy_hitter.enabled    = true;
+    heavy_hitter.interval   = (uint64_t) config->heavy_hitter_interval * 1000000;
+
+    timer_event_init(&(heavy_hitter.timer), heavy_hitter_report);
+
+    LOG_PRINTLN(LOG_HEAVY_HITTER, LOG_INFO, ("heavy hitters enabled: size=%" PRIu32 ", interval=%" PRIu32 "s", config->heavy_hitter_size, config->heavy_hitter_interval));
+
+    return true;
+}
+
+static inline void
+heavy_hitter_update_addr(heavy_hitter_type_t type, const ipv4_address_t *addr, uint64_t weight)
+{
+    topk_entry_t   *entry;
+    bool            inserted;
+    uint32_t        key;
+
+    memcpy(&key, addr->addr, IPV4_ADDRESS_LEN);
+
+    entry = topk_update(&(heavy_hitter.topk[type]), key, weight, &inserted);
+
+    if (inserted) {
+        inet_ntop(AF_INET, addr->addr, entry->label, TOPK_LABEL_LEN);
+    }
+}
+
+/****************************************************************************
+ * heavy_hitter_process
+ *
+ * Counts a DNS response (all fragments) for its destination, its source
+ * and its question. A question (name and type) is weighted by the bytes the
+ * response adds to its query: the most abused names are on top
+ *
+ * @param  packet                   decoded packet
+ * @param  raw_packet               raw packet (timestamp)
+ * @param  sample                   sizes and amplification of the response
+ ***************************************************************************/
+void
+heavy_hitter_process(packet_t *packet, raw_packet_t *raw_packet, const amplification_sample_t *sample)
+{
+    ipv4_header_t      *ipv4;
+    udpv4_header_t     *udpv4;
+    dns_header_t       *dns;
+    topk_entry_t       *entry;
+    bool                inserted;
+    char                domain[DNS_DOMAIN_MAX_LEN + 1];
+
+    if (!heavy_hitter.enabled) {
+        return;
+    }
+
+    ipv4    = (ipv4_header_t *)  packet_get_header(packet, PACKET_TYPE_IPV4);
+    udpv4   = (udpv4_header_t *) packet_get_header(packet, PACKET_TYPE_UDPV4);
+    dns     = (dns_header_t *)   packet_get_header(packet, PACKET_TYPE_DNS);
+
+    /* only responses of a DNS server */
+    if (ipv4 == NULL || udpv4 == NULL || dns == NULL || !dns->flags.qr || udpv4->src_port != PORT_DNS) {
+        return;
+    }
+
+    if (!timer_event_armed(&(heavy_hitter.timer)) && heavy_hitter.interval > 0) {
+        timer_wheel_arm(&(heavy_hitter.timer), raw_packet->timestamp + heavy_hitter.interval);
+    }
+
+    heavy_hitter_update_addr(HEAVY_HITTER_VICTIM,    &(ipv4->dest), sample->response_len * packet->weight);
+    heavy_hitter_update_addr(HEAVY_HITTER_REFLECTOR, &(ipv4->src),  sample->response_len * packet->weight);
+
+    if (dns->qd == NULL || sample->response_len <= sample->query_len) {
+        return;
+    }
+
+    entry = topk_update(&(heavy_hitter.topk[HEAVY_HITTER_QNAME]),
+                        ((uint64_t) dns->qd->qtype << 32) | dns_label_hash(dns->qd->qname),
+                        (sample->response_len - sample->query_len) * packet->weight,
+                        &inserted);
+
+    if (inserted) {
+        dns_convert_to_domain(domain, dns->qd->qname);
+        snprintf(entry->label, TOPK_LABEL_LEN, "%s/%s", domain, log_dns_type(dns->qd->qtype));
+    }
+}
+
+uint32_t
+heavy_hitter_snapshot(heavy_hitter_type_t type, topk_entry_t *entries, uint32_t size)
+{
+    if (!heavy_hitter.enabled) {
+        return 0;
+    }
+
+    return topk_snapshot(&(heavy_hitter.topk[type]), entries, size);
+}
+
+/**
+ * Logs the top entries of every type and halves the counters
+ */
+static void
+heavy_hitter_report(timer_event_t *event, uint64_t now)
+{
+    heavy_hitter_type_t type;
+    uint32_t            size;
+    uint32_t            i;
+
+    for (type = 0; type < HEAVY_HITTER_TYPE_SIZE; type++) {
+        size = topk_snapshot(&(heavy_hitter.topk[type]), heavy_hitter.report, HEAVY_HITTER_REPORT);
+
+        for (i = 0; i < size; i++) {
+            LOG_PRINTLN(LOG_HEAVY_HITTER, LOG_INFO, ("top %s #%" PRIu32 ": %s %" PRIu64 " bytes (+/- %" PRIu64 ")", heavy_hitter_name[type],
+                                                                                                                i + 1,
+                                                                                                                heavy_hitter.report[i].label,
+                                                                                                                heavy_hitter.report[i].count,
+                                                                                                                heavy_hitter.report[i].error));
+        }
+
+        topk_decay(&(heavy_hitter.topk[type]));
+    }
+
+    timer_wheel_arm(event, now + heavy_hitter.interval);
+}
+
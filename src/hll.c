@@ -0,0 +1,210 @@
+#include "hll.h"
+#include "log.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#define HLL_RANK_BITS               6
+#define HLL_RANK_MASK               ((1 << HLL_RANK_BITS) - 1)
+#define HLL_RANK_MAX                (64 - HLL_PRECISION + 1)
+#define HLL_ALPHA                   (0.7213 / (1.0 + 1.079 / HLL_REGISTERS))
+
+/* 2^-rank */
+static double hll_pow2[HLL_RANK_MAX + 1];
+
+static void __attribute__((constructor))
+hll_pow2_init(void)
+{
+    uint32_t rank;
+
+    for (rank = 0; rank <= HLL_RANK_MAX; rank++) {
+        hll_pow2[rank] = ldexp(1.0, -(int) rank);
+    }
+}
+
+void
+hll_init(hll_t *hll)
+{
+    hll->dense      = NULL;
+    hll->sparse_len = 0;
+    hll->zeros      = HLL_REGISTERS;
+    hll->sum        = HLL_REGISTERS;
+}
+
+void
+hll_free(hll_t *hll)
+{
+    free(hll->dense);
+    hll_init(hll);
+}
+
+/**
+ * Sets a register to rank if that is larger, keeps the sum and the zeros
+ */
+static inline bool
+hll_dense_set(hll_t *hll, uint32_t idx, uint8_t rank)
+{
+    uint8_t old = hll->dense[idx];
+
+    if (rank <= old) {
+        return false;
+    }
+
+    hll->sum        += hll_pow2[rank] - hll_pow2[old];
+    hll->zeros      -= (old == 0);
+    hll->dense[idx]  = rank;
+
+    return true;
+}
+
+static bool
+hll_promote(hll_t *hll)
+{
+    uint16_t    i;
+
+    if ((hll->dense = calloc(HLL_REGISTERS, 1)) == NULL) {
+        LOG_PRINTLN(LOG_HLL, LOG_ERROR, ("could not allocate dense registers"));
+        return false;
+    }
+
+    hll->zeros  = HLL_REGISTERS;
+    hll->sum    = HLL_REGISTERS;
+
+    for (i = 0; i < hll->sparse_len; i++) {
+        hll_dense_set(hll, hll->sparse[i] >> HLL_RANK_BITS, hll->sparse[i] & HLL_RANK_MASK);
+    }
+
+    hll->sparse_len = 0;
+
+    return true;
+}
+
+/****************************************************************************
+ * hll_add
+ *
+ * @param  hll                      sketch
+ * @param  hash                     64 bit hash of the element
+ * @return                          true if the sketch has changed
+ ***************************************************************************/
+bool
+hll_add(hll_t *hll, uint64_t hash)
+{
+    uint32_t    idx  = hash >> (64 - HLL_PRECISION);
+    uint8_t     rank = __builtin_clzll((hash << HLL_PRECISION) | ((uint64_t) 1 << (HLL_PRECISION - 1))) + 1;
+    uint16_t    i;
+
+    if (hll->dense != NULL) {
+        return hll_dense_set(hll, idx, rank);
+    }
+
+    for (i = 0; i < hll->sparse_len; i++) {
+        if ((hll->sparse[i] >> HLL_RANK_BITS) == idx) {
+            if ((hll->sparse[i] & HLL_RANK_MASK) >= rank) {
+                return false;
+            }
+
+            hll->sum        += hll_pow2[rank] - hll_pow2[hll->sparse[i] & HLL_RANK_MASK];
+            hll->sparse[i]   = (idx << HLL_RANK_BITS) | rank;
+            return true;
+        }
+    }
+
+    if (hll->sparse_len == HLL_SPARSE_MAX) {
+        if (!hll_promote(hll)) {
+            return false;
+        }
+
+        return hll_dense_set(hll, idx, rank);
+    }
+
+    hll->sparse[hll->sparse_len++]  = (idx << HLL_RANK_BITS) | rank;
+    hll->sum                       += hll_pow2[rank] - 1.0;
+    hll->zeros--;
+
+    return true;
+}
+
+static uint64_t
+hll_estimate_sum(double sum, uint32_t zeros)
+{
+    double estimate = HLL_ALPHA * HLL_REGISTERS * HLL_REGISTERS / sum;
+
+    /* small range: linear counting */
+    if (estimate <= 2.5 * HLL_REGISTERS && zeros > 0) {
+        estimate = HLL_REGISTERS * log((double) HLL_REGISTERS / zeros);
+    }
+
+    return (uint64_t) (estimate + 0.5);
+}
+
+uint64_t
+hll_estimate(const hll_t *hll)
+{
+    return hll_estimate_sum(hll->sum, hll->zeros);
+}
+
+/****************************************************************************
+ * hll_merge
+ *
+ * Merges a sketch into dense registers (union of the sets)
+ *
+ * @param  registers                HLL_REGISTERS dense registers
+ * @param  hll                      sketch to be merged
+ ***************************************************************************/
+void
+hll_merge(uint8_t *registers, const hll_t *hll)
+{
+    uint32_t    i;
+
+    if (hll->dense == NULL) {
+        for (i = 0; i < hll->sparse_len; i++) {
+            uint32_t idx  = hll->sparse[i] >> HLL_RANK_BITS;
+            uint8_t  rank = hll->sparse[i] & HLL_RANK_MASK;
+
+            if (registers[idx] < rank) {
+                registers[idx] = rank;
+            }
+        }
+
+        return;
+    }
+
+#ifdef __SSE2__
+    for (i = 0; i < HLL_REGISTERS; i += 16) {
+        __m128i a = _mm_loadu_si128((const __m128i *) &(registers[i]));
+        __m128i b = _mm_loadu_si128((const __m128i *) &(hll->dense[i]));
+
+        _mm_storeu_si128((__m128i *) &(registers[i]), _mm_max_epu8(a, b));
+    }
+#else
+    for (i = 0; i < HLL_REGISTERS; i++) {
+        if (registers[i] < hll->dense[i]) {
+            registers[i] = hll->dense[i];
+        }
+    }
+#endif
+}
+
+/**
+ * Estimates merged dense registers
+ */
+uint64_t
+hll_estimate_registers(const uint8_t *registers)
+{
+    double      sum     = 0.0;
+    uint32_t    zeros   = 0;
+    uint32_t    i;
+
+    for (i = 0; i < HLL_REGISTERS; i++) {
+        sum     += hll_pow2[registers[i]];
+        zeros   += (registers[i] == 0);
+    }
+
+    return hll_estimate_sum(sum, zeros);
+}
+
@@ -18,7 +18,27 @@ log_level_t LOG_CATEGORY_LEVEL[] = {
     [LOG_HEADER_ETHERNET]       = LOG_DEBUG,
     [LOG_HEADER_IPV4]           = LOG_DEBUG,
     [LOG_HEADER_UDPV4]          = LOG_DEBUG,
-    [LOG_HEADER_DNS]            = LOG_DEBUG
+    [LOG_HEADER_DNS]            = LOG_DEBUG,
+    [LOG_HEADER_GRE]            = LOG_DEBUG,
+    [LOG_HEADER_VXLAN]          = LOG_DEBUG,
+    [LOG_SLIP]                  = LOG_DEBUG,
+    [LOG_DISPATCH]              = LOG_DEBUG,
+    [LOG_CORRELATION]           = LOG_DEBUG,
+    [LOG_VICTIM]                = LOG_DEBUG,
+    [LOG_TOPK]                  = LOG_DEBUG,
+    [LOG_HEAVY_HITTER]          = LOG_DEBUG,
+    [LOG_AMPLIFICATION]         = LOG_DEBUG,
+    [LOG_RRL]                   = LOG_DEBUG,
+    [LOG_HLL]                   = LOG_DEBUG,
+    [LOG_CARDINALITY]           = LOG_DEBUG,
+    [LOG_VERDICT]               = LOG_DEBUG,
+    [LOG_POLICY]                = LOG_DEBUG,
+    [LOG_LPM]                   = LOG_DEBUG,
+    [LOG_FIREWALL]              = LOG_DEBUG,
+    [LOG_AGGREGATE]             = LOG_DEBUG,
+    [LOG_BLOCK]                 = LOG_DEBUG,
+    [LOG_BRIDGE]                = LOG_DEBUG,
+    [LOG_BLOCKLIST]             = LOG_DEBUG
 };
 
 const char *LOG_CATEGORY_STRING[] = {
@@ -31,7 +51,27 @@ const char *LOG_CATEGORY_STRING[] = {
     [LOG_HEADER_ETHERNET]       = "[HEADER ETHERNET  ]",
     [LOG_HEADER_IPV4]           = "[HEADER IPV4      ]",
     [LOG_HEADER_UDPV4]          = "[HEADER UDPV4     ]",
-    [LOG_HEADER_DNS]            = "[HEADER DNS       ]"
+    [LOG_HEADER_DNS]            = "[HEADER DNS       ]",
+    [LOG_HEADER_GRE]            = "[HEADER GRE       ]",
+    [LOG_HEADER_VXLAN]          = "[HEADER VXLAN     ]",
+    [LOG_SLIP]                  = "[SLIP             ]",
+    [LOG_DISPATCH]              = "[DISPATCH         ]",
+    [LOG_CORRELATION]           = "[CORRELATION      ]",
+    [LOG_VICTIM]                = "[VICTIM           ]",
+    [LOG_TOPK]                  = "[TOPK             ]",
+    [LOG_HEAVY_HITTER]          = "[HEAVY HITTER     ]",
+    [LOG_AMPLIFICATION]         = "[AMPLIFICATION    ]",
+    [LOG_RRL]                   = "[RRL              ]",
+    [LOG_HLL]                   = "[HLL              ]",
+    [LOG_CARDINALITY]           = "[CARDINALITY      ]",
+    [LOG_VERDICT]               = "[VERDICT          ]",
+    [LOG_POLICY]                = "[POLICY           ]",
+    [LOG_LPM]                   = "[LPM              ]",
+    [LOG_FIREWALL]              = "[FIREWALL         ]",
+    [LOG_AGGREGATE]             = "[AGGREGATE        ]",
+    [LOG_BLOCK]                 = "[BLOCK            ]",
+    [LOG_BRIDGE]                = "[BRIDGE           ]",
+    [LOG_BLOCKLIST]             = "[BLOCKLIST        ]"
 };
 
 const char *LOG_LEVEL_STRING[] = {
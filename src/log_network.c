@@ -86,6 +86,8 @@ log_packet(const packet_t *packet)
             case PACKET_TYPE_IPV4:      log_ipv4_header((const ipv4_header_t *) header);            break;
             case PACKET_TYPE_UDPV4:     log_udpv4_header((const udpv4_header_t *) header);          break;
             case PACKET_TYPE_DNS:       log_dns_header((const dns_header_t *) header);              break;
+            case PACKET_TYPE_GRE:       log_gre_header((const gre_header_t *) header);              break;
+            case PACKET_TYPE_VXLAN:     log_vxlan_header((const vxlan_header_t *) header);          break;
             default:                                                                                break;
         }
         header = header->next;
@@ -181,6 +183,60 @@ log_dns_header(const dns_header_t *dns_header)
     log_dns_resource_records(dns_header->ar_count, dns_header->ar);
 }
 
+void
+log_gre_header(const gre_header_t *gre_header)
+{
+    LOG_PRINTF(LOG_STREAM, "GRE Header\n");
+    
+    LOG_PRINTF(LOG_STREAM, "   |-Flags / Version                    0x%04" PRIx16 "          (%" PRIu16 ")\n",    gre_header->flags_version, gre_header->flags_version);
+    LOG_PRINTF(LOG_STREAM, "      |-Checksum Present     (c)        %s\n",                                        gre_header->c ? "set" : "not set");
+    LOG_PRINTF(LOG_STREAM, "      |-Key Present          (k)        %s\n",                                        gre_header->k ? "set" : "not set");
+    LOG_PRINTF(LOG_STREAM, "      |-Sequence Present     (s)        %s\n",                                        gre_header->s ? "set" : "not set");
+    LOG_PRINTF(LOG_STREAM, "   |-Protocol Type                      %-15s (0x%04" PRIx16 ")\n",                   log_ether_type(gre_header->protocol), gre_header->protocol);
+    
+    if (gre_header->c) {
+        LOG_PRINTF(LOG_STREAM, "   |-Checksum                           0x%04" PRIx16 "\n",                       gre_header->checksum);
+    }
+    if (gre_header->k) {
+        LOG_PRINTF(LOG_STREAM, "   |-Key                                0x%08" PRIx32 "      (%" PRIu32 ")\n",    gre_header->key, gre_header->key);
+    }
+    if (gre_header->s) {
+        LOG_PRINTF(LOG_STREAM, "   |-Sequence Number                    %" PRIu32 "\n",                           gre_header->sequence);
+    }
+    
+    switch (gre_header->erspan.type) {
+        case ERSPAN_TYPE_I:     LOG_PRINTF(LOG_STREAM, "   |-ERSPAN                             Type I\n");
+                                break;
+        
+        case ERSPAN_TYPE_II:
+        case ERSPAN_TYPE_III:   LOG_PRINTF(LOG_STREAM, "   |-ERSPAN                             Type %s   (version %u)\n", gre_header->erspan.type == ERSPAN_TYPE_II ? "II " : "III", gre_header->erspan.version);
+                                LOG_PRINTF(LOG_STREAM, "      |-Session ID                      %u\n",     gre_header->erspan.session_id);
+                                LOG_PRINTF(LOG_STREAM, "      |-VLAN                            %u\n",     gre_header->erspan.vlan);
+                                LOG_PRINTF(LOG_STREAM, "      |-Class of Service                %u\n",     gre_header->erspan.cos);
+                                LOG_PRINTF(LOG_STREAM, "      |-Truncated            (t)        %s\n",     gre_header->erspan.truncated ? "set" : "not set");
+                                
+                                if (gre_header->erspan.type == ERSPAN_TYPE_II) {
+                                    LOG_PRINTF(LOG_STREAM, "      |-Index                           %u\n", gre_header->erspan.index);
+                                } else {
+                                    LOG_PRINTF(LOG_STREAM, "      |-Timestamp                       %" PRIu32 "\n", gre_header->erspan.timestamp);
+                                    LOG_PRINTF(LOG_STREAM, "      |-Hardware ID                     %u\n", gre_header->erspan.hw_id);
+                                    LOG_PRINTF(LOG_STREAM, "      |-Direction                       %s\n", gre_header->erspan.direction ? "Egress" : "Ingress");
+                                }
+                                break;
+        
+        default:                break;
+    }
+}
+
+void
+log_vxlan_header(const vxlan_header_t *vxlan_header)
+{
+    LOG_PRINTF(LOG_STREAM, "VXLAN Header\n");
+    
+    LOG_PRINTF(LOG_STREAM, "   |-Flags                              0x%02" PRIx8 "\n",                            vxlan_header->flags);
+    LOG_PRINTF(LOG_STREAM, "   |-Network Identifier (VNI)           %" PRIu32 "\n",                               vxlan_header->vni);
+}
+
 void
 log_dns_queries(const uint16_t count, const dns_query_t *query)
 {
@@ -340,6 +396,9 @@ log_ether_type(const uint16_t ether_type)
         case ETHERTYPE_IPV6:        return "IPv6";
         case ETHERTYPE_ARP:         return "ARP";
         case ETHERTYPE_VLAN:        return "VLAN";
+        case ETHERTYPE_TEB:         return "Ethernet";
+        case ETHERTYPE_ERSPAN_II:   return "ERSPAN I/II";
+        case ETHERTYPE_ERSPAN_III:  return "ERSPAN III";
         default:                    return "unknow";
     }
 }
@@ -351,6 +410,7 @@ log_ipv4_protocol(const uint8_t ipv4_protocol)
         case IPV4_PROTOCOL_TCP:     return "TCP";
         case IPV4_PROTOCOL_UDP:     return "UDP";
         case IPV4_PROTOCOL_ICMP:    return "ICMP";
+        case IPV4_PROTOCOL_GRE:     return "GRE";
         default:                    return "unknow";
     }
 }
@@ -360,6 +420,7 @@ log_ip_port(const uint16_t port)
 {
     switch (port) {
         case PORT_DNS:              return "DNS";
+        case PORT_VXLAN:            return "VXLAN";
         default:                    return "unknow";
     }
 }
@@ -0,0 +1,825 @@
+#include "lpm.h"
+#include "verdict.h"
+#include "blocklist.h"
+#include "log.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <arpa/inet.h>
+
+#define LPM_LINE_LEN                256
+
+#define LPM_TBL24_SIZE              (1 << 24)
+#define LPM_TBL8_GROUP              256
+#define LPM_TBL8_GROUPS_MAX         (1 << 15)
+#define LPM_EXTENDED                0x8000              /**< tbl24 entry is a tbl8 group */
+
+#define LPM6_DIRECT_BITS            16
+#define LPM6_STRIDE                 6
+#define LPM6_CHILDREN               (1 << LPM6_STRIDE)
+#define LPM6_NODE                   0x80000000          /**< direct entry is a node */
+
+typedef unsigned __int128           lpm6_addr_t;
+
+typedef struct _lpm_prefix_t {
+    uint8_t             family;                         /**< AF_INET, AF_INET6 */
+    uint8_t             len;
+    uint8_t             policy;
+    uint32_t            line;                           /**< keeps the file order of equal lengths */
+    lpm6_addr_t         addr;                           /**< IPv4 in the lower 32 bits */
+} lpm_prefix_t;
+
+/**
+ * Poptrie node: a set bit in vector is a child (base1 + rank of the bit),
+ * a set bit in leafvec starts a run of equal leaves (base0 + rank - 1)
+ */
+typedef struct _lpm6_node_t {
+    uint64_t            vector;
+    uint64_t            leafvec;
+    uint32_t            base0;
+    uint32_t            base1;
+} lpm6_node_t;
+
+/**
+ * Uncompressed node while building, values are pushed down into children
+ */
+typedef struct _lpm6_build_node_t {
+    uint16_t            value[LPM6_CHILDREN];
+    uint32_t            child[LPM6_CHILDREN];           /**< node, zero if none (node 0 is never a child) */
+} lpm6_build_node_t;
+
+typedef struct _lpm_table_t {
+    uint16_t           *tbl24;
+    uint16_t           *tbl8;
+    uint32_t            tbl8_groups;
+    uint32_t           *direct;                         /**< 2^16 entries */
+    lpm6_node_t        *nodes;
+    uint32_t            node_count;
+    uint16_t           *leaves;
+    uint32_t            leaf_count;
+} lpm_table_t;
+
+typedef struct _lpm_builder_t {
+    lpm6_build_node_t  *nodes;
+    uint32_t            node_count;
+    uint32_t            node_size;
+    uint32_t            direct[1 << LPM6_DIRECT_BITS];  /**< LPM6_NODE | build node, or value */
+} lpm_builder_t;
+
+typedef struct _lpm_t {
+    const char         *file;
+    lpm_table_t        *table;                          /**< read by the capture loop */
+    lpm_table_t        *pending;                        /**< built, not yet published */
+    bool                building;
+} lpm_t;
+
+static lpm_t lpm;
+
+static const char *lpm_policy_string[LPM_POLICY_SIZE] = {
+    [LPM_POLICY_NONE]       = "none",
+    [LPM_POLICY_PROTECTED]  = "protected",
+    [LPM_POLICY_TRUSTED]    = "trusted",
+    [LPM_POLICY_BLOCKED]    = "blocked"
+};
+
+const char *
+lpm_policy_name(lpm_policy_t policy)
+{
+    return policy < LPM_POLICY_SIZE ? lpm_policy_string[policy] : "unknown";
+}
+
+static void
+lpm_table_free(lpm_table_t *table)
+{
+    if (table == NULL) {
+        return;
+    }
+
+    free(table->tbl24);
+    free(table->tbl8);
+    free(table->direct);
+    free(table->nodes);
+    free(table->leaves);
+    free(table);
+}
+
+/**
+ * Grows an array to hold len more elements
+ */
+static bool
+lpm_grow(void **array, uint32_t *size, uint32_t count, uint32_t len, size_t element)
+{
+    void       *grown;
+    uint32_t    new_size = *size;
+
+    while (count + len > new_size) {
+        new_size = new_size > 0 ? new_size * 2 : 64;
+    }
+
+    if (new_size == *size) {
+        return true;
+    }
+
+    if ((grown = realloc(*array, (size_t) new_size * element)) == NULL) {
+        return false;
+    }
+
+    *array  = grown;
+    *size   = new_size;
+
+    return true;
+}
+
+/**
+ * Bits [offset, offset + n) of an IPv6 address, zero beyond bit 128
+ */
+static inline uint32_t
+lpm6_bits(lpm6_addr_t addr, uint32_t offset, uint32_t n)
+{
+    return (uint32_t) ((addr << offset) >> (128 - n));
+}
+
+static inline lpm6_addr_t
+lpm6_addr(const uint8_t *bytes)
+{
+    lpm6_addr_t addr = 0;
+    uint32_t    i;
+
+    for (i = 0; i < IPV6_ADDRESS_LEN; i++) {
+        addr = (addr << 8) | bytes[i];
+    }
+
+    return addr;
+}
+
+/*** IPv4: DIR-24-8 ***********************************************************/
+
+/**
+ * Prefixes are inserted by ascending length: a longer prefix overwrites
+ * the range of the shorter ones, no depths need to be remembered
+ */
+static bool
+lpm_ipv4_insert(lpm_table_t *table, uint32_t addr, uint8_t len, uint16_t policy, uint32_t *tbl8_size)
+{
+    uint32_t    start;
+    uint32_t    count;
+    uint32_t    group;
+    uint32_t    i;
+
+    if (len <= 24) {
+        start = (addr >> 8) & ~((1u << (24 - len)) - 1);
+        count = 1u << (24 - len);
+
+        for (i = start; i < start + count; i++) {
+            table->tbl24[i] = policy;
+        }
+
+        return true;
+    }
+
+    /* expand into a tbl8 group, which starts with the value of the /24 */
+    if ((table->tbl24[addr >> 8] & LPM_EXTENDED) == 0) {
+        if (table->tbl8_groups == LPM_TBL8_GROUPS_MAX ||
+            !lpm_grow((void **) &(table->tbl8), tbl8_size, table->tbl8_groups * LPM_TBL8_GROUP, LPM_TBL8_GROUP, sizeof(uint16_t))) {
+            return false;
+        }
+
+        group = table->tbl8_groups++;
+
+        for (i = 0; i < LPM_TBL8_GROUP; i++) {
+            table->tbl8[group * LPM_TBL8_GROUP + i] = table->tbl24[addr >> 8];
+        }
+
+        table->tbl24[addr >> 8] = LPM_EXTENDED | group;
+    }
+
+    group = table->tbl24[addr >> 8] & ~LPM_EXTENDED;
+    start = (addr & 0xff) & ~((1u << (32 - len)) - 1);
+    count = 1u << (32 - len);
+
+    for (i = start; i < start + count; i++) {
+        table->tbl8[group * LPM_TBL8_GROUP + i] = policy;
+    }
+
+    return true;
+}
+
+/*** IPv6: poptrie ************************************************************/
+
+static uint32_t
+lpm6_build_node_new(lpm_builder_t *builder, uint16_t value)
+{
+    lpm6_build_node_t  *node;
+    uint32_t            i;
+
+    if (!lpm_grow((void **) &(builder->nodes), &(builder->node_size), builder->node_count, 1, sizeof(lpm6_build_node_t))) {
+        return 0;
+    }
+
+    node = &(builder->nodes[builder->node_count]);
+
+    for (i = 0; i < LPM6_CHILDREN; i++) {
+        node->value[i] = value;
+        node->child[i] = 0;
+    }
+
+    return builder->node_count++;
+}
+
+/**
+ * Controlled prefix expansion by ascending length, as for IPv4
+ */
+static bool
+lpm6_insert(lpm_builder_t *builder, lpm6_addr_t addr, uint8_t len, uint16_t policy)
+{
+    uint32_t    idx = lpm6_bits(addr, 0, LPM6_DIRECT_BITS);
+    uint32_t    offset;
+    uint32_t    node;
+    uint32_t    child;
+    uint32_t    start;
+    uint32_t    count;
+    uint32_t    i;
+
+    if (len <= LPM6_DIRECT_BITS) {
+        start = idx & ~((1u << (LPM6_DIRECT_BITS - len)) - 1);
+        count = 1u << (LPM6_DIRECT_BITS - len);
+
+        for (i = start; i < start + count; i++) {
+            builder->direct[i] = policy;
+        }
+
+        return true;
+    }
+
+    if ((builder->direct[idx] & LPM6_NODE) == 0) {
+        if ((node = lpm6_build_node_new(builder, builder->direct[idx])) == 0) {
+            return false;
+        }
+        builder->direct[idx] = LPM6_NODE | node;
+    }
+
+    node = builder->direct[idx] & ~LPM6_NODE;
+
+    for (offset = LPM6_DIRECT_BITS; len > offset + LPM6_STRIDE; offset += LPM6_STRIDE) {
+        idx = lpm6_bits(addr, offset, LPM6_STRIDE);
+
+        if (builder->nodes[node].child[idx] == 0) {
+            if ((child = lpm6_build_node_new(builder, builder->nodes[node].value[idx])) == 0) {
+                return false;
+            }
+            builder->nodes[node].child[idx] = child;
+        }
+
+        node = builder->nodes[node].child[idx];
+    }
+
+    start = lpm6_bits(addr, offset, LPM6_STRIDE) & ~((1u << (offset + LPM6_STRIDE - len)) - 1);
+    count = 1u << (offset + LPM6_STRIDE - len);
+
+    for (i = start; i < start + count; i++) {
+        builder->nodes[node].value[i] = policy;
+    }
+
+    return true;
+}
+
+/**
+ * Packs a build node into the poptrie node at index: its children are
+ * reserved as one block first, so that they are contiguous
+ */
+static bool
+lpm6_compress(lpm_table_t *table, lpm_builder_t *builder, uint32_t build_node, uint32_t index, uint32_t *node_size, uint32_t *leaf_size)
+{
+    lpm6_build_node_t  *node = &(builder->nodes[build_node]);
+    uint64_t            vector  = 0;
+    uint64_t            leafvec = 0;
+    uint32_t            base0   = table->leaf_count;
+    uint32_t            base1   = table->node_count;
+    uint32_t            children = 0;
+    bool                leaf    = false;
+    uint16_t            last    = 0;
+    uint32_t            i;
+
+    for (i = 0; i < LPM6_CHILDREN; i++) {
+        if (node->child[i] != 0) {
+            vector |= (uint64_t) 1 << i;
+            children++;
+            continue;
+        }
+
+        if (!leaf || node->value[i] != last) {
+            if (!lpm_grow((void **) &(table->leaves), leaf_size, table->leaf_count, 1, sizeof(uint16_t))) {
+                return false;
+            }
+
+            leafvec |= (uint64_t) 1 << i;
+            table->leaves[table->leaf_count++] = node->value[i];
+            leaf = true;
+            last = node->value[i];
+        }
+    }
+
+    if (!lpm_grow((void **) &(table->nodes), node_size, table->node_count, children, sizeof(lpm6_node_t))) {
+        return false;
+    }
+
+    table->node_count += children;
+    table->nodes[index] = (lpm6_node_t) { .vector = vector, .leafvec = leafvec, .base0 = base0, .base1 = base1 };
+
+    for (i = 0; i < LPM6_CHILDREN; i++) {
+        if (node->child[i] != 0) {
+            if (!lpm6_compress(table, builder, node->child[i], base1++, node_size, leaf_size)) {
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+static bool
+lpm6_build(lpm_table_t *table, lpm_builder_t *builder)
+{
+    uint32_t    node_size = 0;
+    uint32_t    leaf_size = 0;
+    uint32_t    idx;
+
+    for (idx = 0; idx < (1 << LPM6_DIRECT_BITS); idx++) {
+        if ((builder->direct[idx] & LPM6_NODE) == 0) {
+            table->direct[idx] = builder->direct[idx];
+            continue;
+        }
+
+        if (!lpm_grow((void **) &(table->nodes), &node_size, table->node_count, 1, sizeof(lpm6_node_t))) {
+            return false;
+        }
+
+        table->direct[idx] = LPM6_NODE | table->node_count++;
+
+        if (!lpm6_compress(table, builder, builder->direct[idx] & ~LPM6_NODE, table->direct[idx] & ~LPM6_NODE, &node_size, &leaf_size)) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/*** Build ********************************************************************/
+
+static int
+lpm_prefix_compare(const void *a, const void *b)
+{
+    const lpm_prefix_t *pa = (const lpm_prefix_t *) a;
+    const lpm_prefix_t *pb = (const lpm_prefix_t *) b;
+
+    if (pa->len != pb->len) {
+        return pa->len < pb->len ? -1 : 1;
+    }
+
+    return pa->line < pb->line ? -1 : pa->line > pb->line;
+}
+
+/**
+ * Parses "address/len policy", a missing length is a host prefix
+ */
+static bool
+lpm_parse(char *line, lpm_prefix_t *prefix)
+{
+    char           *address;
+    char           *name;
+    char           *slash;
+    char           *end;
+    char           *save;
+    uint8_t         bytes[IPV6_ADDRESS_LEN];
+    unsigned long   len;
+    uint32_t        max;
+    uint32_t        policy;
+
+    if ((address = strtok_r(line, " \t\r\n", &save)) == NULL || (name = strtok_r(NULL, " \t\r\n", &save)) == NULL) {
+        return false;
+    }
+
+    if ((slash = strchr(address, '/')) != NULL) {
+        *slash++ = '\0';
+    }
+
+    if (inet_pton(AF_INET, address, bytes) == 1) {
+        prefix->family  = AF_INET;
+        prefix->addr    = ((uint32_t) bytes[0] << 24) | ((uint32_t) bytes[1] << 16) | ((uint32_t) bytes[2] << 8) | bytes[3];
+        max             = 32;
+    } else if (inet_pton(AF_INET6, address, bytes) == 1) {
+        prefix->family  = AF_INET6;
+        prefix->addr    = lpm6_addr(bytes);
+        max             = 128;
+    } else {
+        return false;
+    }
+
+    len = max;
+    if (slash != NULL && ((len = strtoul(slash, &end, 10)) > max || *end != '\0' || end == slash)) {
+        return false;
+    }
+
+    for (policy = LPM_POLICY_NONE + 1; policy < LPM_POLICY_SIZE; policy++) {
+        if (strcasecmp(name, lpm_policy_string[policy]) == 0) {
+            break;
+        }
+    }
+
+    if (policy == LPM_POLICY_SIZE) {
+        return false;
+    }
+
+    prefix->len     = len;
+    prefix->policy  = policy;
+
+    return true;
+}
+
+/**
+ * Hands the trusted and blocked prefixes to the shared blocklist
+ */
+static void
+lpm_export(const lpm_prefix_t *prefixes, uint32_t prefix_count)
+{
+    blocklist_prefix_t *exported;
+    uint32_t            count = 0;
+    uint32_t            i;
+    uint32_t            j;
+
+    if ((exported = calloc(prefix_count + 1, sizeof(blocklist_prefix_t))) == NULL) {
+        LOG_PRINTLN(LOG_LPM, LOG_ERROR, ("could not export prefixes"));
+        return;
+    }
+
+    for (i = 0; i < prefix_count; i++) {
+        if (prefixes[i].policy != LPM_POLICY_TRUSTED && prefixes[i].policy != LPM_POLICY_BLOCKED) {
+            continue;
+        }
+
+        exported[count].prefix.family   = prefixes[i].family;
+        exported[count].prefix.len      = prefixes[i].len;
+        exported[count].policy          = prefixes[i].policy == LPM_POLICY_TRUSTED ? BLOCKLIST_POLICY_ALLOW : BLOCKLIST_POLICY_BLOCK;
+
+        if (prefixes[i].family == AF_INET) {
+            exported[count].prefix.ipv4.s_addr = htonl((uint32_t) prefixes[i].addr);
+        } else {
+            for (j = 0; j < IPV6_ADDRESS_LEN; j++) {
+                exported[count].prefix.ipv6.s6_addr[j] = (uint8_t) (prefixes[i].addr >> (8 * (IPV6_ADDRESS_LEN - 1 - j)));
+            }
+        }
+
+        count++;
+    }
+
+    blocklist_static(exported, count);
+    free(exported);
+}
+
+/**
+ * Reads the prefix file and builds both tables
+ */
+static lpm_table_t *
+lpm_build(const char *file)
+{
+    lpm_table_t    *table    = NULL;
+    lpm_builder_t  *builder  = NULL;
+    lpm_prefix_t   *prefixes = NULL;
+    uint32_t        prefix_count = 0;
+    uint32_t        prefix_size  = 0;
+    uint32_t        tbl8_size    = 0;
+    uint32_t        line_nr      = 0;
+    uint32_t        i;
+    char            line[LPM_LINE_LEN];
+    char           *comment;
+    FILE           *fp;
+
+    if ((fp = fopen(file, "r")) == NULL) {
+        LOG_ERRNO(LOG_LPM, LOG_ERROR, errno, ("Could not open prefix file %s", file));
+        return NULL;
+    }
+
+    while (fgets(line, sizeof(line), fp) != NULL) {
+        line_nr++;
+
+        if ((comment = strchr(line, '#')) != NULL) {
+            *comment = '\0';
+        }
+
+        if (strspn(line, " \t\r\n") == strlen(line)) {
+            continue;
+        }
+
+        if (!lpm_grow((void **) &prefixes, &prefix_size, prefix_count, 1, sizeof(lpm_prefix_t))) {
+            goto failure;
+        }
+
+        if (!lpm_parse(line, &(prefixes[prefix_count]))) {
+            LOG_PRINTLN(LOG_LPM, LOG_ERROR, ("%s:%" PRIu32 ": invalid prefix", file, line_nr));
+            goto failure;
+        }
+
+        prefixes[prefix_count++].line = line_nr;
+    }
+
+    qsort(prefixes, prefix_count, sizeof(lpm_prefix_t), lpm_prefix_compare);
+
+    if ((table = calloc(1, sizeof(lpm_table_t))) == NULL ||
+        (table->tbl24  = calloc(LPM_TBL24_SIZE, sizeof(uint16_t))) == NULL ||
+        (table->direct = calloc(1 << LPM6_DIRECT_BITS, sizeof(uint32_t))) == NULL ||
+        (builder = calloc(1, sizeof(lpm_builder_t))) == NULL) {
+        goto failure;
+    }
+
+    /* node 0 is never a child */
+    lpm6_build_node_new(builder, LPM_POLICY_NONE);
+    if (builder->node_count == 0) {
+        goto failure;
+    }
+
+    for (i = 0; i < prefix_count; i++) {
+        if (prefixes[i].family == AF_INET ? !lpm_ipv4_insert(table, (uint32_t) prefixes[i].addr, prefixes[i].len, prefixes[i].policy, &tbl8_size)
+                                          : !lpm6_insert(builder, prefixes[i].addr, prefixes[i].len, prefixes[i].policy)) {
+            LOG_PRINTLN(LOG_LPM, LOG_ERROR, ("%s:%" PRIu32 ": could not insert prefix", file, prefixes[i].line));
+            goto failure;
+        }
+    }
+
+    if (!lpm6_build(table, builder)) {
+        goto failure;
+    }
+
+    lpm_export(prefixes, prefix_count);
+
+    LOG_PRINTLN(LOG_LPM, LOG_INFO, ("prefixes %s: %" PRIu32 " prefixes, %" PRIu32 " tbl8 groups, %" PRIu32 " IPv6 nodes, %" PRIu32 " IPv6 leaves",
+                                    file, prefix_count, table->tbl8_groups, table->node_count, table->leaf_count));
+
+    fclose(fp);
+    free(prefixes);
+    free(builder->nodes);
+    free(builder);
+
+    return table;
+
+failure:
+    fclose(fp);
+    free(prefixes);
+    if (builder != NULL) {
+        free(builder->nodes);
+        free(builder);
+    }
+    lpm_table_free(table);
+
+    return NULL;
+}
+
+static void *
+lpm_build_thread(void *arg)
+{
+    lpm_table_t *table;
+
+    if ((table = lpm_build(lpm.file)) != NULL) {
+        lpm_table_free(__atomic_exchange_n(&(lpm.pending), table, __ATOMIC_ACQ_REL));
+    }
+
+    __atomic_store_n(&(lpm.building), false, __ATOMIC_RELEASE);
+
+    return NULL;
+}
+
+bool
+lpm_init(config_t *config)
+{
+    memset(&lpm, 0, sizeof(lpm));
+
+    if (config->prefix_file == NULL) {
+        LOG_PRINTLN(LOG_LPM, LOG_INFO, ("prefix policies disabled"));
+        return true;
+    }
+
+    lpm.file = config->prefix_file;
+
+    /* the first tables are built before capturing */
+    return (lpm.table = lpm_build(lpm.file)) != NULL;
+}
+
+/****************************************************************************
+ * lpm_reload
+ *
+ * Builds new tables from the prefix file in a thread, they are published
+ * by the next lpm_publish() after the build
+ *
+ * @return                          true if a build has been started
+ ***************************************************************************/
+bool
+lpm_reload(void)
+{
+    pthread_t       thread;
+    pthread_attr_t  attr;
+    int             err;
+
+    if (lpm.file == NULL || __atomic_exchange_n(&(lpm.building), true, __ATOMIC_ACQ_REL)) {
+        return false;
+    }
+
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+
+    if ((err = pthread_create(&thread, &attr, lpm_build_thread, NULL)) != 0) {
+        LOG_ERRNO(LOG_LPM, LOG_ERROR, err, ("Could not start prefix build"));
+        __atomic_store_n(&(lpm.building), false, __ATOMIC_RELEASE);
+    }
+
+    pthread_attr_destroy(&attr);
+
+    return err == 0;
+}
+
+/**
+ * Swaps built tables in. Called by the capture loop between two batches,
+ * so the old tables are not referenced by a lookup anymore
+ */
+void
+lpm_publish(void)
+{
+    lpm_table_t *table;
+
+    if (__atomic_load_n(&(lpm.pending), __ATOMIC_RELAXED) == NULL) {
+        return;
+    }
+
+    table = __atomic_exchange_n(&(lpm.pending), NULL, __ATOMIC_ACQ_REL);
+
+    lpm_table_free(__atomic_exchange_n(&(lpm.table), table, __ATOMIC_ACQ_REL));
+    verdict_invalidate();
+
+    LOG_PRINTLN(LOG_LPM, LOG_INFO, ("prefix policies published"));
+}
+
+/**
+ * @param  addr                     IPv4 address (network byte order)
+ */
+lpm_policy_t
+lpm_lookup_ipv4(uint32_t addr)
+{
+    const lpm_table_t  *table = __atomic_load_n(&(lpm.table), __ATOMIC_ACQUIRE);
+    uint16_t            entry;
+
+    if (table == NULL) {
+        return LPM_POLICY_NONE;
+    }
+
+    addr  = ntohl(addr);
+    entry = table->tbl24[addr >> 8];
+
+    if (entry & LPM_EXTENDED) {
+        entry = table->tbl8[(entry & ~LPM_EXTENDED) * LPM_TBL8_GROUP + (addr & 0xff)];
+    }
+
+    return entry;
+}
+
+/****************************************************************************
+ * lpm_bitmap_ipv4
+ *
+ * Marks the addresses of the /24 of addr whose policy is one of policies:
+ * one tbl24 entry covers all of them, otherwise its tbl8 group is scanned
+ *
+ * @param  addr                     IPv4 address (network byte order)
+ * @param  policies                 bit mask of lpm_policy_t
+ * @param  bitmap                   bit i set if <prefix>.i matches
+ ***************************************************************************/
+void
+lpm_bitmap_ipv4(uint32_t addr, uint32_t policies, uint64_t bitmap[4])
+{
+    const lpm_table_t  *table = __atomic_load_n(&(lpm.table), __ATOMIC_ACQUIRE);
+    const uint16_t     *group;
+    uint16_t            entry;
+    uint32_t            i;
+
+    memset(bitmap, 0, 4 * sizeof(uint64_t));
+
+    if (table == NULL) {
+        return;
+    }
+
+    entry = table->tbl24[ntohl(addr) >> 8];
+
+    if ((entry & LPM_EXTENDED) == 0) {
+        if (policies & (1 << entry)) {
+            memset(bitmap, 0xff, 4 * sizeof(uint64_t));
+        }
+        return;
+    }
+
+    group = &(table->tbl8[(entry & ~LPM_EXTENDED) * LPM_TBL8_GROUP]);
+
+    for (i = 0; i < LPM_TBL8_GROUP; i++) {
+        if (policies & (1 << group[i])) {
+            bitmap[i / 64] |= (uint64_t) 1 << (i % 64);
+        }
+    }
+}
+
+lpm_policy_t
+lpm_lookup_ipv6(const ipv6_address_t *ipv6)
+{
+    const lpm_table_t  *table = __atomic_load_n(&(lpm.table), __ATOMIC_ACQUIRE);
+    const lpm6_node_t  *node;
+    lpm6_addr_t         addr;
+    uint32_t            entry;
+    uint32_t            offset;
+    uint64_t            bit;
+
+    if (table == NULL) {
+        return LPM_POLICY_NONE;
+    }
+
+    addr  = lpm6_addr(ipv6->addr);
+    entry = table->direct[lpm6_bits(addr, 0, LPM6_DIRECT_BITS)];
+
+    if ((entry & LPM6_NODE) == 0) {
+        return entry;
+    }
+
+    node = &(table->nodes[entry & ~LPM6_NODE]);
+
+    for (offset = LPM6_DIRECT_BITS; ; offset += LPM6_STRIDE) {
+        bit = (uint64_t) 1 << lpm6_bits(addr, offset, LPM6_STRIDE);
+
+        if ((node->vector & bit) == 0) {
+            return table->leaves[node->base0 + __builtin_popcountll(node->leafvec & ((bit << 1) - 1)) - 1];
+        }
+
+        node = &(table->nodes[node->base1 + __builtin_popcountll(node->vector & (bit - 1))]);
+    }
+}
+
+/**
+ * Whether a leaf below node within the first len bits of addr has one of
+ * policies, offset is the first bit the node decides
+ */
+static bool
+lpm6_match(const lpm_table_t *table, const lpm6_node_t *node, lpm6_addr_t addr, uint32_t offset, uint32_t len, uint32_t policies)
+{
+    uint32_t    fixed = len > offset ? len - offset : 0;
+    uint32_t    first;
+    uint32_t    i;
+    uint64_t    bit;
+
+    if (fixed > LPM6_STRIDE) {
+        fixed = LPM6_STRIDE;
+    }
+
+    first = fixed > 0 ? lpm6_bits(addr, offset, fixed) << (LPM6_STRIDE - fixed) : 0;
+
+    for (i = first; i < first + (1 << (LPM6_STRIDE - fixed)); i++) {
+        bit = (uint64_t) 1 << i;
+
+        if (node->vector & bit) {
+            if (lpm6_match(table, &(table->nodes[node->base1 + __builtin_popcountll(node->vector & (bit - 1))]), addr, offset + LPM6_STRIDE, len, policies)) {
+                return true;
+            }
+        } else if (policies & (1 << table->leaves[node->base0 + __builtin_popcountll(node->leafvec & ((bit << 1) - 1)) - 1])) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/****************************************************************************
+ * lpm_match_ipv6
+ *
+ * Whether an address of the prefix has one of policies: the trie below
+ * the prefix is walked, not just the longest match of its first address
+ *
+ * @param  addr                     first address of the prefix
+ * @param  len                      prefix length, at least 16
+ * @param  policies                 bit mask of lpm_policy_t
+ ***************************************************************************/
+bool
+lpm_match_ipv6(const ipv6_address_t *ipv6, uint8_t len, uint32_t policies)
+{
+    const lpm_table_t  *table = __atomic_load_n(&(lpm.table), __ATOMIC_ACQUIRE);
+    lpm6_addr_t         addr;
+    uint32_t            entry;
+
+    if (table == NULL) {
+        return false;
+    }
+
+    addr  = lpm6_addr(ipv6->addr);
+    entry = table->direct[lpm6_bits(addr, 0, LPM6_DIRECT_BITS)];
+
+    if ((entry & LPM6_NODE) == 0) {
+        return (policies & (1 << entry)) != 0;
+    }
+
+    return lpm6_match(table, &(table->nodes[entry & ~LPM6_NODE]), addr, LPM6_DIRECT_BITS, len, policies);
+}
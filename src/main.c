@@ -8,6 +8,7 @@
 
 #include "config.h"
 #include "dns_defender.h"
+#include "rrl.h"
 
 #endif
 
@@ -21,7 +22,44 @@ main(int argc, char *argv[])
 #else
     config_t config = {
         .ifname     = "re0",
-        .timeout    = 1
+        .timeout    = 1,
+        .bridge_ifname          = NULL,
+        .bridge_backend         = NULL,
+        .bridge_batch           = 64,
+        .firewall_backend       = NULL,
+        .firewall_block_table   = "hacker",
+        .firewall_slip_table    = "slip",
+        .firewall_mock_latency  = 0,
+        .firewall_queue         = 4096,
+        .firewall_interval      = 10,
+        .firewall_sync          = 60,
+        .aggregate_prefix       = 24,
+        .aggregate_density      = 75,
+        .aggregate_ipv6_subnets = 8,
+        .blocklist_file         = NULL,
+        .blocklist_size         = 1 << 16,
+        .slip_rate  = 10,
+        .slip_burst = 20,
+        .slip_hold  = 60,
+        .correlation_size       = 1 << 18,
+        .correlation_timeout    = 5000,
+        .victim_packets         = 1000,
+        .victim_bytes           = 1000000,
+        .heavy_hitter_size      = 64,
+        .heavy_hitter_interval  = 10,
+        .rrl_rate               = 5,
+        .rrl_burst              = 10,
+        .rrl_prefix             = 24,
+        .rrl_action             = RRL_ACTION_SLIP,
+        .block_enter            = 20,
+        .block_exit             = 5,
+        .block_hold             = 60,
+        .block_hold_max         = 3600,
+        .block_escalate         = 8,
+        .cardinality_reflectors = 100,
+        .cardinality_victims    = 5000,
+        .policy_file            = NULL,
+        .prefix_file            = NULL
     };
     
     if (dns_defender_init(&config)) {
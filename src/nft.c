@@ -0,0 +1,656 @@
+#include "nft.h"
+#include "log.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <unistd.h>
+
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <arpa/inet.h>
+
+#include <linux/netlink.h>
+#include <linux/netfilter.h>
+#include <linux/netfilter/nfnetlink.h>
+#include <linux/netfilter/nf_tables.h>
+
+#define NFT_SETS_MAX            8                   /**< IPv4 and IPv6 set of four tables */
+#define NFT_SET_NAME_SIZE       64
+#define NFT_OPS_INIT_SIZE       64
+#define NFT_BUFFER_INIT_SIZE    (64 * 1024)
+#define NFT_ELEMENTS_MAX        60000               /**< bytes of elements per message, a nested attribute has a 16 bit length */
+#define NFT_SNDBUF              (16 * 1024 * 1024)  /**< a transaction is one datagram */
+#define NFT_ACK_TIMEOUT         1                   /**< s to wait for the acknowledgements */
+
+typedef struct _nft_op_t {
+    prefix_t            prefix;
+    bool                add;
+} nft_op_t;
+
+typedef struct _nft_set_t {
+    char                name[NFT_SET_NAME_SIZE];    /**< empty if unused */
+    uint8_t             family;
+    nft_op_t           *ops;                        /**< queued for the next flush, in order */
+    uint32_t            op_count;
+    uint32_t            op_size;
+    prefix_set_t        content;                    /**< elements sent since the last sync, for the statistics */
+} nft_set_t;
+
+typedef struct _nft_t {
+    int                 sock;                       /**< -1 if not open */
+    uint32_t            seq;
+    uint32_t            acks;                       /**< messages of the batch which are acknowledged */
+    uint8_t            *buffer;                     /**< batch being built */
+    uint32_t            len;
+    uint32_t            size;
+    nft_set_t           sets[NFT_SETS_MAX];
+    firewall_backend_stats_t stats;
+} nft_t;
+
+static nft_t nft = {
+    .sock   = -1
+};
+
+static void nft_close(void);
+
+static bool
+nft_open(config_t *config)
+{
+    struct sockaddr_nl  addr = { .nl_family = AF_NETLINK };
+    struct timeval      timeout = { .tv_sec = NFT_ACK_TIMEOUT };
+    int                 sndbuf = NFT_SNDBUF;
+
+    /* an interval set rejects overlapping elements: without aggregation a
+       blocked /24 and its blocked addresses would fail every transaction */
+    if (config->aggregate_prefix == 0) {
+        LOG_PRINTLN(LOG_FIREWALL, LOG_ERROR, ("nftables sets need prefix aggregation (aggregate_prefix > 0)"));
+        return false;
+    }
+
+    if ((nft.sock = socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC, NETLINK_NETFILTER)) == -1) {
+        LOG_ERRNO(LOG_FIREWALL, LOG_ERROR, errno, ("Couldn't open netfilter netlink socket"));
+        return false;
+    }
+
+    if (bind(nft.sock, (struct sockaddr *) &addr, sizeof(addr)) == -1) {
+        LOG_ERRNO(LOG_FIREWALL, LOG_ERROR, errno, ("Couldn't bind netfilter netlink socket"));
+        nft_close();
+        return false;
+    }
+
+    if (setsockopt(nft.sock, SOL_SOCKET, SO_SNDBUFFORCE, &sndbuf, sizeof(sndbuf)) == -1 &&
+        setsockopt(nft.sock, SOL_SOCKET, SO_SNDBUF, &sndbuf, sizeof(sndbuf)) == -1) {
+        LOG_ERRNO(LOG_FIREWALL, LOG_WARNING, errno, ("Couldn't set send buffer: len=%u", NFT_SNDBUF));
+    }
+
+    setsockopt(nft.sock, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+    LOG_PRINTLN(LOG_FIREWALL, LOG_INFO, ("nftables sets in table inet %s", NFT_TABLE));
+
+    return true;
+}
+
+static void
+nft_close(void)
+{
+    if (nft.sock == -1) {
+        return;
+    }
+
+    close(nft.sock);
+    nft.sock = -1;
+}
+
+/**
+ * The set of a table and family, IPv6 prefixes go to the set <table>6.
+ * Without create, NULL if the set was never used
+ */
+static nft_set_t *
+nft_set_get(const char *table, uint8_t family, bool create)
+{
+    char        name[NFT_SET_NAME_SIZE];
+    uint32_t    i;
+
+    snprintf(name, sizeof(name), "%s%s", table, family == AF_INET6 ? "6" : "");
+
+    for (i = 0; i < NFT_SETS_MAX && nft.sets[i].name[0] != '\0'; i++) {
+        if (strcmp(nft.sets[i].name, name) == 0) {
+            return &(nft.sets[i]);
+        }
+    }
+
+    if (!create) {
+        return NULL;
+    }
+
+    if (i == NFT_SETS_MAX) {
+        LOG_PRINTLN(LOG_FIREWALL, LOG_ERROR, ("Too many sets: %s", name));
+        return NULL;
+    }
+
+    strcpy(nft.sets[i].name, name);
+    nft.sets[i].family = family;
+
+    return &(nft.sets[i]);
+}
+
+/**
+ * Queues a change. A pending change of the opposite direction for the same
+ * prefix cancels out instead: the kernel can not delete an interval which
+ * was added in the same transaction
+ */
+static int
+nft_queue(const char *name, const prefix_t *prefix, bool add)
+{
+    nft_set_t  *set;
+    nft_op_t   *ops;
+    uint32_t    size;
+    uint32_t    i;
+
+    if ((set = nft_set_get(name, prefix->family, true)) == NULL) {
+        return -1;
+    }
+
+    for (i = set->op_count; i-- > 0; ) {
+        if (prefix_compare(&(set->ops[i].prefix), prefix) == 0) {
+            if (set->ops[i].add != add) {
+                memmove(&(set->ops[i]), &(set->ops[i + 1]), (set->op_count - i - 1) * sizeof(nft_op_t));
+                set->op_count--;
+                return 0;
+            }
+            break;
+        }
+    }
+
+    if (set->op_count == set->op_size) {
+        size = set->op_size > 0 ? set->op_size * 2 : NFT_OPS_INIT_SIZE;
+
+        if ((ops = realloc(set->ops, size * sizeof(nft_op_t))) == NULL) {
+            LOG_PRINTLN(LOG_FIREWALL, LOG_ERROR, ("Couldn't queue element for set %s", name));
+            return -1;
+        }
+
+        set->ops     = ops;
+        set->op_size = size;
+    }
+
+    set->ops[set->op_count++] = (nft_op_t) { .prefix = *prefix, .add = add };
+
+    return 0;
+}
+
+static int
+nft_add(const char *set, const prefix_t *prefix)
+{
+    return nft_queue(set, prefix, true);
+}
+
+static int
+nft_remove(const char *set, const prefix_t *prefix)
+{
+    return nft_queue(set, prefix, false);
+}
+
+/**
+ * Reserves room at the end of the batch, zeroed
+ */
+static void *
+nft_put(uint32_t len)
+{
+    uint8_t    *buffer;
+    uint32_t    size;
+    void       *data;
+
+    len = NLMSG_ALIGN(len);
+
+    if (nft.len + len > nft.size) {
+        for (size = nft.size > 0 ? nft.size : NFT_BUFFER_INIT_SIZE; size < nft.len + len; size *= 2);
+
+        if ((buffer = realloc(nft.buffer, size)) == NULL) {
+            return NULL;
+        }
+
+        nft.buffer  = buffer;
+        nft.size    = size;
+    }
+
+    data     = &(nft.buffer[nft.len]);
+    nft.len += len;
+    memset(data, 0, len);
+
+    return data;
+}
+
+/**
+ * Appends a message header, the length is fixed by nft_msg_end()
+ *
+ * @return                  offset of the message, -1 if out of memory
+ */
+static int32_t
+nft_msg_begin(uint16_t type, uint16_t flags, uint8_t family, uint16_t res_id)
+{
+    uint32_t            offset = nft.len;
+    struct nlmsghdr    *nlh;
+    struct nfgenmsg    *nfg;
+
+    if ((nlh = nft_put(NLMSG_HDRLEN + sizeof(struct nfgenmsg))) == NULL) {
+        return -1;
+    }
+
+    nlh->nlmsg_type     = type;
+    nlh->nlmsg_flags    = NLM_F_REQUEST | flags;
+    nlh->nlmsg_seq      = ++nft.seq;
+
+    nfg                 = NLMSG_DATA(nlh);
+    nfg->nfgen_family   = family;
+    nfg->version        = NFNETLINK_V0;
+    nfg->res_id         = htons(res_id);
+
+    if (flags & NLM_F_ACK) {
+        nft.acks++;
+    }
+
+    return offset;
+}
+
+static void
+nft_msg_end(int32_t offset)
+{
+    ((struct nlmsghdr *) &(nft.buffer[offset]))->nlmsg_len = nft.len - offset;
+}
+
+static int32_t
+nft_attr_begin(uint16_t type)
+{
+    uint32_t        offset = nft.len;
+    struct nlattr  *attr;
+
+    if ((attr = nft_put(NLA_HDRLEN)) == NULL) {
+        return -1;
+    }
+
+    attr->nla_type = type;
+
+    return offset;
+}
+
+static void
+nft_attr_end(int32_t offset)
+{
+    ((struct nlattr *) &(nft.buffer[offset]))->nla_len = nft.len - offset;
+}
+
+static bool
+nft_attr_put(uint16_t type, const void *data, uint16_t len)
+{
+    struct nlattr  *attr;
+
+    if ((attr = nft_put(NLA_HDRLEN + len)) == NULL) {
+        return false;
+    }
+
+    attr->nla_type  = type;
+    attr->nla_len   = NLA_HDRLEN + len;
+    memcpy((uint8_t *) attr + NLA_HDRLEN, data, len);
+
+    return true;
+}
+
+/**
+ * One interval element: the key and, for the end of an interval, its flag
+ */
+static bool
+nft_elem_put(const void *key, uint16_t key_len, bool end)
+{
+    int32_t     elem;
+    int32_t     nest;
+    uint32_t    flags = htonl(NFT_SET_ELEM_INTERVAL_END);
+
+    if ((elem = nft_attr_begin(NLA_F_NESTED | NFTA_LIST_ELEM)) == -1 ||
+        (nest = nft_attr_begin(NLA_F_NESTED | NFTA_SET_ELEM_KEY)) == -1 ||
+        !nft_attr_put(NFTA_DATA_VALUE, key, key_len)) {
+        return false;
+    }
+
+    nft_attr_end(nest);
+
+    if (end && !nft_attr_put(NFTA_SET_ELEM_FLAGS, &flags, sizeof(flags))) {
+        return false;
+    }
+
+    nft_attr_end(elem);
+
+    return true;
+}
+
+/**
+ * A prefix is the interval [first, last + 1), the end is left out if it
+ * wraps around
+ */
+static bool
+nft_prefix_put(const prefix_t *prefix)
+{
+    unsigned __int128   first = 0;
+    unsigned __int128   end;
+    uint8_t             bytes[sizeof(struct in6_addr)];
+    uint32_t            len   = prefix->family == AF_INET6 ? sizeof(struct in6_addr) : sizeof(struct in_addr);
+    uint32_t            i;
+
+    for (i = 0; i < len; i++) {
+        first = (first << 8) | ((const uint8_t *) &(prefix->ipv6))[i];
+    }
+
+    end = prefix->len > 0 ? first + ((unsigned __int128) 1 << (len * 8 - prefix->len)) : 0;
+
+    if (!nft_elem_put(&(prefix->ipv6), len, false)) {
+        return false;
+    }
+
+    /* wrapped around: the interval ends with the address space */
+    if (len == sizeof(struct in_addr) ? (uint32_t) end == 0 : end == 0) {
+        return true;
+    }
+
+    for (i = len; i-- > 0; end >>= 8) {
+        bytes[i] = (uint8_t) end;
+    }
+
+    return nft_elem_put(bytes, len, true);
+}
+
+/**
+ * Appends a NEWSETELEM or DELSETELEM message, without prefixes it flushes
+ * the set. Returns the number of prefixes taken, at most one message full
+ */
+static int32_t
+nft_setelem_put(const char *set, bool add, const prefix_t *prefixes, uint32_t count, uint32_t stride)
+{
+    int32_t     msg;
+    int32_t     elements;
+    uint32_t    start;
+    uint32_t    i;
+
+    if ((msg = nft_msg_begin((NFNL_SUBSYS_NFTABLES << 8) | (add ? NFT_MSG_NEWSETELEM : NFT_MSG_DELSETELEM),
+                             NLM_F_ACK | (add ? NLM_F_CREATE : 0), NFPROTO_INET, 0)) == -1 ||
+        !nft_attr_put(NFTA_SET_ELEM_LIST_TABLE, NFT_TABLE, strlen(NFT_TABLE) + 1) ||
+        !nft_attr_put(NFTA_SET_ELEM_LIST_SET, set, strlen(set) + 1)) {
+        return -1;
+    }
+
+    if (count > 0) {
+        if ((elements = nft_attr_begin(NLA_F_NESTED | NFTA_SET_ELEM_LIST_ELEMENTS)) == -1) {
+            return -1;
+        }
+
+        start = nft.len;
+
+        for (i = 0; i < count && nft.len - start < NFT_ELEMENTS_MAX; i++) {
+            if (!nft_prefix_put((const prefix_t *) ((const uint8_t *) prefixes + i * stride))) {
+                return -1;
+            }
+        }
+
+        nft_attr_end(elements);
+        count = i;
+    }
+
+    nft_msg_end(msg);
+
+    return count;
+}
+
+static bool
+nft_batch_begin(void)
+{
+    int32_t msg;
+
+    nft.len  = 0;
+    nft.acks = 0;
+
+    if ((msg = nft_msg_begin(NFNL_MSG_BATCH_BEGIN, 0, AF_UNSPEC, NFNL_SUBSYS_NFTABLES)) == -1) {
+        return false;
+    }
+
+    nft_msg_end(msg);
+
+    return true;
+}
+
+/**
+ * Closes the batch, sends it and collects an acknowledgement for every
+ * message: one failing message aborts the whole transaction
+ */
+static int
+nft_batch_send(void)
+{
+    uint8_t             buffer[8192];
+    struct nlmsghdr    *nlh;
+    struct nlmsgerr    *err;
+    int32_t             msg;
+    uint32_t            acks = 0;
+    ssize_t             len;
+    int                 ret = 0;
+
+    if ((msg = nft_msg_begin(NFNL_MSG_BATCH_END, 0, AF_UNSPEC, NFNL_SUBSYS_NFTABLES)) == -1) {
+        LOG_PRINTLN(LOG_FIREWALL, LOG_ERROR, ("Couldn't build nftables batch"));
+        nft.stats.errors++;
+        return -1;
+    }
+
+    nft_msg_end(msg);
+    nft.stats.batches++;
+
+    if (send(nft.sock, nft.buffer, nft.len, 0) == -1) {
+        LOG_ERRNO(LOG_FIREWALL, LOG_ERROR, errno, ("Couldn't send nftables batch (%" PRIu32 " bytes)", nft.len));
+        nft.stats.errors++;
+        return -1;
+    }
+
+    while (acks < nft.acks) {
+        if ((len = recv(nft.sock, buffer, sizeof(buffer), 0)) == -1) {
+            LOG_ERRNO(LOG_FIREWALL, LOG_ERROR, errno, ("Couldn't receive nftables acknowledgement (%" PRIu32 " of %" PRIu32 ")", acks, nft.acks));
+            nft.stats.errors++;
+            return -1;
+        }
+
+        for (nlh = (struct nlmsghdr *) buffer; NLMSG_OK(nlh, len); nlh = NLMSG_NEXT(nlh, len)) {
+            if (nlh->nlmsg_type != NLMSG_ERROR) {
+                continue;
+            }
+
+            acks++;
+            err = NLMSG_DATA(nlh);
+
+            if (err->error != 0 && ret == 0) {
+                LOG_ERRNO(LOG_FIREWALL, LOG_ERROR, -err->error, ("nftables transaction aborted (message %" PRIu32 ")", err->msg.nlmsg_seq));
+                nft.stats.errors++;
+                ret = -1;
+            }
+        }
+    }
+
+    return ret;
+}
+
+/**
+ * Sends the queued changes of all sets as one transaction. Consecutive
+ * changes of the same direction share a message
+ */
+static int
+nft_flush(void)
+{
+    nft_set_t  *set;
+    uint32_t    queued = 0;
+    uint32_t    added = 0;
+    uint32_t    i;
+    uint32_t    j;
+    uint32_t    run;
+    int32_t     taken;
+    int         ret;
+
+    for (i = 0; i < NFT_SETS_MAX && nft.sets[i].name[0] != '\0'; i++) {
+        queued += nft.sets[i].op_count;
+    }
+
+    if (queued == 0) {
+        return 0;
+    }
+
+    if (!nft_batch_begin()) {
+        return -1;
+    }
+
+    for (i = 0; i < NFT_SETS_MAX && nft.sets[i].name[0] != '\0'; i++) {
+        set = &(nft.sets[i]);
+
+        for (j = 0; j < set->op_count; j += taken) {
+            for (run = 1; j + run < set->op_count && set->ops[j + run].add == set->ops[j].add; run++);
+
+            if ((taken = nft_setelem_put(set->name, set->ops[j].add, &(set->ops[j].prefix), run, sizeof(nft_op_t))) <= 0) {
+                LOG_PRINTLN(LOG_FIREWALL, LOG_ERROR, ("Couldn't build nftables batch"));
+                return -1;
+            }
+
+            if (set->ops[j].add) {
+                added += taken;
+            }
+        }
+
+        /* a failed transaction is followed by a sync, which starts over */
+        for (j = 0; j < set->op_count; j++) {
+            if (set->ops[j].add) {
+                prefix_set_add(&(set->content), &(set->ops[j].prefix));
+            } else {
+                prefix_set_remove(&(set->content), &(set->ops[j].prefix));
+            }
+        }
+
+        set->op_count = 0;
+    }
+
+    if ((ret = nft_batch_send()) == 0) {
+        nft.stats.added     += added;
+        nft.stats.removed   += queued - added;
+
+        LOG_PRINTLN(LOG_FIREWALL, LOG_INFO, ("nftables: %" PRIu32 " added, %" PRIu32 " removed", added, queued - added));
+    }
+
+    return ret;
+}
+
+/****************************************************************************
+ * nft_sync
+ *
+ * Flushes the sets of the table and refills them with the desired
+ * prefixes, in one transaction: packets never see a set half empty. The
+ * IPv6 set is left alone as long as no IPv6 prefix was ever blocked, the
+ * ruleset does not need to have it then
+ *
+ * @param  name                     table
+ * @param  desired                  prefixes the sets should hold, IPv4 first
+ * @param  count                    number of desired prefixes
+ * @return                          0 on success, -1 otherwise
+ ***************************************************************************/
+static int
+nft_sync(const char *name, const prefix_t *desired, uint32_t count)
+{
+    static const uint8_t    families[] = { AF_INET, AF_INET6 };
+    nft_set_t              *set;
+    nft_set_t              *sets[sizeof(families)] = { NULL };
+    uint32_t                bounds[sizeof(families) + 1] = { 0 };
+    uint32_t                added = 0;
+    uint32_t                removed = 0;
+    uint32_t                kept;
+    uint32_t                first = 0;
+    uint32_t                last;
+    uint32_t                f;
+    uint32_t                i;
+    int32_t                 taken;
+
+    nft_flush();
+
+    if (!nft_batch_begin()) {
+        LOG_PRINTLN(LOG_FIREWALL, LOG_ERROR, ("Couldn't build nftables batch"));
+        return -1;
+    }
+
+    for (f = 0; f < sizeof(families); f++) {
+        for (last = first; last < count && desired[last].family == families[f]; last++);
+
+        bounds[f + 1] = last;
+
+        if ((set = nft_set_get(name, families[f], families[f] == AF_INET || last > first)) == NULL) {
+            first = last;
+            continue;
+        }
+
+        sets[f] = set;
+
+        if (nft_setelem_put(set->name, false, NULL, 0, 0) == -1) {
+            LOG_PRINTLN(LOG_FIREWALL, LOG_ERROR, ("Couldn't build nftables batch"));
+            return -1;
+        }
+
+        for (i = first; i < last; i += taken) {
+            if ((taken = nft_setelem_put(set->name, true, &(desired[i]), last - i, sizeof(prefix_t))) <= 0) {
+                LOG_PRINTLN(LOG_FIREWALL, LOG_ERROR, ("Couldn't build nftables batch"));
+                return -1;
+            }
+        }
+
+        first = last;
+    }
+
+    if (nft_batch_send() != 0) {
+        return -1;
+    }
+
+    /* the refill only adds what the sets were missing */
+    for (f = 0; f < sizeof(families); f++) {
+        if ((set = sets[f]) == NULL) {
+            continue;
+        }
+
+        for (i = bounds[f], kept = 0; i < bounds[f + 1]; i++) {
+            if (prefix_set_contains(&(set->content), &(desired[i]))) {
+                kept++;
+            }
+        }
+
+        added   += bounds[f + 1] - bounds[f] - kept;
+        removed += set->content.count - kept;
+
+        prefix_set_free(&(set->content));
+
+        for (i = bounds[f]; i < bounds[f + 1]; i++) {
+            prefix_set_add(&(set->content), &(desired[i]));
+        }
+    }
+
+    nft.stats.added     += added;
+    nft.stats.removed   += removed;
+
+    LOG_PRINTLN(LOG_FIREWALL, LOG_DEBUG, ("nftables sets of %s synced (%" PRIu32 " prefixes, %" PRIu32 " added, %" PRIu32 " removed)", name, count, added, removed));
+
+    return 0;
+}
+
+static void
+nft_stats(firewall_backend_stats_t *stats)
+{
+    *stats = nft.stats;
+}
+
+const firewall_backend_t firewall_backend_nft = {
+    .name       = "nft",
+    .open       = nft_open,
+    .close      = nft_close,
+    .add        = nft_add,
+    .remove     = nft_remove,
+    .flush      = nft_flush,
+    .sync       = nft_sync,
+    .stats      = nft_stats
+};
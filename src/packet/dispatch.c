@@ -0,0 +1,78 @@
+#include "packet/dispatch.h"
+#include "log.h"
+
+#include <inttypes.h>
+
+static uint8_t                  dispatch_ethertype[DISPATCH_KEY_MAX];
+static uint8_t                  dispatch_ip_protocol[256];                  /**< looked up with an uint8_t protocol only */
+static uint8_t                  dispatch_udp_port[DISPATCH_KEY_MAX];
+static uint16_t                 dispatch_entry_size = 1;                    /**< entry 0: not registered */
+
+static const uint32_t           dispatch_key_limit[DISPATCH_LAYER_SIZE] = {
+    [DISPATCH_LAYER_ETHERTYPE]      = DISPATCH_KEY_MAX,
+    [DISPATCH_LAYER_IP_PROTOCOL]    = 256,
+    [DISPATCH_LAYER_UDP_PORT]       = DISPATCH_KEY_MAX
+};
+
+dispatch_entry_t                dispatch_entry[DISPATCH_ENTRY_MAX];
+uint64_t                        dispatch_udp_port_bitmap[DISPATCH_KEY_MAX / 64];
+uint8_t                        *dispatch_table[DISPATCH_LAYER_SIZE] = {
+    [DISPATCH_LAYER_ETHERTYPE]      = dispatch_ethertype,
+    [DISPATCH_LAYER_IP_PROTOCOL]    = dispatch_ip_protocol,
+    [DISPATCH_LAYER_UDP_PORT]       = dispatch_udp_port
+};
+
+/****************************************************************************
+ * dispatch_register
+ *
+ * Called from constructors, i.e. before main(). An already registered
+ * decoder/encoder pair re-uses its entry
+ *
+ * @param  layer                    dispatch layer
+ * @param  key                      ethertype, protocol or port
+ * @param  decode                   decoder of the next header
+ * @param  encode                   encoder of the next header (optional)
+ * @return                          true on success
+ ***************************************************************************/
+bool
+dispatch_register(dispatch_layer_t layer, uint16_t key, header_decode_fn decode, header_encode_fn encode)
+{
+    uint16_t id;
+
+    if (layer >= DISPATCH_LAYER_SIZE || key >= dispatch_key_limit[layer]) {
+        LOG_PRINTLN(LOG_DISPATCH, LOG_ERROR, ("invalid dispatch key (layer=%u, key=0x%04" PRIx16 ")", layer, key));
+        return false;
+    }
+
+    if (dispatch_table[layer][key] != 0) {
+        LOG_PRINTLN(LOG_DISPATCH, LOG_WARNING, ("dispatch key already registered, replace it (layer=%u, key=0x%04" PRIx16 ")", layer, key));
+    }
+
+    for (id = 1; id < dispatch_entry_size; id++) {
+        if (dispatch_entry[id].decode == decode && dispatch_entry[id].encode == encode) {
+            break;
+        }
+    }
+
+    if (id == dispatch_entry_size) {
+        if (dispatch_entry_size == DISPATCH_ENTRY_MAX) {
+            LOG_PRINTLN(LOG_DISPATCH, LOG_ERROR, ("dispatch entries exhausted (max=%u)", DISPATCH_ENTRY_MAX));
+            return false;
+        }
+
+        dispatch_entry[id].decode   = decode;
+        dispatch_entry[id].encode   = encode;
+        dispatch_entry_size++;
+    }
+
+    dispatch_table[layer][key] = id;
+
+    if (layer == DISPATCH_LAYER_UDP_PORT) {
+        dispatch_udp_port_bitmap[key >> 6] |= UINT64_C(1) << (key & 63);
+    }
+
+    LOG_PRINTLN(LOG_DISPATCH, LOG_DEBUG, ("register dispatch (layer=%u, key=0x%04" PRIx16 ", id=%" PRIu16 ")", layer, key, id));
+
+    return true;
+}
+
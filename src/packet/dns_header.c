@@ -1,15 +1,26 @@
 
 #include "packet/packet.h"
+#include "packet/dispatch.h"
+#include "packet/port.h"
 #include "log.h"
+#include "hash.h"
 
 #include <string.h>
+#include <strings.h>
+#include <ctype.h>
 #include <inttypes.h>
 
 #define DNS_STORAGE_INIT_SIZE           8
+#define DNS_LABEL_POOL_SIZE             256
+#define DNS_QUERY_POOL_SIZE             32
+#define DNS_RR_POOL_SIZE                64
 #define DNS_QUERY_FAILURE_EXIT
 #define DNS_FAILURE_EXIT                dns_header_free((header_t *) dns); \
                                         return NULL
 #define DNS_LABEL_NEW                   label = dns_label_new(); \
+                                        if (label == NULL) { \
+                                            return false; \
+                                        } \
                                         if (!dns_header_decode_label(raw_packet, header_offset, field_offset, label)) { \
                                             dns_label_free(label); \
                                             return false; \
@@ -43,14 +54,23 @@ static header_storage_t         storage = {
     .init               = &entry
 };
 
-static dns_label_t              label[64];
-static uint16_t                 label_idx = 0;
+/**
+ * Labels, queries and resource records are taken from static pools. Every
+ * pool is a free list linked over the 'next' member, so that they can be
+ * returned when the DNS header is freed
+ */
+static dns_label_t              label[DNS_LABEL_POOL_SIZE];
+static dns_label_t             *label_free_list = NULL;
+
+static dns_query_t              query[DNS_QUERY_POOL_SIZE];
+static dns_query_t             *query_free_list = NULL;
 
-static dns_query_t              query[32];
-static uint16_t                 query_idx = 0;
+static dns_rr_t                 rr[DNS_RR_POOL_SIZE];
+static dns_rr_t                *rr_free_list    = NULL;
 
-static dns_rr_t                 rr[32];
-static uint16_t                 rr_idx = 0;
+static bool                     pool_initialized = false;
+
+static void dns_pool_init(void);
 
 // static dns_resource_record_a_t      a[8];
 // static uint16_t                     a_idx;
@@ -79,33 +99,91 @@ dns_header_new(void)
 void
 dns_header_free(header_t *header)
 {
+    dns_header_t *dns = (dns_header_t *) header;
+    
     LOG_PRINTLN(LOG_HEADER_DNS, LOG_DEBUG, ("DNS header free 0x%016" PRIxPTR, (unsigned long) header));
     
+    /* return sections to the pools */
+    if (dns->qd != NULL)        dns_query_free(dns->qd);
+    if (dns->an != NULL)        dns_rr_free(dns->an);
+    if (dns->ns != NULL)        dns_rr_free(dns->ns);
+    if (dns->ar != NULL)        dns_rr_free(dns->ar);
+    
     header_storage_free(header);
 }
 
+/*****************************************************************************
+ * Pool
+ */
+static void
+dns_pool_init(void)
+{
+    uint16_t i;
+    
+    for (i = 0; i < DNS_LABEL_POOL_SIZE; i++) {
+        label[i].next   = label_free_list;
+        label_free_list = &label[i];
+    }
+    
+    for (i = 0; i < DNS_QUERY_POOL_SIZE; i++) {
+        query[i].next   = query_free_list;
+        query_free_list = &query[i];
+    }
+    
+    for (i = 0; i < DNS_RR_POOL_SIZE; i++) {
+        rr[i].next      = rr_free_list;
+        rr_free_list    = &rr[i];
+    }
+    
+    pool_initialized = true;
+}
+
 /*****************************************************************************
  * Label
  */
 dns_label_t *
 dns_label_new(void)
 {
-    return &label[label_idx++];
+    dns_label_t *new_label;
+    
+    if (!pool_initialized) {
+        dns_pool_init();
+    }
+    
+    if (label_free_list == NULL) {
+        LOG_PRINTLN(LOG_HEADER_DNS, LOG_ERROR, ("label pool exhausted (size=%u)", DNS_LABEL_POOL_SIZE));
+        return NULL;
+    }
+    
+    new_label           = label_free_list;
+    label_free_list     = new_label->next;
+    
+    new_label->len      = 0;
+    new_label->value[0] = 0;
+    new_label->next     = NULL;
+    
+    return new_label;
 }
 
 void
 dns_label_free(dns_label_t *label)
 {
-    if (label->next != NULL) dns_label_free(label->next);
+    dns_label_t *next;
     
-    /* TODO: free current label */
+    /* return the whole list */
+    for (; label != NULL; label = next) {
+        next            = label->next;
+        label->next     = label_free_list;
+        label_free_list = label;
+    }
 }
 
 /**
  *
  * @param   field_offset        offset of the start of the label (len or pointer)
  *
- * TODO: check offset range and return false if out-of-range!
+ * Compression pointers must point backwards, so a pointer loop can not
+ * recurse endlessly.
  */
 static bool
 dns_header_decode_label(raw_packet_t *raw_packet, packet_offset_t header_offset, packet_offset_t *field_offset, dns_label_t *label)
@@ -118,12 +196,22 @@ dns_header_decode_label(raw_packet_t *raw_packet, packet_offset_t header_offset,
 
     do {
 
+        if (raw_packet->len < (*field_offset + DNS_LABEL_SIZE_LEN)) {
+            LOG_PRINTLN(LOG_HEADER_DNS, LOG_ERROR, ("decode DNS label: out of range (offset=%" PRIoffset ", len=%" PRIoffset ")", *field_offset, raw_packet->len));
+            return false;
+        }
+
         /* len */
         len = raw_packet->data[*field_offset + DNS_LABEL_OFFSET_LEN];
 
         /* it's a pointer? */
         if ((len & DNS_LABEL_POINTER_MASK) == DNS_LABEL_POINTER_MASK) {
 
+            if (raw_packet->len < (*field_offset + DNS_LABEL_SIZE_POINTER)) {
+                LOG_PRINTLN(LOG_HEADER_DNS, LOG_ERROR, ("decode DNS label: pointer out of range (offset=%" PRIoffset ", len=%" PRIoffset ")", *field_offset, raw_packet->len));
+                return false;
+            }
+
             /* fetch the whole pointer (16-bit) */
             uint8_to_uint16(&pointer,  &(raw_packet->data[*field_offset + DNS_QUERY_OFFSET_QTYPE]));
 
@@ -133,8 +221,16 @@ dns_header_decode_label(raw_packet_t *raw_packet, packet_offset_t header_offset,
             /* add header offset */
             pointer += header_offset;
 
+            /* only backward pointers, otherwise a loop is possible */
+            if (pointer >= *field_offset) {
+                LOG_PRINTLN(LOG_HEADER_DNS, LOG_ERROR, ("decode DNS label: invalid pointer (pointer=%" PRIoffset ", offset=%" PRIoffset ")", pointer, *field_offset));
+                return false;
+            }
+
             /* decode label with dummy field offset */
-            dns_header_decode_label(raw_packet, header_offset, &pointer, label);
+            if (!dns_header_decode_label(raw_packet, header_offset, &pointer, label)) {
+                return false;
+            }
 
             *field_offset  += DNS_LABEL_SIZE_POINTER;
             valid           = false;
@@ -142,6 +238,11 @@ dns_header_decode_label(raw_packet_t *raw_packet, packet_offset_t header_offset,
         /* it's a length */
         } else if (len != 0) {
 
+            if (len > DNS_LABEL_MAX_LEN || raw_packet->len < (*field_offset + DNS_LABEL_SIZE_LEN + len)) {
+                LOG_PRINTLN(LOG_HEADER_DNS, LOG_ERROR, ("decode DNS label: invalid length (label=%" PRIu8 ", offset=%" PRIoffset ", len=%" PRIoffset ")", len, *field_offset, raw_packet->len));
+                return false;
+            }
+
             label->len = len;
 
             memcpy(label->value,  &(raw_packet->data[*field_offset + DNS_LABEL_OFFSET_VALUE]), label->len);
@@ -150,6 +251,10 @@ dns_header_decode_label(raw_packet_t *raw_packet, packet_offset_t header_offset,
             label->next     = dns_label_new();
             label           = label->next;
 
+            if (label == NULL) {
+                return false;
+            }
+
         /* it's a zero */
         } else {
             *field_offset  += DNS_LABEL_SIZE_LEN;
@@ -168,13 +273,39 @@ dns_header_decode_label(raw_packet_t *raw_packet, packet_offset_t header_offset,
 dns_query_t *
 dns_query_new(void)
 {
-    return &query[query_idx++];
+    dns_query_t *new_query;
+    
+    if (!pool_initialized) {
+        dns_pool_init();
+    }
+    
+    if (query_free_list == NULL) {
+        LOG_PRINTLN(LOG_HEADER_DNS, LOG_ERROR, ("query pool exhausted (size=%u)", DNS_QUERY_POOL_SIZE));
+        return NULL;
+    }
+    
+    new_query           = query_free_list;
+    query_free_list     = new_query->next;
+    
+    memset(new_query, 0, sizeof(dns_query_t));
+    
+    return new_query;
 }
 
 void 
 dns_query_free(dns_query_t *query)
 {
+    dns_query_t *next;
     
+    /* return the whole list */
+    for (; query != NULL; query = next) {
+        next            = query->next;
+        
+        if (query->qname != NULL) dns_label_free(query->qname);
+        
+        query->next     = query_free_list;
+        query_free_list = query;
+    }
 }
 
 static bool
@@ -192,12 +323,21 @@ dns_header_decode_query(raw_packet_t *raw_packet, packet_offset_t header_offset,
         /* qname */
         label = dns_label_new();
 
+        if (label == NULL) {
+            return false;
+        }
+
         if (!dns_header_decode_label(raw_packet, header_offset, field_offset, label)) {
             dns_label_free(label);
             return false;
         }
         query->qname = label;
 
+        if (raw_packet->len < (*field_offset + DNS_QUERY_SIZE)) {
+            LOG_PRINTLN(LOG_HEADER_DNS, LOG_ERROR, ("decode DNS query: size too small (present=%" PRIoffset ", required=%" PRIoffset ")", raw_packet->len - *field_offset, DNS_QUERY_SIZE));
+            return false;
+        }
+
         /* qtype + qclass */
         uint8_to_uint16(&(query->qtype),  &(raw_packet->data[*field_offset + DNS_QUERY_OFFSET_QTYPE]));
         uint8_to_uint16(&(query->qclass), &(raw_packet->data[*field_offset + DNS_QUERY_OFFSET_QCLASS]));
@@ -208,6 +348,10 @@ dns_header_decode_query(raw_packet_t *raw_packet, packet_offset_t header_offset,
         if (count > 1) {
             query->next = dns_query_new();
             query       = query->next;
+
+            if (query == NULL) {
+                return false;
+            }
         }
     }
 
@@ -231,13 +375,50 @@ dns_rr_new()
     }
     */
     
-    return &rr[rr_idx++];
+    dns_rr_t *new_rr;
+    
+    if (!pool_initialized) {
+        dns_pool_init();
+    }
+    
+    if (rr_free_list == NULL) {
+        LOG_PRINTLN(LOG_HEADER_DNS, LOG_ERROR, ("resource record pool exhausted (size=%u)", DNS_RR_POOL_SIZE));
+        return NULL;
+    }
+    
+    new_rr              = rr_free_list;
+    rr_free_list        = new_rr->next;
+    
+    memset(new_rr, 0, sizeof(dns_rr_t));
+    
+    return new_rr;
 }
 
 void
 dns_rr_free(dns_rr_t *rr)
 {
+    dns_rr_t *next;
     
+    /* return the whole list */
+    for (; rr != NULL; rr = next) {
+        next            = rr->next;
+        
+        if (rr->name != NULL) dns_label_free(rr->name);
+        
+        switch (rr->type) {
+            case DNS_TYPE_NS:       if (rr->ns.nsdname    != NULL) dns_label_free(rr->ns.nsdname);      break;
+            case DNS_TYPE_CNAME:    if (rr->cname.cname   != NULL) dns_label_free(rr->cname.cname);     break;
+            case DNS_TYPE_SOA:      if (rr->soa.mname     != NULL) dns_label_free(rr->soa.mname);
+                                    if (rr->soa.rname     != NULL) dns_label_free(rr->soa.rname);
+                                    break;
+            case DNS_TYPE_PTR:      if (rr->ptr.ptrdname  != NULL) dns_label_free(rr->ptr.ptrdname);    break;
+            case DNS_TYPE_MX:       if (rr->mx.exchange   != NULL) dns_label_free(rr->mx.exchange);     break;
+            default:                                                                                    break;
+        }
+        
+        rr->next        = rr_free_list;
+        rr_free_list    = rr;
+    }
 }
 
 static bool
@@ -263,10 +444,20 @@ dns_header_decode_rr(raw_packet_t *raw_packet, packet_offset_t header_offset, pa
 
         *field_offset += DNS_RR_SIZE;
 
+        if (raw_packet->len < (*field_offset + rr->rdlength)) {
+            LOG_PRINTLN(LOG_HEADER_DNS, LOG_ERROR, ("decode DNS resource record: rdata out of range (rdlength=%" PRIu16 ", offset=%" PRIoffset ", len=%" PRIoffset ")", rr->rdlength, *field_offset, raw_packet->len));
+            return false;
+        }
+
+        rr->rdata = &(raw_packet->data[*field_offset]);
+
         /* decode type */
-        /* TODO: check offset range and return false if out-of-range! */
         switch (rr->type) {
-            case DNS_TYPE_A:            memcpy(&(rr->a.ipv4_address), &(raw_packet->data[*field_offset]),  rr->rdlength);
+            case DNS_TYPE_A:            if (rr->rdlength != IPV4_ADDRESS_LEN) {
+                                            LOG_PRINTLN(LOG_HEADER_DNS, LOG_ERROR, ("decode DNS resource record: invalid A rdlength (rdlength=%" PRIu16 ")", rr->rdlength));
+                                            return false;
+                                        }
+                                        memcpy(&(rr->a.ipv4_address), &(raw_packet->data[*field_offset]),  rr->rdlength);
                                         *field_offset += rr->rdlength;
                                         break;
 
@@ -283,6 +474,10 @@ dns_header_decode_rr(raw_packet_t *raw_packet, packet_offset_t header_offset, pa
                                         DNS_LABEL_NEW
                                         rr->soa.rname = label;
 
+                                        if (raw_packet->len < (*field_offset + DNS_RR_SOA_SIZE)) {
+                                            return false;
+                                        }
+
                                         uint8_to_uint32(&(rr->soa.serial),  &(raw_packet->data[*field_offset + DNS_RR_SOA_OFFSET_SERIAL]));
                                         uint8_to_uint32(&(rr->soa.refresh), &(raw_packet->data[*field_offset + DNS_RR_SOA_OFFSET_REFRESH]));
                                         uint8_to_uint32(&(rr->soa.retry),   &(raw_packet->data[*field_offset + DNS_RR_SOA_OFFSET_RETRY]));
@@ -296,7 +491,11 @@ dns_header_decode_rr(raw_packet_t *raw_packet, packet_offset_t header_offset, pa
                                         rr->ptr.ptrdname = label;
                                         break;
 
-            case DNS_TYPE_MX:           uint8_to_uint16(&(rr->mx.preference),  &(raw_packet->data[*field_offset + DNS_RR_MX_OFFSET_PREFERENCE]));
+            case DNS_TYPE_MX:           if (raw_packet->len < (*field_offset + DNS_RR_MX_SIZE)) {
+                                            return false;
+                                        }
+
+                                        uint8_to_uint16(&(rr->mx.preference),  &(raw_packet->data[*field_offset + DNS_RR_MX_OFFSET_PREFERENCE]));
                                         *field_offset += DNS_RR_MX_SIZE;
 
                                         DNS_LABEL_NEW
@@ -312,6 +511,10 @@ dns_header_decode_rr(raw_packet_t *raw_packet, packet_offset_t header_offset, pa
         if (count > 1) {
             rr->next    = dns_rr_new();
             rr          = rr->next;
+
+            if (rr == NULL) {
+                return false;
+            }
         }
     }
 
@@ -322,6 +525,31 @@ dns_header_decode_rr(raw_packet_t *raw_packet, packet_offset_t header_offset, pa
  * Convert
  */
 
+/**
+ * Hashes a list of labels case-insensitive (FNV-1a), the length octets are
+ * part of the hash, so "a.bc" and "ab.c" differ
+ */
+uint32_t
+dns_label_hash(const dns_label_t *label)
+{
+    uint32_t        hash = HASH_FNV1A_INIT;
+    uint8_t         i;
+    
+    for (; label != NULL; label = label->next) {
+        hash = hash_fnv1a(hash, label->len);
+        
+        if (label->len == 0) {
+            break;
+        }
+        
+        for (i = 0; i < label->len; i++) {
+            hash = hash_fnv1a(hash, tolower(label->value[i]));
+        }
+    }
+    
+    return hash;
+}
+
 /**
  * Converts a list of labels into a domain string.
  * Both arguments have to be re-allocated.
@@ -372,23 +600,273 @@ dns_convert_to_label_list(dns_label_t **label, const char *domain)
 }
 
 /*****************************************************************************
- * Encode / Decode
+ * Encode
  */
+
+/**
+ * Names already written to the message, a later name with the same
+ * suffix is replaced by a pointer to it (RFC 1035, 4.1.4)
+ */
+typedef struct _dns_encode_t {
+    raw_packet_t                   *raw_packet;
+    packet_offset_t                 header_offset;
+    packet_offset_t                 field_offset;
+    uint16_t                        names_size;
+    struct {
+        const dns_label_t          *label;          /**< suffix (list of labels) */
+        uint16_t                    pointer;        /**< offset relative to the DNS header */
+    } names[DNS_COMPRESSION_MAX];
+} dns_encode_t;
+
+static inline bool
+dns_encode_space(dns_encode_t *encode, packet_len_t len)
+{
+    if (encode->raw_packet->size < (encode->field_offset + len)) {
+        LOG_PRINTLN(LOG_HEADER_DNS, LOG_ERROR, ("encode DNS: size too small (size=%" PRIu16 ", required=%u)", encode->raw_packet->size, encode->field_offset + len));
+        return false;
+    }
+
+    return true;
+}
+
+/**
+ * Compares two lists of labels case-insensitive up to the zero label
+ */
+static bool
+dns_label_equal(const dns_label_t *a, const dns_label_t *b)
+{
+    for (; a != NULL && b != NULL; a = a->next, b = b->next) {
+        if (a->len != b->len || strncasecmp((const char *) a->value, (const char *) b->value, a->len) != 0) {
+            return false;
+        }
+
+        if (a->len == 0) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static bool
+dns_header_encode_label(dns_encode_t *encode, const dns_label_t *label)
+{
+    uint16_t        pointer;
+    uint16_t        i;
+
+    for (; label != NULL && label->len != 0; label = label->next) {
+
+        /* suffix already written? */
+        for (i = 0; i < encode->names_size; i++) {
+            if (dns_label_equal(label, encode->names[i].label)) {
+                if (!dns_encode_space(encode, DNS_LABEL_SIZE_POINTER)) {
+                    return false;
+                }
+
+                pointer = (DNS_LABEL_POINTER_MASK << 8) | encode->names[i].pointer;
+                uint16_to_uint8(&(encode->raw_packet->data[encode->field_offset]), &pointer);
+                encode->field_offset += DNS_LABEL_SIZE_POINTER;
+
+                return true;
+            }
+        }
+
+        if (label->len > DNS_LABEL_MAX_LEN || !dns_encode_space(encode, DNS_LABEL_SIZE_LEN + label->len)) {
+            return false;
+        }
+
+        /* remember suffix */
+        pointer = encode->field_offset - encode->header_offset;
+        if (encode->names_size < DNS_COMPRESSION_MAX && pointer <= DNS_COMPRESSION_MAX_OFFSET) {
+            encode->names[encode->names_size].label     = label;
+            encode->names[encode->names_size].pointer   = pointer;
+            encode->names_size++;
+        }
+
+        encode->raw_packet->data[encode->field_offset + DNS_LABEL_OFFSET_LEN] = label->len;
+        memcpy(&(encode->raw_packet->data[encode->field_offset + DNS_LABEL_OFFSET_VALUE]), label->value, label->len);
+        encode->field_offset += DNS_LABEL_SIZE_LEN + label->len;
+    }
+
+    /* zero label (root) */
+    if (!dns_encode_space(encode, DNS_LABEL_SIZE_LEN)) {
+        return false;
+    }
+
+    encode->raw_packet->data[encode->field_offset] = 0;
+    encode->field_offset += DNS_LABEL_SIZE_LEN;
+
+    return true;
+}
+
+static bool
+dns_header_encode_query(dns_encode_t *encode, const dns_query_t *query, uint16_t *count)
+{
+    for (*count = 0; query != NULL; query = query->next, (*count)++) {
+        if (!dns_header_encode_label(encode, query->qname) || !dns_encode_space(encode, DNS_QUERY_SIZE)) {
+            return false;
+        }
+
+        uint16_to_uint8(&(encode->raw_packet->data[encode->field_offset + DNS_QUERY_OFFSET_QTYPE]),  &(query->qtype));
+        uint16_to_uint8(&(encode->raw_packet->data[encode->field_offset + DNS_QUERY_OFFSET_QCLASS]), &(query->qclass));
+
+        encode->field_offset += DNS_QUERY_SIZE;
+    }
+
+    return true;
+}
+
+static bool
+dns_header_encode_rr(dns_encode_t *encode, const dns_rr_t *rr, uint16_t *count)
+{
+    packet_offset_t rr_offset;      /**< offset of type, class, ttl and rdlength */
+    packet_offset_t rdata_offset;
+    uint16_t        rdlength;
+
+    for (*count = 0; rr != NULL; rr = rr->next, (*count)++) {
+        if (!dns_header_encode_label(encode, rr->name) || !dns_encode_space(encode, DNS_RR_SIZE)) {
+            return false;
+        }
+
+        rr_offset               = encode->field_offset;
+        encode->field_offset   += DNS_RR_SIZE;
+        rdata_offset            = encode->field_offset;
+
+        uint16_to_uint8(&(encode->raw_packet->data[rr_offset + DNS_RR_OFFSET_TYPE]),  &(rr->type));                    /**< Type */
+        uint16_to_uint8(&(encode->raw_packet->data[rr_offset + DNS_RR_OFFSET_CLASS]), &(rr->klass));                   /**< Class */
+        uint32_to_uint8(&(encode->raw_packet->data[rr_offset + DNS_RR_OFFSET_TTL]),   &(rr->ttl));                     /**< TTL */
+
+        /* rdata */
+        switch (rr->type) {
+            case DNS_TYPE_A:            if (!dns_encode_space(encode, IPV4_ADDRESS_LEN)) {
+                                            return false;
+                                        }
+                                        memcpy(&(encode->raw_packet->data[encode->field_offset]), &(rr->a.ipv4_address), IPV4_ADDRESS_LEN);
+                                        encode->field_offset += IPV4_ADDRESS_LEN;
+                                        break;
+
+            case DNS_TYPE_NS:           if (!dns_header_encode_label(encode, rr->ns.nsdname))     return false;
+                                        break;
+
+            case DNS_TYPE_CNAME:        if (!dns_header_encode_label(encode, rr->cname.cname))    return false;
+                                        break;
+
+            case DNS_TYPE_PTR:          if (!dns_header_encode_label(encode, rr->ptr.ptrdname))   return false;
+                                        break;
+
+            case DNS_TYPE_SOA:          if (!dns_header_encode_label(encode, rr->soa.mname) ||
+                                            !dns_header_encode_label(encode, rr->soa.rname) ||
+                                            !dns_encode_space(encode, DNS_RR_SOA_SIZE)) {
+                                            return false;
+                                        }
+                                        uint32_to_uint8(&(encode->raw_packet->data[encode->field_offset + DNS_RR_SOA_OFFSET_SERIAL]),  &(rr->soa.serial));
+                                        uint32_to_uint8(&(encode->raw_packet->data[encode->field_offset + DNS_RR_SOA_OFFSET_REFRESH]), &(rr->soa.refresh));
+                                        uint32_to_uint8(&(encode->raw_packet->data[encode->field_offset + DNS_RR_SOA_OFFSET_RETRY]),   &(rr->soa.retry));
+                                        uint32_to_uint8(&(encode->raw_packet->data[encode->field_offset + DNS_RR_SOA_OFFSET_EXPIRE]),  &(rr->soa.expire));
+                                        uint32_to_uint8(&(encode->raw_packet->data[encode->field_offset + DNS_RR_SOA_OFFSET_MINIMUM]), &(rr->soa.minimum));
+                                        encode->field_offset += DNS_RR_SOA_SIZE;
+                                        break;
+
+            case DNS_TYPE_MX:           if (!dns_encode_space(encode, DNS_RR_MX_SIZE)) {
+                                            return false;
+                                        }
+                                        uint16_to_uint8(&(encode->raw_packet->data[encode->field_offset + DNS_RR_MX_OFFSET_PREFERENCE]), &(rr->mx.preference));
+                                        encode->field_offset += DNS_RR_MX_SIZE;
+
+                                        if (!dns_header_encode_label(encode, rr->mx.exchange))    return false;
+                                        break;
+
+            /* opaque rdata (OPT, DNSSEC, ...) is copied as it was decoded, it must not contain compressed names */
+            case DNS_TYPE_OPT:
+            default:                    if (rr->rdlength > 0 && rr->rdata == NULL) {
+                                            LOG_PRINTLN(LOG_HEADER_DNS, LOG_ERROR, ("encode DNS resource record: no rdata (type=%" PRIu16 ")", rr->type));
+                                            return false;
+                                        }
+                                        if (!dns_encode_space(encode, rr->rdlength)) {
+                                            return false;
+                                        }
+                                        memcpy(&(encode->raw_packet->data[encode->field_offset]), rr->rdata, rr->rdlength);
+                                        encode->field_offset += rr->rdlength;
+                                        break;
+        }
+
+        rdlength = encode->field_offset - rdata_offset;
+        uint16_to_uint8(&(encode->raw_packet->data[rr_offset + DNS_RR_OFFSET_RDLENGTH]), &rdlength);                  /**< RD Length */
+    }
+
+    return true;
+}
+
+/****************************************************************************
+ * dns_header_encode
+ *
+ * Builds the whole message (header, question, answer, authority and
+ * additional section) with message compression. The section counts are
+ * taken from the lists, not from the *_count members
+ *
+ * @param  this                     logical packet to be read
+ * @param  raw_packet               raw packet to be written
+ * @param  offset                   offset from origin to dns header
+ * @return                          number of bytes written to raw packet
+ ***************************************************************************/
 packet_len_t
 dns_header_encode(netif_t *netif, packet_t *packet, raw_packet_t *raw_packet, packet_offset_t offset)
 {
-    packet_len_t    len;
-    len = 0;
-    
-    return len;
+    dns_header_t   *dns;
+    dns_encode_t    encode;
+
+    if (packet->tail == NULL || packet->tail->klass->type != PACKET_TYPE_DNS) {
+        return 0;
+    }
+    dns             = (dns_header_t *) packet->tail;
+    packet->tail    = dns->header.next;
+
+    encode.raw_packet       = raw_packet;
+    encode.header_offset    = offset;
+    encode.field_offset     = offset;
+    encode.names_size       = 0;
+
+    if (!dns_encode_space(&encode, DNS_HEADER_LEN)) {
+        return 0;
+    }
+
+    encode.field_offset    += DNS_HEADER_LEN;
+
+    if (!dns_header_encode_query(&encode, dns->qd, &(dns->qd_count)) ||
+        !dns_header_encode_rr(&encode, dns->an, &(dns->an_count)) ||
+        !dns_header_encode_rr(&encode, dns->ns, &(dns->ns_count)) ||
+        !dns_header_encode_rr(&encode, dns->ar, &(dns->ar_count))) {
+        return 0;
+    }
+
+    uint16_to_uint8(&(raw_packet->data[offset + DNS_HEADER_OFFSET_ID]),        &(dns->id));
+    uint16_to_uint8(&(raw_packet->data[offset + DNS_HEADER_OFFSET_FLAGS]),     &(dns->flags.raw));
+    uint16_to_uint8(&(raw_packet->data[offset + DNS_HEADER_OFFSET_QD_COUNT]),  &(dns->qd_count));
+    uint16_to_uint8(&(raw_packet->data[offset + DNS_HEADER_OFFSET_AN_COUNT]),  &(dns->an_count));
+    uint16_to_uint8(&(raw_packet->data[offset + DNS_HEADER_OFFSET_NS_COUNT]),  &(dns->ns_count));
+    uint16_to_uint8(&(raw_packet->data[offset + DNS_HEADER_OFFSET_AR_COUNT]),  &(dns->ar_count));
+
+    LOG_PRINTLN(LOG_HEADER_DNS, LOG_DEBUG, ("encode DNS message: id=0x%04" PRIx16 ", len=%u", dns->id, encode.field_offset - offset));
+
+    return encode.field_offset - offset;
 }
 
+/*****************************************************************************
+ * Decode
+ */
 header_t *
 dns_header_decode(netif_t *netif, packet_t *packet, raw_packet_t *raw_packet, packet_offset_t offset)
 {
     dns_header_t       *dns = dns_header_new();
     packet_offset_t     field_offset;
 
+    /* sections are returned to their pools by dns_header_free(), the storage
+       still holds the pointers of the previous packet */
+    dns->qd = NULL;
+    dns->an = NULL;
+    dns->ns = NULL;
+    dns->ar = NULL;
+
     if (raw_packet->len < (offset + DNS_HEADER_LEN)) {
         LOG_PRINTLN(LOG_HEADER_DNS, LOG_ERROR, ("decode DNS header: size too small (present=%u, required=%u)", raw_packet->len - offset, DNS_HEADER_LEN));
         DNS_FAILURE_EXIT;
@@ -403,21 +881,27 @@ dns_header_decode(netif_t *netif, packet_t *packet, raw_packet_t *raw_packet, pa
     uint8_to_uint16(&(dns->ar_count),   &(raw_packet->data[offset + DNS_HEADER_OFFSET_AR_COUNT]));
     
     field_offset = offset + DNS_HEADER_LEN;
+    dns->offset  = offset;
+    dns->qd_len  = 0;
     
     /* question section */
     if (dns->qd_count > 0) {
         dns->qd = dns_query_new();
-        if (!dns_header_decode_query(raw_packet, offset, &field_offset, dns->qd_count, dns->qd)) {
-            dns_query_free(dns->qd);
+        if (dns->qd == NULL || !dns_header_decode_query(raw_packet, offset, &field_offset, dns->qd_count, dns->qd)) {
             DNS_FAILURE_EXIT;
         }
+        dns->qd_len = field_offset - offset - DNS_HEADER_LEN;
+    }
+    
+    /* first fragment: the records are cut off, header and question are enough to account the response */
+    if (packet->fragment) {
+        return (header_t *) dns;
     }
     
     /* answer records section */
     if (dns->an_count > 0) {
         dns->an = dns_rr_new();
-        if (!dns_header_decode_rr(raw_packet, offset, &field_offset, dns->an_count, dns->an)) {
-            dns_rr_free(dns->an);
+        if (dns->an == NULL || !dns_header_decode_rr(raw_packet, offset, &field_offset, dns->an_count, dns->an)) {
             DNS_FAILURE_EXIT;
         }
     }
@@ -425,8 +909,7 @@ dns_header_decode(netif_t *netif, packet_t *packet, raw_packet_t *raw_packet, pa
     /* authority records section */
     if (dns->ns_count > 0) {
         dns->ns = dns_rr_new();
-        if (!dns_header_decode_rr(raw_packet, offset, &field_offset, dns->ns_count, dns->ns)) {
-            dns_rr_free(dns->ns);
+        if (dns->ns == NULL || !dns_header_decode_rr(raw_packet, offset, &field_offset, dns->ns_count, dns->ns)) {
             DNS_FAILURE_EXIT;
         }
     }
@@ -434,8 +917,7 @@ dns_header_decode(netif_t *netif, packet_t *packet, raw_packet_t *raw_packet, pa
     /* additional records section */
     if (dns->ar_count > 0) {
         dns->ar = dns_rr_new();
-        if (!dns_header_decode_rr(raw_packet, offset, &field_offset, dns->ar_count, dns->ar)) {
-            dns_rr_free(dns->ar);
+        if (dns->ar == NULL || !dns_header_decode_rr(raw_packet, offset, &field_offset, dns->ar_count, dns->ar)) {
             DNS_FAILURE_EXIT;
         }
     }
@@ -443,3 +925,8 @@ dns_header_decode(netif_t *netif, packet_t *packet, raw_packet_t *raw_packet, pa
     return (header_t *) dns;
 }
 
+DISPATCH_REGISTER(dns_header)
+{
+    dispatch_register(DISPATCH_LAYER_UDP_PORT, PORT_DNS, dns_header_decode, dns_header_encode);
+}
+
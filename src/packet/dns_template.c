@@ -0,0 +1,211 @@
+#include "packet/dns_template.h"
+#include "packet/port.h"
+#include "log.h"
+
+#include <string.h>
+#include <inttypes.h>
+
+/****************************************************************************
+ * dns_template_compile
+ *
+ * Encodes the IPv4, UDP and DNS header of a response without question
+ * once. Addresses, ports, lengths and checksums are patched by
+ * dns_template_apply()
+ *
+ * @param  template                 template to be written
+ * @param  rcode                    response code (e.g. REFUSED)
+ * @param  truncated                set TC flag, the client retries over TCP
+ * @return                          true on success
+ ***************************************************************************/
+bool
+dns_template_compile(dns_template_t *template, uint8_t rcode, bool truncated)
+{
+    uint8_t             buffer[ETHERNET_HEADER_LEN + DNS_TEMPLATE_LEN];
+    raw_packet_t        raw_packet;
+    packet_t           *packet;
+    ethernet_header_t  *ether;
+    ipv4_header_t      *ipv4;
+    udpv4_header_t     *udpv4;
+    dns_header_t       *dns;
+    bool                encoded;
+
+    if ((packet = packet_new()) == NULL) {
+        return false;
+    }
+
+    raw_packet_init(&raw_packet, buffer, sizeof(buffer));
+
+    ether                   = ethernet_header_new();
+    ipv4                    = ipv4_header_new();
+    udpv4                   = udpv4_header_new();
+    dns                     = dns_header_new();
+
+    packet->head            = (header_t *) ether;
+    ether->header.next      = (header_t *) ipv4;
+    ipv4->header.next       = (header_t *) udpv4;
+    udpv4->header.next      = (header_t *) dns;
+
+    /* Ethernet: written per response */
+    memset(&(ether->dest), 0, sizeof(ether->dest));
+    memset(&(ether->src),  0, sizeof(ether->src));
+    ether->type             = ETHERTYPE_IPV4;
+
+    /* IPv4: addresses, length, ID and checksum are patched */
+    ipv4->version           = IPV4_HEADER_VERSION;
+    ipv4->ihl               = IPV4_HEADER_IHL;
+    ipv4->tos               = 0;
+    ipv4->id                = 0;
+    ipv4->flags_offset      = IPV4_HEADER_MASK_DONT_FRAGMENT;
+    ipv4->ttl               = DNS_TEMPLATE_TTL;
+    ipv4->protocol          = IPV4_PROTOCOL_UDP;
+    memset(&(ipv4->src),  0, sizeof(ipv4->src));
+    memset(&(ipv4->dest), 0, sizeof(ipv4->dest));
+
+    /* UDP: destination port, length and checksum are patched */
+    udpv4->src_port         = PORT_DNS;
+    udpv4->dest_port        = 0;
+
+    /* DNS: ID, opcode, RD, CD and QDCOUNT are patched */
+    dns->id                 = 0;
+    dns->flags.raw          = DNS_HEADER_FLAG_QR | (rcode & DNS_HEADER_MASK_RCODE);
+    dns->flags.tc           = truncated;
+    dns->qd                 = NULL;
+    dns->an                 = NULL;
+    dns->ns                 = NULL;
+    dns->ar                 = NULL;
+
+    encoded = packet_encode(NULL, packet, &raw_packet) && raw_packet.len == sizeof(buffer);
+
+    if (encoded) {
+        memcpy(template->data, &(buffer[ETHERNET_HEADER_LEN]), DNS_TEMPLATE_LEN);
+
+        /* checksums are calculated per response over the zeroed fields */
+        memset(&(template->data[DNS_TEMPLATE_OFFSET_IPV4  + IPV4_HEADER_OFFSET_CHECKSUM]),  0, sizeof(uint16_t));
+        memset(&(template->data[DNS_TEMPLATE_OFFSET_UDPV4 + UDPV4_HEADER_OFFSET_CHECKSUM]), 0, sizeof(uint16_t));
+        template->flags     = dns->flags.raw;
+        template->id        = 0;
+
+        LOG_PRINTLN(LOG_HEADER_DNS, LOG_DEBUG, ("compiled DNS template: flags=0x%04" PRIx16, template->flags));
+    } else {
+        LOG_PRINTLN(LOG_HEADER_DNS, LOG_ERROR, ("could not compile DNS template (rcode=%u, tc=%u)", rcode, truncated));
+    }
+
+    object_release(packet);
+
+    return encoded;
+}
+
+/****************************************************************************
+ * dns_template_apply
+ *
+ * Builds the response to a decoded query from a precompiled template. The
+ * innermost Ethernet, IPv4, UDP and DNS header of the query are used, so
+ * tunneled (mirrored) queries are answered without the tunnel
+ *
+ * @param  template                 precompiled template
+ * @param  query                    decoded query
+ * @param  query_raw                raw query (source of the question)
+ * @return                          response (to be released), NULL on error
+ ***************************************************************************/
+raw_packet_t *
+dns_template_apply(dns_template_t *template, packet_t *query, raw_packet_t *query_raw)
+{
+    ethernet_header_t  *ether   = NULL;
+    ipv4_header_t      *ipv4    = NULL;
+    udpv4_header_t     *udpv4   = NULL;
+    dns_header_t       *dns     = NULL;
+    header_t           *header;
+    raw_packet_t       *raw_packet;
+    uint8_t            *data;
+    packet_len_t        ethernet_len;
+    packet_len_t        ipv4_len;
+    packet_len_t        udpv4_len;
+    uint16_t            value;
+    uint32_t            sum;
+
+    for (header = query->head; header != NULL; header = header->next) {
+        switch (header->klass->type) {
+            case PACKET_TYPE_ETHERNET:  ether   = (ethernet_header_t *) header;     break;
+            case PACKET_TYPE_IPV4:      ipv4    = (ipv4_header_t *)     header;     break;
+            case PACKET_TYPE_UDPV4:     udpv4   = (udpv4_header_t *)    header;     break;
+            case PACKET_TYPE_DNS:       dns     = (dns_header_t *)      header;     break;
+            default:                                                                break;
+        }
+    }
+
+    if (ether == NULL || ipv4 == NULL || udpv4 == NULL || dns == NULL) {
+        return NULL;
+    }
+
+    /* never answer a response */
+    if (dns->flags.qr) {
+        return NULL;
+    }
+
+    if (query_raw->len < (dns->offset + DNS_HEADER_LEN + dns->qd_len)) {
+        return NULL;
+    }
+
+    ethernet_len    = (ether->type == ETHERTYPE_VLAN) ? VLAN_HEADER_LEN : ETHERNET_HEADER_LEN;
+    udpv4_len       = UDPV4_HEADER_LEN + DNS_HEADER_LEN + dns->qd_len;
+    ipv4_len        = IPV4_HEADER_LEN + udpv4_len;
+
+    if ((raw_packet = raw_packet_new(ethernet_len + ipv4_len)) == NULL) {
+        return NULL;
+    }
+
+    raw_packet->len = ethernet_len + ipv4_len;
+    data            = raw_packet->data;
+
+    /* Ethernet: swap addresses */
+    memcpy(&(data[ETHERNET_HEADER_OFFSET_DEST]), ether->src.addr,  sizeof(ether->src.addr));
+    memcpy(&(data[ETHERNET_HEADER_OFFSET_SRC]),  ether->dest.addr, sizeof(ether->dest.addr));
+    uint16_to_uint8(&(data[ETHERNET_HEADER_OFFSET_TYPE]), &(ether->type));
+
+    if (ether->type == ETHERTYPE_VLAN) {
+        uint16_to_uint8(&(data[VLAN_HEADER_OFFSET_VLAN]), &(ether->vlan.tci));
+        uint16_to_uint8(&(data[VLAN_HEADER_OFFSET_TYPE]), &(ether->vlan.type));
+    }
+
+    /* template */
+    data = &(data[ethernet_len]);
+    memcpy(data, template->data, DNS_TEMPLATE_LEN);
+
+    /* DNS: keep opcode, RD and CD of the query */
+    value = template->flags | (dns->flags.raw & (DNS_HEADER_MASK_OPCODE | DNS_HEADER_FLAG_RD | DNS_HEADER_FLAG_CD));
+    uint16_to_uint8(&(data[DNS_TEMPLATE_OFFSET_DNS + DNS_HEADER_OFFSET_ID]),       &(dns->id));
+    uint16_to_uint8(&(data[DNS_TEMPLATE_OFFSET_DNS + DNS_HEADER_OFFSET_FLAGS]),    &value);
+    value = (dns->qd_len > 0) ? dns->qd_count : 0;
+    uint16_to_uint8(&(data[DNS_TEMPLATE_OFFSET_DNS + DNS_HEADER_OFFSET_QD_COUNT]), &value);
+
+    memcpy(&(data[DNS_TEMPLATE_LEN]), &(query_raw->data[dns->offset + DNS_HEADER_LEN]), dns->qd_len);
+
+    /* UDP: swap ports, checksum over pseudo header, UDP header and payload */
+    uint16_to_uint8(&(data[DNS_TEMPLATE_OFFSET_UDPV4 + UDPV4_HEADER_OFFSET_SRC_PORT]),  &(udpv4->dest_port));
+    uint16_to_uint8(&(data[DNS_TEMPLATE_OFFSET_UDPV4 + UDPV4_HEADER_OFFSET_DEST_PORT]), &(udpv4->src_port));
+    uint16_to_uint8(&(data[DNS_TEMPLATE_OFFSET_UDPV4 + UDPV4_HEADER_OFFSET_LEN]),       &udpv4_len);
+
+    sum = raw_packet_sum_checksum(0,   ipv4->dest.addr, IPV4_ADDRESS_LEN);
+    sum = raw_packet_sum_checksum(sum, ipv4->src.addr,  IPV4_ADDRESS_LEN);
+    sum = sum + IPV4_PROTOCOL_UDP + udpv4_len;
+    sum = raw_packet_sum_checksum(sum, &(data[DNS_TEMPLATE_OFFSET_UDPV4]), udpv4_len);
+
+    value = raw_packet_fold_checksum(sum);
+    if (value == 0) {
+        value = 0xffff;
+    }
+    uint16_to_uint8(&(data[DNS_TEMPLATE_OFFSET_UDPV4 + UDPV4_HEADER_OFFSET_CHECKSUM]),  &value);
+
+    /* IPv4: swap addresses, checksum over the header */
+    template->id++;
+    uint16_to_uint8(&(data[DNS_TEMPLATE_OFFSET_IPV4 + IPV4_HEADER_OFFSET_LEN]),         &ipv4_len);
+    uint16_to_uint8(&(data[DNS_TEMPLATE_OFFSET_IPV4 + IPV4_HEADER_OFFSET_ID]),          &(template->id));
+    memcpy(&(data[DNS_TEMPLATE_OFFSET_IPV4 + IPV4_HEADER_OFFSET_SRC]),  ipv4->dest.addr, IPV4_ADDRESS_LEN);
+    memcpy(&(data[DNS_TEMPLATE_OFFSET_IPV4 + IPV4_HEADER_OFFSET_DEST]), ipv4->src.addr,  IPV4_ADDRESS_LEN);
+
+    value = raw_packet_calc_checksum((uint16_t *) &(data[DNS_TEMPLATE_OFFSET_IPV4]), IPV4_HEADER_LEN);
+    uint16_to_uint8(&(data[DNS_TEMPLATE_OFFSET_IPV4 + IPV4_HEADER_OFFSET_CHECKSUM]),    &value);
+
+    return raw_packet;
+}
+
@@ -1,6 +1,7 @@
 
 #include "packet/ethernet_header.h"
 #include "packet/header_storage.h"
+#include "packet/dispatch.h"
 #include "log.h"
 
 #include <string.h>
@@ -83,10 +84,11 @@ ethernet_header_encode(netif_t *netif, packet_t *packet, raw_packet_t *raw_packe
         ethernet_len        = ETHERNET_HEADER_LEN;
     }
     
-    /* decide */
-    switch(ethertype) {
-        case ETHERTYPE_IPV4:    len = ipv4_header_encode(netif, packet, raw_packet, offset + ethernet_len);         break;
-        default:                                                                                                    return 0;
+    /* decide: IPv4 directly, everything else through the registry */
+    if (DISPATCH_LIKELY(ethertype == ETHERTYPE_IPV4)) {
+        len = ipv4_header_encode(netif, packet, raw_packet, offset + ethernet_len);
+    } else {
+        len = dispatch_encode(DISPATCH_LAYER_ETHERTYPE, ethertype, netif, packet, raw_packet, offset + ethernet_len);
     }
     
     if (len == 0) {
@@ -153,10 +155,11 @@ ethernet_header_decode(netif_t *netif, packet_t *packet, raw_packet_t *raw_packe
         ethernet_len        = ETHERNET_HEADER_LEN;
     }
     
-    /* decide */
-    switch(ethertype) {
-        case ETHERTYPE_IPV4:    ether->header.next = ipv4_header_decode(netif, packet, raw_packet, offset + ethernet_len);  break;
-        default:                                                                                                    ETHERNET_FAILURE_EXIT;
+    /* decide: IPv4 directly, everything else through the registry */
+    if (DISPATCH_LIKELY(ethertype == ETHERTYPE_IPV4)) {
+        ether->header.next = ipv4_header_decode(netif, packet, raw_packet, offset + ethernet_len);
+    } else {
+        ether->header.next = dispatch_decode(DISPATCH_LAYER_ETHERTYPE, ethertype, netif, packet, raw_packet, offset + ethernet_len);
     }
     
     if (ether->header.next == NULL) {
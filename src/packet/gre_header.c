@@ -0,0 +1,185 @@
+#include "packet/packet.h"
+#include "packet/dispatch.h"
+#include "log.h"
+
+#include <string.h>
+#include <inttypes.h>
+
+#define GRE_STORAGE_INIT_SIZE       2
+#define GRE_FAILURE_EXIT            gre_header_free((header_t *) gre); \
+                                    return NULL
+
+static gre_header_t             gre[GRE_STORAGE_INIT_SIZE];
+static uint32_t                 idx[GRE_STORAGE_INIT_SIZE];
+
+static header_class_t           klass = {
+    .type               = PACKET_TYPE_GRE,
+    .size               = sizeof(gre_header_t),
+    .free               = gre_header_free
+};
+
+static header_storage_entry_t   entry = {
+    .allocator          = (header_t *) gre,
+    .allocator_size     = GRE_STORAGE_INIT_SIZE,
+    .available_idxs     = idx,
+    .available_size     = GRE_STORAGE_INIT_SIZE,
+    .next               = NULL
+};
+
+static header_storage_t         storage = {
+    .klass              = &klass,
+    .head               = NULL,
+    .init               = &entry
+};
+
+gre_header_t *
+gre_header_new(void)
+{
+    gre_header_t *header = (gre_header_t *) header_storage_new(&storage);
+
+    LOG_PRINTLN(LOG_HEADER_GRE, LOG_DEBUG, ("GRE header new 0x%016" PRIxPTR, (unsigned long) header));
+
+    return header;
+}
+
+void
+gre_header_free(header_t *header)
+{
+    if (header->next != NULL)   header->next->klass->free(header->next);
+
+    LOG_PRINTLN(LOG_HEADER_GRE, LOG_DEBUG, ("GRE header free 0x%016" PRIxPTR, (unsigned long) header));
+
+    header_storage_free(header);
+}
+
+/****************************************************************************
+ * gre_header_decode
+ *
+ * Decapsulates GRE, ERSPAN type I/II/III and IPv4-in-GRE. Inner Ethernet
+ * frames re-enter the Ethernet decoder, the outer headers stay in front of
+ * it in the header chain (attribution to the mirroring router)
+ *
+ * @param  this                     logical packet to be written
+ * @param  raw_packet               raw packet to be read
+ * @param  offset                   offset from origin to gre header
+ ***************************************************************************/
+header_t *
+gre_header_decode(netif_t *netif, packet_t *packet, raw_packet_t *raw_packet, packet_offset_t offset)
+{
+    gre_header_t   *gre = gre_header_new();
+    packet_len_t    gre_len;        /**< length of GRE header including optional fields */
+    packet_len_t    erspan_len;     /**< length of ERSPAN header (zero if none) */
+    packet_offset_t field_offset;   /**< offset of the next optional field */
+
+    if (raw_packet->len < (offset + GRE_HEADER_LEN)) {
+        LOG_PRINTLN(LOG_HEADER_GRE, LOG_ERROR, ("decode GRE header: size too small (present=%u, required=%u)", raw_packet->len - offset, GRE_HEADER_LEN));
+        GRE_FAILURE_EXIT;
+    }
+
+    /* fetch */
+    uint8_to_uint16(&(gre->flags_version), &(raw_packet->data[offset + GRE_HEADER_OFFSET_FLAGS]));             /**< Flags + Version */
+    uint8_to_uint16(&(gre->protocol),      &(raw_packet->data[offset + GRE_HEADER_OFFSET_PROTOCOL]));          /**< Protocol Type */
+
+    if (gre->version != GRE_HEADER_VERSION || gre->r) {
+        LOG_PRINTLN(LOG_HEADER_GRE, LOG_ERROR, ("decode GRE header: unsupported version or routing (flags=0x%04" PRIx16 ")", gre->flags_version));
+        GRE_FAILURE_EXIT;
+    }
+
+    /* optional fields */
+    gre->checksum       = 0;
+    gre->key            = 0;
+    gre->sequence       = 0;
+    gre->erspan.word0   = 0;
+    gre->erspan.word1   = 0;
+    gre->erspan.word2   = 0;
+    gre_len             = GRE_HEADER_LEN + (gre->c + gre->k + gre->s) * GRE_HEADER_OPTION_LEN;
+
+    if (raw_packet->len < (offset + gre_len)) {
+        LOG_PRINTLN(LOG_HEADER_GRE, LOG_ERROR, ("decode GRE header: size too small (present=%u, required=%u)", raw_packet->len - offset, gre_len));
+        GRE_FAILURE_EXIT;
+    }
+
+    field_offset = offset + GRE_HEADER_OFFSET_OPTION;
+
+    if (gre->c) {
+        uint8_to_uint16(&(gre->checksum), &(raw_packet->data[field_offset]));                                   /**< Checksum */
+        field_offset += GRE_HEADER_OPTION_LEN;
+    }
+
+    if (gre->k) {
+        uint8_to_uint32(&(gre->key), &(raw_packet->data[field_offset]));                                        /**< Key */
+        field_offset += GRE_HEADER_OPTION_LEN;
+    }
+
+    if (gre->s) {
+        uint8_to_uint32(&(gre->sequence), &(raw_packet->data[field_offset]));                                   /**< Sequence Number */
+        field_offset += GRE_HEADER_OPTION_LEN;
+    }
+
+    LOG_PRINTLN(LOG_HEADER_GRE, LOG_INFO, ("protocol=0x%04" PRIx16 " key=0x%08" PRIx32 " seq=%" PRIu32, gre->protocol, gre->key, gre->sequence));
+
+    /* ERSPAN header? */
+    erspan_len = 0;
+
+    switch (gre->protocol) {
+        case ETHERTYPE_ERSPAN_II:   if (!gre->s) {
+                                        gre->erspan.type = ERSPAN_TYPE_I;
+                                        break;
+                                    }
+                                    gre->erspan.type = ERSPAN_TYPE_II;
+                                    erspan_len       = ERSPAN_II_HEADER_LEN;
+                                    break;
+
+        case ETHERTYPE_ERSPAN_III:  gre->erspan.type = ERSPAN_TYPE_III;
+                                    erspan_len       = ERSPAN_III_HEADER_LEN;
+                                    break;
+
+        default:                    gre->erspan.type = ERSPAN_TYPE_NONE;
+                                    break;
+    }
+
+    if (erspan_len > 0) {
+        if (raw_packet->len < (offset + gre_len + erspan_len)) {
+            LOG_PRINTLN(LOG_HEADER_GRE, LOG_ERROR, ("decode ERSPAN header: size too small (present=%u, required=%u)", raw_packet->len - offset - gre_len, erspan_len));
+            GRE_FAILURE_EXIT;
+        }
+
+        uint8_to_uint32(&(gre->erspan.word0), &(raw_packet->data[offset + gre_len + ERSPAN_HEADER_OFFSET_WORD0]));
+        uint8_to_uint32(&(gre->erspan.word1), &(raw_packet->data[offset + gre_len + ERSPAN_HEADER_OFFSET_WORD1]));
+
+        if (gre->erspan.type == ERSPAN_TYPE_III) {
+            uint8_to_uint32(&(gre->erspan.word2), &(raw_packet->data[offset + gre_len + ERSPAN_HEADER_OFFSET_WORD2]));
+
+            /* platform specific sub-header */
+            if (gre->erspan.o) {
+                erspan_len += ERSPAN_III_SUBHEADER_LEN;
+            }
+        }
+
+        LOG_PRINTLN(LOG_HEADER_GRE, LOG_DEBUG, ("ERSPAN: type=%u version=%u session=%u vlan=%u truncated=%u", gre->erspan.type,
+                                                                                                        gre->erspan.version,
+                                                                                                        gre->erspan.session_id,
+                                                                                                        gre->erspan.vlan,
+                                                                                                        gre->erspan.truncated));
+    }
+
+    /* decide: ERSPAN carries an Ethernet frame behind its own header, everything else through the registry */
+    if (gre->erspan.type != ERSPAN_TYPE_NONE) {
+        gre->header.next = ethernet_header_decode(netif, packet, raw_packet, offset + gre_len + erspan_len);
+    } else {
+        gre->header.next = dispatch_decode(DISPATCH_LAYER_ETHERTYPE, gre->protocol, netif, packet, raw_packet, offset + gre_len);
+    }
+
+    if (gre->header.next == NULL) {
+        GRE_FAILURE_EXIT;
+    }
+
+    return (header_t *) gre;
+}
+
+DISPATCH_REGISTER(gre_header)
+{
+    dispatch_register(DISPATCH_LAYER_IP_PROTOCOL, IPV4_PROTOCOL_GRE, gre_header_decode, NULL);
+    dispatch_register(DISPATCH_LAYER_ETHERTYPE,   ETHERTYPE_TEB,     ethernet_header_decode, NULL);     /**< GRE payload */
+}
+
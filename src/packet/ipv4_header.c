@@ -1,4 +1,5 @@
 #include "packet/packet.h"
+#include "packet/dispatch.h"
 #include "log.h"
 
 #include <string.h>
@@ -79,10 +80,11 @@ ipv4_header_encode(netif_t *netif, packet_t *packet, raw_packet_t *raw_packet, p
         return 0;
     }
     
-    /* decide */
-    switch (ipv4->protocol) {
-        case IPV4_PROTOCOL_UDP:     len = udpv4_header_encode(netif, packet, raw_packet, offset + IPV4_HEADER_LEN); break;
-        default:                                                                                                    return 0;
+    /* decide: UDP directly, everything else through the registry */
+    if (DISPATCH_LIKELY(ipv4->protocol == IPV4_PROTOCOL_UDP)) {
+        len = udpv4_header_encode(netif, packet, raw_packet, offset + IPV4_HEADER_LEN);
+    } else {
+        len = dispatch_encode(DISPATCH_LAYER_IP_PROTOCOL, ipv4->protocol, netif, packet, raw_packet, offset + IPV4_HEADER_LEN);
     }
     
     if (len == 0) {
@@ -147,10 +149,19 @@ ipv4_header_decode(netif_t *netif, packet_t *packet, raw_packet_t *raw_packet, p
         memcpy(&(ipv4->src.addr),  &(raw_packet->data[offset + IPV4_HEADER_OFFSET_SRC]),  IPV4_ADDRESS_LEN);    /**< Source Address */
         memcpy(&(ipv4->dest.addr), &(raw_packet->data[offset + IPV4_HEADER_OFFSET_DEST]), IPV4_ADDRESS_LEN);    /**< Destination Address */
         
-        /* decide */
-        switch (ipv4->protocol) {
-            case IPV4_PROTOCOL_UDP:     ipv4->header.next = udpv4_header_decode(netif, packet, raw_packet, offset + IPV4_HEADER_LEN);   break;
-            default:                    IPV4_FAILURE_EXIT;
+        /* only the first fragment carries the transport header */
+        if (ipv4->fragment_offset != 0) {
+            LOG_PRINTLN(LOG_HEADER_IPV4, LOG_DEBUG, ("decode IPv4 header: non-first fragment (id=0x%04" PRIx16 ", offset=%u)", ipv4->id, ipv4->fragment_offset * 8));
+            IPV4_FAILURE_EXIT;
+        }
+        
+        packet->fragment = ipv4->more_fragments;
+        
+        /* decide: UDP directly, everything else through the registry */
+        if (DISPATCH_LIKELY(ipv4->protocol == IPV4_PROTOCOL_UDP)) {
+            ipv4->header.next = udpv4_header_decode(netif, packet, raw_packet, offset + IPV4_HEADER_LEN);
+        } else {
+            ipv4->header.next = dispatch_decode(DISPATCH_LAYER_IP_PROTOCOL, ipv4->protocol, netif, packet, raw_packet, offset + IPV4_HEADER_LEN);
         }
         
         if (ipv4->header.next == NULL) {
@@ -166,3 +177,8 @@ ipv4_header_decode(netif_t *netif, packet_t *packet, raw_packet_t *raw_packet, p
     }
 }
 
+DISPATCH_REGISTER(ipv4_header)
+{
+    dispatch_register(DISPATCH_LAYER_ETHERTYPE, ETHERTYPE_IPV4, ipv4_header_decode, ipv4_header_encode);
+}
+
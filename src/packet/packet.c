@@ -44,10 +44,30 @@ packet_encode(netif_t *netif, packet_t *packet, raw_packet_t *raw_packet)
     return (raw_packet->len == 0) ? false : true;
 }
 
+/**
+ * Returns the innermost header of a type (the last one in the chain),
+ * tunneled packets carry the outer headers in front of it
+ */
+header_t *
+packet_get_header(packet_t *packet, header_type_t type)
+{
+    header_t *header;
+    header_t *found = NULL;
+    
+    for (header = packet->head; header != NULL; header = header->next) {
+        if (header->klass->type == type) {
+            found = header;
+        }
+    }
+    
+    return found;
+}
+
 packet_t *
 packet_decode(netif_t *netif, raw_packet_t *raw_packet)
 {
     packet_t *packet = packet_new();
+    packet->weight = 1;
     packet->head = ethernet_header_decode(netif, packet, raw_packet, 0);
     
     return packet;
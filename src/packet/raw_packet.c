@@ -1,37 +1,129 @@
-
 #include "packet/raw_packet.h"
 #include "log.h"
 
+#include <inttypes.h>
+
 static void raw_packet_destructor(void *ptr);
+static void raw_packet_pool_put(void *ptr);
 
 static class_info_t class_info = {
-    .size        = sizeof(raw_packet_t),
+    .name        = "raw_packet",
+    .size        = sizeof(raw_packet_t),            /**< only the header is cleared, not the data */
     .destructor  = raw_packet_destructor,
     .mem_alloc   = malloc,
-    .mem_free    = free
+    .mem_free    = raw_packet_pool_put
+};
+
+/**
+ * Every size class has its own free list. The data is allocated together
+ * with the header (data = raw_packet + 1), so that a pooled buffer is a
+ * single allocation and a single cache-friendly block
+ */
+typedef struct _raw_packet_pool_t {
+    uint32_t            size;                       /**< capacity of the data */
+    uint32_t            free_max;                   /**< keep at most that many buffers */
+    uint32_t            free_size;                  /**< how many buffers are in the free list */
+    raw_packet_t       *free_list;
+} raw_packet_pool_t;
+
+static raw_packet_pool_t pool[RAW_PACKET_CLASS_SIZE] = {
+    [RAW_PACKET_CLASS_SMALL]    = { .size = RAW_PACKET_SIZE_SMALL,  .free_max = 1024 },
+    [RAW_PACKET_CLASS_MEDIUM]   = { .size = RAW_PACKET_SIZE_MEDIUM, .free_max = 256  },
+    [RAW_PACKET_CLASS_JUMBO]    = { .size = RAW_PACKET_SIZE_JUMBO,  .free_max = 32   },
+    [RAW_PACKET_CLASS_MAX]      = { .size = RAW_PACKET_SIZE_MAX,    .free_max = 4    }
 };
 
+/**
+ * Get a raw packet from the pool of the smallest size class which fits
+ *
+ * @param   size            required capacity in bytes
+ * @return                  raw packet with len = 0, NULL if size is too big
+ */
 raw_packet_t *
-raw_packet_new(void)
+raw_packet_new(uint32_t size)
 {
-    raw_packet_t *raw_packet;
-    
-    raw_packet = object_new(&class_info);
-    
+    raw_packet_t           *raw_packet;
+    raw_packet_class_t      klass;
+
+    for (klass = RAW_PACKET_CLASS_SMALL; klass < RAW_PACKET_CLASS_SIZE; klass++) {
+        if (size <= pool[klass].size) {
+            break;
+        }
+    }
+
+    if (klass == RAW_PACKET_CLASS_SIZE) {
+        LOG_PRINTLN(LOG_OBJECT, LOG_ERROR, ("raw packet too big (size=%" PRIu32 ", max=%u)", size, RAW_PACKET_SIZE_MAX));
+        return NULL;
+    }
+
+    /* re-use from the free list... */
+    if (pool[klass].free_list != NULL) {
+        raw_packet              = pool[klass].free_list;
+        pool[klass].free_list   = raw_packet->next;
+        pool[klass].free_size--;
+
+    /* ...or allocate header and data at once */
+    } else {
+        raw_packet = malloc(sizeof(raw_packet_t) + pool[klass].size);
+        if (raw_packet == NULL) {
+            return NULL;
+        }
+
+        LOG_PRINTLN(LOG_OBJECT, LOG_DEBUG, ("allocate raw packet (class=%u, size=%" PRIu32 ")", klass, pool[klass].size));
+    }
+
+    object_init(raw_packet, &class_info);
+
+    raw_packet->obj.is_on_heap  = true;
+    raw_packet->klass           = klass;
+    raw_packet->size            = pool[klass].size;
+    raw_packet->data            = (uint8_t *) (raw_packet + 1);
+
     return raw_packet;
 }
 
+/**
+ * Initialize a raw packet around a buffer which is not owned by the pool
+ * (stack, static or a foreign capture buffer)
+ */
 bool
-raw_packet_init(raw_packet_t *raw_packet)
+raw_packet_init(raw_packet_t *raw_packet, uint8_t *data, uint16_t size)
 {
     object_init(raw_packet, &class_info);
+
+    raw_packet->klass   = RAW_PACKET_CLASS_EXTERNAL;
+    raw_packet->size    = size;
+    raw_packet->data    = data;
+
     return true;
 }
 
 static void
 raw_packet_destructor(void *ptr)
 {
-    
+
+}
+
+/**
+ * Return a raw packet to the free list of its size class
+ */
+static void
+raw_packet_pool_put(void *ptr)
+{
+    raw_packet_t *raw_packet = (raw_packet_t *) ptr;
+
+    if (raw_packet->klass >= RAW_PACKET_CLASS_SIZE) {
+        return;
+    }
+
+    if (pool[raw_packet->klass].free_size >= pool[raw_packet->klass].free_max) {
+        free(raw_packet);
+        return;
+    }
+
+    raw_packet->next                    = pool[raw_packet->klass].free_list;
+    pool[raw_packet->klass].free_list   = raw_packet;
+    pool[raw_packet->klass].free_size++;
 }
 
 /*
@@ -42,18 +134,43 @@ raw_packet_destructor(void *ptr)
 uint16_t
 raw_packet_calc_checksum(uint16_t *buffer, uint16_t len)
 {
-    const uint16_t  words = len / 2;
-    uint32_t        sum;
+    return raw_packet_fold_checksum(raw_packet_sum_checksum(0, (const uint8_t *) buffer, len));
+}
+
+/**
+ * Add big-endian 16 bit words to a partial checksum, an odd trailing byte
+ * is padded with zero. Partial sums of several buffers (pseudo header,
+ * header, payload) can be chained before folding
+ */
+uint32_t
+raw_packet_sum_checksum(uint32_t sum, const uint8_t *buffer, uint16_t len)
+{
     uint16_t        i;
-    
-    sum = 0;
-    for (i = 0; i < words; i++) {
-        sum = sum + *(buffer + i);
+
+    for (i = 0; i + 1 < len; i += 2) {
+        sum += (((uint32_t) buffer[i]) << 8) | buffer[i + 1];
+    }
+
+    /* odd length: pad with zero */
+    if (len % 2 == 1) {
+        sum += ((uint32_t) buffer[len - 1]) << 8;
     }
-    
-    /* add carry */
-    sum = (sum >> 16) + sum;
-    
+
+    return sum;
+}
+
+/**
+ * Fold the carries of a partial checksum and complement it
+ *
+ * @return                  checksum in host byte order
+ */
+uint16_t
+raw_packet_fold_checksum(uint32_t sum)
+{
+    /* add carry, twice: the first fold may carry again */
+    sum = (sum >> 16) + (sum & 0xffff);
+    sum = (sum >> 16) + (sum & 0xffff);
+
     /* truncate to 16 bits */
-    return ntohs(~sum);
+    return (uint16_t) ~sum;
 }
@@ -1,5 +1,6 @@
 
 #include "packet/packet.h"
+#include "packet/dispatch.h"
 #include "packet/port.h"
 #include "log.h"
 
@@ -71,10 +72,15 @@ udpv4_header_encode(netif_t *netif, packet_t *packet, raw_packet_t *raw_packet,
     udpv4           = (udpv4_header_t *) packet->tail->next;
     packet->tail    = udpv4->header.next;
     
-    /* decide */
-    switch (udpv4->dest_port) {
-        case PORT_DNS:      len = dns_header_encode(netif, packet, raw_packet, offset + UDPV4_HEADER_LEN);  break;
-        default:                                                                                            return 0;
+    /* decide: DNS queries and responses directly, everything else through the registry */
+    if (DISPATCH_LIKELY(udpv4->dest_port == PORT_DNS || udpv4->src_port == PORT_DNS)) {
+        len = dns_header_encode(netif, packet, raw_packet, offset + UDPV4_HEADER_LEN);
+    } else if (dispatch_udp_port_registered(udpv4->dest_port)) {
+        len = dispatch_encode(DISPATCH_LAYER_UDP_PORT, udpv4->dest_port, netif, packet, raw_packet, offset + UDPV4_HEADER_LEN);
+    } else if (dispatch_udp_port_registered(udpv4->src_port)) {
+        len = dispatch_encode(DISPATCH_LAYER_UDP_PORT, udpv4->src_port, netif, packet, raw_packet, offset + UDPV4_HEADER_LEN);
+    } else {
+        return 0;
     }
     
     if (len == 0) {
@@ -109,16 +115,15 @@ udpv4_header_encode(netif_t *netif, packet_t *packet, raw_packet_t *raw_packet,
         return 0;
     }
     
-    /* check whether the UDP datagram length is an odd number */
-    if (len % 2 == 1) {
-        /* add a padding zero for checksum calculation and increase length by one */
-        raw_packet->data[offset + len] = 0;
-        len += 1;
-    }
-    
     /* data = pseudo-ip-header + udp-header + payload
-     *  len = pseudo-ip-header + udp-header + payload    */
+     *  len = pseudo-ip-header + udp-header + payload
+     * an odd UDP datagram length is padded with zero by the checksum calculation */
     udpv4->checksum = raw_packet_calc_checksum((uint16_t *) &(raw_packet->data[offset - pseudo_offset]), len + pseudo_offset);
+    
+    /* a calculated zero is transmitted as all ones (zero = no checksum) */
+    if (udpv4->checksum == 0) {
+        udpv4->checksum = 0xffff;
+    }
     LOG_PRINTLN(LOG_HEADER_UDPV4, LOG_DEBUG, ("encode UDP packet: checksum = 0x%04x, offset = %u, pseudo_offset = %u, size = %u", ntohs(udpv4->checksum), offset, pseudo_offset, len));
     
     /* set pseudo-ip-header to zero */
@@ -164,9 +169,11 @@ udpv4_header_decode(netif_t *netif, packet_t *packet, raw_packet_t *raw_packet,
         high_port   = udpv4->src_port;
     }
     
-    switch (low_port) {
-        case PORT_DNS:      udpv4->header.next = dns_header_decode(netif, packet, raw_packet, offset + UDPV4_HEADER_LEN);       break;
-        default:            break;
+    /* DNS directly, everything else through the registry */
+    if (DISPATCH_LIKELY(low_port == PORT_DNS)) {
+        udpv4->header.next = dns_header_decode(netif, packet, raw_packet, offset + UDPV4_HEADER_LEN);
+    } else if (dispatch_udp_port_registered(low_port)) {
+        udpv4->header.next = dispatch_decode(DISPATCH_LAYER_UDP_PORT, low_port, netif, packet, raw_packet, offset + UDPV4_HEADER_LEN);
     }
     
     /* if next header is filled in, return... */
@@ -175,9 +182,8 @@ udpv4_header_decode(netif_t *netif, packet_t *packet, raw_packet_t *raw_packet,
     }
     
     /* ...otherwise try again with high port */
-    switch (high_port) {
-        case PORT_DNS:      udpv4->header.next = dns_header_decode(netif, packet, raw_packet, offset + UDPV4_HEADER_LEN);       break;
-        default:            UDPV4_FAILURE_EXIT;
+    if (dispatch_udp_port_registered(high_port)) {
+        udpv4->header.next = dispatch_decode(DISPATCH_LAYER_UDP_PORT, high_port, netif, packet, raw_packet, offset + UDPV4_HEADER_LEN);
     }
     
     if (udpv4->header.next == NULL) {
@@ -189,3 +195,8 @@ udpv4_header_decode(netif_t *netif, packet_t *packet, raw_packet_t *raw_packet,
     return (header_t *) udpv4;
 }
 
+DISPATCH_REGISTER(udpv4_header)
+{
+    dispatch_register(DISPATCH_LAYER_IP_PROTOCOL, IPV4_PROTOCOL_UDP, udpv4_header_decode, udpv4_header_encode);
+}
+
@@ -0,0 +1,103 @@
+#include "packet/packet.h"
+#include "packet/dispatch.h"
+#include "packet/port.h"
+#include "log.h"
+
+#include <string.h>
+#include <inttypes.h>
+
+#define VXLAN_STORAGE_INIT_SIZE     2
+#define VXLAN_FAILURE_EXIT          vxlan_header_free((header_t *) vxlan); \
+                                    return NULL
+
+static vxlan_header_t           vxlan[VXLAN_STORAGE_INIT_SIZE];
+static uint32_t                 idx[VXLAN_STORAGE_INIT_SIZE];
+
+static header_class_t           klass = {
+    .type               = PACKET_TYPE_VXLAN,
+    .size               = sizeof(vxlan_header_t),
+    .free               = vxlan_header_free
+};
+
+static header_storage_entry_t   entry = {
+    .allocator          = (header_t *) vxlan,
+    .allocator_size     = VXLAN_STORAGE_INIT_SIZE,
+    .available_idxs     = idx,
+    .available_size     = VXLAN_STORAGE_INIT_SIZE,
+    .next               = NULL
+};
+
+static header_storage_t         storage = {
+    .klass              = &klass,
+    .head               = NULL,
+    .init               = &entry
+};
+
+vxlan_header_t *
+vxlan_header_new(void)
+{
+    vxlan_header_t *header = (vxlan_header_t *) header_storage_new(&storage);
+
+    LOG_PRINTLN(LOG_HEADER_VXLAN, LOG_DEBUG, ("VXLAN header new 0x%016" PRIxPTR, (unsigned long) header));
+
+    return header;
+}
+
+void
+vxlan_header_free(header_t *header)
+{
+    if (header->next != NULL)   header->next->klass->free(header->next);
+
+    LOG_PRINTLN(LOG_HEADER_VXLAN, LOG_DEBUG, ("VXLAN header free 0x%016" PRIxPTR, (unsigned long) header));
+
+    header_storage_free(header);
+}
+
+/****************************************************************************
+ * vxlan_header_decode
+ *
+ * The inner frame re-enters the Ethernet decoder, the outer headers stay
+ * in front of it in the header chain (attribution to the mirroring router)
+ *
+ * @param  this                     logical packet to be written
+ * @param  raw_packet               raw packet to be read
+ * @param  offset                   offset from origin to vxlan header
+ ***************************************************************************/
+header_t *
+vxlan_header_decode(netif_t *netif, packet_t *packet, raw_packet_t *raw_packet, packet_offset_t offset)
+{
+    vxlan_header_t *vxlan = vxlan_header_new();
+    uint32_t        vni;
+
+    if (raw_packet->len < (offset + VXLAN_HEADER_LEN)) {
+        LOG_PRINTLN(LOG_HEADER_VXLAN, LOG_ERROR, ("decode VXLAN header: size too small (present=%u, required=%u)", raw_packet->len - offset, VXLAN_HEADER_LEN));
+        VXLAN_FAILURE_EXIT;
+    }
+
+    /* fetch */
+    vxlan->flags = raw_packet->data[offset + VXLAN_HEADER_OFFSET_FLAGS];                                        /**< Flags */
+    uint8_to_uint32(&vni, &(raw_packet->data[offset + VXLAN_HEADER_OFFSET_VNI]));                              /**< VNI + Reserved */
+    vxlan->vni   = vni >> 8;
+
+    if ((vxlan->flags & VXLAN_HEADER_FLAG_VNI) == 0) {
+        LOG_PRINTLN(LOG_HEADER_VXLAN, LOG_ERROR, ("decode VXLAN header: VNI flag not set (flags=0x%02" PRIx8 ")", vxlan->flags));
+        VXLAN_FAILURE_EXIT;
+    }
+
+    LOG_PRINTLN(LOG_HEADER_VXLAN, LOG_INFO, ("vni=%" PRIu32, vxlan->vni));
+
+    /* inner frame */
+    vxlan->header.next = ethernet_header_decode(netif, packet, raw_packet, offset + VXLAN_HEADER_LEN);
+
+    if (vxlan->header.next == NULL) {
+        VXLAN_FAILURE_EXIT;
+    }
+
+    return (header_t *) vxlan;
+}
+
+DISPATCH_REGISTER(vxlan_header)
+{
+    dispatch_register(DISPATCH_LAYER_UDP_PORT, PORT_VXLAN, vxlan_header_decode, NULL);
+}
+
@@ -1,4 +1,3 @@
-
 #include "pf.h"
 #include "log.h"
 
@@ -18,79 +17,695 @@
 #include <net/pfvar.h>
 #include <arpa/inet.h>
 
+#define PF_TABLES_MAX       4
+#define PF_BATCH_INIT_SIZE  64
+#define PF_SYNC_REPLACE     2                       /**< replace the table if the delta exceeds 1/n of the desired set */
+
+typedef struct _pf_batch_t {
+    struct pfr_addr    *addrs;
+    uint32_t            count;
+    uint32_t            size;
+} pf_batch_t;
+
+typedef struct _pf_table_t {
+    char                name[PF_TABLE_NAME_SIZE];   /**< empty if unused */
+    pf_batch_t          add;
+    pf_batch_t          remove;
+    pf_batch_t          kill;                       /**< sources whose states are killed after the adds */
+} pf_table_t;
+
+typedef struct _pf_t {
+    int                 dev;                        /**< -1 if not open */
+    pf_table_t          tables[PF_TABLES_MAX];
+    pf_batch_t          kernel;                     /**< scratch: table read back by pf_sync() */
+    pf_batch_t          wanted;                     /**< scratch: sorted desired set */
+    firewall_backend_stats_t stats;
+} pf_t;
+
+static pf_t pf = {
+    .dev    = -1
+};
+
 const static char  *pf_device       = "/dev/pf";
 const static int    pf_mode         = O_RDWR;
-const static char  *pf_table_name   = "hacker";
 
-static int pf_alter_ipv4_address(struct in_addr *addr, unsigned long request);
+static const char *pf_feedback_name[PFR_FB_MAX] = {
+    [PFR_FB_NONE]       = "none",
+    [PFR_FB_MATCH]      = "match",
+    [PFR_FB_ADDED]      = "added",
+    [PFR_FB_DELETED]    = "deleted",
+    [PFR_FB_CHANGED]    = "changed",
+    [PFR_FB_CLEARED]    = "cleared",
+    [PFR_FB_DUPLICATE]  = "duplicate",
+    [PFR_FB_NOTMATCH]   = "not match",
+    [PFR_FB_CONFLICT]   = "conflict"
+};
 
-int
-pf_add_ipv4_address(struct in_addr *addr)
+static int  pf_queue_address       (const char *table_name, const prefix_t *prefix, unsigned long request);
+static void pf_close               (void);
+
+static bool
+pf_open(config_t *config)
 {
-    return pf_alter_ipv4_address(addr, DIOCRADDADDRS);
+    if ((pf.dev = open(pf_device, pf_mode)) == -1) {
+        LOG_ERRNO(LOG_FIREWALL_PF, LOG_ERROR, errno, ("Couldn't open device %s", pf_device));
+        return false;
+    }
+
+    return true;
 }
 
-int
-pf_remove_ipv4_address(struct in_addr *addr)
+static int
+pf_add(const char *table_name, const prefix_t *prefix)
 {
-    return pf_alter_ipv4_address(addr, DIOCRDELADDRS);
+    return pf_queue_address(table_name, prefix, DIOCRADDADDRS);
 }
 
 static int
-pf_alter_ipv4_address(struct in_addr *addr, unsigned long request)
+pf_remove(const char *table_name, const prefix_t *prefix)
 {
-    int                 dev;
-    struct pfioc_table  io;
-    struct pfr_table    table;
-    struct pfr_addr     address;
-    
-    /* table */
-    strncpy(table.pfrt_anchor, "",            sizeof(table.pfrt_anchor));
-    strncpy(table.pfrt_name,   pf_table_name, sizeof(table.pfrt_name));
-    table.pfrt_flags = 0;
-    table.pfrt_fback = 0;
-    
-    /* address */
-    bzero(&address, sizeof(struct pfr_addr));               /**< clean the whole struct, otherwise
+    return pf_queue_address(table_name, prefix, DIOCRDELADDRS);
+}
+
+static void
+pf_stats(firewall_backend_stats_t *stats)
+{
+    *stats = pf.stats;
+}
+
+static pf_table_t *
+pf_table_get(const char *table_name)
+{
+    pf_table_t *free_table = NULL;
+    uint32_t    i;
+
+    for (i = 0; i < PF_TABLES_MAX; i++) {
+        if (strncmp(pf.tables[i].name, table_name, PF_TABLE_NAME_SIZE) == 0) {
+            return &(pf.tables[i]);
+        }
+
+        if (pf.tables[i].name[0] == '\0' && free_table == NULL) {
+            free_table = &(pf.tables[i]);
+        }
+    }
+
+    if (free_table != NULL) {
+        strncpy(free_table->name, table_name, PF_TABLE_NAME_SIZE - 1);
+    }
+
+    return free_table;
+}
+
+/**
+ * Orders by family, address (network byte order compares like a number)
+ * and prefix length
+ */
+static int
+pf_addr_compare(const void *a, const void *b)
+{
+    const struct pfr_addr  *x = a;
+    const struct pfr_addr  *y = b;
+    int                     cmp;
+
+    if (x->pfra_af != y->pfra_af) {
+        return x->pfra_af < y->pfra_af ? -1 : 1;
+    }
+
+    if ((cmp = memcmp(&(x->pfra_u), &(y->pfra_u), x->pfra_af == AF_INET6 ? sizeof(struct in6_addr) : sizeof(struct in_addr))) != 0) {
+        return cmp;
+    }
+
+    if (x->pfra_net != y->pfra_net) {
+        return x->pfra_net < y->pfra_net ? -1 : 1;
+    }
+
+    return (int) x->pfra_not - (int) y->pfra_not;
+}
+
+/**
+ * Finds an address in a batch, -1 if it is not queued
+ */
+static int32_t
+pf_batch_find(pf_batch_t *batch, struct pfr_addr *address)
+{
+    uint32_t i;
+
+    for (i = 0; i < batch->count; i++) {
+        if (pf_addr_compare(&(batch->addrs[i]), address) == 0) {
+            return i;
+        }
+    }
+
+    return -1;
+}
+
+/**
+ * IPv4 prefixes go up to /32, IPv6 prefixes up to /128
+ */
+static void
+pf_addr_set(struct pfr_addr *address, const prefix_t *prefix)
+{
+    bzero(address, sizeof(struct pfr_addr));                /**< clean the whole struct, otherwise
                                                                  ioctl() failes with "Invalid argument" */
-    address.pfra_ip4addr        = *addr;
-    address.pfra_af             = AF_INET;
-    address.pfra_net            = 32;                       /**< single IP */
-    address.pfra_not            = 0;                        /**< not inverted */
-    address.pfra_fback          = PFR_FB_NONE;              /**< no feeback */
-    
+    if (prefix->family == AF_INET6) {
+        address->pfra_ip6addr   = prefix->ipv6;
+    } else {
+        address->pfra_ip4addr   = prefix->ipv4;
+    }
+
+    address->pfra_af            = prefix->family;
+    address->pfra_net           = prefix->len;              /**< 32 (128): single IP */
+    address->pfra_not           = 0;                        /**< not inverted */
+    address->pfra_fback         = PFR_FB_NONE;              /**< filled in by the kernel */
+}
+
+static bool
+pf_batch_reserve(pf_batch_t *batch, uint32_t count)
+{
+    struct pfr_addr    *addrs;
+    uint32_t            size = batch->size > 0 ? batch->size : PF_BATCH_INIT_SIZE;
+
+    if (count <= batch->size) {
+        return true;
+    }
+
+    while (size < count) {
+        size *= 2;
+    }
+
+    if ((addrs = realloc(batch->addrs, size * sizeof(struct pfr_addr))) == NULL) {
+        return false;
+    }
+
+    batch->addrs    = addrs;
+    batch->size     = size;
+
+    return true;
+}
+
+/**
+ * Queues an address for the next flush
+ *
+ * @return                  0 if queued, -1 otherwise
+ */
+static int
+pf_queue_address(const char *table_name, const prefix_t *prefix, unsigned long request)
+{
+    pf_table_t         *table;
+    pf_batch_t         *batch;
+    pf_batch_t         *opposite;
+    struct pfr_addr     address;
+    int32_t             idx;
+
+    if ((table = pf_table_get(table_name)) == NULL) {
+        LOG_PRINTLN(LOG_FIREWALL_PF, LOG_ERROR, ("Too many tables: %s", table_name));
+        return -1;
+    }
+
+    pf_addr_set(&address, prefix);
+
+    batch    = (request == DIOCRADDADDRS) ? &(table->add)    : &(table->remove);
+    opposite = (request == DIOCRADDADDRS) ? &(table->remove) : &(table->add);
+
+    /* a removed source must not lose its states once the prefix is unblocked */
+    if (request == DIOCRDELADDRS && (idx = pf_batch_find(&(table->kill), &address)) != -1) {
+        table->kill.addrs[idx] = table->kill.addrs[--table->kill.count];
+    }
+
+    /* cancels the opposite, which has not reached the kernel yet */
+    if ((idx = pf_batch_find(opposite, &address)) != -1) {
+        opposite->addrs[idx] = opposite->addrs[--opposite->count];
+        return 0;
+    }
+
+    if (pf_batch_find(batch, &address) != -1) {
+        return 0;
+    }
+
+    if (!pf_batch_reserve(batch, batch->count + 1)) {
+        LOG_PRINTLN(LOG_FIREWALL_PF, LOG_ERROR, ("Couldn't queue address for table %s", table_name));
+        return -1;
+    }
+
+    batch->addrs[batch->count++] = address;
+
+    return 0;
+}
+
+/**
+ * Queues killing the states of the sources in a prefix
+ *
+ * @return                  0 if queued, -1 otherwise
+ */
+static int
+pf_kill(const char *table_name, const prefix_t *prefix)
+{
+    pf_table_t         *table;
+    struct pfr_addr     address;
+
+    if ((table = pf_table_get(table_name)) == NULL) {
+        LOG_PRINTLN(LOG_FIREWALL_PF, LOG_ERROR, ("Too many tables: %s", table_name));
+        return -1;
+    }
+
+    pf_addr_set(&address, prefix);
+
+    if (pf_batch_find(&(table->kill), &address) != -1) {
+        return 0;
+    }
+
+    if (!pf_batch_reserve(&(table->kill), table->kill.count + 1)) {
+        LOG_PRINTLN(LOG_FIREWALL_PF, LOG_ERROR, ("Couldn't queue state kill"));
+        return -1;
+    }
+
+    table->kill.addrs[table->kill.count++] = address;
+
+    return 0;
+}
+
+/**
+ * Pushes a batch with one ioctl, logs the feedback of every address
+ */
+static int
+pf_flush_batch(const char *table_name, pf_batch_t *batch, unsigned long request)
+{
+    struct pfioc_table  io;
+    uint32_t            i;
+    char                addr_str[INET6_ADDRSTRLEN];
+    int                 err;
+
+    if (batch->count == 0) {
+        return 0;
+    }
+
     /* ioctl table */
     bzero(&io, sizeof(struct pfioc_table));
-    io.pfrio_flags  = 0;
-    io.pfrio_table  = table;
-    io.pfrio_buffer = &address;
+    io.pfrio_flags  = PFR_FLAG_FEEDBACK;
+    io.pfrio_buffer = batch->addrs;
     io.pfrio_esize  = sizeof(struct pfr_addr);
-    io.pfrio_size   = 1;
-    
-    dev = open(pf_device, pf_mode);
-    if (dev == -1) {
-        LOG_ERRNO(LOG_FIREWALL_PF, LOG_ERROR, errno, ("Couldn't open device %s", pf_device));
-        goto pf_alter_ipv4_address_error;
+    io.pfrio_size   = batch->count;
+    strncpy(io.pfrio_table.pfrt_anchor, "",            sizeof(io.pfrio_table.pfrt_anchor));
+    strncpy(io.pfrio_table.pfrt_name,   table_name,    sizeof(io.pfrio_table.pfrt_name));
+
+    pf.stats.batches++;
+
+    if (ioctl(pf.dev, request, &io)) {
+        err = errno;
+        LOG_ERRNO(LOG_FIREWALL_PF, LOG_ERROR, err, ("Couldn't manipulate table %s (%" PRIu32 " addresses)", table_name, batch->count));
+        pf.stats.errors++;
+
+        /* the descriptor is broken: reopen on the next flush, the batch is retried */
+        if (err == EBADF || err == ENXIO) {
+            pf_close();
+            return -1;
+        }
+
+        batch->count = 0;
+        return -1;
     }
-    
-    if (ioctl(dev, request, &io)) {
-        LOG_ERRNO(LOG_FIREWALL_PF, LOG_ERROR, errno, ("Couldn't manipulate device %s", pf_device));
-        goto pf_alter_ipv4_address_error;
+
+    if (request == DIOCRADDADDRS) {
+        pf.stats.added   += batch->count;
+    } else {
+        pf.stats.removed += batch->count;
     }
-    
+
     switch (request) {
-        case DIOCRADDADDRS: LOG_PRINTLN(LOG_FIREWALL_PF, LOG_INFO, ("Add %" PRIu8 " IPv4 %s", io.pfrio_nadd, io.pfrio_nadd > 1 ? "addresses" : "address"));       break;
-        case DIOCRDELADDRS: LOG_PRINTLN(LOG_FIREWALL_PF, LOG_INFO, ("Remove %" PRIu8 " IPv4 %s", io.pfrio_ndel, io.pfrio_nadd > 1 ? "addresses" : "address"));    break;
+        case DIOCRADDADDRS: LOG_PRINTLN(LOG_FIREWALL_PF, LOG_INFO, ("Add %d of %" PRIu32 " addresses to %s", io.pfrio_nadd, batch->count, table_name));       break;
+        case DIOCRDELADDRS: LOG_PRINTLN(LOG_FIREWALL_PF, LOG_INFO, ("Remove %d of %" PRIu32 " addresses from %s", io.pfrio_ndel, batch->count, table_name));  break;
     }
-    
+
+    for (i = 0; i < batch->count; i++) {
+        if (batch->addrs[i].pfra_fback == PFR_FB_ADDED || batch->addrs[i].pfra_fback == PFR_FB_DELETED) {
+            continue;
+        }
+
+        inet_ntop(batch->addrs[i].pfra_af, &(batch->addrs[i].pfra_u), addr_str, sizeof(addr_str));
+        LOG_PRINTLN(LOG_FIREWALL_PF, LOG_DEBUG, ("%s/%u in %s: %s", addr_str, batch->addrs[i].pfra_net, table_name,
+                                                 batch->addrs[i].pfra_fback < PFR_FB_MAX && pf_feedback_name[batch->addrs[i].pfra_fback] != NULL ?
+                                                 pf_feedback_name[batch->addrs[i].pfra_fback] : "unknown"));
+    }
+
+    batch->count = 0;
+
     return 0;
-    
-pf_alter_ipv4_address_error:
-    if (dev != -1) {
-        if (close(dev) == -1) {
-            LOG_ERRNO(LOG_FIREWALL_PF, LOG_ERROR, errno, ("Couldn't close device %s", pf_device));
+}
+
+/**
+ * Netmask of a prefix length, IPv4 in the first word
+ */
+static void
+pf_mask_set(struct pf_addr *mask, uint8_t len)
+{
+    uint32_t i;
+
+    bzero(mask, sizeof(struct pf_addr));
+
+    for (i = 0; i < 4 && len > 32 * i; i++) {
+        mask->addr32[i] = len - 32 * i >= 32 ? UINT32_MAX : htonl(UINT32_MAX << (32 - (len - 32 * i)));
+    }
+}
+
+/**
+ * Kills the states created by the queued sources, one DIOCKILLSTATES each
+ * (there is no batch ioctl for states). The queue is kept for a retry if
+ * the descriptor broke
+ */
+static int
+pf_flush_kills(pf_batch_t *kill)
+{
+    struct pfioc_state_kill psk;
+    struct pfr_addr        *address;
+    uint64_t                killed = 0;
+    uint32_t                i;
+    char                    addr_str[INET6_ADDRSTRLEN];
+    int                     ret = 0;
+    int                     err;
+
+    if (kill->count == 0) {
+        return 0;
+    }
+
+    if (pf.dev == -1 && (pf.dev = open(pf_device, pf_mode)) == -1) {
+        LOG_ERRNO(LOG_FIREWALL_PF, LOG_ERROR, errno, ("Couldn't open device %s", pf_device));
+        return -1;
+    }
+
+    for (i = 0; i < kill->count; i++) {
+        address = &(kill->addrs[i]);
+
+        bzero(&psk, sizeof(struct pfioc_state_kill));
+        psk.psk_af                  = address->pfra_af;
+        psk.psk_src.addr.type       = PF_ADDR_ADDRMASK;
+
+        if (address->pfra_af == AF_INET6) {
+            psk.psk_src.addr.v.a.addr.v6 = address->pfra_ip6addr;
+        } else {
+            psk.psk_src.addr.v.a.addr.v4 = address->pfra_ip4addr;
         }
+
+        pf_mask_set(&(psk.psk_src.addr.v.a.mask), address->pfra_net);
+
+        pf.stats.batches++;
+
+        inet_ntop(address->pfra_af, &(address->pfra_u), addr_str, sizeof(addr_str));
+
+        if (ioctl(pf.dev, DIOCKILLSTATES, &psk)) {
+            err = errno;
+            LOG_ERRNO(LOG_FIREWALL_PF, LOG_ERROR, err, ("Couldn't kill states of %s/%u", addr_str, address->pfra_net));
+            pf.stats.errors++;
+
+            if (err == EBADF || err == ENXIO) {
+                pf_close();
+                return -1;
+            }
+
+            ret = -1;
+            continue;
+        }
+
+        if (psk.psk_killed > 0) {
+            LOG_PRINTLN(LOG_FIREWALL_PF, LOG_DEBUG, ("Kill %u states of %s/%u", psk.psk_killed, addr_str, address->pfra_net));
+        }
+
+        killed += psk.psk_killed;
     }
-    return -1;
+
+    LOG_PRINTLN(LOG_FIREWALL_PF, LOG_INFO, ("Kill %" PRIu64 " states of %" PRIu32 " blocked prefixes", killed, kill->count));
+
+    pf.stats.killed += killed;
+    kill->count      = 0;
+
+    return ret;
+}
+
+/**
+ * Pushes the queued removals and adds of all tables, one ioctl each
+ */
+static int
+pf_flush_tables(void)
+{
+    int         ret = 0;
+    uint32_t    i;
+
+    for (i = 0; i < PF_TABLES_MAX; i++) {
+        if (pf.tables[i].add.count == 0 && pf.tables[i].remove.count == 0) {
+            continue;
+        }
+
+        if (pf.dev == -1 && (pf.dev = open(pf_device, pf_mode)) == -1) {
+            LOG_ERRNO(LOG_FIREWALL_PF, LOG_ERROR, errno, ("Couldn't open device %s", pf_device));
+            return -1;
+        }
+
+        if (pf_flush_batch(pf.tables[i].name, &(pf.tables[i].remove), DIOCRDELADDRS) != 0) {
+            ret = -1;
+        }
+
+        if (pf.dev != -1 && pf_flush_batch(pf.tables[i].name, &(pf.tables[i].add), DIOCRADDADDRS) != 0) {
+            ret = -1;
+        }
+    }
+
+    return ret;
+}
+
+/****************************************************************************
+ * pf_flush
+ *
+ * Pushes the queued removals and adds of all tables, one ioctl each,
+ * then kills the states of the newly blocked sources
+ *
+ * @return                          0 on success, -1 if a batch failed
+ ***************************************************************************/
+static int
+pf_flush(void)
+{
+    int         ret;
+    uint32_t    i;
+
+    ret = pf_flush_tables();
+
+    /* only after the adds: a killed flow must not come back before the table matches */
+    for (i = 0; i < PF_TABLES_MAX && ret == 0; i++) {
+        ret = pf_flush_kills(&(pf.tables[i].kill));
+    }
+
+    return ret;
+}
+
+/**
+ * Reads a table back into pf.kernel, the buffer grows until the table fits
+ */
+static int
+pf_table_read(const char *table_name)
+{
+    struct pfioc_table  io;
+    int                 err;
+
+    for (;;) {
+        bzero(&io, sizeof(struct pfioc_table));
+        io.pfrio_buffer = pf.kernel.addrs;
+        io.pfrio_esize  = sizeof(struct pfr_addr);
+        io.pfrio_size   = pf.kernel.size;
+        strncpy(io.pfrio_table.pfrt_anchor, "",            sizeof(io.pfrio_table.pfrt_anchor));
+        strncpy(io.pfrio_table.pfrt_name,   table_name,    sizeof(io.pfrio_table.pfrt_name));
+
+        pf.stats.batches++;
+
+        if (ioctl(pf.dev, DIOCRGETADDRS, &io)) {
+            err = errno;
+            pf.stats.errors++;
+            LOG_ERRNO(LOG_FIREWALL_PF, LOG_ERROR, err, ("Couldn't read table %s", table_name));
+
+            if (err == EBADF || err == ENXIO) {
+                pf_close();
+            }
+            return -1;
+        }
+
+        /* the kernel only tells the size if the buffer is too small */
+        if ((uint32_t) io.pfrio_size <= pf.kernel.size) {
+            pf.kernel.count = io.pfrio_size;
+            return 0;
+        }
+
+        if (!pf_batch_reserve(&(pf.kernel), io.pfrio_size)) {
+            LOG_PRINTLN(LOG_FIREWALL_PF, LOG_ERROR, ("Couldn't read table %s (%d addresses)", table_name, io.pfrio_size));
+            return -1;
+        }
+    }
+}
+
+/**
+ * Replaces the whole content of a table with pf.wanted in one ioctl
+ */
+static int
+pf_table_replace(const char *table_name)
+{
+    struct pfioc_table  io;
+    int                 err;
+
+    bzero(&io, sizeof(struct pfioc_table));
+    io.pfrio_buffer = pf.wanted.addrs;
+    io.pfrio_esize  = sizeof(struct pfr_addr);
+    io.pfrio_size   = pf.wanted.count;
+    strncpy(io.pfrio_table.pfrt_anchor, "",            sizeof(io.pfrio_table.pfrt_anchor));
+    strncpy(io.pfrio_table.pfrt_name,   table_name,    sizeof(io.pfrio_table.pfrt_name));
+
+    pf.stats.batches++;
+
+    if (ioctl(pf.dev, DIOCRSETADDRS, &io)) {
+        err = errno;
+        pf.stats.errors++;
+        LOG_ERRNO(LOG_FIREWALL_PF, LOG_ERROR, err, ("Couldn't replace table %s (%" PRIu32 " addresses)", table_name, pf.wanted.count));
+
+        if (err == EBADF || err == ENXIO) {
+            pf_close();
+        }
+        return -1;
+    }
+
+    pf.stats.added   += io.pfrio_nadd;
+    pf.stats.removed += io.pfrio_ndel;
+
+    LOG_PRINTLN(LOG_FIREWALL_PF, LOG_INFO, ("Replace %s: %d added, %d removed, %d changed", table_name, io.pfrio_nadd, io.pfrio_ndel, io.pfrio_nchange));
+
+    return 0;
+}
+
+/****************************************************************************
+ * pf_sync
+ *
+ * Makes the kernel table match the desired set, whatever happened to it
+ * meanwhile: restarts, crashes, manual pfctl edits. The kernel table is
+ * read back and compared with the desired set in a sorted merge. A small
+ * delta is pushed as adds and removals, a large one replaces the table
+ * with one DIOCRSETADDRS.
+ *
+ * @param  table_name               pf table
+ * @param  desired                  prefixes the table should hold
+ * @param  count                    number of desired prefixes
+ * @return                          0 on success, -1 otherwise
+ ***************************************************************************/
+static int
+pf_sync(const char *table_name, const prefix_t *desired, uint32_t count)
+{
+    pf_table_t         *table;
+    struct pfr_addr    *kernel;
+    struct pfr_addr    *wanted;
+    uint32_t            delta;
+    uint32_t            k;
+    uint32_t            w;
+    uint32_t            i;
+    int                 cmp;
+    int                 ret;
+
+    if ((table = pf_table_get(table_name)) == NULL) {
+        LOG_PRINTLN(LOG_FIREWALL_PF, LOG_ERROR, ("Too many tables: %s", table_name));
+        return -1;
+    }
+
+    /* queued actions first, the batches are reused for the delta. The state
+       kills wait until the table is repaired */
+    if (pf_flush_tables() != 0) {
+        return -1;
+    }
+
+    if (pf.dev == -1 && (pf.dev = open(pf_device, pf_mode)) == -1) {
+        LOG_ERRNO(LOG_FIREWALL_PF, LOG_ERROR, errno, ("Couldn't open device %s", pf_device));
+        return -1;
+    }
+
+    if (pf_table_read(table_name) != 0) {
+        return -1;
+    }
+
+    if (!pf_batch_reserve(&(pf.wanted), count) ||
+        !pf_batch_reserve(&(table->add), count) ||
+        !pf_batch_reserve(&(table->remove), pf.kernel.count)) {
+        LOG_PRINTLN(LOG_FIREWALL_PF, LOG_ERROR, ("Couldn't sync table %s", table_name));
+        return -1;
+    }
+
+    for (i = 0; i < count; i++) {
+        pf_addr_set(&(pf.wanted.addrs[i]), &(desired[i]));
+    }
+    pf.wanted.count = count;
+
+    qsort(pf.wanted.addrs, pf.wanted.count, sizeof(struct pfr_addr), pf_addr_compare);
+    qsort(pf.kernel.addrs, pf.kernel.count, sizeof(struct pfr_addr), pf_addr_compare);
+
+    /* sorted merge: only in the kernel -> remove, only desired -> add */
+    kernel = pf.kernel.addrs;
+    wanted = pf.wanted.addrs;
+
+    for (k = 0, w = 0; k < pf.kernel.count || w < pf.wanted.count; ) {
+        if (k == pf.kernel.count) {
+            cmp = 1;
+        } else if (w == pf.wanted.count) {
+            cmp = -1;
+        } else {
+            cmp = pf_addr_compare(&(kernel[k]), &(wanted[w]));
+        }
+
+        if (cmp < 0) {
+            table->remove.addrs[table->remove.count] = kernel[k++];
+            table->remove.addrs[table->remove.count++].pfra_fback = PFR_FB_NONE;
+        } else if (cmp > 0) {
+            table->add.addrs[table->add.count++] = wanted[w++];
+        } else {
+            k++;
+            w++;
+        }
+    }
+
+    delta = table->add.count + table->remove.count;
+
+    if (delta == 0) {
+        LOG_PRINTLN(LOG_FIREWALL_PF, LOG_DEBUG, ("Table %s in sync (%" PRIu32 " addresses)", table_name, pf.wanted.count));
+        ret = 0;
+    } else {
+        LOG_PRINTLN(LOG_FIREWALL_PF, LOG_INFO, ("Table %s drifted: %" PRIu32 " in kernel, %" PRIu32 " desired, %" PRIu32 " missing, %" PRIu32 " unexpected",
+                                                table_name, pf.kernel.count, pf.wanted.count, table->add.count, table->remove.count));
+
+        if (delta * PF_SYNC_REPLACE > pf.wanted.count) {
+            table->add.count    = 0;
+            table->remove.count = 0;
+
+            ret = pf_table_replace(table_name);
+        } else if ((ret = pf_flush_batch(table_name, &(table->remove), DIOCRDELADDRS)) == 0) {
+            ret = pf_flush_batch(table_name, &(table->add), DIOCRADDADDRS);
+        }
+    }
+
+    /* the table matches now: the states of its blocked sources can go */
+    return ret == 0 ? pf_flush_kills(&(table->kill)) : -1;
+}
+
+static void
+pf_close(void)
+{
+    if (pf.dev == -1) {
+        return;
+    }
+
+    if (close(pf.dev) == -1) {
+        LOG_ERRNO(LOG_FIREWALL_PF, LOG_ERROR, errno, ("Couldn't close device %s", pf_device));
+    }
+
+    pf.dev = -1;
 }
 
+const firewall_backend_t firewall_backend_pf = {
+    .name       = "pf",
+    .open       = pf_open,
+    .close      = pf_close,
+    .add        = pf_add,
+    .remove     = pf_remove,
+    .kill       = pf_kill,
+    .flush      = pf_flush,
+    .sync       = pf_sync,
+    .stats      = pf_stats
+};
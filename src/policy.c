@@ -0,0 +1,535 @@
+#include "policy.h"
+#include "hash.h"
+#include "log.h"
+#include "log_network.h"
+#include "verdict.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include <strings.h>
+#include <inttypes.h>
+
+#define POLICY_LINE_LEN             1024
+#define POLICY_LABELS_MAX           128                 /**< labels of a name (253 bytes) */
+#define POLICY_EDGES_INIT           1024                /**< edge table slots, power of two */
+
+typedef struct _policy_edge_t {
+    uint32_t            parent;                         /**< node */
+    uint32_t            hash;                           /**< label hash */
+    uint32_t            child;                          /**< node, zero if the slot is unused (the root is never a child) */
+    uint32_t            label;                          /**< offset of the label (len, bytes) in the label pool */
+} policy_edge_t;
+
+typedef struct _policy_rule_t {
+    uint8_t             action;                         /**< policy_action_t */
+    bool                wildcard;                       /**< only names below the suffix */
+    uint8_t             qtype_count;
+    uint16_t            qtypes[POLICY_QTYPE_MAX];
+    uint32_t            next;                           /**< next rule of the node + 1, zero if last */
+} policy_rule_t;
+
+/**
+ * The trie is a node array (first rule of a node + 1) and one open
+ * addressed edge table keyed by (parent node, label hash): a walk touches
+ * one edge slot per label, compared against the pooled label only when the
+ * hash matches
+ */
+struct _policy_trie_t {
+    policy_edge_t      *edges;
+    uint32_t            edge_mask;
+    uint32_t            edge_count;
+    uint32_t           *nodes;
+    uint32_t            node_count;
+    uint32_t            node_size;
+    policy_rule_t      *rules;
+    uint32_t            rule_count;
+    uint32_t            rule_size;
+    uint8_t            *labels;
+    uint32_t            label_len;
+    uint32_t            label_size;
+};
+
+typedef struct _policy_t {
+    const char         *file;
+    policy_trie_t      *trie;                           /**< swapped atomically on reload */
+} policy_t;
+
+static policy_t policy;
+
+static const char *policy_action_name[] = {
+    [POLICY_NONE]       = "none",
+    [POLICY_ALLOW]      = "allow",
+    [POLICY_SUSPECT]    = "suspect"
+};
+
+/**
+ * Grows an array to hold one more element
+ */
+static bool
+policy_grow(void **array, uint32_t *size, uint32_t count, uint32_t len, size_t element)
+{
+    void       *grown;
+    uint32_t    new_size = *size;
+
+    while (count + len > new_size) {
+        new_size = new_size > 0 ? new_size * 2 : 64;
+    }
+
+    if (new_size == *size) {
+        return true;
+    }
+
+    if ((grown = realloc(*array, new_size * element)) == NULL) {
+        return false;
+    }
+
+    *array  = grown;
+    *size   = new_size;
+
+    return true;
+}
+
+static void
+policy_trie_free(policy_trie_t *trie)
+{
+    if (trie == NULL) {
+        return;
+    }
+
+    free(trie->edges);
+    free(trie->nodes);
+    free(trie->rules);
+    free(trie->labels);
+    free(trie);
+}
+
+static inline uint32_t
+policy_label_hash(const uint8_t *value, uint8_t len)
+{
+    uint32_t    hash = hash_fnv1a(HASH_FNV1A_INIT, len);
+    uint8_t     i;
+
+    for (i = 0; i < len; i++) {
+        hash = hash_fnv1a(hash, tolower(value[i]));
+    }
+
+    return hash;
+}
+
+static inline uint32_t
+policy_edge_slot(uint32_t parent, uint32_t hash)
+{
+    return (uint32_t) hash_mix64(((uint64_t) parent << 32) | hash);
+}
+
+/**
+ * Finds the child of a node by its label, zero if there is none
+ */
+static inline uint32_t
+policy_trie_child(const policy_trie_t *trie, uint32_t parent, const uint8_t *value, uint8_t len)
+{
+    const policy_edge_t    *edge;
+    uint32_t                hash = policy_label_hash(value, len);
+    uint32_t                idx;
+    uint8_t                 i;
+
+    for (idx = policy_edge_slot(parent, hash) & trie->edge_mask; ; idx = (idx + 1) & trie->edge_mask) {
+        edge = &(trie->edges[idx]);
+
+        if (edge->child == 0) {
+            return 0;
+        }
+
+        if (edge->parent != parent || edge->hash != hash || trie->labels[edge->label] != len) {
+            continue;
+        }
+
+        for (i = 0; i < len && tolower(value[i]) == trie->labels[edge->label + 1 + i]; i++);
+
+        if (i == len) {
+            return edge->child;
+        }
+    }
+}
+
+/**
+ * Doubles the edge table, the load stays below 1/2
+ */
+static bool
+policy_trie_rehash(policy_trie_t *trie)
+{
+    policy_edge_t  *edges;
+    uint32_t        mask = trie->edge_mask * 2 + 1;
+    uint32_t        idx;
+    uint32_t        i;
+
+    if ((edges = calloc(mask + 1, sizeof(policy_edge_t))) == NULL) {
+        return false;
+    }
+
+    for (i = 0; i <= trie->edge_mask; i++) {
+        if (trie->edges[i].child == 0) {
+            continue;
+        }
+
+        for (idx = policy_edge_slot(trie->edges[i].parent, trie->edges[i].hash) & mask; edges[idx].child != 0; idx = (idx + 1) & mask);
+
+        edges[idx] = trie->edges[i];
+    }
+
+    free(trie->edges);
+
+    trie->edges     = edges;
+    trie->edge_mask = mask;
+
+    return true;
+}
+
+/**
+ * Finds or adds the child of a node, zero if out of memory
+ */
+static uint32_t
+policy_trie_add_child(policy_trie_t *trie, uint32_t parent, const uint8_t *value, uint8_t len)
+{
+    uint32_t    child;
+    uint32_t    hash;
+    uint32_t    idx;
+    uint8_t     i;
+
+    if ((child = policy_trie_child(trie, parent, value, len)) != 0) {
+        return child;
+    }
+
+    if ((trie->edge_count + 1) * 2 > trie->edge_mask + 1 && !policy_trie_rehash(trie)) {
+        return 0;
+    }
+
+    if (!policy_grow((void **) &(trie->nodes),  &(trie->node_size),  trie->node_count, 1,       sizeof(uint32_t)) ||
+        !policy_grow((void **) &(trie->labels), &(trie->label_size), trie->label_len,  len + 1, 1)) {
+        return 0;
+    }
+
+    hash = policy_label_hash(value, len);
+
+    for (idx = policy_edge_slot(parent, hash) & trie->edge_mask; trie->edges[idx].child != 0; idx = (idx + 1) & trie->edge_mask);
+
+    child = trie->node_count++;
+
+    trie->nodes[child]      = 0;
+    trie->edges[idx]        = (policy_edge_t) { .parent = parent, .hash = hash, .child = child, .label = trie->label_len };
+
+    trie->labels[trie->label_len++] = len;
+    for (i = 0; i < len; i++) {
+        trie->labels[trie->label_len++] = tolower(value[i]);
+    }
+
+    trie->edge_count++;
+
+    return child;
+}
+
+static bool
+policy_rule_matches(const policy_rule_t *rule, uint16_t qtype, bool below)
+{
+    uint8_t i;
+
+    if (rule->wildcard && !below) {
+        return false;
+    }
+
+    if (rule->qtype_count == 0) {
+        return true;
+    }
+
+    for (i = 0; i < rule->qtype_count; i++) {
+        if (rule->qtypes[i] == qtype) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/**
+ * Parses a qtype by its mnemonic (as logged) or its number
+ */
+static bool
+policy_parse_qtype(const char *token, uint16_t *qtype)
+{
+    const char     *name;
+    char           *end;
+    size_t          len = strlen(token);
+    unsigned long   value;
+    uint32_t        type;
+
+    value = strtoul(token, &end, 10);
+    if (*end == '\0' && end != token && value <= UINT16_MAX) {
+        *qtype = value;
+        return true;
+    }
+
+    for (type = 1; type <= UINT16_MAX; type++) {
+        name = log_dns_type(type);
+
+        if (strncasecmp(name, token, len) == 0 && (name[len] == '\0' || name[len] == ' ')) {
+            *qtype = type;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/**
+ * Adds a rule: walks (or creates) the reversed labels of the suffix and
+ * appends the rule to the node
+ */
+static bool
+policy_trie_add(policy_trie_t *trie, const char *suffix, policy_rule_t *rule)
+{
+    const char     *labels[POLICY_LABELS_MAX];
+    uint8_t         lens[POLICY_LABELS_MAX];
+    uint32_t        count = 0;
+    uint32_t        node  = 0;
+    const char     *dot;
+
+    if (strncmp(suffix, "*.", 2) == 0) {
+        rule->wildcard  = true;
+        suffix         += 2;
+    }
+
+    /* split, the root "." has no labels */
+    for (; *suffix != '\0' && strcmp(suffix, ".") != 0; suffix = *dot == '.' ? dot + 1 : dot) {
+        dot = strchr(suffix, '.');
+        if (dot == NULL) {
+            dot = suffix + strlen(suffix);
+        }
+
+        if (dot == suffix || dot - suffix > DNS_LABEL_MAX_LEN || count == POLICY_LABELS_MAX) {
+            return false;
+        }
+
+        labels[count]   = suffix;
+        lens[count++]   = dot - suffix;
+    }
+
+    while (count-- > 0) {
+        if ((node = policy_trie_add_child(trie, node, (const uint8_t *) labels[count], lens[count])) == 0) {
+            return false;
+        }
+    }
+
+    if (!policy_grow((void **) &(trie->rules), &(trie->rule_size), trie->rule_count, 1, sizeof(policy_rule_t))) {
+        return false;
+    }
+
+    rule->next                          = trie->nodes[node];
+    trie->rules[trie->rule_count++]     = *rule;
+    trie->nodes[node]                   = trie->rule_count;
+
+    return true;
+}
+
+/**
+ * Compiles the rules of the policy file into a new trie
+ */
+static policy_trie_t *
+policy_trie_compile(const char *file)
+{
+    policy_trie_t  *trie;
+    policy_rule_t   rule;
+    FILE           *fp;
+    char            line[POLICY_LINE_LEN];
+    char           *action;
+    char           *suffix;
+    char           *qtypes;
+    char           *qtype;
+    char           *save;
+    char           *qtype_save;
+    uint32_t        line_nr = 0;
+
+    if ((fp = fopen(file, "r")) == NULL) {
+        LOG_ERRNO(LOG_POLICY, LOG_ERROR, errno, ("Could not open policy file %s", file));
+        return NULL;
+    }
+
+    if ((trie = calloc(1, sizeof(policy_trie_t))) == NULL ||
+        (trie->edges = calloc(POLICY_EDGES_INIT, sizeof(policy_edge_t))) == NULL ||
+        !policy_grow((void **) &(trie->nodes), &(trie->node_size), 0, 1, sizeof(uint32_t))) {
+        goto failure;
+    }
+
+    trie->edge_mask     = POLICY_EDGES_INIT - 1;
+    trie->nodes[0]      = 0;                            /**< root */
+    trie->node_count    = 1;
+
+    while (fgets(line, sizeof(line), fp) != NULL) {
+        line_nr++;
+
+        if ((action = strtok_r(line, " \t\r\n", &save)) == NULL || *action == '#') {
+            continue;
+        }
+
+        memset(&rule, 0, sizeof(rule));
+
+        if (strcasecmp(action, policy_action_name[POLICY_ALLOW]) == 0) {
+            rule.action = POLICY_ALLOW;
+        } else if (strcasecmp(action, policy_action_name[POLICY_SUSPECT]) == 0) {
+            rule.action = POLICY_SUSPECT;
+        } else {
+            LOG_PRINTLN(LOG_POLICY, LOG_ERROR, ("%s:%" PRIu32 ": unknown action %s", file, line_nr, action));
+            goto failure;
+        }
+
+        if ((suffix = strtok_r(NULL, " \t\r\n", &save)) == NULL) {
+            LOG_PRINTLN(LOG_POLICY, LOG_ERROR, ("%s:%" PRIu32 ": suffix missing", file, line_nr));
+            goto failure;
+        }
+
+        if ((qtypes = strtok_r(NULL, " \t\r\n", &save)) != NULL) {
+            for (qtype = strtok_r(qtypes, ",", &qtype_save); qtype != NULL; qtype = strtok_r(NULL, ",", &qtype_save)) {
+                if (rule.qtype_count == POLICY_QTYPE_MAX || !policy_parse_qtype(qtype, &(rule.qtypes[rule.qtype_count++]))) {
+                    LOG_PRINTLN(LOG_POLICY, LOG_ERROR, ("%s:%" PRIu32 ": invalid qtype %s", file, line_nr, qtype));
+                    goto failure;
+                }
+            }
+        }
+
+        if (!policy_trie_add(trie, suffix, &rule)) {
+            LOG_PRINTLN(LOG_POLICY, LOG_ERROR, ("%s:%" PRIu32 ": invalid suffix %s", file, line_nr, suffix));
+            goto failure;
+        }
+    }
+
+    fclose(fp);
+
+    LOG_PRINTLN(LOG_POLICY, LOG_INFO, ("policy %s: %" PRIu32 " rules, %" PRIu32 " nodes, %" PRIu32 " label bytes", file, trie->rule_count, trie->node_count, trie->label_len));
+
+    return trie;
+
+failure:
+    fclose(fp);
+    policy_trie_free(trie);
+
+    return NULL;
+}
+
+bool
+policy_init(config_t *config)
+{
+    memset(&policy, 0, sizeof(policy));
+
+    if (config->policy_file == NULL) {
+        LOG_PRINTLN(LOG_POLICY, LOG_INFO, ("qname policy disabled"));
+        return true;
+    }
+
+    policy.file = config->policy_file;
+
+    return policy_reload();
+}
+
+/****************************************************************************
+ * policy_reload
+ *
+ * Compiles the policy file and swaps the new trie in. On failure the old
+ * trie stays in place. The trie is only read by the capture loop, which
+ * also reloads, so the old one is not referenced anymore when it is freed
+ *
+ * @return                          true if the new policy is in place
+ ***************************************************************************/
+bool
+policy_reload(void)
+{
+    policy_trie_t *trie;
+
+    if (policy.file == NULL) {
+        return true;
+    }
+
+    if ((trie = policy_trie_compile(policy.file)) == NULL) {
+        return false;
+    }
+
+    policy_trie_free(__atomic_exchange_n(&(policy.trie), trie, __ATOMIC_ACQ_REL));
+    verdict_invalidate();
+
+    return true;
+}
+
+/****************************************************************************
+ * policy_match
+ *
+ * Matches a qname in one walk over its reversed labels
+ *
+ * @param  qname                    labels of the name
+ * @param  qtype                    query type
+ * @return                          action of the longest matching suffix
+ ***************************************************************************/
+policy_action_t
+policy_match(const dns_label_t *qname, uint16_t qtype)
+{
+    const policy_trie_t    *trie = __atomic_load_n(&(policy.trie), __ATOMIC_ACQUIRE);
+    const dns_label_t      *labels[POLICY_LABELS_MAX];
+    const policy_rule_t    *rule;
+    policy_action_t         action = POLICY_NONE;
+    uint32_t                count = 0;
+    uint32_t                node  = 0;
+    uint32_t                r;
+
+    if (trie == NULL) {
+        return POLICY_NONE;
+    }
+
+    for (; qname != NULL && qname->len > 0 && count < POLICY_LABELS_MAX; qname = qname->next) {
+        labels[count++] = qname;
+    }
+
+    for (;;) {
+        for (r = trie->nodes[node]; r != 0; r = rule->next) {
+            rule = &(trie->rules[r - 1]);
+
+            if (policy_rule_matches(rule, qtype, count > 0)) {
+                action = rule->action;
+                break;
+            }
+        }
+
+        if (count == 0) {
+            break;
+        }
+
+        count--;
+
+        if ((node = policy_trie_child(trie, node, labels[count]->value, labels[count]->len)) == 0) {
+            break;
+        }
+    }
+
+    return action;
+}
+
+/**
+ * Matches the question of a DNS packet
+ */
+policy_action_t
+policy_process(packet_t *packet)
+{
+    dns_header_t   *dns;
+
+    if (policy.trie == NULL) {
+        return POLICY_NONE;
+    }
+
+    dns = (dns_header_t *) packet_get_header(packet, PACKET_TYPE_DNS);
+
+    if (dns == NULL || dns->qd == NULL) {
+        return POLICY_NONE;
+    }
+
+    return policy_match(dns->qd->qname, dns->qd->qtype);
+}
+
@@ -0,0 +1,208 @@
+#include "prefix_set.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <arpa/inet.h>
+
+#define PREFIX_SET_INIT_SIZE    256
+
+static inline uint32_t
+prefix_addr_len(const prefix_t *prefix)
+{
+    return prefix->family == AF_INET6 ? sizeof(struct in6_addr) : sizeof(struct in_addr);
+}
+
+static uint32_t
+prefix_hash(const prefix_t *prefix)
+{
+    const uint8_t  *bytes = (const uint8_t *) &(prefix->ipv6);
+    uint32_t        hash  = 2166136261u ^ prefix->len;
+    uint32_t        i;
+
+    for (i = 0; i < prefix_addr_len(prefix); i++) {
+        hash = (hash ^ bytes[i]) * 16777619u;
+    }
+
+    return hash;
+}
+
+/**
+ * Orders by family, address (network byte order compares like a number)
+ * and prefix length
+ */
+int
+prefix_compare(const void *a, const void *b)
+{
+    const prefix_t *x = a;
+    const prefix_t *y = b;
+    int             cmp;
+
+    if (x->family != y->family) {
+        return x->family < y->family ? -1 : 1;
+    }
+
+    if ((cmp = memcmp(&(x->ipv6), &(y->ipv6), prefix_addr_len(x))) != 0) {
+        return cmp;
+    }
+
+    return (int) x->len - (int) y->len;
+}
+
+/**
+ * Whether prefix holds the address (or prefix) addr
+ */
+bool
+prefix_covers(const prefix_t *prefix, const prefix_t *addr)
+{
+    const uint8_t  *a = (const uint8_t *) &(prefix->ipv6);
+    const uint8_t  *b = (const uint8_t *) &(addr->ipv6);
+    uint32_t        bytes = prefix->len / 8;
+    uint32_t        bits  = prefix->len % 8;
+
+    if (prefix->family != addr->family || prefix->len > addr->len) {
+        return false;
+    }
+
+    if (memcmp(a, b, bytes) != 0) {
+        return false;
+    }
+
+    return bits == 0 || ((a[bytes] ^ b[bytes]) & (0xff << (8 - bits))) == 0;
+}
+
+static uint32_t
+prefix_set_find(const prefix_set_t *set, const prefix_t *prefix)
+{
+    uint32_t i = prefix_hash(prefix) & (set->size - 1);
+
+    while (set->prefixes[i].family != 0 && prefix_compare(&(set->prefixes[i]), prefix) != 0) {
+        i = (i + 1) & (set->size - 1);
+    }
+
+    return i;
+}
+
+/**
+ * @return                  false if out of memory
+ */
+bool
+prefix_set_add(prefix_set_t *set, const prefix_t *prefix)
+{
+    prefix_set_t    grown;
+    uint32_t        i;
+
+    if ((set->count + 1) * 2 > set->size) {
+        grown.size  = set->size > 0 ? set->size * 2 : PREFIX_SET_INIT_SIZE;
+        grown.count = set->count;
+
+        if ((grown.prefixes = calloc(grown.size, sizeof(prefix_t))) == NULL) {
+            return false;
+        }
+
+        for (i = 0; i < set->size; i++) {
+            if (set->prefixes[i].family != 0) {
+                grown.prefixes[prefix_set_find(&grown, &(set->prefixes[i]))] = set->prefixes[i];
+            }
+        }
+
+        free(set->prefixes);
+        *set = grown;
+    }
+
+    i = prefix_set_find(set, prefix);
+    if (set->prefixes[i].family == 0) {
+        set->prefixes[i] = *prefix;
+        set->count++;
+    }
+
+    return true;
+}
+
+/**
+ * Removes with backward shift, so that no probe sequence is broken
+ *
+ * @return                  false if the prefix is not in the set
+ */
+bool
+prefix_set_remove(prefix_set_t *set, const prefix_t *prefix)
+{
+    uint32_t    mask = set->size - 1;
+    uint32_t    i;
+    uint32_t    j;
+    uint32_t    home;
+
+    if (set->count == 0) {
+        return false;
+    }
+
+    i = prefix_set_find(set, prefix);
+    if (set->prefixes[i].family == 0) {
+        return false;
+    }
+
+    for (j = (i + 1) & mask; set->prefixes[j].family != 0; j = (j + 1) & mask) {
+        home = prefix_hash(&(set->prefixes[j])) & mask;
+
+        /* j may move into the hole at i if its home is not within (i, j] */
+        if (((j - home) & mask) >= ((j - i) & mask)) {
+            set->prefixes[i] = set->prefixes[j];
+            i = j;
+        }
+    }
+
+    memset(&(set->prefixes[i]), 0, sizeof(prefix_t));
+    set->count--;
+
+    return true;
+}
+
+bool
+prefix_set_contains(const prefix_set_t *set, const prefix_t *prefix)
+{
+    return set->count > 0 && set->prefixes[prefix_set_find(set, prefix)].family != 0;
+}
+
+/**
+ * Copies the set in prefix_compare() order
+ *
+ * @param  prefixes         room for count prefixes
+ * @return                  count
+ */
+uint32_t
+prefix_set_sorted(const prefix_set_t *set, prefix_t *prefixes)
+{
+    uint32_t    count = 0;
+    uint32_t    i;
+
+    for (i = 0; i < set->size; i++) {
+        if (set->prefixes[i].family != 0) {
+            prefixes[count++] = set->prefixes[i];
+        }
+    }
+
+    qsort(prefixes, count, sizeof(prefix_t), prefix_compare);
+
+    return count;
+}
+
+void
+prefix_set_free(prefix_set_t *set)
+{
+    free(set->prefixes);
+    memset(set, 0, sizeof(prefix_set_t));
+}
+
+/**
+ * Formats "address/len"
+ */
+const char *
+prefix_ntop(const prefix_t *prefix, char *str, size_t len)
+{
+    char addr[INET6_ADDRSTRLEN];
+
+    inet_ntop(prefix->family, &(prefix->ipv6), addr, sizeof(addr));
+    snprintf(str, len, "%s/%u", addr, prefix->len);
+
+    return str;
+}
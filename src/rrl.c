@@ -0,0 +1,186 @@
+#include "rrl.h"
+#include "slip.h"
+#include "block.h"
+#include "hash.h"
+#include "log.h"
+
+#include "packet/port.h"
+
+#include <string.h>
+#include <inttypes.h>
+#include <arpa/inet.h>
+
+#define RRL_SET_BITS                12
+#define RRL_SETS                    (1 << RRL_SET_BITS)
+#define RRL_WAYS                    4                   /**< buckets per set */
+#define RRL_TOKEN                   1000                /**< one response in token units (1/ms resolution) */
+
+typedef struct _rrl_bucket_t {
+    uint64_t            key;                            /**< hash of the response tuple, zero if unused */
+    uint32_t            last;                           /**< ms of the last refill (wraps) */
+    uint32_t            tokens;
+    uint32_t            limited;                        /**< responses over the limit in a row */
+} rrl_bucket_t;
+
+typedef struct _rrl_t {
+    bool                enabled;
+    rrl_action_t        action;
+    uint32_t            rate;                           /**< responses per second = tokens per ms */
+    uint32_t            burst;                          /**< in token units */
+    uint32_t            fill_time;                      /**< ms from empty to full */
+    uint8_t             prefix_len;
+    uint32_t            mask;                           /**< prefix mask (network byte order) */
+    rrl_bucket_t        buckets[RRL_SETS][RRL_WAYS];
+} rrl_t;
+
+static rrl_t rrl;
+
+static const char *rrl_action_name[] = {
+    [RRL_ACTION_PASS]   = "pass",
+    [RRL_ACTION_SLIP]   = "slip",
+    [RRL_ACTION_BLOCK]  = "block"
+};
+
+bool
+rrl_init(config_t *config)
+{
+    memset(&rrl, 0, sizeof(rrl));
+
+    if (config->rrl_rate == 0) {
+        LOG_PRINTLN(LOG_RRL, LOG_INFO, ("response rate limiting disabled"));
+        return true;
+    }
+
+    if (config->rrl_prefix == 0 || config->rrl_prefix > 32 || config->rrl_action > RRL_ACTION_BLOCK) {
+        LOG_PRINTLN(LOG_RRL, LOG_ERROR, ("invalid response rate limiting configuration: prefix=%" PRIu32 ", action=%" PRIu32, config->rrl_prefix, config->rrl_action));
+        return false;
+    }
+
+    rrl.enabled     = true;
+    rrl.action      = config->rrl_action;
+    rrl.rate        = config->rrl_rate;
+    rrl.burst       = (config->rrl_burst > 0 ? config->rrl_burst : 1) * RRL_TOKEN;
+    rrl.fill_time   = rrl.burst / rrl.rate + 1;
+    rrl.prefix_len  = config->rrl_prefix;
+    rrl.mask        = htonl(UINT32_MAX << (32 - rrl.prefix_len));
+
+    LOG_PRINTLN(LOG_RRL, LOG_INFO, ("response rate limiting enabled: rate=%" PRIu32 "/s, burst=%" PRIu32 ", prefix=/%u, action=%s",
+                                    config->rrl_rate, config->rrl_burst, rrl.prefix_len, rrl_action_name[rrl.action]));
+
+    return true;
+}
+
+/**
+ * Finds the bucket of a key in its set, otherwise the least recently used
+ * bucket of the set is (re)initialized with a full bucket
+ */
+static inline rrl_bucket_t *
+rrl_bucket_get(uint64_t key, uint32_t now)
+{
+    rrl_bucket_t   *set = rrl.buckets[key >> (64 - RRL_SET_BITS)];
+    rrl_bucket_t   *lru = &(set[0]);
+    uint32_t        way;
+
+    for (way = 0; way < RRL_WAYS; way++) {
+        if (set[way].key == key) {
+            return &(set[way]);
+        }
+
+        if (set[way].key == 0 || (lru->key != 0 && now - set[way].last > now - lru->last)) {
+            lru = &(set[way]);
+        }
+    }
+
+    lru->key        = key;
+    lru->last       = now;
+    lru->tokens     = rrl.burst;
+    lru->limited    = 0;
+
+    return lru;
+}
+
+/****************************************************************************
+ * rrl_process
+ *
+ * Meters a response. Refill is lazy and integer only: tokens per ms
+ * elapsed since the last response of the bucket
+ *
+ * @param  packet                   decoded packet
+ * @param  raw_packet               raw packet (timestamp)
+ * @param  suspect                  limit the response regardless of the tokens (qname policy)
+ * @return                          action taken for the response
+ ***************************************************************************/
+rrl_action_t
+rrl_process(packet_t *packet, raw_packet_t *raw_packet, bool suspect)
+{
+    ipv4_header_t      *ipv4;
+    udpv4_header_t     *udpv4;
+    dns_header_t       *dns;
+    rrl_bucket_t       *bucket;
+    struct in_addr      client;
+    uint32_t            prefix;
+    uint32_t            now;
+    uint32_t            elapsed;
+    uint64_t            key;
+
+    if (!rrl.enabled) {
+        return RRL_ACTION_PASS;
+    }
+
+    ipv4    = (ipv4_header_t *)  packet_get_header(packet, PACKET_TYPE_IPV4);
+    udpv4   = (udpv4_header_t *) packet_get_header(packet, PACKET_TYPE_UDPV4);
+    dns     = (dns_header_t *)   packet_get_header(packet, PACKET_TYPE_DNS);
+
+    /* only responses of a DNS server */
+    if (ipv4 == NULL || udpv4 == NULL || dns == NULL || dns->qd == NULL || !dns->flags.qr || udpv4->src_port != PORT_DNS) {
+        return RRL_ACTION_PASS;
+    }
+
+    memcpy(&(client.s_addr), ipv4->dest.addr, IPV4_ADDRESS_LEN);
+    prefix  = client.s_addr & rrl.mask;
+    now     = raw_packet->timestamp / 1000;
+
+    key = hash_combine(hash_mix64(((uint64_t) prefix << 32) | dns_label_hash(dns->qd->qname)),
+                       ((uint64_t) dns->qd->qtype << 8) | dns->flags.rcode);
+    key |= 1;                                           /**< zero marks an unused bucket */
+
+    bucket = rrl_bucket_get(key, now);
+
+    /* refill */
+    elapsed = now - bucket->last;
+    if (elapsed >= rrl.fill_time) {
+        bucket->tokens = rrl.burst;
+    } else if (elapsed > 0) {
+        bucket->tokens += elapsed * rrl.rate;
+        if (bucket->tokens > rrl.burst) {
+            bucket->tokens = rrl.burst;
+        }
+    }
+    bucket->last = now;
+
+    /* a sampled response stands for several: it takes their tokens, as many as there are */
+    if (bucket->tokens >= RRL_TOKEN && !suspect) {
+        bucket->tokens -= (bucket->tokens / RRL_TOKEN >= packet->weight) ? packet->weight * RRL_TOKEN : bucket->tokens;
+        bucket->limited = 0;
+        return RRL_ACTION_PASS;
+    }
+
+    if (bucket->limited++ == 0) {
+        LOG_PRINTLN(LOG_RRL, LOG_INFO, ("rate limited: %s/%u, qtype=%" PRIu16 ", rcode=%u, action=%s",
+                                        inet_ntoa(client), rrl.prefix_len, dns->qd->qtype, dns->flags.rcode, rrl_action_name[rrl.action]));
+    }
+
+    switch (rrl.action) {
+        case RRL_ACTION_SLIP:   if (!slip_add(&client, raw_packet->timestamp)) {
+                                    return RRL_ACTION_PASS;
+                                }
+                                break;
+
+        case RRL_ACTION_BLOCK:  block_report(&client, packet->weight, raw_packet->timestamp);
+                                break;
+
+        default:                break;
+    }
+
+    return rrl.action;
+}
@@ -0,0 +1,284 @@
+#include "slip.h"
+#include "bpf.h"
+#include "firewall.h"
+#include "log.h"
+#include "timer_wheel.h"
+#include "verdict.h"
+
+#include "packet/dns_template.h"
+#include "packet/port.h"
+
+#include <string.h>
+#include <inttypes.h>
+#include <arpa/inet.h>
+
+#define SLIP_TABLE_SIZE             4096                /**< tracked sources, power of two */
+#define SLIP_TABLE_BITS             12
+#define SLIP_PROBE_MAX              8                   /**< linear probing distance */
+#define SLIP_TOKEN                  1000000             /**< one query in token units (1/us resolution) */
+#define SLIP_RETRY_INTERVAL         1000000             /**< us until a failed pf action is retried */
+
+typedef struct _slip_source_t {
+    uint32_t            addr;                           /**< IPv4 address (network byte order), zero if unused */
+    bool                slipped;                        /**< source is in the pf slip table */
+    uint64_t            tokens;                         /**< token bucket, SLIP_TOKEN per query */
+    uint64_t            last;                           /**< timestamp of the last query (us) */
+    uint64_t            exceeded;                       /**< timestamp the rate was exceeded last (us) */
+    uint64_t            retry;                          /**< timestamp a failed pf add may be retried (us) */
+    timer_event_t       timer;                          /**< pf removal or forgetting an idle source */
+} slip_source_t;
+
+typedef struct _slip_t {
+    bool                enabled;
+    int                 bpf;
+    uint64_t            rate;                           /**< queries per second */
+    uint64_t            burst;                          /**< in token units */
+    uint64_t            hold;                           /**< in us */
+    dns_template_t      template;                       /**< truncated response */
+    slip_source_t       sources[SLIP_TABLE_SIZE];
+} slip_t;
+
+static slip_t slip;
+
+static slip_source_t   *slip_source_get (uint32_t addr, uint64_t now);
+static void             slip_expire     (timer_event_t *event, uint64_t now);
+
+bool
+slip_init(config_t *config, int bpf)
+{
+    memset(&slip, 0, sizeof(slip));
+    
+    if (config->slip_rate == 0) {
+        LOG_PRINTLN(LOG_SLIP, LOG_INFO, ("slip responder disabled"));
+        return true;
+    }
+    
+    if (!dns_template_compile(&slip.template, DNS_HEADER_RCODE_NO_ERROR, true)) {
+        return false;
+    }
+    
+    slip.enabled    = true;
+    slip.bpf        = bpf;
+    slip.rate       = config->slip_rate;
+    slip.burst      = (uint64_t) (config->slip_burst > 0 ? config->slip_burst : 1) * SLIP_TOKEN;
+    slip.hold       = (uint64_t) config->slip_hold * 1000000;
+    
+    LOG_PRINTLN(LOG_SLIP, LOG_INFO, ("slip responder enabled: rate=%" PRIu32 "/s, burst=%" PRIu32 ", hold=%" PRIu32 "s", config->slip_rate, config->slip_burst, config->slip_hold));
+    
+    return true;
+}
+
+/****************************************************************************
+ * slip_process
+ *
+ * Meters the queries of every source with a token bucket. A query of a
+ * rate-exceeded source is answered with TC=1
+ *
+ * @param  packet                   decoded packet
+ * @param  raw_packet               raw packet (timestamp, question)
+ * @return                          true if a truncated response was sent
+ ***************************************************************************/
+bool
+slip_process(packet_t *packet, raw_packet_t *raw_packet)
+{
+    ipv4_header_t      *ipv4;
+    udpv4_header_t     *udpv4;
+    dns_header_t       *dns;
+    slip_source_t      *source;
+    raw_packet_t       *response;
+    uint64_t            now;
+    struct in_addr      addr;
+    bool                sent;
+    
+    if (!slip.enabled) {
+        return false;
+    }
+    
+    now = raw_packet->timestamp;
+    
+    ipv4    = (ipv4_header_t *)  packet_get_header(packet, PACKET_TYPE_IPV4);
+    udpv4   = (udpv4_header_t *) packet_get_header(packet, PACKET_TYPE_UDPV4);
+    dns     = (dns_header_t *)   packet_get_header(packet, PACKET_TYPE_DNS);
+    
+    /* only queries to a DNS server */
+    if (ipv4 == NULL || udpv4 == NULL || dns == NULL || dns->flags.qr || udpv4->dest_port != PORT_DNS) {
+        return false;
+    }
+    
+    memcpy(&(addr.s_addr), ipv4->src.addr, IPV4_ADDRESS_LEN);
+    
+    if ((source = slip_source_get(addr.s_addr, now)) == NULL) {
+        return false;
+    }
+    
+    /* refill */
+    if (now > source->last) {
+        source->tokens += (now - source->last) * slip.rate;
+        if (source->tokens > slip.burst) {
+            source->tokens = slip.burst;
+        }
+    }
+    source->last = now;
+    
+    /* conforming: the response of a slipped source is still blocked by pf, so it is truncated anyway */
+    if (source->tokens >= SLIP_TOKEN) {
+        source->tokens -= SLIP_TOKEN;
+        
+        if (!source->slipped) {
+            return false;
+        }
+    
+    /* rate exceeded */
+    } else {
+        source->exceeded = now;
+    }
+    
+    /* a full firewall queue is not hammered with every query of the source */
+    if (!source->slipped && now >= source->retry) {
+        LOG_PRINTLN(LOG_SLIP, LOG_INFO, ("rate exceeded: %s", inet_ntoa(addr)));
+        
+        if (!(source->slipped = firewall_post(FIREWALL_TABLE_SLIP, &addr, 32, FIREWALL_ADD))) {
+            source->retry = now + SLIP_RETRY_INTERVAL;
+        }
+    }
+    
+    if ((response = dns_template_apply(&slip.template, packet, raw_packet)) == NULL) {
+        return false;
+    }
+    
+#ifdef __FreeBSD__
+    sent = bpf_write(slip.bpf, response);
+#else
+    /* no bpf device to send the TC=1 response through */
+    sent = false;
+#endif
+    object_release(response);
+    
+    return sent;
+}
+
+/****************************************************************************
+ * slip_add
+ *
+ * Slips a source on behalf of another limiter (e.g. RRL): the responses to
+ * it are blocked and its queries are answered with TC=1 for the hold time
+ *
+ * @param  addr                     source address
+ * @param  now                      timestamp (us)
+ * @return                          true if the source is slipped
+ ***************************************************************************/
+bool
+slip_add(struct in_addr *addr, uint64_t now)
+{
+    slip_source_t *source;
+    
+    if (!slip.enabled || (source = slip_source_get(addr->s_addr, now)) == NULL) {
+        return false;
+    }
+    
+    source->exceeded = now;
+    
+    if (!source->slipped && now >= source->retry) {
+        LOG_PRINTLN(LOG_SLIP, LOG_INFO, ("slip: %s", inet_ntoa(*addr)));
+        
+        if (!(source->slipped = firewall_post(FIREWALL_TABLE_SLIP, addr, 32, FIREWALL_ADD))) {
+            source->retry = now + SLIP_RETRY_INTERVAL;
+        }
+    }
+    
+    return source->slipped;
+}
+
+/**
+ * Finds or inserts a source. A free slot is taken first, otherwise the
+ * least recently seen source which is not slipped is replaced
+ */
+static slip_source_t *
+slip_source_get(uint32_t addr, uint64_t now)
+{
+    slip_source_t  *source;
+    slip_source_t  *victim = NULL;
+    uint32_t        idx;
+    uint32_t        i;
+    
+    idx = (addr * 2654435761u) >> (32 - SLIP_TABLE_BITS);
+    
+    for (i = 0; i < SLIP_PROBE_MAX; i++) {
+        source = &(slip.sources[(idx + i) & (SLIP_TABLE_SIZE - 1)]);
+        
+        if (source->addr == addr) {
+            return source;
+        }
+        
+        /* expiry leaves holes, so the whole probing distance is searched */
+        if (victim != NULL && victim->addr == 0) {
+            continue;
+        }
+        
+        if (source->addr == 0 || (!source->slipped && (victim == NULL || source->last < victim->last))) {
+            victim = source;
+        }
+    }
+    
+    if (victim == NULL) {
+        return NULL;
+    }
+    
+    victim->addr        = addr;
+    victim->slipped     = false;
+    victim->tokens      = slip.burst;
+    victim->last        = now;
+    victim->exceeded    = 0;
+    victim->retry       = 0;
+    
+    /* a replaced source keeps its timer, the expiry re-arms it for the new one */
+    if (!timer_event_armed(&(victim->timer))) {
+        timer_event_init(&(victim->timer), slip_expire);
+        timer_wheel_arm(&(victim->timer), now + slip.burst / slip.rate);
+    }
+    
+    return victim;
+}
+
+/**
+ * Removes a source from the pf slip table which has not exceeded the rate
+ * for the hold time and forgets it once idle. The timer is armed lazily:
+ * queries do not move it, it re-arms itself until there is nothing left
+ */
+static void
+slip_expire(timer_event_t *event, uint64_t now)
+{
+    slip_source_t  *source = TIMER_EVENT_CONTAINER(event, slip_source_t, timer);
+    struct in_addr  addr;
+    uint64_t        idle;
+    
+    if (source->slipped) {
+        if (now < source->exceeded + slip.hold) {
+            timer_wheel_arm(event, source->exceeded + slip.hold);
+            return;
+        }
+        
+        addr.s_addr = source->addr;
+        
+        LOG_PRINTLN(LOG_SLIP, LOG_INFO, ("rate recovered: %s", inet_ntoa(addr)));
+        
+        if (!firewall_post(FIREWALL_TABLE_SLIP, &addr, 32, FIREWALL_REMOVE)) {
+            timer_wheel_arm(event, now + SLIP_RETRY_INTERVAL);
+            return;
+        }
+        
+        source->slipped = false;
+        verdict_invalidate();
+    }
+    
+    /* bucket is full again, nothing to remember */
+    idle = source->last + slip.burst / slip.rate;
+    
+    if (now < idle) {
+        timer_wheel_arm(event, idle);
+        return;
+    }
+    
+    source->addr = 0;
+}
+
@@ -0,0 +1,275 @@
+#include "timer_wheel.h"
+
+#include <string.h>
+#include <inttypes.h>
+#include <sys/time.h>
+
+#define TIMER_WHEEL_MASK            (TIMER_WHEEL_SLOTS - 1)
+#define TIMER_WHEEL_WORDS           (TIMER_WHEEL_SLOTS / 64)
+#define TIMER_WHEEL_RANGE           (((uint64_t) 1 << (TIMER_WHEEL_BITS * TIMER_WHEEL_LEVELS)) - 1)
+
+/**
+ * Hierarchical timing wheel: level 0 has a slot per tick, every further
+ * level a slot per full turn of the level below. When a level turns over,
+ * the next slot of the level above is cascaded down. Arm and cancel are
+ * O(1), an advance touches only slots which are occupied (bitmap).
+ *
+ * The wheel is driven by the capture timestamps, not by the wall clock
+ */
+typedef struct _timer_wheel_t {
+    bool                started;
+    uint64_t            tick;                                           /**< last tick which has fired */
+    uint32_t            count;                                          /**< armed events */
+    timer_event_t      *slots[TIMER_WHEEL_LEVELS][TIMER_WHEEL_SLOTS];
+    uint64_t            occupied[TIMER_WHEEL_LEVELS][TIMER_WHEEL_WORDS];
+} timer_wheel_t;
+
+static timer_wheel_t timer_wheel;
+
+static inline void
+timer_wheel_link(timer_event_t *event, uint8_t level, uint8_t slot)
+{
+    timer_event_t **head = &(timer_wheel.slots[level][slot]);
+
+    event->level    = level;
+    event->slot     = slot;
+    event->next     = *head;
+    event->pprev    = head;
+
+    if (*head != NULL) {
+        (*head)->pprev = &(event->next);
+    }
+
+    *head = event;
+    timer_wheel.occupied[level][slot / 64] |= (uint64_t) 1 << (slot % 64);
+}
+
+static inline void
+timer_wheel_unlink(timer_event_t *event)
+{
+    *(event->pprev) = event->next;
+
+    if (event->next != NULL) {
+        event->next->pprev = event->pprev;
+    }
+
+    if (timer_wheel.slots[event->level][event->slot] == NULL) {
+        timer_wheel.occupied[event->level][event->slot / 64] &= ~((uint64_t) 1 << (event->slot % 64));
+    }
+
+    event->next     = NULL;
+    event->pprev    = NULL;
+}
+
+/**
+ * Puts an event into the slot of its expiry relative to the current tick
+ */
+static void
+timer_wheel_place(timer_event_t *event)
+{
+    uint64_t    expires = event->expires / TIMER_WHEEL_TICK;
+    uint64_t    delta;
+    uint8_t     level;
+
+    /* already due: fires with the next tick */
+    if (expires <= timer_wheel.tick) {
+        expires = timer_wheel.tick + 1;
+    }
+
+    delta = expires - timer_wheel.tick;
+
+    if (delta > TIMER_WHEEL_RANGE) {
+        expires = timer_wheel.tick + TIMER_WHEEL_RANGE;
+        delta   = TIMER_WHEEL_RANGE;
+    }
+
+    for (level = 0; level < TIMER_WHEEL_LEVELS - 1; level++) {
+        if (delta < ((uint64_t) 1 << (TIMER_WHEEL_BITS * (level + 1)))) {
+            break;
+        }
+    }
+
+    timer_wheel_link(event, level, (expires >> (TIMER_WHEEL_BITS * level)) & TIMER_WHEEL_MASK);
+}
+
+/****************************************************************************
+ * timer_wheel_start
+ *
+ * Starts the wheel at the current time, before the first event is armed.
+ * Later calls do nothing
+ *
+ * @param  now                      timestamp in us
+ ***************************************************************************/
+void
+timer_wheel_start(uint64_t now)
+{
+    if (timer_wheel.started) {
+        return;
+    }
+
+    timer_wheel.started = true;
+    timer_wheel.tick    = now / TIMER_WHEEL_TICK;
+}
+
+/****************************************************************************
+ * timer_wheel_arm
+ *
+ * Arms (or re-arms) an event, an expiry in the past fires with the next tick
+ *
+ * @param  event                    event initialized by timer_event_init()
+ * @param  expires                  timestamp in us
+ ***************************************************************************/
+void
+timer_wheel_arm(timer_event_t *event, uint64_t expires)
+{
+    struct timeval tv;
+
+    if (timer_event_armed(event)) {
+        timer_wheel_unlink(event);
+    } else {
+        timer_wheel.count++;
+    }
+
+    /* not started by the capture loop: the capture timestamps are wall clock time */
+    if (!timer_wheel.started) {
+        gettimeofday(&tv, NULL);
+        timer_wheel_start((uint64_t) tv.tv_sec * 1000000 + tv.tv_usec);
+    }
+
+    event->expires = expires;
+    timer_wheel_place(event);
+}
+
+void
+timer_wheel_cancel(timer_event_t *event)
+{
+    if (!timer_event_armed(event)) {
+        return;
+    }
+
+    timer_wheel_unlink(event);
+    timer_wheel.count--;
+}
+
+/**
+ * Relinks an armed event which has been copied to another address (table
+ * resize), the copy replaces the original in the wheel
+ */
+void
+timer_wheel_move(timer_event_t *to, timer_event_t *from)
+{
+    if (to != from) {
+        *to = *from;
+    }
+
+    if (!timer_event_armed(to)) {
+        return;
+    }
+
+    *(to->pprev) = to;
+
+    if (to->next != NULL) {
+        to->next->pprev = &(to->next);
+    }
+
+    from->pprev = NULL;
+}
+
+/**
+ * Re-distributes the slot of a higher level which is due now
+ */
+static void
+timer_wheel_cascade(uint8_t level)
+{
+    uint8_t         slot = (timer_wheel.tick >> (TIMER_WHEEL_BITS * level)) & TIMER_WHEEL_MASK;
+    timer_event_t  *event;
+
+    while ((event = timer_wheel.slots[level][slot]) != NULL) {
+        timer_wheel_unlink(event);
+        timer_wheel_place(event);
+    }
+}
+
+/**
+ * Returns the ticks to the next occupied level 0 slot in the current turn,
+ * or to the start of the next turn (which has to be cascaded first)
+ */
+static uint64_t
+timer_wheel_skip(void)
+{
+    uint32_t    slot = (timer_wheel.tick + 1) & TIMER_WHEEL_MASK;
+    uint32_t    word;
+    uint64_t    bits;
+
+    if (slot == 0) {
+        return 1;
+    }
+
+    for (word = slot / 64; word < TIMER_WHEEL_WORDS; word++) {
+        bits = timer_wheel.occupied[0][word];
+
+        if (word == slot / 64) {
+            bits &= ~(uint64_t) 0 << (slot % 64);
+        }
+
+        if (bits != 0) {
+            return word * 64 + __builtin_ctzll(bits) - slot + 1;
+        }
+    }
+
+    return TIMER_WHEEL_SLOTS - slot + 1;
+}
+
+/****************************************************************************
+ * timer_wheel_advance
+ *
+ * Fires every event which is due until now. Called once per capture batch
+ * with the timestamp of its last packet, ticks without events are skipped
+ *
+ * @param  now                      timestamp in us
+ ***************************************************************************/
+void
+timer_wheel_advance(uint64_t now)
+{
+    uint64_t        target = now / TIMER_WHEEL_TICK;
+    uint64_t        skip;
+    uint8_t         level;
+    timer_event_t  *event;
+
+    if (!timer_wheel.started) {
+        timer_wheel_start(now);
+        return;
+    }
+
+    while (timer_wheel.tick < target) {
+        if (timer_wheel.count == 0) {
+            timer_wheel.tick = target;
+            break;
+        }
+
+        /* jump over empty slots, but stop in front of a turn over to cascade */
+        skip = timer_wheel_skip();
+        if (skip > target - timer_wheel.tick) {
+            skip = target - timer_wheel.tick;
+        }
+
+        timer_wheel.tick += skip;
+
+        for (level = 1; level < TIMER_WHEEL_LEVELS; level++) {
+            if ((timer_wheel.tick & (((uint64_t) 1 << (TIMER_WHEEL_BITS * level)) - 1)) != 0) {
+                break;
+            }
+
+            timer_wheel_cascade(level);
+        }
+
+        /* the callback may re-arm the event, it is placed behind the current tick */
+        while ((event = timer_wheel.slots[0][timer_wheel.tick & TIMER_WHEEL_MASK]) != NULL) {
+            timer_wheel_unlink(event);
+            timer_wheel.count--;
+
+            event->callback(event, now);
+        }
+    }
+}
+
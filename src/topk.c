@@ -0,0 +1,283 @@
+#include "topk.h"
+#include "hash.h"
+#include "log.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define TOPK_INDEX_EMPTY            0
+
+/**
+ * Seqlock, writer side
+ */
+static inline void
+topk_write_begin(topk_t *topk)
+{
+    __atomic_store_n(&(topk->seq), topk->seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+static inline void
+topk_write_end(topk_t *topk)
+{
+    __atomic_store_n(&(topk->seq), topk->seq + 1, __ATOMIC_RELEASE);
+}
+
+static inline uint32_t
+topk_index_hash(topk_t *topk, uint64_t key)
+{
+    return hash_mix64(key) & topk->index_mask;
+}
+
+bool
+topk_init(topk_t *topk, const char *name, uint32_t size)
+{
+    uint32_t index_size;
+
+    memset(topk, 0, sizeof(*topk));
+
+    /* at most half full */
+    for (index_size = 2; index_size < 2 * size; index_size <<= 1);
+
+    topk->entries   = calloc(size, sizeof(topk_entry_t));
+    topk->index     = calloc(index_size, sizeof(uint32_t));
+
+    if (topk->entries == NULL || topk->index == NULL) {
+        LOG_PRINTLN(LOG_TOPK, LOG_ERROR, ("could not allocate top-K %s (size=%u)", name, size));
+        free(topk->entries);
+        free(topk->index);
+        return false;
+    }
+
+    topk->name          = name;
+    topk->size          = size;
+    topk->index_mask    = index_size - 1;
+
+    return true;
+}
+
+static inline void
+topk_swap(topk_t *topk, uint32_t a, uint32_t b)
+{
+    topk_entry_t tmp = topk->entries[a];
+
+    topk->entries[a] = topk->entries[b];
+    topk->entries[b] = tmp;
+
+    topk->index[topk->entries[a].slot] = a + 1;
+    topk->index[topk->entries[b].slot] = b + 1;
+}
+
+static void
+topk_sift_down(topk_t *topk, uint32_t pos)
+{
+    uint32_t child;
+
+    while ((child = 2 * pos + 1) < topk->used) {
+        if (child + 1 < topk->used && topk->entries[child + 1].count < topk->entries[child].count) {
+            child++;
+        }
+
+        if (topk->entries[pos].count <= topk->entries[child].count) {
+            break;
+        }
+
+        topk_swap(topk, pos, child);
+        pos = child;
+    }
+}
+
+static void
+topk_sift_up(topk_t *topk, uint32_t pos)
+{
+    uint32_t parent;
+
+    while (pos > 0) {
+        parent = (pos - 1) / 2;
+
+        if (topk->entries[parent].count <= topk->entries[pos].count) {
+            break;
+        }
+
+        topk_swap(topk, pos, parent);
+        pos = parent;
+    }
+}
+
+/**
+ * Removes a slot from the index (backward shift, no tombstones)
+ */
+static void
+topk_index_remove(topk_t *topk, uint32_t slot)
+{
+    uint32_t next;
+    uint32_t home;
+
+    for (next = (slot + 1) & topk->index_mask; topk->index[next] != TOPK_INDEX_EMPTY; next = (next + 1) & topk->index_mask) {
+        home = topk_index_hash(topk, topk->entries[topk->index[next] - 1].key);
+
+        /* the entry in next may move to slot if its home is not in (slot, next] */
+        if (((next - home) & topk->index_mask) >= ((next - slot) & topk->index_mask)) {
+            topk->index[slot]                               = topk->index[next];
+            topk->entries[topk->index[slot] - 1].slot       = slot;
+            slot                                            = next;
+        }
+    }
+
+    topk->index[slot] = TOPK_INDEX_EMPTY;
+}
+
+/****************************************************************************
+ * topk_update
+ *
+ * Adds weight to the counter of key
+ *
+ * @param  topk                     top-K
+ * @param  key                      key (e.g. address or hash of a name)
+ * @param  weight                   e.g. bytes
+ * @param  inserted                 set if key was not monitored before, the
+ *                                  label of the returned entry is empty then
+ * @return                          entry of key (valid until the next update)
+ ***************************************************************************/
+topk_entry_t *
+topk_update(topk_t *topk, uint64_t key, uint64_t weight, bool *inserted)
+{
+    topk_entry_t   *entry;
+    uint32_t        slot;
+    uint32_t        pos;
+    bool            replaced = false;
+
+    topk_write_begin(topk);
+
+    for (slot = topk_index_hash(topk, key); topk->index[slot] != TOPK_INDEX_EMPTY; slot = (slot + 1) & topk->index_mask) {
+        pos = topk->index[slot] - 1;
+
+        if (topk->entries[pos].key == key) {
+            topk->entries[pos].count += weight;
+            topk_sift_down(topk, pos);
+
+            *inserted = false;
+            entry     = &(topk->entries[topk->index[slot] - 1]);
+
+            topk_write_end(topk);
+
+            return entry;
+        }
+    }
+
+    /* not monitored: take a free counter or replace the minimum */
+    if (topk->used < topk->size) {
+        pos             = topk->used++;
+        entry           = &(topk->entries[pos]);
+        entry->count    = 0;
+        entry->error    = 0;
+    } else {
+        pos             = 0;
+        entry           = &(topk->entries[pos]);
+        entry->error    = entry->count;
+        replaced        = true;
+
+        topk_index_remove(topk, entry->slot);
+
+        /* the removal may have shifted the free slot */
+        for (slot = topk_index_hash(topk, key); topk->index[slot] != TOPK_INDEX_EMPTY; slot = (slot + 1) & topk->index_mask);
+    }
+
+    entry->key          = key;
+    entry->count       += weight;
+    entry->slot         = slot;
+    entry->label[0]     = '\0';
+    topk->index[slot]   = pos + 1;
+
+    /* the minimum only grows, a new counter may be smaller than its parent */
+    if (replaced) {
+        topk_sift_down(topk, pos);
+    } else {
+        topk_sift_up(topk, pos);
+    }
+
+    *inserted = true;
+    entry     = &(topk->entries[topk->index[slot] - 1]);
+
+    topk_write_end(topk);
+
+    return entry;
+}
+
+/**
+ * Halves all counters, so that the top-K follows the current traffic. The
+ * heap order is kept
+ */
+void
+topk_decay(topk_t *topk)
+{
+    uint32_t pos;
+
+    topk_write_begin(topk);
+
+    for (pos = 0; pos < topk->used; pos++) {
+        topk->entries[pos].count /= 2;
+        topk->entries[pos].error /= 2;
+    }
+
+    topk_write_end(topk);
+}
+
+static int
+topk_compare(const void *a, const void *b)
+{
+    const topk_entry_t *x = a;
+    const topk_entry_t *y = b;
+
+    return (x->count < y->count) - (x->count > y->count);
+}
+
+/****************************************************************************
+ * topk_snapshot
+ *
+ * Copies the largest monitored entries without blocking the writer,
+ * retries if an update interfered
+ *
+ * @param  topk                     top-K
+ * @param  entries                  buffer of size entries
+ * @param  size                     number of entries to return at most
+ * @return                          number of entries, ordered by count descending
+ ***************************************************************************/
+uint32_t
+topk_snapshot(topk_t *topk, topk_entry_t *entries, uint32_t size)
+{
+    topk_entry_t   *scratch;
+    uint32_t        seq;
+    uint32_t        used;
+
+    /* all entries have to be sorted, any thread may take a snapshot: not shared with other callers */
+    if ((scratch = malloc(topk->size * sizeof(topk_entry_t))) == NULL) {
+        LOG_PRINTLN(LOG_TOPK, LOG_ERROR, ("could not snapshot top-K %s", topk->name));
+        return 0;
+    }
+
+    do {
+        /* an update is in progress */
+        while ((seq = __atomic_load_n(&(topk->seq), __ATOMIC_ACQUIRE)) & 1);
+
+        used = __atomic_load_n(&(topk->used), __ATOMIC_RELAXED);
+        if (used > topk->size) {
+            used = topk->size;
+        }
+        memcpy(scratch, topk->entries, used * sizeof(topk_entry_t));
+
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    } while (__atomic_load_n(&(topk->seq), __ATOMIC_RELAXED) != seq);
+
+    qsort(scratch, used, sizeof(topk_entry_t), topk_compare);
+
+    if (used > size) {
+        used = size;
+    }
+
+    memcpy(entries, scratch, used * sizeof(topk_entry_t));
+    free(scratch);
+
+    return used;
+}
+
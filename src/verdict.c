@@ -0,0 +1,208 @@
+#include "verdict.h"
+#include "lpm.h"
+#include "hash.h"
+#include "log.h"
+
+#include "packet/port.h"
+
+#include <string.h>
+#include <inttypes.h>
+
+static uint32_t verdict_generation = 1;             /**< zeroed entries are never valid */
+
+static const char *verdict_name[] = {
+    [VERDICT_PASS]      = "pass",
+    [VERDICT_DROP]      = "drop",
+    [VERDICT_SAMPLE]    = "sample"
+};
+
+void
+verdict_cache_init(verdict_cache_t *cache)
+{
+    memset(cache, 0, sizeof(verdict_cache_t));
+}
+
+/**
+ * Fast-path classifier: the UDP flow of a frame without decoding it.
+ * Only DNS flows are cacheable, tunnels (VXLAN, GRE) carry many flows in
+ * one outer tuple and fragments have no ports
+ */
+static bool
+verdict_flow(raw_packet_t *raw_packet, verdict_flow_t *flow)
+{
+    const uint8_t  *data = raw_packet->data;
+    uint32_t        offset = ETHERNET_HEADER_LEN;
+    uint16_t        ethertype;
+    uint16_t        fragment;
+    uint32_t        ihl;
+
+    if (raw_packet->len < ETHERNET_HEADER_LEN + IPV4_HEADER_LEN + UDPV4_HEADER_LEN) {
+        return false;
+    }
+
+    ethertype = (data[ETHERNET_HEADER_OFFSET_TYPE] << 8) | data[ETHERNET_HEADER_OFFSET_TYPE + 1];
+
+    if (ethertype == ETHERTYPE_VLAN) {
+        ethertype   = (data[VLAN_HEADER_OFFSET_TYPE] << 8) | data[VLAN_HEADER_OFFSET_TYPE + 1];
+        offset      = VLAN_HEADER_LEN;
+    }
+
+    if (ethertype != ETHERTYPE_IPV4 || (data[offset + IPV4_HEADER_OFFSET_VERSION] >> 4) != IPV4_HEADER_VERSION) {
+        return false;
+    }
+
+    ihl         = (data[offset + IPV4_HEADER_OFFSET_VERSION] & 0x0f) * 4;
+    fragment    = (data[offset + IPV4_HEADER_OFFSET_FLAGS] << 8) | data[offset + IPV4_HEADER_OFFSET_FLAGS + 1];
+
+    if (data[offset + IPV4_HEADER_OFFSET_PROTOCOL] != IPV4_PROTOCOL_UDP || ihl < IPV4_HEADER_LEN ||
+        (fragment & ~IPV4_HEADER_MASK_FLAGS) != 0 || (fragment & IPV4_HEADER_MASK_MORE_FRAGMENT) != 0 ||
+        raw_packet->len < offset + ihl + UDPV4_HEADER_LEN) {
+        return false;
+    }
+
+    memcpy(&(flow->src),  &(data[offset + IPV4_HEADER_OFFSET_SRC]),  sizeof(flow->src));
+    memcpy(&(flow->dest), &(data[offset + IPV4_HEADER_OFFSET_DEST]), sizeof(flow->dest));
+
+    offset += ihl;
+
+    flow->src_port  = (data[offset + UDPV4_HEADER_OFFSET_SRC_PORT]  << 8) | data[offset + UDPV4_HEADER_OFFSET_SRC_PORT + 1];
+    flow->dest_port = (data[offset + UDPV4_HEADER_OFFSET_DEST_PORT] << 8) | data[offset + UDPV4_HEADER_OFFSET_DEST_PORT + 1];
+
+    return (flow->src_port == PORT_DNS || flow->dest_port == PORT_DNS) && flow->src != 0;
+}
+
+static inline verdict_entry_t *
+verdict_entry(verdict_cache_t *cache, const verdict_flow_t *flow)
+{
+    uint64_t hash = hash_combine(hash_mix64(((uint64_t) flow->src << 32) | flow->dest),
+                                 ((uint32_t) flow->src_port << 16) | flow->dest_port);
+
+    return &(cache->entries[hash & (VERDICT_CACHE_SIZE - 1)]);
+}
+
+/****************************************************************************
+ * verdict_lookup
+ *
+ * Looks up the verdict of the flow of a frame. A packet which is not
+ * handled by the cache is decoded with a weight: a sampled packet stands
+ * for the packets of its flow which have been skipped
+ *
+ * @param  cache                    cache of the worker
+ * @param  raw_packet               raw packet
+ * @param  flow                     returns the flow, to store its verdict
+ * @param  weight                   returns the packets the decode accounts for
+ * @param  verdict                  returns VERDICT_DROP for a skipped packet of a blocked flow
+ * @return                          true if the packet is skipped
+ ***************************************************************************/
+bool
+verdict_lookup(verdict_cache_t *cache, raw_packet_t *raw_packet, verdict_flow_t *flow, uint32_t *weight, verdict_t *verdict)
+{
+    verdict_entry_t *entry;
+
+    *weight     = 1;
+    *verdict    = VERDICT_PASS;
+
+    if (!verdict_flow(raw_packet, flow)) {
+        flow->src = 0;
+        return false;
+    }
+
+    /* trusted and statically blocked sources skip the detection */
+    switch (lpm_lookup_ipv4(flow->src)) {
+        case LPM_POLICY_TRUSTED:    return true;
+        case LPM_POLICY_BLOCKED:    *verdict = VERDICT_DROP;
+                                    return true;
+        default:                    break;
+    }
+
+    entry = verdict_entry(cache, flow);
+
+    if (entry->generation != __atomic_load_n(&verdict_generation, __ATOMIC_ACQUIRE) || memcmp(&(entry->flow), flow, sizeof(verdict_flow_t)) != 0) {
+        return false;
+    }
+
+    switch (entry->verdict) {
+        case VERDICT_DROP:      *verdict = VERDICT_DROP;
+                                return true;
+
+        case VERDICT_SAMPLE:    if (++entry->hits < VERDICT_SAMPLE_RATE) {
+                                    return true;
+                                }
+                                *weight      = entry->hits;
+                                entry->hits  = 0;
+                                return false;
+
+        default:                return false;
+    }
+}
+
+/**
+ * Stores the verdict of a decoded flow, VERDICT_PASS drops a cached one
+ */
+void
+verdict_store(verdict_cache_t *cache, const verdict_flow_t *flow, verdict_t verdict)
+{
+    verdict_entry_t *entry;
+
+    if (flow->src == 0) {
+        return;
+    }
+
+    entry = verdict_entry(cache, flow);
+
+    if (verdict == VERDICT_PASS) {
+        if (memcmp(&(entry->flow), flow, sizeof(verdict_flow_t)) == 0) {
+            entry->generation = 0;
+        }
+        return;
+    }
+
+    LOG_PRINTLN(LOG_VERDICT, LOG_DEBUG, ("verdict: %08" PRIx32 ":%" PRIu16 " -> %08" PRIx32 ":%" PRIu16 " %s", flow->src, flow->src_port,
+                                                                                                           flow->dest, flow->dest_port,
+                                                                                                           verdict_name[verdict]));
+
+    entry->flow         = *flow;
+    entry->generation   = __atomic_load_n(&verdict_generation, __ATOMIC_ACQUIRE);
+    entry->verdict      = verdict;
+    entry->hits         = 0;
+}
+
+/****************************************************************************
+ * verdict_classify
+ *
+ * Verdict of a flow after the full decode and detection of one packet
+ *
+ * @param  packet                   decoded packet
+ * @param  limited                  response has been rate limited (slip or block)
+ * @param  victim                   destination is a victim
+ * @return                          verdict of the flow
+ ***************************************************************************/
+verdict_t
+verdict_classify(packet_t *packet, bool limited, bool victim)
+{
+    /* undecodable packets are never cached: one spoofed packet must not blind the detection of its flow */
+    if (packet_get_header(packet, PACKET_TYPE_DNS) == NULL) {
+        return VERDICT_PASS;
+    }
+
+    if (limited) {
+        return VERDICT_DROP;
+    }
+
+    return victim ? VERDICT_SAMPLE : VERDICT_PASS;
+}
+
+/**
+ * Invalidates the verdicts of all workers (a blocklist or a victim changed)
+ */
+void
+verdict_invalidate(void)
+{
+    __atomic_add_fetch(&verdict_generation, 1, __ATOMIC_RELEASE);
+
+    /* wrapped: zero marks a never valid entry */
+    if (__atomic_load_n(&verdict_generation, __ATOMIC_RELAXED) == 0) {
+        __atomic_add_fetch(&verdict_generation, 1, __ATOMIC_RELEASE);
+    }
+}
+
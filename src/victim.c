@@ -0,0 +1,278 @@
+#include "victim.h"
+#include "hash.h"
+#include "timer_wheel.h"
+#include "verdict.h"
+#include "lpm.h"
+#include "log.h"
+
+#include "packet/port.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <arpa/inet.h>
+
+#define VICTIM_SKETCH_ROWS          4
+#define VICTIM_SKETCH_BITS          16                  /**< 4 rows of 16 bits: one 64 bit hash */
+#define VICTIM_SKETCH_WIDTH         (1 << VICTIM_SKETCH_BITS)
+
+/**
+ * Every epoch the counters lose 1/8: the sum over the decaying epochs of
+ * a constant rate is 8 * 1/8 s = 1 s worth of traffic, so a counter reads
+ * as packets (bytes) per second
+ */
+#define VICTIM_EPOCH                125000              /**< us */
+#define VICTIM_DECAY_SHIFT          3
+#define VICTIM_DECAY_MAX            64                  /**< epochs until a counter is zero anyway */
+
+#define VICTIM_TABLE_SIZE           1024                /**< exact victims, power of two */
+#define VICTIM_TABLE_BITS           10
+#define VICTIM_PROBE_MAX            8
+#define VICTIM_CHECK_INTERVAL       1000000             /**< us between two checks of a victim's rate */
+
+typedef struct _victim_counter_t {
+    uint32_t            epoch;                          /**< epoch of the last decay */
+    uint32_t            packets;
+    uint64_t            bytes;
+} victim_counter_t;
+
+typedef struct _victim_entry_t {
+    uint32_t            addr;                           /**< IPv4 address (network byte order), zero if unused */
+    victim_counter_t    counter;
+    timer_event_t       timer;                          /**< demotion check */
+} victim_entry_t;
+
+typedef struct _victim_t {
+    bool                enabled;
+    uint32_t            packets;                        /**< threshold: packets per second */
+    uint64_t            bytes;                          /**< threshold: bytes per second */
+    victim_counter_t   *sketch;                         /**< VICTIM_SKETCH_ROWS x VICTIM_SKETCH_WIDTH */
+    victim_entry_t      victims[VICTIM_TABLE_SIZE];
+} victim_t;
+
+static victim_t victim;
+
+static void             victim_expire   (timer_event_t *event, uint64_t now);
+
+/**
+ * Adds packets, saturating
+ */
+static inline void
+victim_add(victim_counter_t *counter, uint32_t packets, uint32_t bytes)
+{
+    counter->packets  = (counter->packets > UINT32_MAX - packets) ? UINT32_MAX : counter->packets + packets;
+    counter->bytes   += bytes;
+}
+
+/**
+ * Applies the decay of the epochs since the last update, rounding up so
+ * that small counters reach zero
+ */
+static inline void
+victim_decay(victim_counter_t *counter, uint32_t epoch)
+{
+    uint32_t elapsed = epoch - counter->epoch;
+
+    if (elapsed == 0) {
+        return;
+    }
+
+    counter->epoch = epoch;
+
+    if (elapsed >= VICTIM_DECAY_MAX) {
+        counter->packets    = 0;
+        counter->bytes      = 0;
+        return;
+    }
+
+    while (elapsed-- > 0 && (counter->packets | counter->bytes) != 0) {
+        counter->packets   -= (counter->packets + (1 << VICTIM_DECAY_SHIFT) - 1) >> VICTIM_DECAY_SHIFT;
+        counter->bytes     -= (counter->bytes   + (1 << VICTIM_DECAY_SHIFT) - 1) >> VICTIM_DECAY_SHIFT;
+    }
+}
+
+bool
+victim_init(config_t *config)
+{
+    memset(&victim, 0, sizeof(victim));
+
+    if (config->victim_packets == 0 && config->victim_bytes == 0) {
+        LOG_PRINTLN(LOG_VICTIM, LOG_INFO, ("victim rate meter disabled"));
+        return true;
+    }
+
+    victim.sketch = calloc(VICTIM_SKETCH_ROWS * VICTIM_SKETCH_WIDTH, sizeof(victim_counter_t));
+    if (victim.sketch == NULL) {
+        LOG_PRINTLN(LOG_VICTIM, LOG_ERROR, ("could not allocate victim sketch"));
+        return false;
+    }
+
+    victim.enabled  = true;
+    victim.packets  = config->victim_packets > 0 ? config->victim_packets : UINT32_MAX;
+    victim.bytes    = config->victim_bytes   > 0 ? config->victim_bytes   : UINT64_MAX;
+
+    LOG_PRINTLN(LOG_VICTIM, LOG_INFO, ("victim rate meter enabled: packets=%" PRIu32 "/s, bytes=%" PRIu32 "/s", config->victim_packets, config->victim_bytes));
+
+    return true;
+}
+
+/**
+ * Count-min sketch with conservative update: only the counters which are
+ * at the minimum are raised, the others already overestimate
+ *
+ * @return                  estimated rate including this packet
+ */
+static victim_counter_t
+victim_sketch_update(uint32_t addr, uint32_t packets, uint32_t bytes, uint32_t epoch)
+{
+    victim_counter_t   *counter[VICTIM_SKETCH_ROWS];
+    victim_counter_t    estimate = { .epoch = epoch, .packets = UINT32_MAX, .bytes = UINT64_MAX };
+    uint64_t            hash     = hash_mix64(addr ^ HASH_SEED);
+    uint32_t            row;
+
+    for (row = 0; row < VICTIM_SKETCH_ROWS; row++) {
+        counter[row] = &(victim.sketch[row * VICTIM_SKETCH_WIDTH + ((hash >> (row * VICTIM_SKETCH_BITS)) & (VICTIM_SKETCH_WIDTH - 1))]);
+
+        victim_decay(counter[row], epoch);
+
+        if (counter[row]->packets < estimate.packets)   estimate.packets = counter[row]->packets;
+        if (counter[row]->bytes   < estimate.bytes)     estimate.bytes   = counter[row]->bytes;
+    }
+
+    victim_add(&estimate, packets, bytes);
+
+    for (row = 0; row < VICTIM_SKETCH_ROWS; row++) {
+        if (counter[row]->packets < estimate.packets)   counter[row]->packets = estimate.packets;
+        if (counter[row]->bytes   < estimate.bytes)     counter[row]->bytes   = estimate.bytes;
+    }
+
+    return estimate;
+}
+
+/**
+ * Finds a victim, or a free slot for it if insert is set
+ */
+static victim_entry_t *
+victim_get(uint32_t addr, bool insert)
+{
+    victim_entry_t *entry;
+    victim_entry_t *free_entry = NULL;
+    uint32_t        idx;
+    uint32_t        i;
+
+    idx = (addr * 2654435761u) >> (32 - VICTIM_TABLE_BITS);
+
+    /* demotion leaves holes, so the whole probing distance is searched */
+    for (i = 0; i < VICTIM_PROBE_MAX; i++) {
+        entry = &(victim.victims[(idx + i) & (VICTIM_TABLE_SIZE - 1)]);
+
+        if (entry->addr == addr) {
+            return entry;
+        }
+
+        if (entry->addr == 0 && free_entry == NULL) {
+            free_entry = entry;
+        }
+    }
+
+    return insert ? free_entry : NULL;
+}
+
+/****************************************************************************
+ * victim_process
+ *
+ * Meters the DNS responses per destination. Known victims are counted
+ * exactly, all other destinations in the sketch. A response counts as
+ * many packets as its amplification factor, and with all its fragments
+ *
+ * @param  packet                   decoded packet
+ * @param  raw_packet               raw packet (timestamp)
+ * @param  sample                   sizes and amplification of the response
+ * @return                          true if the destination is a victim
+ ***************************************************************************/
+bool
+victim_process(packet_t *packet, raw_packet_t *raw_packet, const amplification_sample_t *sample)
+{
+    ipv4_header_t      *ipv4;
+    udpv4_header_t     *udpv4;
+    dns_header_t       *dns;
+    victim_entry_t     *entry;
+    victim_counter_t    estimate;
+    uint32_t            epoch;
+    uint32_t            addr;
+    struct in_addr      in_addr;
+
+    if (!victim.enabled) {
+        return false;
+    }
+
+    ipv4    = (ipv4_header_t *)  packet_get_header(packet, PACKET_TYPE_IPV4);
+    udpv4   = (udpv4_header_t *) packet_get_header(packet, PACKET_TYPE_UDPV4);
+    dns     = (dns_header_t *)   packet_get_header(packet, PACKET_TYPE_DNS);
+
+    /* only responses of a DNS server */
+    if (ipv4 == NULL || udpv4 == NULL || dns == NULL || !dns->flags.qr || udpv4->src_port != PORT_DNS) {
+        return false;
+    }
+
+    memcpy(&addr, ipv4->dest.addr, IPV4_ADDRESS_LEN);
+    epoch = raw_packet->timestamp / VICTIM_EPOCH;
+
+    /* known victim: exact */
+    if ((entry = victim_get(addr, false)) != NULL) {
+        victim_decay(&(entry->counter), epoch);
+
+        victim_add(&(entry->counter), sample->factor * packet->weight, sample->response_len * packet->weight);
+
+        return true;
+    }
+
+    estimate = victim_sketch_update(addr, sample->factor * packet->weight, sample->response_len * packet->weight, epoch);
+
+    if (estimate.packets < victim.packets && estimate.bytes < victim.bytes) {
+        return false;
+    }
+
+    /* promote, the exact counter starts from the estimate */
+    in_addr.s_addr = addr;
+
+    if ((entry = victim_get(addr, true)) == NULL) {
+        LOG_PRINTLN(LOG_VICTIM, LOG_WARNING, ("victim table full: %s not tracked", inet_ntoa(in_addr)));
+        return true;
+    }
+
+    LOG_PRINTLN(LOG_VICTIM, LOG_WARNING, ("victim: %s (%" PRIu32 " weighted packets/s, %" PRIu64 " bytes/s, %s)", inet_ntoa(in_addr), estimate.packets, estimate.bytes,
+                                                                                                                   lpm_policy_name(lpm_lookup_ipv4(addr))));
+
+    entry->addr     = addr;
+    entry->counter  = estimate;
+
+    timer_event_init(&(entry->timer), victim_expire);
+    timer_wheel_arm(&(entry->timer), raw_packet->timestamp + VICTIM_CHECK_INTERVAL);
+
+    return true;
+}
+
+/**
+ * Demotes a victim whose rate has dropped below half of the thresholds
+ */
+static void
+victim_expire(timer_event_t *event, uint64_t now)
+{
+    victim_entry_t *entry = TIMER_EVENT_CONTAINER(event, victim_entry_t, timer);
+    struct in_addr  in_addr;
+
+    victim_decay(&(entry->counter), now / VICTIM_EPOCH);
+
+    if (entry->counter.packets >= victim.packets / 2 || entry->counter.bytes >= victim.bytes / 2) {
+        timer_wheel_arm(event, now + VICTIM_CHECK_INTERVAL);
+        return;
+    }
+
+    in_addr.s_addr = entry->addr;
+    LOG_PRINTLN(LOG_VICTIM, LOG_INFO, ("victim recovered: %s", inet_ntoa(in_addr)));
+
+    entry->addr = 0;
+    verdict_invalidate();
+}
+